@@ -0,0 +1,445 @@
+// Allocation tracking
+
+#include "alloc.h"
+
+static alloc_tracker_t s_local_tracker = { .lock = MUTEX_INITIALIZER };
+static alloc_tracker_t *s_tracker = &s_local_tracker;
+
+static PURPL_THREAD_LOCAL uint8_t t_alloc_tags[ALLOC_TAG_DEPTH];
+static PURPL_THREAD_LOCAL uint32_t t_alloc_tag_depth;
+
+static const char *s_tag_names[] = {
+	"general", "pack", "render", "log", "ini", "ecs", "sdl", "zstd",
+};
+static_assert(PURPL_ARRSIZE(s_tag_names) == ALLOC_TAG_COUNT, "s_tag_names is missing a tag");
+
+void alloc_push_tag(uint8_t tag)
+{
+	if (t_alloc_tag_depth < ALLOC_TAG_DEPTH)
+		t_alloc_tags[t_alloc_tag_depth] = tag;
+	t_alloc_tag_depth++;
+}
+
+void alloc_pop_tag(void)
+{
+	PURPL_ASSERT(t_alloc_tag_depth > 0);
+	t_alloc_tag_depth--;
+}
+
+uint8_t alloc_get_tag(void)
+{
+	if (!t_alloc_tag_depth)
+		return ALLOC_TAG_GENERAL;
+
+	return t_alloc_tags[PURPL_MIN(t_alloc_tag_depth, ALLOC_TAG_DEPTH) - 1];
+}
+
+// Get the slot an address would go in if nothing else was there
+static size_t get_home(const alloc_tracker_t *tracker, const void *ptr)
+{
+	uint64_t hash;
+
+	hash = (uint64_t)(uintptr_t)ptr;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+
+	return (size_t)hash & (tracker->capacity - 1);
+}
+
+// Find the slot an address is in, or the empty one it would go in
+static size_t find(const alloc_tracker_t *tracker, const void *ptr)
+{
+	size_t i;
+
+	i = get_home(tracker, ptr);
+	while (tracker->records[i].ptr && tracker->records[i].ptr != ptr)
+		i = (i + 1) & (tracker->capacity - 1);
+
+	return i;
+}
+
+// Double the size of the table, or make it if it doesn't exist
+static void grow(alloc_tracker_t *tracker)
+{
+	alloc_record_t *old;
+	size_t old_capacity;
+	size_t i;
+
+	old = tracker->records;
+	old_capacity = tracker->capacity;
+
+	// The table is allocated directly, since tracking it would mean growing it while it's being grown
+	tracker->capacity = old_capacity ? old_capacity * 2 : ALLOC_TABLE_SIZE;
+	tracker->records = calloc(tracker->capacity, sizeof(alloc_record_t));
+	PURPL_ASSERT(tracker->records);
+
+	for (i = 0; i < old_capacity; i++) {
+		if (old[i].ptr)
+			tracker->records[find(tracker, old[i].ptr)] = old[i];
+	}
+	free(old);
+}
+
+// Add to the stats of a tag, count is the change in live allocations
+static void add_stats(alloc_tracker_t *tracker, uint8_t tag, int64_t bytes, int64_t count)
+{
+	alloc_stats_t *stats;
+	uint32_t i;
+
+	stats = &tracker->stats[tag & ~ALLOC_PERMANENT];
+	stats->live_bytes += bytes;
+	stats->live_count += count;
+	stats->peak_bytes = PURPL_MAX(stats->peak_bytes, stats->live_bytes);
+	tracker->total.live_bytes += bytes;
+	tracker->total.live_count += count;
+	if (bytes > 0) {
+		stats->allocations++;
+		stats->bytes_allocated += bytes;
+		tracker->total.allocations++;
+		tracker->total.bytes_allocated += bytes;
+	}
+
+	if (tracker->total.live_bytes > tracker->total.peak_bytes) {
+		tracker->total.peak_bytes = tracker->total.live_bytes;
+		for (i = 0; i < ALLOC_TAG_COUNT; i++)
+			tracker->peak_breakdown[i] = tracker->stats[i].live_bytes;
+	}
+}
+
+// Add a record while holding the lock, returns true if its tag just went over budget
+static bool insert(alloc_tracker_t *tracker, const alloc_record_t *record)
+{
+	alloc_tag_t tag;
+	size_t i;
+
+	if (!tracker->start)
+		tracker->start = util_get_time();
+
+	// Keep it at most half full so probes stay short
+	if ((tracker->count + 1) * 2 > tracker->capacity)
+		grow(tracker);
+
+	i = find(tracker, record->ptr);
+	if (tracker->records[i].ptr) {
+		// The address was freed without being untracked and reused
+		add_stats(tracker, tracker->records[i].tag, -(int64_t)tracker->records[i].size, -1);
+		tracker->count--;
+	}
+
+	tracker->records[i] = *record;
+	tracker->count++;
+	add_stats(tracker, record->tag, (int64_t)record->size, 1);
+
+	tag = record->tag & ~ALLOC_PERMANENT;
+	if (!tracker->budgets[tag] || tracker->over_budget[tag] ||
+	    tracker->stats[tag].live_bytes <= tracker->budgets[tag])
+		return false;
+
+	tracker->over_budget[tag] = true;
+	return true;
+}
+
+// Warn about a tag going over budget, without holding the lock
+static void report_budget(alloc_tracker_t *tracker, uint8_t tag)
+{
+	alloc_stats_t stats;
+
+	tag &= ~ALLOC_PERMANENT;
+	alloc_get_stats(tag, &stats);
+	LOG_WARNING(LOG_SUBSYSTEM_GENERAL,
+		    ALLOC_LOG_PREFIX "Tag %s is over its budget of %.1lf KiB with %.1lf KiB live\n", s_tag_names[tag],
+		    (double)tracker->budgets[tag] / 1024.0, (double)stats.live_bytes / 1024.0);
+}
+
+// Take a record out while holding the lock, returns false if it isn't there
+static bool remove_record(alloc_tracker_t *tracker, const void *ptr, alloc_record_t *record)
+{
+	alloc_tag_t tag;
+	size_t i;
+	size_t j;
+	size_t home;
+
+	if (!tracker->count)
+		return false;
+
+	i = find(tracker, ptr);
+	if (!tracker->records[i].ptr)
+		return false;
+
+	*record = tracker->records[i];
+	tracker->records[i].ptr = NULL;
+	tracker->count--;
+	add_stats(tracker, record->tag, -(int64_t)record->size, -1);
+	tag = record->tag & ~ALLOC_PERMANENT;
+	if (tracker->stats[tag].live_bytes <= tracker->budgets[tag])
+		tracker->over_budget[tag] = false;
+
+	// Move records after it back into the gap if they'd be unreachable otherwise
+	j = i;
+	while (true) {
+		j = (j + 1) & (tracker->capacity - 1);
+		if (!tracker->records[j].ptr)
+			break;
+
+		home = get_home(tracker, tracker->records[j].ptr);
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			tracker->records[i] = tracker->records[j];
+			tracker->records[j].ptr = NULL;
+			i = j;
+		}
+	}
+
+	return true;
+}
+
+// Fill in a record for the current tag
+static void make_record(alloc_tracker_t *tracker, void *ptr, size_t size, uint8_t tag, alloc_record_t *record)
+{
+	record->ptr = ptr;
+	record->size = size;
+	record->tag = tag;
+	record->frame_count = 0;
+	if (atomic_load_explicit(&tracker->capture_stacks, memory_order_relaxed))
+		record->frame_count = alloc_capture_stack(record->frames, ALLOC_STACK_DEPTH);
+}
+
+void alloc_track(void *ptr, size_t size)
+{
+	alloc_tracker_t *tracker;
+	alloc_record_t record;
+	bool over_budget;
+
+	if (!ptr)
+		return;
+
+	tracker = s_tracker;
+	make_record(tracker, ptr, size, alloc_get_tag(), &record);
+
+	mutex_lock(&tracker->lock);
+	over_budget = insert(tracker, &record);
+	mutex_unlock(&tracker->lock);
+
+	if (over_budget)
+		report_budget(tracker, record.tag);
+}
+
+void *alloc_realloc_tracked(void *old, size_t size)
+{
+	alloc_tracker_t *tracker;
+	alloc_record_t record;
+	bool over_budget;
+	bool found;
+	void *buf;
+	uint8_t tag;
+
+	// Once realloc frees old, another thread can get the same address back and track it, so old's record has to be
+	// out of the table before then and can't be looked up after
+	tracker = s_tracker;
+	mutex_lock(&tracker->lock);
+	found = old && remove_record(tracker, old, &record);
+	mutex_unlock(&tracker->lock);
+
+	buf = realloc(old, size);
+	if (!buf) {
+		// old is still valid, so it goes back
+		if (found) {
+			mutex_lock(&tracker->lock);
+			insert(tracker, &record);
+			mutex_unlock(&tracker->lock);
+		}
+		return NULL;
+	}
+
+	tag = found ? record.tag : alloc_get_tag();
+	make_record(tracker, buf, size, tag, &record);
+
+	mutex_lock(&tracker->lock);
+	over_budget = insert(tracker, &record);
+	mutex_unlock(&tracker->lock);
+
+	if (over_budget)
+		report_budget(tracker, record.tag);
+
+	return buf;
+}
+
+bool alloc_untrack(void *ptr)
+{
+	alloc_tracker_t *tracker;
+	alloc_record_t record;
+	bool found;
+
+	if (!ptr)
+		return false;
+
+	tracker = s_tracker;
+	mutex_lock(&tracker->lock);
+	found = remove_record(tracker, ptr, &record);
+	mutex_unlock(&tracker->lock);
+
+	return found;
+}
+
+void *alloc_malloc(alloc_tag_t tag, size_t size)
+{
+	void *buf;
+
+	if (!size)
+		return NULL;
+
+	buf = malloc(size);
+	ALLOC_TAG_SCOPE(tag | (alloc_get_tag() & ALLOC_PERMANENT))
+		ALLOC_TRACK(buf, size);
+
+	return buf;
+}
+
+void *alloc_calloc(alloc_tag_t tag, size_t count, size_t size)
+{
+	void *buf;
+
+	if (!count || !size)
+		return NULL;
+
+	buf = calloc(count, size);
+	ALLOC_TAG_SCOPE(tag | (alloc_get_tag() & ALLOC_PERMANENT))
+		ALLOC_TRACK(buf, count * size);
+
+	return buf;
+}
+
+void *alloc_realloc(alloc_tag_t tag, void *ptr, size_t size)
+{
+	void *buf;
+
+	if (!ptr)
+		return alloc_malloc(tag, size);
+	if (!size) {
+		alloc_free(ptr);
+		return NULL;
+	}
+
+	// If this fails, ptr is still valid and still tracked
+	ALLOC_TAG_SCOPE(tag | (alloc_get_tag() & ALLOC_PERMANENT))
+		buf = ALLOC_REALLOC(ptr, size);
+
+	return buf;
+}
+
+void alloc_free(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	ALLOC_UNTRACK(ptr);
+	free(ptr);
+}
+
+void alloc_set_budget(alloc_tag_t tag, uint64_t budget)
+{
+	if (tag >= ALLOC_TAG_COUNT)
+		return;
+
+	mutex_lock(&s_tracker->lock);
+	s_tracker->budgets[tag] = budget;
+	s_tracker->over_budget[tag] = false;
+	mutex_unlock(&s_tracker->lock);
+}
+
+void alloc_get_stats(alloc_tag_t tag, alloc_stats_t *stats)
+{
+	if (!stats || tag > ALLOC_TAG_COUNT)
+		return;
+
+	mutex_lock(&s_tracker->lock);
+	*stats = tag == ALLOC_TAG_COUNT ? s_tracker->total : s_tracker->stats[tag];
+	mutex_unlock(&s_tracker->lock);
+}
+
+const char *alloc_tag_name(alloc_tag_t tag)
+{
+	return tag < ALLOC_TAG_COUNT ? s_tag_names[tag] : "unknown";
+}
+
+void alloc_set_capture_stacks(bool capture)
+{
+	atomic_store(&s_tracker->capture_stacks, capture);
+}
+
+void alloc_report(bool leaks)
+{
+	alloc_stats_t stats[ALLOC_TAG_COUNT];
+	uint64_t breakdown[ALLOC_TAG_COUNT];
+	alloc_record_t leaked[ALLOC_MAX_LEAKS];
+	alloc_stats_t total;
+	uint64_t leak_count;
+	uint64_t leak_bytes;
+	double seconds;
+	uint32_t count;
+	size_t i;
+
+	// Copy everything first, logging allocates
+	mutex_lock(&s_tracker->lock);
+	memcpy(stats, s_tracker->stats, sizeof(stats));
+	memcpy(breakdown, s_tracker->peak_breakdown, sizeof(breakdown));
+	total = s_tracker->total;
+	seconds = s_tracker->start ? (double)(util_get_time() - s_tracker->start) / UTIL_NS_PER_SEC : 0.0;
+	leak_count = 0;
+	leak_bytes = 0;
+	count = 0;
+	for (i = 0; leaks && i < s_tracker->capacity; i++) {
+		if (!s_tracker->records[i].ptr || s_tracker->records[i].tag & ALLOC_PERMANENT)
+			continue;
+		if (count < ALLOC_MAX_LEAKS)
+			leaked[count++] = s_tracker->records[i];
+		leak_count++;
+		leak_bytes += s_tracker->records[i].size;
+	}
+	mutex_unlock(&s_tracker->lock);
+
+	seconds = PURPL_MAX(seconds, 0.001);
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+		 ALLOC_LOG_PREFIX "Peak of %.1lf KiB, %" PRIu64 " %s still live (sizes in KiB):\n",
+		 (double)total.peak_bytes / 1024.0, total.live_count,
+		 PURPL_PLURALIZE(total.live_count, "allocations", "allocation"));
+	for (i = 0; i < ALLOC_TAG_COUNT; i++) {
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+			 ALLOC_LOG_PREFIX "%-8s live %10.1lf peak %10.1lf at total peak %10.1lf allocations %8" PRIu64
+					  " (%.1lf/s, %.1lf KiB/s)\n",
+			 s_tag_names[i], (double)stats[i].live_bytes / 1024.0, (double)stats[i].peak_bytes / 1024.0,
+			 (double)breakdown[i] / 1024.0, stats[i].allocations, stats[i].allocations / seconds,
+			 (double)stats[i].bytes_allocated / 1024.0 / seconds);
+	}
+
+	if (!leaks)
+		return;
+
+	if (!leak_count) {
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "No leaks\n");
+		return;
+	}
+
+	LOG_WARNING(LOG_SUBSYSTEM_GENERAL,
+		    ALLOC_LOG_PREFIX "%" PRIu64 " %s leaked, %" PRIu64 " %s:\n", leak_count,
+		    PURPL_PLURALIZE(leak_count, "allocations", "allocation"), leak_bytes,
+		    PURPL_PLURALIZE(leak_bytes, "bytes", "byte"));
+	for (i = 0; i < count; i++) {
+		LOG_WARNING(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "0x%" PRIXPTR " %zu %s (%s)\n",
+			    (uintptr_t)leaked[i].ptr, leaked[i].size, PURPL_PLURALIZE(leaked[i].size, "bytes", "byte"),
+			    s_tag_names[leaked[i].tag & ~ALLOC_PERMANENT]);
+		alloc_log_stack(leaked[i].frames, leaked[i].frame_count);
+	}
+	if (leak_count > count)
+		LOG_WARNING(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "And %" PRIu64 " more\n", leak_count - count);
+}
+
+alloc_tracker_t *alloc_get_tracker(void)
+{
+	return s_tracker;
+}
+
+void alloc_use_tracker(alloc_tracker_t *tracker)
+{
+	s_tracker = tracker ? tracker : &s_local_tracker;
+}
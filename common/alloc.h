@@ -0,0 +1,162 @@
+// Allocation tracking. util_alloc, util_alloc_aligned and the containers record every allocation in a table with its
+// size and a tag for the subsystem it belongs to, which comes from the innermost ALLOC_TAG_SCOPE or ALLOC_PUSH_TAG on
+// the calling thread, and util_free and util_free_aligned remove them. That gives live bytes, peak bytes and the
+// number of allocations for each tag, and at shutdown alloc_report logs those, what each tag was using when the total
+// peaked, and anything that was never freed, optionally with the call stack that allocated it. Tracking is compiled
+// out unless PURPL_TRACK_ALLOCATIONS is defined, which it is in debug builds. Since common is a static library, the
+// launcher gives the engine its tracker, like the metrics registry.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "thread.h"
+#include "util.h"
+
+#define ALLOC_LOG_PREFIX COMMON_LOG_PREFIX "ALLOC: "
+
+// Whether allocations are tracked
+#ifndef PURPL_TRACK_ALLOCATIONS
+#ifdef PURPL_DEBUG
+#define PURPL_TRACK_ALLOCATIONS 1
+#endif
+#endif
+
+// Deepest tags can be nested on a thread
+#define ALLOC_TAG_DEPTH 16
+
+// Most stack frames captured for each allocation
+#define ALLOC_STACK_DEPTH 12
+
+// Number of allocations the table starts with room for
+#define ALLOC_TABLE_SIZE 4096
+
+// Most leaks logged individually, the rest are only counted
+#define ALLOC_MAX_LEAKS 16
+
+// Subsystems allocations are charged to
+typedef enum alloc_tag {
+	ALLOC_TAG_GENERAL, // Anything not in a tag scope
+	ALLOC_TAG_PACK, // Pack files and their contents
+	ALLOC_TAG_RENDER, // Rendering
+	ALLOC_TAG_LOG, // Logging
+	ALLOC_TAG_INI, // Parsed INI files
+	ALLOC_TAG_ECS, // Entity component system
+	ALLOC_TAG_SDL, // SDL
+	ALLOC_TAG_ZSTD, // Zstandard contexts
+	ALLOC_TAG_COUNT
+} alloc_tag_t;
+
+// Or'd with a tag for allocations meant to last until the process exits, like the atom table, which aren't leaks
+#define ALLOC_PERMANENT 0x80
+
+// Usage of one tag
+typedef struct alloc_stats {
+	uint64_t live_bytes; // Bytes allocated and not freed
+	uint64_t peak_bytes; // Highest value of live_bytes
+	uint64_t live_count; // Allocations not freed
+	uint64_t allocations; // Allocations made, including reallocations
+	uint64_t bytes_allocated; // Bytes allocated, including ones that've been freed
+} alloc_stats_t;
+
+// A live allocation
+typedef struct alloc_record {
+	void *ptr; // Address, NULL if the slot is empty
+	size_t size; // Size
+	uint8_t tag; // Tag, with ALLOC_PERMANENT
+	uint8_t frame_count; // Number of frames in the call stack
+	void *frames[ALLOC_STACK_DEPTH]; // Call stack, if stacks were being captured
+} alloc_record_t;
+
+// Every live allocation, in a hash table keyed by address
+typedef struct alloc_tracker {
+	mutex_t lock; // Held while using anything below
+	alloc_record_t *records; // Table of allocations, allocated without tracking
+	size_t capacity; // Slots in the table, always a power of 2
+	size_t count; // Allocations in the table
+	alloc_stats_t stats[ALLOC_TAG_COUNT]; // Usage of each tag
+	alloc_stats_t total; // Usage of every tag
+	uint64_t peak_breakdown[ALLOC_TAG_COUNT]; // Live bytes of each tag when the total peaked
+	uint64_t budgets[ALLOC_TAG_COUNT]; // Live bytes each tag is expected to stay under, 0 for no limit
+	bool over_budget[ALLOC_TAG_COUNT]; // Whether each tag is over its budget, so it's only reported once
+	uint64_t start; // util_get_time of the first allocation
+	atomic_bool capture_stacks; // Whether new allocations get a call stack
+} alloc_tracker_t;
+
+#ifdef PURPL_TRACK_ALLOCATIONS
+#define ALLOC_TRACK(ptr, size) alloc_track((ptr), (size))
+#define ALLOC_REALLOC(old, size) alloc_realloc_tracked((old), (size))
+#define ALLOC_UNTRACK(ptr) alloc_untrack((ptr))
+#define ALLOC_PUSH_TAG(tag) alloc_push_tag((tag))
+#define ALLOC_POP_TAG() alloc_pop_tag()
+#define ALLOC_TAG_SCOPE(tag)                                                                                   \
+	for (int alloc_scope_once_ = (alloc_push_tag(tag), 1); alloc_scope_once_;                              \
+	     alloc_scope_once_ = 0, alloc_pop_tag())
+#else
+#define ALLOC_TRACK(ptr, size) ((void)0)
+#define ALLOC_REALLOC(old, size) realloc((old), (size))
+#define ALLOC_UNTRACK(ptr) ((void)0)
+#define ALLOC_PUSH_TAG(tag) ((void)0)
+#define ALLOC_POP_TAG() ((void)0)
+#define ALLOC_TAG_SCOPE(tag)
+#endif
+
+// Charge allocations on this thread to a tag until the matching alloc_pop_tag, use the macros instead
+extern void alloc_push_tag(uint8_t tag);
+
+// Go back to the previous tag, use the macros instead
+extern void alloc_pop_tag(void);
+
+// Get the calling thread's current tag, with ALLOC_PERMANENT if it's set
+extern uint8_t alloc_get_tag(void);
+
+// Record an allocation under the current tag, use the macros instead
+extern void alloc_track(void *ptr, size_t size);
+
+// Reallocate old like realloc, moving its record to the new address and keeping its tag, use the macros instead
+extern void *alloc_realloc_tracked(void *old, size_t size);
+
+// Remove an allocation, returns false if it wasn't tracked, use the macros instead
+extern bool alloc_untrack(void *ptr);
+
+// Allocate memory like malloc for a library that expects it to act like malloc, charged to tag. Returns NULL if size
+// is 0 or the allocation fails.
+extern void *alloc_malloc(alloc_tag_t tag, size_t size);
+
+// Allocate zeroed memory like calloc for a library
+extern void *alloc_calloc(alloc_tag_t tag, size_t count, size_t size);
+
+// Resize memory like realloc for a library, the memory keeps the tag it was allocated with
+extern void *alloc_realloc(alloc_tag_t tag, void *ptr, size_t size);
+
+// Free memory from alloc_malloc, alloc_calloc or alloc_realloc
+extern void alloc_free(void *ptr);
+
+// Set the live bytes a tag is expected to stay under, going over it logs a warning. 0 removes the limit.
+extern void alloc_set_budget(alloc_tag_t tag, uint64_t budget);
+
+// Get the usage of a tag, or of every tag if tag is ALLOC_TAG_COUNT
+extern void alloc_get_stats(alloc_tag_t tag, alloc_stats_t *stats);
+
+// Get the name of a tag
+extern const char *alloc_tag_name(alloc_tag_t tag);
+
+// Set whether to capture the call stack of new allocations, which is slow, so it's only done in developer mode
+extern void alloc_set_capture_stacks(bool capture);
+
+// Log the usage of each tag, and every allocation that isn't permanent if leaks is true
+extern void alloc_report(bool leaks);
+
+// Get the tracker this module uses
+extern alloc_tracker_t *alloc_get_tracker(void);
+
+// Use another module's tracker. Allocations from before this stay in the old one, and freeing them later does nothing
+// to the new one.
+extern void alloc_use_tracker(alloc_tracker_t *tracker);
+
+// Capture the caller's call stack, not including alloc_capture_stack, platform specific
+extern uint8_t alloc_capture_stack(void **frames, uint8_t max_frames);
+
+// Log a call stack, platform specific
+extern void alloc_log_stack(void *const *frames, uint8_t frame_count);
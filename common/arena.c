@@ -0,0 +1,365 @@
+// Linear allocators
+
+#include "arena.h"
+
+// Let AddressSanitizer know which parts of an arena are allocated in debug builds
+#if ARENA_DEBUG
+#ifdef __SANITIZE_ADDRESS__
+#define ARENA_ASAN 1
+#elif defined __has_feature
+#if __has_feature(address_sanitizer)
+#define ARENA_ASAN 1
+#endif
+#endif
+#endif
+
+#ifdef ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#endif
+
+// Round a pointer up to a power of two
+#define ALIGN_UP(ptr, alignment) ((uint8_t *)(((uintptr_t)(ptr) + (alignment)-1) & ~(uintptr_t)((alignment)-1)))
+
+void arena_init(arena_t *arena, size_t block_size)
+{
+	if (!arena)
+		return;
+
+	memset(arena, 0, sizeof(arena_t));
+	arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+}
+
+// Start a new block with room for at least min_size bytes
+static void add_block(arena_t *arena, size_t min_size)
+{
+	arena_block_t *block;
+	size_t size;
+
+	size = PURPL_MAX(arena->block_size, min_size);
+	block = malloc(sizeof(arena_block_t) + size + ARENA_ALIGNMENT);
+	PURPL_ASSERT(block);
+	ALLOC_TRACK(block, sizeof(arena_block_t) + size + ARENA_ALIGNMENT);
+	block->size = size;
+	block->base = ALIGN_UP(block + 1, ARENA_ALIGNMENT);
+	ASAN_POISON_MEMORY_REGION(block->base, block->size);
+
+	if (arena->blocks)
+		arena->used += arena->cur - arena->blocks->base;
+	block->next = arena->blocks;
+	arena->blocks = block;
+	arena->cur = block->base;
+	arena->end = block->base + block->size;
+}
+
+// Take size bytes plus room for a header and a trailer from the current block, NULL if they don't fit
+static uint8_t *bump(arena_t *arena, size_t size, size_t alignment, size_t header, size_t trailer)
+{
+	uint8_t *buf;
+
+	if (!arena->cur)
+		return NULL;
+
+	buf = ALIGN_UP(arena->cur + header, alignment);
+	if (buf > arena->end || size + trailer > (size_t)(arena->end - buf))
+		return NULL;
+
+	arena->cur = buf + size + trailer;
+	return buf;
+}
+
+void *arena_alloc_slow(arena_t *arena, size_t size, size_t alignment)
+{
+	size_t header;
+	size_t trailer;
+	uint8_t *buf;
+#if ARENA_DEBUG
+	arena_debug_header_t *debug;
+	uint32_t canary;
+#endif
+
+	PURPL_ASSERT(arena && alignment && !(alignment & (alignment - 1)));
+
+#if ARENA_DEBUG
+	// The header has to be aligned too
+	alignment = PURPL_MAX(alignment, sizeof(void *));
+	header = sizeof(arena_debug_header_t);
+	trailer = sizeof(uint32_t);
+#else
+	header = 0;
+	trailer = 0;
+#endif
+
+	buf = bump(arena, size, alignment, header, trailer);
+	if (!buf) {
+		add_block(arena, size + alignment + header + trailer);
+		buf = bump(arena, size, alignment, header, trailer);
+		PURPL_ASSERT(buf);
+	}
+
+#if ARENA_DEBUG
+	ASAN_UNPOISON_MEMORY_REGION(buf - header, header + size + trailer);
+	debug = (arena_debug_header_t *)buf - 1;
+	debug->prev = arena->last;
+	debug->size = (uint32_t)size;
+	debug->canary = ARENA_CANARY;
+	canary = ARENA_CANARY;
+	memcpy(buf + size, &canary, sizeof(uint32_t));
+	arena->last = debug;
+#endif
+
+	return buf;
+}
+
+size_t arena_get_used(arena_t *arena)
+{
+	if (!arena || !arena->blocks)
+		return 0;
+
+	return arena->used + (arena->cur - arena->blocks->base);
+}
+
+bool arena_check(arena_t *arena)
+{
+#if ARENA_DEBUG
+	arena_debug_header_t *header;
+	uint32_t canary;
+	bool ok;
+
+	if (!arena)
+		return false;
+
+	ok = true;
+	for (header = arena->last; header; header = header->prev) {
+		if (header->canary != ARENA_CANARY) {
+			// The header is the end of the allocation before it, and the rest of the chain can't be trusted
+			PURPL_LOG(ARENA_LOG_PREFIX "Header of allocation at 0x%" PRIXPTR " was overwritten\n",
+				  (uintptr_t)(header + 1));
+			return false;
+		}
+
+		memcpy(&canary, (uint8_t *)(header + 1) + header->size, sizeof(uint32_t));
+		if (canary != ARENA_CANARY) {
+			PURPL_LOG(ARENA_LOG_PREFIX "Allocation of %u bytes at 0x%" PRIXPTR " was overflowed\n",
+				  header->size, (uintptr_t)(header + 1));
+			ok = false;
+		}
+	}
+
+	return ok;
+#else
+	return arena != NULL;
+#endif
+}
+
+void arena_reset(arena_t *arena)
+{
+	arena_block_t *block;
+	arena_block_t *next;
+	size_t used;
+
+	if (!arena || !arena->blocks)
+		return;
+
+	used = arena_get_used(arena);
+	arena->peak = PURPL_MAX(arena->peak, used);
+
+#if ARENA_DEBUG
+	PURPL_ASSERT(arena_check(arena));
+	for (block = arena->blocks; block; block = block->next) {
+		ASAN_UNPOISON_MEMORY_REGION(block->base, block->size);
+		memset(block->base, ARENA_POISON, block == arena->blocks ? (size_t)(arena->cur - block->base) : block->size);
+		ASAN_POISON_MEMORY_REGION(block->base, block->size);
+	}
+	arena->last = NULL;
+#endif
+
+	if (arena->blocks->next) {
+		// Replace the blocks with one big enough for everything, so the next time is a pointer bump again
+		PURPL_LOG(ARENA_LOG_PREFIX "Arena outgrew its blocks with %zu bytes, growing it\n", used);
+		for (block = arena->blocks; block; block = next) {
+			next = block->next;
+			util_free(block);
+		}
+		arena->blocks = NULL;
+		arena->block_size = PURPL_MAX(arena->block_size, used + used / 2);
+		add_block(arena, 0);
+	}
+
+	arena->cur = arena->blocks->base;
+	arena->used = 0;
+}
+
+void arena_free(arena_t *arena)
+{
+	arena_block_t *block;
+	arena_block_t *next;
+
+	if (!arena)
+		return;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		util_free(block);
+	}
+
+	arena_init(arena, arena->block_size);
+}
+
+// A thread's frame arena. There are two buffers so that memory from the previous frame is still valid for things
+// that are handed from one frame to the next.
+typedef struct frame_arena {
+	arena_t buffers[2]; // Alternating buffers, frame & 1 is the current one
+	uint64_t frame; // Frame this thread last allocated in
+	uint64_t thread_id; // Thread the arena belongs to
+	struct frame_arena *next; // Next arena in the list of every thread's arena
+} frame_arena_t;
+
+static atomic_uint_fast64_t s_frame;
+static _Atomic(frame_arena_t *) s_frame_arenas;
+static PURPL_THREAD_LOCAL frame_arena_t *t_frame_arena;
+
+// Get the calling thread's frame arena, creating it or switching it to the current frame
+static frame_arena_t *get_frame_arena(void)
+{
+	frame_arena_t *arena;
+	uint64_t frame;
+
+	frame = atomic_load_explicit(&s_frame, memory_order_relaxed);
+	arena = t_frame_arena;
+
+	if (!arena) {
+		arena = util_alloc(1, sizeof(frame_arena_t), NULL);
+		arena_init(&arena->buffers[0], FRAME_ARENA_BLOCK_SIZE);
+		arena_init(&arena->buffers[1], FRAME_ARENA_BLOCK_SIZE);
+		arena->frame = frame;
+		arena->thread_id = thread_get_id();
+
+		arena->next = atomic_load(&s_frame_arenas);
+		while (!atomic_compare_exchange_weak(&s_frame_arenas, &arena->next, arena))
+			;
+		t_frame_arena = arena;
+	} else if (arena->frame != frame) {
+		// If this thread skipped a frame, what it allocated last is from two or more frames ago
+		if (frame - arena->frame > 1)
+			arena_reset(&arena->buffers[arena->frame & 1]);
+		arena_reset(&arena->buffers[frame & 1]);
+		arena->frame = frame;
+	}
+
+	return arena;
+}
+
+void *frame_alloc(size_t size)
+{
+	frame_arena_t *arena;
+
+	arena = t_frame_arena;
+	if (!arena || arena->frame != atomic_load_explicit(&s_frame, memory_order_relaxed))
+		arena = get_frame_arena();
+
+	return arena_alloc(&arena->buffers[arena->frame & 1], size, ARENA_ALIGNMENT);
+}
+
+void *frame_calloc(size_t count, size_t size)
+{
+	void *buf;
+
+	buf = frame_alloc(count * size);
+	memset(buf, 0, count * size);
+
+	return buf;
+}
+
+char *frame_strdup(const char *str)
+{
+	char *buf;
+	size_t len;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str) + 1;
+	buf = frame_alloc(len);
+	memcpy(buf, str, len);
+
+	return buf;
+}
+
+char *frame_strfmt(const char *fmt, ...)
+{
+	va_list args;
+	char *buf;
+
+	va_start(args, fmt);
+	buf = frame_vstrfmt(fmt, args);
+	va_end(args);
+
+	return buf;
+}
+
+char *frame_vstrfmt(const char *fmt, va_list args)
+{
+	va_list args2;
+	char *buf;
+	int len;
+
+	if (!fmt)
+		return NULL;
+
+	va_copy(args2, args);
+
+	len = stbsp_vsnprintf(NULL, 0, fmt, args) + 1;
+	buf = frame_alloc(len);
+	stbsp_vsnprintf(buf, len, fmt, args2);
+
+	va_end(args2);
+
+	return buf;
+}
+
+void frame_begin(void)
+{
+	atomic_fetch_add_explicit(&s_frame, 1, memory_order_relaxed);
+	get_frame_arena();
+}
+
+void frame_end(void)
+{
+	frame_arena_t *arena;
+
+	arena = t_frame_arena;
+	if (arena)
+		PURPL_ASSERT(arena_check(&arena->buffers[arena->frame & 1]));
+}
+
+bool frame_check(const void *buf)
+{
+#if ARENA_DEBUG
+	// Memory from a frame that's over has been poisoned, so its header is gone
+	return buf && ((const arena_debug_header_t *)buf - 1)->canary == ARENA_CANARY;
+#else
+	return buf != NULL;
+#endif
+}
+
+void frame_shutdown(void)
+{
+	frame_arena_t *arena;
+	frame_arena_t *next;
+
+	for (arena = atomic_exchange(&s_frame_arenas, NULL); arena; arena = next) {
+		next = arena->next;
+		PURPL_LOG(ARENA_LOG_PREFIX "Frame arena of thread %" PRIu64 " used at most %zu bytes in a frame\n",
+			  arena->thread_id,
+			  PURPL_MAX(PURPL_MAX(arena->buffers[0].peak, arena_get_used(&arena->buffers[0])),
+				    PURPL_MAX(arena->buffers[1].peak, arena_get_used(&arena->buffers[1]))));
+		arena_free(&arena->buffers[0]);
+		arena_free(&arena->buffers[1]);
+		util_free(arena);
+	}
+
+	t_frame_arena = NULL;
+}
@@ -0,0 +1,124 @@
+// Linear allocators. An arena hands out memory by bumping a pointer and frees all of it at once when it's reset. The
+// frame arena is a pair of them per thread, used for memory that only has to live for a frame or two, like temporary
+// strings. It's only reset by frame_begin, so code that also runs outside the frame loop, like the loader's workers or
+// the tools, shouldn't use it.
+
+#pragma once
+
+#include "common.h"
+#include "alloc.h"
+#include "thread.h"
+#include "util.h"
+
+#define ARENA_LOG_PREFIX COMMON_LOG_PREFIX "ARENA: "
+
+// Debug builds put a header and a canary around every allocation and poison memory when it's reset
+#ifdef PURPL_DEBUG
+#define ARENA_DEBUG 1
+#else
+#define ARENA_DEBUG 0
+#endif
+
+// Alignment of allocations if not specified
+#define ARENA_ALIGNMENT 16
+
+// Default size of arena blocks
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Size of the blocks of frame arenas
+#define FRAME_ARENA_BLOCK_SIZE (1024 * 1024)
+
+// Written over memory when an arena is reset, to make use after reset obvious
+#define ARENA_POISON 0xDD
+
+// Goes in the debug header and after the end of every allocation in debug builds
+#define ARENA_CANARY 0xA4E4A4E4
+
+// A block of memory in an arena
+typedef struct arena_block {
+	struct arena_block *next; // Previous block, the current one is first
+	size_t size; // Usable size of the block
+	uint8_t *base; // Start of the usable memory
+} arena_block_t;
+
+// Header in front of allocations in debug builds
+typedef struct arena_debug_header {
+	struct arena_debug_header *prev; // Previous allocation in the arena
+	uint32_t size; // Size of the allocation
+	uint32_t canary; // ARENA_CANARY
+} arena_debug_header_t;
+
+// A linear allocator
+typedef struct arena {
+	uint8_t *cur; // Next free byte in the current block
+	uint8_t *end; // End of the current block
+	arena_block_t *blocks; // Blocks, the current one first
+	size_t block_size; // Size of new blocks
+	size_t used; // Bytes used in full blocks
+	size_t peak; // Most bytes used before a reset
+#if ARENA_DEBUG
+	arena_debug_header_t *last; // Most recent allocation
+#endif
+} arena_t;
+
+// Set up an arena, no memory is allocated until it's needed
+extern void arena_init(arena_t *arena, size_t block_size);
+
+// Allocate from an arena when the current block is full (or always in debug builds)
+extern void *arena_alloc_slow(arena_t *arena, size_t size, size_t alignment);
+
+// Allocate uninitialized memory from an arena. alignment has to be a power of two.
+static inline void *arena_alloc(arena_t *arena, size_t size, size_t alignment)
+{
+#if !ARENA_DEBUG
+	uint8_t *buf;
+
+	buf = (uint8_t *)(((uintptr_t)arena->cur + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	if (arena->cur && buf <= arena->end && size <= (size_t)(arena->end - buf)) {
+		arena->cur = buf + size;
+		return buf;
+	}
+#endif
+
+	return arena_alloc_slow(arena, size, alignment);
+}
+
+// Get the number of bytes allocated from an arena since it was last reset
+extern size_t arena_get_used(arena_t *arena);
+
+// Check the canaries of every allocation in an arena in debug builds, returns false if any were overwritten
+extern bool arena_check(arena_t *arena);
+
+// Free everything allocated from an arena. If it needed more than one block, they're replaced with one big enough for
+// all of it.
+extern void arena_reset(arena_t *arena);
+
+// Free all of an arena's memory
+extern void arena_free(arena_t *arena);
+
+// Allocate memory that stays valid until the end of the next frame on this thread. Costs a pointer bump.
+extern void *frame_alloc(size_t size);
+
+// Allocate zeroed memory that stays valid until the end of the next frame
+extern void *frame_calloc(size_t count, size_t size);
+
+// Duplicate a string into frame memory
+extern char *frame_strdup(const char *str);
+
+// Format a string into frame memory
+extern char *frame_strfmt(const char *fmt, ...);
+
+// Format a string into frame memory
+extern char *frame_vstrfmt(const char *fmt, va_list args);
+
+// Start a new frame, making memory from two frames ago invalid. Other threads switch over the next time they allocate.
+extern void frame_begin(void);
+
+// End a frame, checking this thread's frame memory for overflows in debug builds
+extern void frame_end(void);
+
+// Check that frame memory hasn't outlived its frame, always true in release builds
+extern bool frame_check(const void *buf);
+
+// Free the frame memory of every thread, no other threads can be using it
+extern void frame_shutdown(void);
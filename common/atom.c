@@ -0,0 +1,198 @@
+// Interned strings
+
+#include "atom.h"
+
+// An entry in the atom table
+typedef struct atom_entry {
+	const char *str; // The string
+	uint64_t hash; // Hash of the string including its terminator
+	uint32_t len; // Length of the string
+	atom_t next; // Next atom with the same hash, only used with the lock held
+} atom_entry_t;
+
+// Maps string hashes to the most recent atom with that hash
+#define ATOM_MAP_HASH(hash) (hash)
+HASHMAP_DECLARE(atom_map, uint64_t, atom_t, ATOM_MAP_HASH, HASHMAP_EQUAL)
+
+// Entries are only ever added, and chunks never move, so looking an atom up doesn't need the lock
+static atom_entry_t *s_chunks[ATOM_MAX_CHUNKS];
+static atomic_uint_fast32_t s_count;
+
+static mutex_t s_lock = MUTEX_INITIALIZER; // Protects everything below
+static atom_map_t s_map;
+static arena_t s_strings;
+
+// Get the entry of an atom
+static atom_entry_t *get_entry(atom_t atom)
+{
+	if (atom == ATOM_NONE || atom > atomic_load_explicit(&s_count, memory_order_acquire))
+		return NULL;
+
+	return &s_chunks[(atom - 1) / ATOM_CHUNK_SIZE][(atom - 1) % ATOM_CHUNK_SIZE];
+}
+
+// Find a string's atom, the lock must be held
+static atom_t find(const char *str, size_t len, uint64_t hash)
+{
+	atom_entry_t *entry;
+	atom_t *first;
+	atom_t atom;
+
+	first = atom_map_get(&s_map, hash);
+	if (!first)
+		return ATOM_NONE;
+
+	// Different strings can have the same hash, so check each one that does
+	for (atom = *first; atom != ATOM_NONE; atom = entry->next) {
+		entry = get_entry(atom);
+		if (entry->len == len && memcmp(entry->str, str, len) == 0)
+			return atom;
+	}
+
+	return ATOM_NONE;
+}
+
+// Look up or add a string with its hash
+static atom_t intern(const char *str, size_t len, uint64_t hash)
+{
+	atom_entry_t *entry;
+	atom_t *existing;
+	atom_t atom;
+	uint32_t count;
+	char *buf;
+
+	mutex_lock(&s_lock);
+
+	atom = find(str, len, hash);
+	if (atom != ATOM_NONE) {
+		mutex_unlock(&s_lock);
+		METRICS_COUNTER_ADD("atom.hits", 1);
+		return atom;
+	}
+
+	count = (uint32_t)atomic_load_explicit(&s_count, memory_order_relaxed);
+	PURPL_ASSERT(count < ATOM_CHUNK_SIZE * ATOM_MAX_CHUNKS);
+	// Atoms are never freed
+	ALLOC_PUSH_TAG(alloc_get_tag() | ALLOC_PERMANENT);
+	if (!s_chunks[count / ATOM_CHUNK_SIZE]) {
+		if (!s_strings.block_size)
+			arena_init(&s_strings, ARENA_BLOCK_SIZE);
+		s_chunks[count / ATOM_CHUNK_SIZE] = util_alloc(ATOM_CHUNK_SIZE, sizeof(atom_entry_t), NULL);
+	}
+	buf = arena_alloc(&s_strings, len + 1, 1);
+	ALLOC_POP_TAG();
+	memcpy(buf, str, len);
+	buf[len] = 0;
+
+	entry = &s_chunks[count / ATOM_CHUNK_SIZE][count % ATOM_CHUNK_SIZE];
+	entry->str = buf;
+	entry->hash = hash;
+	entry->len = (uint32_t)len;
+	existing = atom_map_get(&s_map, hash);
+	entry->next = existing ? *existing : ATOM_NONE;
+
+	atom = count + 1;
+	atom_map_put(&s_map, hash, atom);
+	atomic_store_explicit(&s_count, count + 1, memory_order_release);
+
+	mutex_unlock(&s_lock);
+	METRICS_COUNTER_ADD("atom.misses", 1);
+
+	return atom;
+}
+
+atom_t atom_intern(const char *str)
+{
+	size_t len;
+
+	if (!str)
+		return ATOM_NONE;
+
+	len = strlen(str);
+	return intern(str, len, ATOM_HASH(str, len));
+}
+
+atom_t atom_intern_n(const char *str, size_t len)
+{
+	char stack_buf[ATOM_PATH_BUFFER_SIZE];
+	char *buf;
+	atom_t atom;
+
+	if (!str)
+		return ATOM_NONE;
+
+	// The hash includes the terminator, so the string needs one added
+	buf = len < ATOM_PATH_BUFFER_SIZE ? stack_buf : util_alloc(len + 1, sizeof(char), NULL);
+	memcpy(buf, str, len);
+	buf[len] = 0;
+	atom = intern(buf, len, ATOM_HASH(buf, len));
+	if (buf != stack_buf)
+		util_free(buf);
+
+	return atom;
+}
+
+atom_t atom_intern_path(const char *path)
+{
+	char stack_buf[ATOM_PATH_BUFFER_SIZE];
+	char *buf;
+	size_t len;
+	atom_t atom;
+
+	if (!path)
+		return ATOM_NONE;
+
+	len = strlen(path);
+	buf = len < ATOM_PATH_BUFFER_SIZE ? stack_buf : util_alloc(len + 1, sizeof(char), NULL);
+	len = util_normalize_path_to(buf, path);
+	atom = intern(buf, len, ATOM_HASH(buf, len));
+	if (buf != stack_buf)
+		util_free(buf);
+
+	return atom;
+}
+
+atom_t atom_find(const char *str)
+{
+	size_t len;
+	atom_t atom;
+
+	if (!str)
+		return ATOM_NONE;
+
+	len = strlen(str);
+	mutex_lock(&s_lock);
+	atom = find(str, len, ATOM_HASH(str, len));
+	mutex_unlock(&s_lock);
+
+	return atom;
+}
+
+const char *atom_str(atom_t atom)
+{
+	atom_entry_t *entry;
+
+	entry = get_entry(atom);
+	return entry ? entry->str : NULL;
+}
+
+size_t atom_len(atom_t atom)
+{
+	atom_entry_t *entry;
+
+	entry = get_entry(atom);
+	return entry ? entry->len : 0;
+}
+
+uint64_t atom_hash(atom_t atom)
+{
+	atom_entry_t *entry;
+
+	entry = get_entry(atom);
+	return entry ? entry->hash : 0;
+}
+
+uint32_t atom_count(void)
+{
+	return (uint32_t)atomic_load(&s_count);
+}
@@ -0,0 +1,57 @@
+// Interned strings. Each distinct string is stored once, for the rest of the program, and identified by a 32-bit atom,
+// which also has the string's length and hash ready, so comparing atoms is comparing integers and looking one up in a
+// pack doesn't hash anything. Since common is a static library, the launcher, the engine and each tool have their own
+// atom table, so atoms shouldn't be passed between them (hashes can be, they're the same everywhere).
+
+#pragma once
+
+#include "common.h"
+#include "arena.h"
+#include "container.h"
+#include "metrics.h"
+#include "thread.h"
+#include "util.h"
+
+#define ATOM_LOG_PREFIX COMMON_LOG_PREFIX "ATOM: "
+
+// Not an atom
+#define ATOM_NONE 0
+
+// Number of atoms in each chunk of the table
+#define ATOM_CHUNK_SIZE 1024
+
+// Most chunks the table can have
+#define ATOM_MAX_CHUNKS 1024
+
+// Paths shorter than this are normalized on the stack
+#define ATOM_PATH_BUFFER_SIZE 256
+
+// An interned string
+typedef uint32_t atom_t;
+
+// Hash an atom's string the same way atom_hash does
+#define ATOM_HASH(str, len) XXH3_64bits((str), (len) + 1)
+
+// Intern a string
+extern atom_t atom_intern(const char *str);
+
+// Intern a string of the given length, which doesn't have to be terminated
+extern atom_t atom_intern_n(const char *str, size_t len);
+
+// Normalize a path like util_normalize_path and intern it, without allocating anything if it's already interned
+extern atom_t atom_intern_path(const char *path);
+
+// Find a string's atom without interning it, ATOM_NONE if it hasn't been interned
+extern atom_t atom_find(const char *str);
+
+// Get an atom's string, which lasts as long as the program
+extern const char *atom_str(atom_t atom);
+
+// Get the length of an atom's string
+extern size_t atom_len(atom_t atom);
+
+// Get the XXH3 hash of an atom's string including its terminator, which is what pack_entry_t.path_hash is
+extern uint64_t atom_hash(atom_t atom);
+
+// Get the number of atoms
+extern uint32_t atom_count(void);
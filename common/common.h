@@ -35,6 +35,8 @@
 #include "stb_sprintf.h"
 #define XXH_INLINE_ALL
 #include "xxhash.h"
+// For ZSTD_customMem
+#define ZSTD_STATIC_LINKING_ONLY
 #include "zstd.h"
 
 #define COMMON_LOG_PREFIX "COMMON: "
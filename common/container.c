@@ -0,0 +1,23 @@
+// Out of line parts of the containers
+
+#include "alloc.h"
+#include "container.h"
+
+void array_grow(void **data, size_t *capacity, size_t min_capacity, size_t elem_size)
+{
+	size_t new_capacity;
+	void *buf;
+
+	if (!data || !capacity || min_capacity <= *capacity)
+		return;
+
+	// Grow by 1.5x so the old blocks can eventually be reused by the allocator
+	new_capacity = PURPL_MAX(*capacity + *capacity / 2, ARRAY_MIN_CAPACITY);
+	new_capacity = PURPL_MAX(new_capacity, min_capacity);
+
+	buf = ALLOC_REALLOC(*data, new_capacity * elem_size);
+	PURPL_ASSERT(buf);
+
+	*data = buf;
+	*capacity = new_capacity;
+}
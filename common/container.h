@@ -0,0 +1,323 @@
+// Typed containers. Each *_DECLARE macro declares a struct called name_t and static inline functions prefixed with
+// name_ that work on it, so there's no casting to and from void * and the compiler can see the element size. All of
+// them start out zeroed (= { 0 } or calloc), grow geometrically with realloc, and have to be freed with name_free.
+
+#pragma once
+
+#include "common.h"
+#include "util.h"
+
+// Smallest capacity an array grows to
+#define ARRAY_MIN_CAPACITY 8
+
+// Grow the storage of an array to hold at least min_capacity elements. The new space isn't zeroed.
+extern void array_grow(void **data, size_t *capacity, size_t min_capacity, size_t elem_size);
+
+// Dynamic array of type, with count elements in data and room for capacity
+#define ARRAY_DECLARE(name, type)                                                                         \
+	typedef struct name {                                                                             \
+		type *data;                                                                               \
+		size_t count;                                                                             \
+		size_t capacity;                                                                          \
+	} name##_t;                                                                                       \
+                                                                                                          \
+	/* Make sure there's room for at least capacity elements */                                       \
+	static inline void name##_reserve(name##_t *array, size_t capacity)                               \
+	{                                                                                                 \
+		if (capacity > array->capacity)                                                           \
+			array_grow((void **)&array->data, &array->capacity, capacity, sizeof(type));      \
+	}                                                                                                 \
+                                                                                                          \
+	/* Add an element to the end, returns a pointer to it which is valid until the next push */      \
+	static inline type *name##_push(name##_t *array, type value)                                      \
+	{                                                                                                 \
+		name##_reserve(array, array->count + 1);                                                  \
+		array->data[array->count] = value;                                                       \
+		return array->data + array->count++;                                                      \
+	}                                                                                                 \
+                                                                                                          \
+	/* Add count elements to the end, returns a pointer to the first one */                           \
+	static inline type *name##_push_n(name##_t *array, const type *values, size_t count)              \
+	{                                                                                                 \
+		type *first;                                                                              \
+                                                                                                          \
+		name##_reserve(array, array->count + count);                                              \
+		first = array->data + array->count;                                                       \
+		if (values)                                                                               \
+			memcpy(first, values, count * sizeof(type));                                      \
+		else                                                                                      \
+			memset(first, 0, count * sizeof(type));                                           \
+		array->count += count;                                                                    \
+		return first;                                                                             \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove the last element and return it */                                                       \
+	static inline type name##_pop(name##_t *array)                                                    \
+	{                                                                                                 \
+		PURPL_ASSERT(array->count > 0);                                                           \
+		return array->data[--array->count];                                                       \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove an element by moving the last one into its place */                                     \
+	static inline void name##_remove_swap(name##_t *array, size_t i)                                  \
+	{                                                                                                 \
+		PURPL_ASSERT(i < array->count);                                                           \
+		array->data[i] = array->data[--array->count];                                             \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove all the elements but keep the storage */                                                \
+	static inline void name##_clear(name##_t *array)                                                  \
+	{                                                                                                 \
+		array->count = 0;                                                                         \
+	}                                                                                                 \
+                                                                                                          \
+	/* Free the storage */                                                                            \
+	static inline void name##_free(name##_t *array)                                                   \
+	{                                                                                                 \
+		util_free(array->data);                                                                   \
+		memset(array, 0, sizeof(name##_t));                                                       \
+	}
+
+// Array that stores up to inline_count elements inside itself before it allocates anything. Don't copy one with
+// memcpy or assignment once it's spilled to the heap unless the original is discarded.
+#define SMALLVEC_DECLARE(name, type, inline_count)                                                        \
+	typedef struct name {                                                                             \
+		type *heap;                                                                               \
+		size_t count;                                                                             \
+		size_t capacity;                                                                          \
+		type inline_data[inline_count];                                                           \
+	} name##_t;                                                                                       \
+                                                                                                          \
+	/* Get the elements */                                                                            \
+	static inline type *name##_data(name##_t *vec)                                                    \
+	{                                                                                                 \
+		return vec->heap ? vec->heap : vec->inline_data;                                          \
+	}                                                                                                 \
+                                                                                                          \
+	/* Make sure there's room for at least capacity elements */                                       \
+	static inline void name##_reserve(name##_t *vec, size_t capacity)                                 \
+	{                                                                                                 \
+		if (capacity <= (inline_count) || capacity <= vec->capacity)                              \
+			return;                                                                           \
+		if (!vec->heap) {                                                                         \
+			array_grow((void **)&vec->heap, &vec->capacity, capacity, sizeof(type));          \
+			memcpy(vec->heap, vec->inline_data, vec->count * sizeof(type));                   \
+		} else {                                                                                  \
+			array_grow((void **)&vec->heap, &vec->capacity, capacity, sizeof(type));          \
+		}                                                                                         \
+	}                                                                                                 \
+                                                                                                          \
+	/* Add an element to the end */                                                                   \
+	static inline type *name##_push(name##_t *vec, type value)                                        \
+	{                                                                                                 \
+		type *data;                                                                               \
+                                                                                                          \
+		name##_reserve(vec, vec->count + 1);                                                      \
+		data = name##_data(vec);                                                                  \
+		data[vec->count] = value;                                                                 \
+		return data + vec->count++;                                                               \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove the last element and return it */                                                       \
+	static inline type name##_pop(name##_t *vec)                                                      \
+	{                                                                                                 \
+		PURPL_ASSERT(vec->count > 0);                                                             \
+		return name##_data(vec)[--vec->count];                                                    \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove all the elements */                                                                     \
+	static inline void name##_clear(name##_t *vec)                                                    \
+	{                                                                                                 \
+		vec->count = 0;                                                                           \
+	}                                                                                                 \
+                                                                                                          \
+	/* Free the heap storage if there is any */                                                       \
+	static inline void name##_free(name##_t *vec)                                                     \
+	{                                                                                                 \
+		util_free(vec->heap);                                                                     \
+		memset(vec, 0, sizeof(name##_t));                                                         \
+	}
+
+// Hash an integer key
+static inline uint64_t hashmap_hash_u64(uint64_t key)
+{
+	// splitmix64 finalizer, keys that are already hashes go through it fine too
+	key ^= key >> 30;
+	key *= 0xBF58476D1CE4E5B9ull;
+	key ^= key >> 27;
+	key *= 0x94D049BB133111EBull;
+	key ^= key >> 31;
+	return key;
+}
+
+// Hash a string key
+static inline uint64_t hashmap_hash_str(const char *key)
+{
+	return XXH3_64bits(key, strlen(key));
+}
+
+// Compare keys with ==
+#define HASHMAP_EQUAL(a, b) ((a) == (b))
+
+// Compare string keys
+#define HASHMAP_STR_EQUAL(a, b) (strcmp((a), (b)) == 0)
+
+// Smallest number of slots in a hash map
+#define HASHMAP_MIN_CAPACITY 16
+
+// Slot hash values with special meanings, real hashes are adjusted to not be either of these
+#define HASHMAP_EMPTY 0
+#define HASHMAP_DELETED 1
+
+// Fix up a hash so it doesn't collide with the special values
+#define HASHMAP_FIX_HASH(hash) ((hash) < 2 ? (hash) + 2 : (hash))
+
+// Open addressing hash map from key_type to value_type with linear probing. hash is a function or macro that takes a
+// key and returns a uint64_t, equal is one that takes two keys and returns whether they're the same. Keys aren't
+// copied, so string keys have to outlive the map.
+#define HASHMAP_DECLARE(name, key_type, value_type, hash, equal)                                          \
+	typedef struct name##_slot {                                                                      \
+		uint64_t hash;                                                                            \
+		key_type key;                                                                             \
+		value_type value;                                                                         \
+	} name##_slot_t;                                                                                  \
+                                                                                                          \
+	typedef struct name {                                                                             \
+		name##_slot_t *slots;                                                                     \
+		size_t count; /* Live entries */                                                          \
+		size_t used; /* Live and deleted entries */                                               \
+		size_t capacity; /* Number of slots, always a power of 2 */                               \
+	} name##_t;                                                                                       \
+                                                                                                          \
+	/* Find the slot a key is in, or NULL */                                                          \
+	static inline name##_slot_t *name##_find(name##_t *map, key_type key, uint64_t key_hash)          \
+	{                                                                                                 \
+		name##_slot_t *slot;                                                                      \
+		size_t i;                                                                                 \
+                                                                                                          \
+		if (!map->capacity)                                                                       \
+			return NULL;                                                                      \
+                                                                                                          \
+		for (i = key_hash & (map->capacity - 1);; i = (i + 1) & (map->capacity - 1)) {            \
+			slot = map->slots + i;                                                            \
+			if (slot->hash == HASHMAP_EMPTY)                                                  \
+				return NULL;                                                              \
+			if (slot->hash == key_hash && equal(slot->key, key))                              \
+				return slot;                                                              \
+		}                                                                                         \
+	}                                                                                                 \
+                                                                                                          \
+	/* Resize the slot array and reinsert everything */                                               \
+	static inline void name##_rehash(name##_t *map, size_t capacity)                                  \
+	{                                                                                                 \
+		name##_slot_t *old;                                                                       \
+		size_t old_capacity;                                                                      \
+		size_t i;                                                                                 \
+		size_t j;                                                                                 \
+                                                                                                          \
+		old = map->slots;                                                                         \
+		old_capacity = map->capacity;                                                             \
+		map->slots = util_alloc(capacity, sizeof(name##_slot_t), NULL);                           \
+		map->capacity = capacity;                                                                 \
+		map->used = map->count;                                                                   \
+		for (i = 0; i < old_capacity; i++) {                                                      \
+			if (old[i].hash < 2)                                                              \
+				continue;                                                                 \
+			for (j = old[i].hash & (capacity - 1); map->slots[j].hash != HASHMAP_EMPTY;       \
+			     j = (j + 1) & (capacity - 1))                                                \
+				;                                                                         \
+			map->slots[j] = old[i];                                                           \
+		}                                                                                         \
+		util_free(old);                                                                           \
+	}                                                                                                 \
+                                                                                                          \
+	/* Make sure count entries fit without going over 3/4 full */                                     \
+	static inline void name##_reserve(name##_t *map, size_t count)                                    \
+	{                                                                                                 \
+		size_t capacity;                                                                          \
+                                                                                                          \
+		capacity = PURPL_MAX(map->capacity, HASHMAP_MIN_CAPACITY);                                \
+		while (count * 4 >= capacity * 3)                                                         \
+			capacity *= 2;                                                                    \
+		if (capacity != map->capacity)                                                            \
+			name##_rehash(map, capacity);                                                     \
+	}                                                                                                 \
+                                                                                                          \
+	/* Get a pointer to the value for a key, or NULL */                                               \
+	static inline value_type *name##_get(name##_t *map, key_type key)                                 \
+	{                                                                                                 \
+		name##_slot_t *slot;                                                                      \
+		uint64_t key_hash;                                                                        \
+                                                                                                          \
+		key_hash = hash(key);                                                                     \
+		slot = name##_find(map, key, HASHMAP_FIX_HASH(key_hash));                                 \
+		return slot ? &slot->value : NULL;                                                        \
+	}                                                                                                 \
+                                                                                                          \
+	/* Add or replace a value, returns a pointer to it which is valid until the next put */           \
+	static inline value_type *name##_put(name##_t *map, key_type key, value_type value)               \
+	{                                                                                                 \
+		name##_slot_t *slot;                                                                      \
+		uint64_t key_hash;                                                                        \
+		size_t i;                                                                                 \
+                                                                                                          \
+		key_hash = hash(key);                                                                     \
+		key_hash = HASHMAP_FIX_HASH(key_hash);                                                    \
+		slot = name##_find(map, key, key_hash);                                                   \
+		if (slot) {                                                                               \
+			slot->value = value;                                                              \
+			return &slot->value;                                                              \
+		}                                                                                         \
+                                                                                                          \
+		if ((map->used + 1) * 4 >= map->capacity * 3) {                                          \
+			/* Only grow if there are actually that many entries, otherwise just clean up */  \
+			if ((map->count + 1) * 2 >= map->capacity)                                        \
+				name##_reserve(map, (map->count + 1) * 2);                                \
+			else                                                                              \
+				name##_rehash(map, map->capacity);                                        \
+		}                                                                                         \
+                                                                                                          \
+		for (i = key_hash & (map->capacity - 1); map->slots[i].hash >= 2;                         \
+		     i = (i + 1) & (map->capacity - 1))                                                   \
+			;                                                                                 \
+		slot = map->slots + i;                                                                    \
+		if (slot->hash == HASHMAP_EMPTY)                                                          \
+			map->used++;                                                                      \
+		slot->hash = key_hash;                                                                    \
+		slot->key = key;                                                                          \
+		slot->value = value;                                                                      \
+		map->count++;                                                                             \
+		return &slot->value;                                                                      \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove a key, returns whether it was there */                                                  \
+	static inline bool name##_remove(name##_t *map, key_type key)                                     \
+	{                                                                                                 \
+		name##_slot_t *slot;                                                                      \
+		uint64_t key_hash;                                                                        \
+                                                                                                          \
+		key_hash = hash(key);                                                                     \
+		slot = name##_find(map, key, HASHMAP_FIX_HASH(key_hash));                                 \
+		if (!slot)                                                                                \
+			return false;                                                                     \
+                                                                                                          \
+		slot->hash = HASHMAP_DELETED;                                                             \
+		map->count--;                                                                             \
+		return true;                                                                              \
+	}                                                                                                 \
+                                                                                                          \
+	/* Remove everything but keep the slots */                                                        \
+	static inline void name##_clear(name##_t *map)                                                    \
+	{                                                                                                 \
+		if (map->slots)                                                                           \
+			memset(map->slots, 0, map->capacity * sizeof(name##_slot_t));                     \
+		map->count = 0;                                                                           \
+		map->used = 0;                                                                            \
+	}                                                                                                 \
+                                                                                                          \
+	/* Free the slots */                                                                              \
+	static inline void name##_free(name##_t *map)                                                     \
+	{                                                                                                 \
+		util_free(map->slots);                                                                    \
+		memset(map, 0, sizeof(name##_t));                                                         \
+	}
@@ -1,5 +1,6 @@
 // DLL loading interface
 
+#include "alloc.h"
 #include "dll.h"
 
 // DLL file prefix and extension
@@ -12,6 +13,11 @@
 #define DLL_EXT ".so"
 #endif
 
+// Number of DLLs the pool of dll_ts starts with room for
+#define DLL_POOL_SIZE 8
+
+static _Atomic(pool_t *) s_dll_pool;
+
 // System-specific DLL loading function (calls LoadLibrary or dlopen)
 extern bool sys_dll_load(dll_t *dll, bool engine);
 
@@ -24,36 +30,49 @@ dll_t *dll_load(const char *path, bool engine)
 	char *path2;
 	char *tmp;
 
-	dll = util_alloc(1, sizeof(dll_t), NULL);
+	dll = pool_calloc(pool_get(&s_dll_pool, "dll", sizeof(dll_t), DLL_POOL_SIZE));
+	PURPL_ASSERT(dll);
 	path2 = util_normalize_path(path);
-	dll->path = util_strdup(path2);
 
 	PURPL_LOG(COMMON_LOG_PREFIX "Searching for DLL matching %s\n", path2);
+	startup_begin("search");
 
+	// Leaks are reported while DLLs are still loaded, so their paths don't count
+	ALLOC_PUSH_TAG(alloc_get_tag() | ALLOC_PERMANENT);
+	dll->path = util_strdup(path2);
 	if (!util_fexist(dll->path)) {
 		tmp = util_append(dll->path, DLL_EXT);
-		free(dll->path);
+		util_free(dll->path);
 		dll->path = tmp;
 	}
 	if (!util_fexist(dll->path)) {
 		tmp = util_insert(dll->path, strrchr(dll->path, '/') ? strrchr(dll->path, '/') - dll->path : 0,
 				  DLL_PREFIX);
-		free(dll->path);
+		util_free(dll->path);
 		dll->path = tmp;
 	}
+	ALLOC_POP_TAG();
 	if (!util_fexist(dll->path)) {
+		startup_end();
 		PURPL_LOG(COMMON_LOG_PREFIX "DLL matching %s does not exist\n", path2);
-		free(dll->path);
-		free(dll);
+		util_free(dll->path);
+		util_free(path2);
+		pool_free(atomic_load(&s_dll_pool), dll);
 		return NULL;
 	}
 
+	startup_end();
+	util_free(path2);
+
 	PURPL_LOG(COMMON_LOG_PREFIX "Loading DLL %s\n", dll->path);
 
+	startup_begin("open");
 	if (!sys_dll_load(dll, engine)) {
+		startup_end();
 		dll_unload(dll);
 		return NULL;
 	}
+	startup_end();
 
 	if (engine && dll->version != PURPL_VERSION)
 		PURPL_LOG(COMMON_LOG_PREFIX "Version mismatch, DLL v" PURPL_PRIVER ", engine v" PURPL_PRIVER
@@ -69,7 +88,7 @@ void dll_unload(dll_t *dll)
 		return;
 
 	PURPL_LOG(COMMON_LOG_PREFIX "Unloading DLL %s\n", dll->path);
-	free(dll->path);
+	util_free(dll->path);
 	sys_dll_unload(dll);
-	free(dll);
+	pool_free(atomic_load(&s_dll_pool), dll);
 }
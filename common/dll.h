@@ -7,6 +7,8 @@
 #pragma once
 
 #include "common.h"
+#include "pool.h"
+#include "startup.h"
 #include "util.h"
 
 // Interface creation function, expected to set the version and function pointer fields of dll (cast it to or declare
@@ -17,7 +19,7 @@ typedef void (*dll_create_interface_t)(void *dll);
 typedef bool (*dll_init_t)(void);
 
 // Frame function
-typedef bool (*dll_frame_t)(uint64_t delta);
+typedef bool (*dll_frame_t)(const frame_delta_t *delta);
 
 // Shutdown function
 typedef void (*dll_shutdown_t)(void);
@@ -0,0 +1,272 @@
+// Frame time statistics
+
+#include "framestats.h"
+
+// Get the bucket a time goes in. Below FRAMESTATS_SUB_BUCKETS microseconds each bucket is a microsecond, after that
+// each power of 2 is split into FRAMESTATS_SUB_BUCKETS buckets.
+static uint32_t get_bucket(uint64_t time)
+{
+	uint64_t us;
+	uint32_t exponent;
+	uint32_t bucket;
+
+	us = time / UTIL_NS_PER_US;
+	if (us < FRAMESTATS_SUB_BUCKETS)
+		return (uint32_t)us;
+
+	exponent = 0;
+	while ((us >> exponent) >= FRAMESTATS_SUB_BUCKETS * 2)
+		exponent++;
+
+	bucket = FRAMESTATS_SUB_BUCKETS * (exponent + 1) + (uint32_t)(us >> exponent) - FRAMESTATS_SUB_BUCKETS;
+	return PURPL_MIN(bucket, FRAMESTATS_BUCKETS - 1);
+}
+
+// Get the time in the middle of a bucket
+static uint64_t get_bucket_time(uint32_t bucket)
+{
+	uint32_t exponent;
+	uint64_t low;
+
+	if (bucket < FRAMESTATS_SUB_BUCKETS)
+		return bucket * UTIL_NS_PER_US + UTIL_NS_PER_US / 2;
+
+	exponent = bucket / FRAMESTATS_SUB_BUCKETS - 1;
+	low = (uint64_t)(FRAMESTATS_SUB_BUCKETS + bucket % FRAMESTATS_SUB_BUCKETS) << exponent;
+	return (low * UTIL_NS_PER_US) + ((UTIL_NS_PER_US << exponent) / 2);
+}
+
+// Add a time to a histogram
+static void add_time(framestats_histogram_t *histogram, uint64_t time)
+{
+	histogram->buckets[get_bucket(time)]++;
+	histogram->count++;
+	histogram->total += time;
+	histogram->max = PURPL_MAX(histogram->max, time);
+}
+
+// Take a time out of a histogram, which leaves its max alone
+static void remove_time(framestats_histogram_t *histogram, uint64_t time)
+{
+	histogram->buckets[get_bucket(time)]--;
+	histogram->count--;
+	histogram->total -= time;
+}
+
+// Get the time below which percentile percent of the times in a histogram are
+static uint64_t get_percentile(const framestats_histogram_t *histogram, double percentile)
+{
+	uint64_t rank;
+	uint64_t seen;
+	uint32_t i;
+
+	rank = (uint64_t)ceil(histogram->count * percentile / 100.0);
+	rank = PURPL_MAX(rank, 1);
+	seen = 0;
+	for (i = 0; i < FRAMESTATS_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+			return PURPL_MIN(get_bucket_time(i), histogram->max);
+	}
+
+	return histogram->max;
+}
+
+framestats_t *framestats_create(uint64_t report_interval)
+{
+	framestats_t *stats;
+
+	stats = util_alloc(1, sizeof(framestats_t), NULL);
+	stats->report_interval = report_interval;
+	stats->last_report = util_get_time();
+
+	return stats;
+}
+
+bool framestats_add_frame(framestats_t *stats, const uint64_t times[FRAMESTATS_PHASE_COUNT])
+{
+	uint64_t slot;
+	uint64_t now;
+	uint32_t i;
+	bool hitch;
+
+	if (!stats || !times)
+		return false;
+
+	slot = stats->frames % FRAMESTATS_WINDOW;
+	for (i = 0; i < FRAMESTATS_PHASE_COUNT; i++) {
+		if (stats->frames >= FRAMESTATS_WINDOW)
+			remove_time(&stats->recent[i], stats->window[i][slot]);
+		stats->window[i][slot] = times[i];
+		add_time(&stats->recent[i], times[i]);
+		add_time(&stats->total[i], times[i]);
+	}
+	stats->frames++;
+
+	// Hitches are compared to the average before them, and don't drag it up as much as a normal frame would
+	hitch = stats->frames > FRAMESTATS_WARMUP_FRAMES &&
+		times[FRAMESTATS_PHASE_FRAME] > stats->average * FRAMESTATS_HITCH_FACTOR;
+	if (hitch) {
+		stats->hitches++;
+		LOG_DEBUG(LOG_SUBSYSTEM_GENERAL,
+			  FRAMESTATS_LOG_PREFIX "Frame %" PRIu64 " took %.3lf ms, %.1lfx the average of %.3lf ms\n",
+			  stats->frames - 1, (double)times[FRAMESTATS_PHASE_FRAME] / UTIL_NS_PER_MS,
+			  times[FRAMESTATS_PHASE_FRAME] / stats->average, stats->average / UTIL_NS_PER_MS);
+		stats->average += stats->average * (FRAMESTATS_HITCH_FACTOR - 1.0) / FRAMESTATS_AVERAGE_FRAMES;
+	} else if (stats->frames == 1) {
+		stats->average = (double)times[FRAMESTATS_PHASE_FRAME];
+	} else {
+		stats->average += ((double)times[FRAMESTATS_PHASE_FRAME] - stats->average) / FRAMESTATS_AVERAGE_FRAMES;
+	}
+
+	if (stats->report_interval) {
+		now = util_get_time();
+		if (now - stats->last_report >= stats->report_interval) {
+			framestats_log(stats, false);
+			stats->last_report = now;
+		}
+	}
+
+	return hitch;
+}
+
+void framestats_summarize(const framestats_histogram_t *histogram, framestats_summary_t *summary)
+{
+	if (!histogram || !summary)
+		return;
+
+	memset(summary, 0, sizeof(framestats_summary_t));
+	if (!histogram->count)
+		return;
+
+	summary->count = histogram->count;
+	summary->mean = histogram->total / histogram->count;
+	summary->p50 = get_percentile(histogram, 50.0);
+	summary->p95 = get_percentile(histogram, 95.0);
+	summary->p99 = get_percentile(histogram, 99.0);
+	summary->max = histogram->max;
+}
+
+const char *framestats_phase_name(framestats_phase_t phase)
+{
+	switch (phase) {
+	case FRAMESTATS_PHASE_BEGIN:
+		return "begin_frame";
+	case FRAMESTATS_PHASE_END:
+		return "end_frame";
+	case FRAMESTATS_PHASE_WAIT:
+		return "wait";
+	case FRAMESTATS_PHASE_PACING:
+		return "pacing_error";
+	case FRAMESTATS_PHASE_FRAME:
+		return "frame";
+	default:
+		return "unknown";
+	}
+}
+
+// Summarize a phase, getting the max of the recent frames from the window since their histogram can't keep track of it
+static void get_summary(framestats_t *stats, framestats_phase_t phase, bool total, framestats_summary_t *summary)
+{
+	uint64_t count;
+	uint64_t i;
+
+	if (total) {
+		framestats_summarize(&stats->total[phase], summary);
+		return;
+	}
+
+	count = PURPL_MIN(stats->frames, FRAMESTATS_WINDOW);
+	stats->recent[phase].max = 0;
+	for (i = 0; i < count; i++)
+		stats->recent[phase].max = PURPL_MAX(stats->recent[phase].max, stats->window[phase][i]);
+	framestats_summarize(&stats->recent[phase], summary);
+}
+
+void framestats_log(framestats_t *stats, bool total)
+{
+	framestats_summary_t summary;
+	uint64_t frames;
+	uint64_t hitches;
+	uint32_t i;
+
+	if (!stats || !stats->frames)
+		return;
+
+	frames = total ? stats->frames : PURPL_MIN(stats->frames, FRAMESTATS_WINDOW);
+	hitches = total ? stats->hitches : stats->hitches - stats->reported_hitches;
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+		 FRAMESTATS_LOG_PREFIX "%s %" PRIu64 " %s, %" PRIu64 " %s%s (times in ms):\n", total ? "All" : "Last",
+		 frames, PURPL_PLURALIZE(frames, "frames", "frame"), hitches,
+		 PURPL_PLURALIZE(hitches, "hitches", "hitch"), total ? "" : " since the last report");
+	for (i = 0; i < FRAMESTATS_PHASE_COUNT; i++) {
+		get_summary(stats, i, total, &summary);
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+			 FRAMESTATS_LOG_PREFIX "%-12s mean %8.3lf p50 %8.3lf p95 %8.3lf p99 %8.3lf max %8.3lf\n",
+			 framestats_phase_name(i), (double)summary.mean / UTIL_NS_PER_MS,
+			 (double)summary.p50 / UTIL_NS_PER_MS, (double)summary.p95 / UTIL_NS_PER_MS,
+			 (double)summary.p99 / UTIL_NS_PER_MS, (double)summary.max / UTIL_NS_PER_MS);
+	}
+
+	if (!total)
+		stats->reported_hitches = stats->hitches;
+}
+
+bool framestats_write(framestats_t *stats, const char *path)
+{
+	framestats_summary_t summary;
+	const char *extension;
+	FILE *file;
+	bool json;
+	uint32_t i;
+
+	if (!stats || !path)
+		return false;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		PURPL_LOG(FRAMESTATS_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	extension = strrchr(path, '.');
+	json = extension && strcmp(extension, ".json") == 0;
+	if (json)
+		fprintf(file, "{\n\t\"frames\": %" PRIu64 ",\n\t\"hitches\": %" PRIu64 ",\n\t\"phases\": {\n",
+			stats->frames, stats->hitches);
+	else
+		fprintf(file, "phase,frames,hitches,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+
+	for (i = 0; i < FRAMESTATS_PHASE_COUNT; i++) {
+		get_summary(stats, i, true, &summary);
+		if (json) {
+			fprintf(file,
+				"\t\t\"%s\": { \"mean_ms\": %.4lf, \"p50_ms\": %.4lf, \"p95_ms\": %.4lf, "
+				"\"p99_ms\": %.4lf, \"max_ms\": %.4lf }%s\n",
+				framestats_phase_name(i), (double)summary.mean / UTIL_NS_PER_MS,
+				(double)summary.p50 / UTIL_NS_PER_MS, (double)summary.p95 / UTIL_NS_PER_MS,
+				(double)summary.p99 / UTIL_NS_PER_MS, (double)summary.max / UTIL_NS_PER_MS,
+				i < FRAMESTATS_PHASE_COUNT - 1 ? "," : "");
+		} else {
+			fprintf(file, "%s,%" PRIu64 ",%" PRIu64 ",%.4lf,%.4lf,%.4lf,%.4lf,%.4lf\n",
+				framestats_phase_name(i), stats->frames, stats->hitches,
+				(double)summary.mean / UTIL_NS_PER_MS, (double)summary.p50 / UTIL_NS_PER_MS,
+				(double)summary.p95 / UTIL_NS_PER_MS, (double)summary.p99 / UTIL_NS_PER_MS,
+				(double)summary.max / UTIL_NS_PER_MS);
+		}
+	}
+
+	if (json)
+		fprintf(file, "\t}\n}\n");
+	fclose(file);
+
+	PURPL_LOG(FRAMESTATS_LOG_PREFIX "Wrote statistics for %" PRIu64 " %s to %s\n", stats->frames,
+		  PURPL_PLURALIZE(stats->frames, "frames", "frame"), path);
+
+	return true;
+}
+
+void framestats_destroy(framestats_t *stats)
+{
+	util_free(stats);
+}
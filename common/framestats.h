@@ -0,0 +1,95 @@
+// Frame time statistics. The time each part of a frame took goes into a histogram of the last few seconds of frames
+// and one of every frame, which give percentiles without sorting anything. Frames that take much longer than the ones
+// before them are counted as hitches. Reports go to the log every so often, and to a CSV or JSON file at the end.
+
+#pragma once
+
+#include "common.h"
+#include "log.h"
+#include "util.h"
+
+#define FRAMESTATS_LOG_PREFIX COMMON_LOG_PREFIX "FRAMESTATS: "
+
+// Number of frames in the recent histograms
+#define FRAMESTATS_WINDOW 1024
+
+// Histogram buckets for each power of 2 microseconds, which sets the precision to about 3%
+#define FRAMESTATS_SUB_BUCKETS 32
+
+// Number of histogram buckets, which covers up to about half an hour
+#define FRAMESTATS_BUCKETS (FRAMESTATS_SUB_BUCKETS * 27)
+
+// Default nanoseconds between reports in the log
+#define FRAMESTATS_REPORT_INTERVAL (10 * UTIL_NS_PER_SEC)
+
+// How many times longer than average a frame has to be to count as a hitch
+#define FRAMESTATS_HITCH_FACTOR 2.0
+
+// Roughly how many frames the moving average of frame times covers
+#define FRAMESTATS_AVERAGE_FRAMES 16.0
+
+// Frames before the average is trusted enough to count hitches
+#define FRAMESTATS_WARMUP_FRAMES 32
+
+// Parts of a frame
+typedef enum framestats_phase {
+	FRAMESTATS_PHASE_BEGIN, // Every begin_frame callback
+	FRAMESTATS_PHASE_END, // Every end_frame callback
+	FRAMESTATS_PHASE_WAIT, // Waiting for the frame pacer
+	FRAMESTATS_PHASE_PACING, // How late the frame ended compared to when the pacer wanted it to, 0 without a limit
+	FRAMESTATS_PHASE_FRAME, // The whole frame, including waiting
+	FRAMESTATS_PHASE_COUNT
+} framestats_phase_t;
+
+// Distribution of times
+typedef struct framestats_histogram {
+	uint32_t buckets[FRAMESTATS_BUCKETS]; // Number of times in each bucket
+	uint64_t count; // Number of times
+	uint64_t total; // Sum of the times
+	uint64_t max; // Longest time
+} framestats_histogram_t;
+
+// Summary of a histogram, in nanoseconds
+typedef struct framestats_summary {
+	uint64_t count; // Number of times
+	uint64_t mean; // Average
+	uint64_t p50; // Median
+	uint64_t p95; // 95th percentile
+	uint64_t p99; // 99th percentile
+	uint64_t max; // Longest
+} framestats_summary_t;
+
+// Frame time statistics
+typedef struct framestats {
+	uint64_t window[FRAMESTATS_PHASE_COUNT][FRAMESTATS_WINDOW]; // Times of the last FRAMESTATS_WINDOW frames
+	framestats_histogram_t recent[FRAMESTATS_PHASE_COUNT]; // Histograms of the last FRAMESTATS_WINDOW frames
+	framestats_histogram_t total[FRAMESTATS_PHASE_COUNT]; // Histograms of every frame
+	uint64_t frames; // Number of frames
+	double average; // Moving average of whole frame times
+	uint64_t hitches; // Number of hitches
+	uint64_t reported_hitches; // Number of hitches at the last report
+	uint64_t report_interval; // Nanoseconds between reports, 0 for none
+	uint64_t last_report; // util_get_time of the last report
+} framestats_t;
+
+// Create frame statistics that report every report_interval nanoseconds, or never if it's 0
+extern framestats_t *framestats_create(uint64_t report_interval);
+
+// Add a frame's times in nanoseconds, indexed by framestats_phase_t. Returns true if it was a hitch.
+extern bool framestats_add_frame(framestats_t *stats, const uint64_t times[FRAMESTATS_PHASE_COUNT]);
+
+// Summarize a histogram
+extern void framestats_summarize(const framestats_histogram_t *histogram, framestats_summary_t *summary);
+
+// Get the name of a phase
+extern const char *framestats_phase_name(framestats_phase_t phase);
+
+// Log the recent frames, or every frame
+extern void framestats_log(framestats_t *stats, bool total);
+
+// Write a summary of every frame to a file, as JSON if its name ends in .json and CSV otherwise. Returns false if it
+// can't be written.
+extern bool framestats_write(framestats_t *stats, const char *path);
+
+// Destroy frame statistics
+extern void framestats_destroy(framestats_t *stats);
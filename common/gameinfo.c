@@ -5,7 +5,7 @@
 // Callback for ini_browse
 static bool parse(const char *section, const char *key, const char *value, gameinfo_t *info)
 {
-	void *tmp;
+	pack_file_t *pack;
 
 	if (strcmp(section, "game") == 0) {
 		if (strcmp(key, "game") == 0) {
@@ -21,16 +21,29 @@ static bool parse(const char *section, const char *key, const char *value, gamei
 			PURPL_LOG(COMMON_LOG_PREFIX "Ignoring unknown key %s with value %s in section [%s]\n", key,
 				  value, section);
 		}
+	} else if (strcmp(section, "engine") == 0) {
+		if (strcmp(key, "ecs_threads") == 0) {
+			info->ecs_threads = (uint32_t)strtoul(value, NULL, 10);
+			PURPL_LOG(COMMON_LOG_PREFIX "Game %s runs ECS systems on %u %s\n", info->game,
+				  info->ecs_threads, PURPL_PLURALIZE(info->ecs_threads, "threads", "thread"));
+		} else {
+			PURPL_LOG(COMMON_LOG_PREFIX "Ignoring unknown key %s with value %s in section [%s]\n", key,
+				  value, section);
+		}
 	} else if (strcmp(section, "data") == 0) {
 		if (strcmp(key, "dir") == 0) {
-			info->dirs = util_alloc(++info->dir_count, sizeof(char *), info->dirs);
-			info->dirs[info->dir_count - 1] = util_replace(value, ".", info->gamedir);
 			PURPL_LOG(COMMON_LOG_PREFIX "Added directory %s to search paths for game %s\n",
-				  info->dirs[info->dir_count - 1], info->game);
+				  *gameinfo_dirs_push(&info->dirs, util_replace(value, ".", info->gamedir)), info->game);
 		} else if (strcmp(key, "pack") == 0) {
-			info->packs = util_alloc(++info->pack_count, sizeof(pack_file_t *), info->packs);
-			info->packs[info->pack_count - 1] = pack_load(value);
-			PURPL_ASSERT(info->packs[info->pack_count - 1]);
+			STARTUP_SCOPE("load pack %s", value)
+				pack = pack_load(value);
+			if (!pack) {
+				LOG_ERROR(LOG_SUBSYSTEM_GENERAL,
+					  COMMON_LOG_PREFIX "Failed to load pack %s_*.pak for game %s, skipping it\n",
+					  value, info->game);
+				return true;
+			}
+			gameinfo_packs_push(&info->packs, pack);
 			PURPL_LOG(COMMON_LOG_PREFIX "Added pack %s_*.pak to search paths for game %s\n", value,
 				  info->game);
 		} else {
@@ -53,6 +66,9 @@ gameinfo_t *gameinfo_parse(const char *name, const char *gamedir)
 	if (!name || !strlen(name))
 		return NULL;
 
+	PURPL_PROFILE_BEGIN("gameinfo_parse");
+
+	ALLOC_PUSH_TAG(ALLOC_TAG_INI);
 	name2 = util_append(gamedir, name);
 
 	info = util_alloc(1, sizeof(gameinfo_t), NULL);
@@ -61,34 +77,62 @@ gameinfo_t *gameinfo_parse(const char *name, const char *gamedir)
 	PURPL_LOG(COMMON_LOG_PREFIX "Parsing gameinfo in %s\n", info->path);
 
 	ini_browse((INI_CALLBACK)parse, info, name2);
+	util_free(name2);
 
 	PURPL_LOG(COMMON_LOG_PREFIX "Checking required fields for gameinfo %s\n", info->path);
 	PURPL_ASSERT(info->game);
 	PURPL_ASSERT(info->title);
 
+	ALLOC_POP_TAG();
+	PURPL_PROFILE_END();
+
 	return info;
 }
 
+pack_entry_t *gameinfo_find(gameinfo_t *info, atom_t path, pack_file_t **pack)
+{
+	pack_entry_t *entry;
+	uint64_t hash;
+	size_t i;
+
+	if (!info || path == ATOM_NONE)
+		return NULL;
+
+	hash = atom_hash(path);
+	for (i = 0; i < info->packs.count; i++) {
+		entry = pack_get_hash(info->packs.data[i], hash);
+		if (entry) {
+			if (pack)
+				*pack = info->packs.data[i];
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
 void gameinfo_free(gameinfo_t *info)
 {
-	uint16_t i;
+	size_t i;
 
 	if (!info)
 		return;
 
 	if (info->gamedir)
-		free(info->gamedir);
+		util_free(info->gamedir);
 	if (info->path)
-		free(info->path);
+		util_free(info->path);
 	if (info->game)
-		free(info->game);
+		util_free(info->game);
 	if (info->title)
-		free(info->title);
-	if (info->dirs)
-		free(info->dirs);
+		util_free(info->title);
 
-	if (info->packs) {
-		for (i = 0; i < info->pack_count; i++)
-			pack_close(info->packs[i]);
-	}
+	util_free_list((void **)info->dirs.data, info->dirs.count);
+	gameinfo_dirs_free(&info->dirs);
+
+	for (i = 0; i < info->packs.count; i++)
+		pack_close(info->packs.data[i]);
+	gameinfo_packs_free(&info->packs);
+
+	util_free(info);
 }
@@ -3,8 +3,13 @@
 #pragma once
 
 #include "common.h"
+#include "container.h"
 #include "ini.h"
 #include "pack.h"
+#include "startup.h"
+
+ARRAY_DECLARE(gameinfo_dirs, char *)
+ARRAY_DECLARE(gameinfo_packs, pack_file_t *)
 
 // Structure representing game.ini
 typedef struct gameinfo {
@@ -15,14 +20,17 @@ typedef struct gameinfo {
 	char *title; // The title of the game
 	uint32_t version; // The version of the game
 
-	char **dirs; // Paths to the directories
-	uint16_t dir_count; // Number of directories
-	pack_file_t **packs; // Pack files
-	uint16_t pack_count; // Number of pack files
+	uint32_t ecs_threads; // Threads to run ECS systems on, 0 for the cores the job system leaves free
+
+	gameinfo_dirs_t dirs; // Paths to the directories
+	gameinfo_packs_t packs; // Pack files
 } gameinfo_t;
 
 // Parse a game.ini file
 extern gameinfo_t *gameinfo_parse(const char *name, const char *gamedir);
 
+// Find a file in a game's packs by its interned path, and get the pack it's in
+extern pack_entry_t *gameinfo_find(gameinfo_t *info, atom_t path, pack_file_t **pack);
+
 // Clean up a gameinfo_t's data
 extern void gameinfo_free(gameinfo_t *info);
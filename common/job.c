@@ -0,0 +1,429 @@
+// Job system
+
+#include "job.h"
+#include "topology.h"
+
+static job_system_t s_local_system = { .lock = MUTEX_INITIALIZER, .cond = COND_INITIALIZER };
+static job_system_t *s_system = &s_local_system;
+
+static PURPL_THREAD_LOCAL uint32_t t_job_worker; // Worker index + 1, 0 if the thread isn't a worker
+static PURPL_THREAD_LOCAL uint32_t t_job_generation; // Generation t_job_worker was looked up in, 0 if it hasn't been
+
+// Find the calling thread's worker. The index is cached, but it's looked up by thread ID the first time, because the
+// worker threads were started by the launcher and the engine has its own copy of t_job_worker.
+static uint32_t get_worker(job_system_t *system)
+{
+	uint64_t id;
+	uint32_t i;
+
+	if (t_job_generation != system->generation) {
+		id = thread_get_id();
+		t_job_worker = 0;
+		for (i = 0; i < system->worker_count; i++) {
+			if (atomic_load_explicit(&system->workers[i].thread_id, memory_order_relaxed) == id) {
+				t_job_worker = i + 1;
+				break;
+			}
+		}
+		t_job_generation = system->generation;
+	}
+
+	return t_job_worker ? t_job_worker - 1 : UINT32_MAX;
+}
+
+// Push a job onto the bottom of the calling worker's deque, returns false if it's full
+static bool deque_push(job_deque_t *deque, const job_t *job)
+{
+	int_fast64_t bottom;
+	int_fast64_t top;
+
+	bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	if (bottom - top >= JOB_DEQUE_SIZE)
+		return false;
+
+	deque->jobs[bottom & (JOB_DEQUE_SIZE - 1)] = *job;
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+
+	return true;
+}
+
+// Pop the newest job off the bottom of the calling worker's deque
+static bool deque_pop(job_deque_t *deque, job_t *job)
+{
+	int_fast64_t bottom;
+	int_fast64_t top;
+	bool success;
+
+	// Claim the bottom job before looking at top, so a thief can't take it at the same time without one of them
+	// noticing
+	bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_seq_cst);
+	top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+	if (top > bottom) {
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		return false;
+	}
+
+	*job = deque->jobs[bottom & (JOB_DEQUE_SIZE - 1)];
+	if (top < bottom)
+		return true;
+
+	// That was the last job, so race any thieves for it
+	success = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+							  memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+
+	return success;
+}
+
+// Steal the oldest job off the top of another worker's deque, fails if it's empty or another thread got there first
+static bool deque_steal(job_deque_t *deque, job_t *job)
+{
+	int_fast64_t bottom;
+	int_fast64_t top;
+
+	top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+	bottom = atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+	if (top >= bottom)
+		return false;
+
+	// This copy can be torn if the owner wraps around and reuses the slot, but then top has moved and it's thrown
+	// away
+	*job = deque->jobs[top & (JOB_DEQUE_SIZE - 1)];
+	return atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+						       memory_order_relaxed);
+}
+
+// Take a job from the shared queue
+static bool dequeue(job_system_t *system, job_t *job)
+{
+	bool success;
+
+	if (!atomic_load_explicit(&system->queue_count, memory_order_relaxed))
+		return false;
+
+	mutex_lock(&system->lock);
+	success = atomic_load_explicit(&system->queue_count, memory_order_relaxed) > 0;
+	if (success) {
+		*job = system->queue[system->queue_head];
+		system->queue_head = (system->queue_head + 1) & (JOB_QUEUE_SIZE - 1);
+		atomic_fetch_sub_explicit(&system->queue_count, 1, memory_order_relaxed);
+	}
+	mutex_unlock(&system->lock);
+
+	return success;
+}
+
+// Find a job for a worker, or for a thread that isn't one if worker is UINT32_MAX. Looks in the worker's own deque,
+// then the shared queue, then steals.
+static bool find_job(job_system_t *system, uint32_t worker, job_t *job)
+{
+	uint32_t start;
+	uint32_t victim;
+	uint32_t i;
+
+	if (worker != UINT32_MAX && deque_pop(&system->workers[worker].deque, job))
+		goto found;
+
+	if (dequeue(system, job))
+		goto found;
+
+	// Start with whoever was stolen from last time, they probably have more
+	start = worker != UINT32_MAX ? system->workers[worker].victim : 0;
+	for (i = 0; i < system->worker_count; i++) {
+		victim = (start + i) % system->worker_count;
+		if (victim == worker)
+			continue;
+
+		if (deque_steal(&system->workers[victim].deque, job)) {
+			if (worker != UINT32_MAX)
+				system->workers[worker].victim = victim;
+			METRICS_COUNTER_ADD("job.steals", 1);
+			goto found;
+		}
+	}
+
+	return false;
+
+found:
+	atomic_fetch_sub_explicit(&system->queued, 1, memory_order_seq_cst);
+	return true;
+}
+
+// Run a job and count it as done
+static void run_job(const job_t *job)
+{
+	if (job->func)
+		job->func(job->data);
+	else
+		job->for_func(job->data, job->start, job->end);
+
+	if (job->counter)
+		atomic_fetch_sub_explicit(&job->counter->value, 1, memory_order_release);
+}
+
+// Queue a job, or run it now if there's nowhere to put it
+static void submit(job_system_t *system, const job_t *job)
+{
+	uint32_t worker;
+	bool queued;
+
+	if (job->counter)
+		atomic_fetch_add_explicit(&job->counter->value, 1, memory_order_relaxed);
+
+	if (!system->worker_count) {
+		run_job(job);
+		return;
+	}
+
+	worker = get_worker(system);
+	if (worker != UINT32_MAX) {
+		queued = deque_push(&system->workers[worker].deque, job);
+	} else {
+		mutex_lock(&system->lock);
+		queued = atomic_load_explicit(&system->queue_count, memory_order_relaxed) < JOB_QUEUE_SIZE;
+		if (queued) {
+			system->queue[(system->queue_head + atomic_load_explicit(&system->queue_count,
+										   memory_order_relaxed)) &
+				      (JOB_QUEUE_SIZE - 1)] = *job;
+			atomic_fetch_add_explicit(&system->queue_count, 1, memory_order_relaxed);
+		}
+		mutex_unlock(&system->lock);
+	}
+
+	if (!queued) {
+		METRICS_COUNTER_ADD("job.overflows", 1);
+		run_job(job);
+		return;
+	}
+
+	// Workers going to sleep increment sleepers and then check queued, this does the opposite, so one of them sees
+	// the other
+	atomic_fetch_add_explicit(&system->queued, 1, memory_order_seq_cst);
+	if (atomic_load_explicit(&system->sleepers, memory_order_seq_cst)) {
+		mutex_lock(&system->lock);
+		cond_signal(&system->cond);
+		mutex_unlock(&system->lock);
+	}
+}
+
+// Runs jobs until the system stops
+static int32_t worker_thread(void *data)
+{
+	job_system_t *system;
+	job_t job;
+	uint32_t worker;
+	uint32_t spins;
+
+	system = s_system;
+	worker = (uint32_t)(uintptr_t)data;
+	atomic_store_explicit(&system->workers[worker].thread_id, thread_get_id(), memory_order_relaxed);
+	topology_pin_thread(TOPOLOGY_ROLE_WORKER, worker);
+
+	spins = 0;
+	while (!atomic_load_explicit(&system->stopping, memory_order_acquire)) {
+		if (find_job(system, worker, &job)) {
+			run_job(&job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < JOB_SPIN_COUNT) {
+			thread_yield();
+			continue;
+		}
+
+		spins = 0;
+		mutex_lock(&system->lock);
+		atomic_fetch_add_explicit(&system->sleepers, 1, memory_order_seq_cst);
+		while (atomic_load_explicit(&system->queued, memory_order_seq_cst) <= 0 &&
+		       !atomic_load_explicit(&system->stopping, memory_order_relaxed))
+			cond_wait(&system->cond, &system->lock);
+		atomic_fetch_sub_explicit(&system->sleepers, 1, memory_order_relaxed);
+		mutex_unlock(&system->lock);
+	}
+
+	return 0;
+}
+
+bool job_init(uint32_t worker_count)
+{
+	job_system_t *system;
+	char name[THREAD_NAME_LENGTH];
+	uint32_t i;
+
+	system = s_system;
+	if (system->worker_count) {
+		PURPL_LOG(JOB_LOG_PREFIX "The job system is already running\n");
+		return false;
+	}
+
+	if (!worker_count)
+		worker_count = thread_get_cpu_count();
+	worker_count = PURPL_MIN(worker_count, JOB_MAX_WORKERS);
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL, JOB_LOG_PREFIX "Starting job system with %u %s\n", worker_count,
+		 PURPL_PLURALIZE(worker_count, "workers", "worker"));
+
+	system->workers = util_alloc_aligned(worker_count * sizeof(job_worker_t), PURPL_CACHE_LINE);
+	PURPL_ASSERT(system->workers);
+	memset(system->workers, 0, worker_count * sizeof(job_worker_t));
+	atomic_store(&system->workers[0].thread_id, thread_get_id());
+
+	system->queue_head = 0;
+	atomic_store(&system->queue_count, 0);
+	atomic_store(&system->queued, 0);
+	atomic_store(&system->stopping, false);
+	system->worker_count = worker_count;
+	system->generation++;
+
+	for (i = 1; i < worker_count; i++) {
+		snprintf(name, sizeof(name), "job%u", i);
+		system->workers[i].thread = thread_create(worker_thread, name, (void *)(uintptr_t)i);
+		PURPL_ASSERT(system->workers[i].thread);
+	}
+
+	METRICS_GAUGE_SET("job.workers", worker_count);
+
+	return true;
+}
+
+void job_shutdown(void)
+{
+	job_system_t *system;
+	job_t job;
+	uint32_t worker;
+	uint32_t i;
+
+	system = s_system;
+	if (!system->worker_count)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL, JOB_LOG_PREFIX "Stopping job system\n");
+
+	// Something could be waiting on what's left
+	worker = get_worker(system);
+	while (atomic_load(&system->queued) > 0) {
+		if (find_job(system, worker, &job))
+			run_job(&job);
+		else
+			thread_yield();
+	}
+
+	mutex_lock(&system->lock);
+	atomic_store(&system->stopping, true);
+	cond_broadcast(&system->cond);
+	mutex_unlock(&system->lock);
+
+	for (i = 1; i < system->worker_count; i++)
+		thread_join(system->workers[i].thread);
+
+	util_free_aligned(system->workers);
+	system->workers = NULL;
+	system->worker_count = 0;
+	system->generation++;
+}
+
+void job_run(job_func_t func, void *data, job_counter_t *counter)
+{
+	job_t job;
+
+	if (!func)
+		return;
+
+	memset(&job, 0, sizeof(job_t));
+	job.func = func;
+	job.data = data;
+	job.counter = counter;
+	submit(s_system, &job);
+}
+
+void job_wait(job_counter_t *counter)
+{
+	job_system_t *system;
+	job_t job;
+	uint32_t worker;
+
+	if (!counter)
+		return;
+
+	system = s_system;
+	worker = system->worker_count ? get_worker(system) : UINT32_MAX;
+	while (atomic_load_explicit(&counter->value, memory_order_acquire) > 0) {
+		if (system->worker_count && find_job(system, worker, &job))
+			run_job(&job);
+		else
+			thread_yield();
+	}
+}
+
+bool job_help(void)
+{
+	job_system_t *system;
+	job_t job;
+
+	system = s_system;
+	if (!system->worker_count || !find_job(system, get_worker(system), &job))
+		return false;
+
+	run_job(&job);
+	return true;
+}
+
+bool job_is_done(job_counter_t *counter)
+{
+	return !counter || atomic_load_explicit(&counter->value, memory_order_acquire) <= 0;
+}
+
+void job_parallel_for(size_t count, size_t batch, job_for_func_t func, void *data)
+{
+	job_counter_t counter = JOB_COUNTER_INITIALIZER;
+	job_t job;
+	size_t start;
+
+	if (!count || !func)
+		return;
+
+	if (!batch)
+		batch = PURPL_MAX(count / (job_get_worker_count() * JOB_BATCHES_PER_WORKER), 1);
+	if (job_get_worker_count() < 2 || batch >= count) {
+		func(data, 0, count);
+		return;
+	}
+
+	memset(&job, 0, sizeof(job_t));
+	job.for_func = func;
+	job.data = data;
+	job.counter = &counter;
+
+	// The last batch is run here instead of being queued
+	for (start = 0; start + batch < count; start += batch) {
+		job.start = start;
+		job.end = start + batch;
+		submit(s_system, &job);
+	}
+	func(data, start, count);
+
+	job_wait(&counter);
+}
+
+uint32_t job_get_worker_count(void)
+{
+	return s_system->worker_count ? s_system->worker_count : 1;
+}
+
+uint32_t job_get_worker_index(void)
+{
+	return s_system->worker_count ? get_worker(s_system) : UINT32_MAX;
+}
+
+job_system_t *job_get_system(void)
+{
+	return s_system;
+}
+
+void job_use_system(job_system_t *system)
+{
+	s_system = system ? system : &s_local_system;
+}
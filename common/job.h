@@ -0,0 +1,125 @@
+// Job system. job_init starts a worker thread for each core but one, since the thread that calls it runs jobs too
+// while it waits on them. Each worker has a Chase-Lev deque, which it pushes and pops jobs at the bottom of without
+// locking, and workers that run out steal from the top of the others'. Threads that aren't workers, like the loader's,
+// submit to a shared queue instead. Dependencies are expressed with counters: a job started with a counter increments
+// it, and decrements it when it's done, and job_wait runs other jobs until the counter reaches 0 rather than blocking.
+// Without job_init, jobs run immediately on the thread that submits them, so code using this works in tools that
+// don't start any workers. Since common is a static library, the launcher gives the engine its job system, like the
+// metrics registry.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "metrics.h"
+#include "thread.h"
+#include "util.h"
+
+#define JOB_LOG_PREFIX COMMON_LOG_PREFIX "JOB: "
+
+// Most workers, including the thread that calls job_init
+#define JOB_MAX_WORKERS 64
+
+// Jobs each worker's deque can hold, has to be a power of 2. When it's full, more jobs run immediately instead.
+#define JOB_DEQUE_SIZE 4096
+
+// Jobs the shared queue can hold, also a power of 2
+#define JOB_QUEUE_SIZE 4096
+
+// Times an idle worker looks for a job before going to sleep
+#define JOB_SPIN_COUNT 64
+
+// Batches job_parallel_for aims to give each worker when it picks the batch size
+#define JOB_BATCHES_PER_WORKER 4
+
+// A job
+typedef void (*job_func_t)(void *data);
+
+// A job_parallel_for batch, which handles items start to end - 1
+typedef void (*job_for_func_t)(void *data, size_t start, size_t end);
+
+// Number of jobs that haven't finished
+typedef struct job_counter {
+	atomic_int_fast32_t value; // Jobs left
+} job_counter_t;
+
+// Static initializer for counters
+#define JOB_COUNTER_INITIALIZER { 0 }
+
+// A queued job
+typedef struct job {
+	job_func_t func; // Function, NULL if this is a job_parallel_for batch
+	job_for_func_t for_func; // Batch function
+	void *data; // Passed to the function
+	size_t start; // First item of the batch
+	size_t end; // One past the last item of the batch
+	job_counter_t *counter; // Decremented when the job is done, can be NULL
+} job_t;
+
+// A worker's jobs. Only the worker touches bottom, anyone can take from top.
+typedef struct job_deque {
+	PURPL_CACHE_ALIGN atomic_int_fast64_t top; // Next job to steal
+	PURPL_CACHE_ALIGN atomic_int_fast64_t bottom; // Where the next job is pushed
+	job_t jobs[JOB_DEQUE_SIZE]; // Ring of jobs
+} job_deque_t;
+
+// A worker thread
+typedef struct job_worker {
+	job_deque_t deque; // Jobs pushed by this worker
+	thread_t *thread; // Thread, NULL for the one that called job_init
+	atomic_uint_fast64_t thread_id; // thread_get_id of the thread, so other modules can find their worker
+	uint32_t victim; // Next worker to try stealing from
+} job_worker_t;
+
+// Workers and the shared queue
+typedef struct job_system {
+	job_worker_t *workers; // Workers, the first one is the thread that called job_init
+	uint32_t worker_count; // Number of workers, 0 if the system isn't running
+	uint32_t generation; // Incremented by job_init and job_shutdown, so threads know to look up their worker again
+
+	mutex_t lock; // Protects the shared queue, and held by workers going to sleep
+	cond_t cond; // Signalled when there's a job for a sleeping worker
+	job_t queue[JOB_QUEUE_SIZE]; // Ring of jobs submitted by threads that aren't workers
+	size_t queue_head; // Next job in the queue
+	atomic_size_t queue_count; // Number of jobs in the queue, read without the lock to skip empty queues
+
+	atomic_int_fast32_t queued; // Jobs in the deques and the queue, can be briefly off by the number of workers
+	atomic_uint_fast32_t sleepers; // Workers waiting on cond
+	atomic_bool stopping; // Set by job_shutdown
+} job_system_t;
+
+// Start the job system with worker_count workers including the calling thread, or one per core if it's 0
+extern bool job_init(uint32_t worker_count);
+
+// Run anything still queued, then stop the workers
+extern void job_shutdown(void);
+
+// Queue a job, incrementing counter if it's not NULL
+extern void job_run(job_func_t func, void *data, job_counter_t *counter);
+
+// Run jobs until counter reaches 0
+extern void job_wait(job_counter_t *counter);
+
+// Run one queued job on the calling thread, for threads waiting on something other than a counter. Returns false if
+// there weren't any.
+extern bool job_help(void);
+
+// Get whether every job started with a counter has finished
+extern bool job_is_done(job_counter_t *counter);
+
+// Call func for batches of items from 0 to count - 1 across the workers, and wait for all of them. If batch is 0, it's
+// picked based on the number of workers.
+extern void job_parallel_for(size_t count, size_t batch, job_for_func_t func, void *data);
+
+// Get the number of workers, including the thread that called job_init, or 1 if the system isn't running
+extern uint32_t job_get_worker_count(void);
+
+// Get the index of the calling thread's worker, or UINT32_MAX if it isn't one
+extern uint32_t job_get_worker_index(void);
+
+// Get the job system this module uses
+extern job_system_t *job_get_system(void);
+
+// Use another module's job system
+extern void job_use_system(job_system_t *system);
@@ -0,0 +1,34 @@
+// Call stacks for allocation tracking on Linux
+
+#include "common/alloc.h"
+
+#include <execinfo.h>
+
+uint8_t alloc_capture_stack(void **frames, uint8_t max_frames)
+{
+	void *all_frames[UINT8_MAX + 1];
+	int count;
+
+	// Leave out this function
+	count = backtrace(all_frames, max_frames + 1) - 1;
+	if (count <= 0)
+		return 0;
+	memcpy(frames, all_frames + 1, count * sizeof(void *));
+
+	return (uint8_t)count;
+}
+
+void alloc_log_stack(void *const *frames, uint8_t frame_count)
+{
+	char **symbols;
+	uint8_t i;
+
+	if (!frames || !frame_count)
+		return;
+
+	// This comes from malloc, and isn't tracked
+	symbols = backtrace_symbols(frames, frame_count);
+	for (i = 0; i < frame_count; i++)
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "\t%s\n", symbols ? symbols[i] : "(unknown)");
+	free(symbols);
+}
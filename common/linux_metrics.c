@@ -0,0 +1,87 @@
+// Metrics socket for Linux
+
+#include "common/metrics.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int32_t s_socket = -1;
+static struct sockaddr_un s_address;
+
+bool metrics_listen(const char *path)
+{
+	if (!path || strlen(path) >= sizeof(s_address.sun_path)) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Socket path %s is too long\n", path ? path : "(null)");
+		return false;
+	}
+
+	memset(&s_address, 0, sizeof(struct sockaddr_un));
+	s_address.sun_family = AF_UNIX;
+	strncpy(s_address.sun_path, path, sizeof(s_address.sun_path) - 1);
+
+	s_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s_socket < 0) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to create socket: %s\n", strerror(errno));
+		return false;
+	}
+
+	// A previous run might have left it behind
+	unlink(path);
+	if (bind(s_socket, (struct sockaddr *)&s_address, sizeof(struct sockaddr_un)) != 0 ||
+	    listen(s_socket, 8) != 0) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to listen on %s: %s\n", path, strerror(errno));
+		close(s_socket);
+		s_socket = -1;
+		return false;
+	}
+
+	return true;
+}
+
+void metrics_serve(void)
+{
+	struct timeval timeout;
+	char *buf;
+	size_t size;
+	size_t sent;
+	ssize_t len;
+	int32_t client;
+	FILE *stream;
+
+	if (s_socket < 0)
+		return;
+
+	while ((client = accept4(s_socket, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		// A client that doesn't read shouldn't hold up the next snapshot for long
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(struct timeval));
+
+		// Formatting into memory first means a client hanging up can't cause a SIGPIPE
+		buf = NULL;
+		size = 0;
+		stream = open_memstream(&buf, &size);
+		if (stream) {
+			metrics_write(stream);
+			fclose(stream);
+			for (sent = 0; sent < size; sent += (size_t)len) {
+				len = send(client, buf + sent, size - sent, MSG_NOSIGNAL);
+				if (len <= 0)
+					break;
+			}
+			free(buf);
+		}
+
+		close(client);
+	}
+}
+
+void metrics_close_socket(void)
+{
+	if (s_socket < 0)
+		return;
+
+	close(s_socket);
+	s_socket = -1;
+	unlink(s_address.sun_path);
+}
@@ -0,0 +1,167 @@
+// thread.h implementation for Linux
+
+#include "common/thread.h"
+
+// After common.h so the feature macros are defined
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// pthread wants a void * return value
+static void *thread_entry(void *data)
+{
+	thread_t *thread = data;
+
+	pthread_setname_np(pthread_self(), thread->name);
+	thread->result = thread->func(thread->data);
+
+	return NULL;
+}
+
+thread_t *thread_create(thread_func_t func, const char *name, void *data)
+{
+	thread_t *thread;
+	pthread_t handle;
+	int32_t error;
+
+	if (!func)
+		return NULL;
+
+	thread = util_alloc(1, sizeof(thread_t), NULL);
+	strncpy(thread->name, name ? name : "purpl", THREAD_NAME_LENGTH - 1);
+	thread->func = func;
+	thread->data = data;
+
+	error = pthread_create(&handle, NULL, thread_entry, thread);
+	if (error != 0) {
+		PURPL_LOG(THREAD_LOG_PREFIX "pthread_create failed for thread %s: %s\n", thread->name, strerror(error));
+		util_free(thread);
+		return NULL;
+	}
+	thread->handle = (void *)handle;
+
+	return thread;
+}
+
+int32_t thread_join(thread_t *thread)
+{
+	int32_t result;
+
+	if (!thread)
+		return -1;
+
+	pthread_join((pthread_t)thread->handle, NULL);
+	result = thread->result;
+	util_free(thread);
+
+	return result;
+}
+
+void thread_yield(void)
+{
+	sched_yield();
+}
+
+void thread_sleep(uint32_t ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000l;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+uint32_t thread_get_cpu_count(void)
+{
+	long count;
+
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+
+uint64_t thread_get_id(void)
+{
+	return (uint64_t)gettid();
+}
+
+void mutex_init(mutex_t *mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void mutex_destroy(mutex_t *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void cond_init(cond_t *cond)
+{
+	pthread_cond_init(cond, NULL);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+bool cond_wait_timeout(cond_t *cond, mutex_t *mutex, uint32_t timeout)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_REALTIME, &time);
+	time.tv_sec += timeout / 1000;
+	time.tv_nsec += (long)(timeout % 1000) * 1000000;
+	if (time.tv_nsec >= 1000000000) {
+		time.tv_sec++;
+		time.tv_nsec -= 1000000000;
+	}
+
+	return pthread_cond_timedwait(cond, mutex, &time) == 0;
+}
+
+void cond_signal(cond_t *cond)
+{
+	pthread_cond_signal(cond);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+void cond_destroy(cond_t *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+bool futex_wait(_Atomic(uint32_t) *address, uint32_t expected, uint32_t timeout)
+{
+	struct timespec time;
+
+	// Unlike FUTEX_WAIT_BITSET, plain FUTEX_WAIT takes a relative timeout
+	time.tv_sec = timeout / 1000;
+	time.tv_nsec = (long)(timeout % 1000) * 1000000;
+
+	if (syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, timeout == UINT32_MAX ? NULL : &time, NULL, 0) !=
+	    0)
+		return errno != ETIMEDOUT;
+
+	return true;
+}
+
+void futex_wake(_Atomic(uint32_t) *address, bool all)
+{
+	syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, all ? INT32_MAX : 1, NULL, NULL, 0);
+}
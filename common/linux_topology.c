@@ -0,0 +1,281 @@
+// CPU topology for Linux, from sysfs
+
+#include "common/topology.h"
+
+// After common.h so the feature macros are defined
+#include <sched.h>
+
+#define CPU_PATH "/sys/devices/system/cpu"
+
+// Most cache levels checked for each processor
+#define MAX_CACHES 10
+
+// Read a small sysfs file, returns false if it can't be read
+static bool read_sysfs(const char *path, char *buf, size_t size)
+{
+	FILE *file;
+	bool succeeded;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	succeeded = fgets(buf, (int32_t)size, file) != NULL;
+	fclose(file);
+
+	return succeeded;
+}
+
+// Read a number from a sysfs file, or return a default
+static uint64_t read_number(const char *path, uint64_t fallback)
+{
+	char buf[64];
+
+	if (!read_sysfs(path, buf, sizeof(buf)))
+		return fallback;
+
+	return strtoull(buf, NULL, 10);
+}
+
+// Read a list of processors like 0-3,8-11, returns false if it can't be read
+static bool read_cpu_list(const char *path, topology_cpuset_t *cpus)
+{
+	char buf[1024];
+	char *current;
+	char *end;
+	uint64_t start;
+	uint64_t last;
+	uint64_t i;
+
+	memset(cpus, 0, sizeof(topology_cpuset_t));
+	if (!read_sysfs(path, buf, sizeof(buf)))
+		return false;
+
+	current = buf;
+	while (*current && *current != '\n') {
+		start = strtoull(current, &end, 10);
+		if (end == current)
+			return false;
+		last = start;
+		if (*end == '-')
+			last = strtoull(end + 1, &end, 10);
+		for (i = start; i <= last && i < TOPOLOGY_MAX_CPUS; i++)
+			topology_cpuset_add(cpus, (uint32_t)i);
+
+		current = *end == ',' ? end + 1 : end;
+	}
+
+	return true;
+}
+
+// Get the lowest processor in a set, which identifies the group of processors in it
+static uint32_t get_first_cpu(const topology_cpuset_t *cpus)
+{
+	uint32_t i;
+
+	for (i = 0; i < TOPOLOGY_MAX_CPUS; i++) {
+		if (topology_cpuset_has(cpus, i))
+			return i;
+	}
+
+	return UINT32_MAX;
+}
+
+// Find the last level cache a processor uses, returns false if there's no cache information
+static bool find_last_cache(uint32_t cpu, uint32_t *level, uint64_t *size, uint32_t *first_cpu)
+{
+	topology_cpuset_t shared;
+	char path[256];
+	char buf[64];
+	char *end;
+	uint32_t current;
+	uint32_t i;
+
+	*level = 0;
+	for (i = 0; i < MAX_CACHES; i++) {
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/cache/index%u/type", cpu, i);
+		if (!read_sysfs(path, buf, sizeof(buf)))
+			break;
+		if (strncmp(buf, "Instruction", 11) == 0)
+			continue;
+
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/cache/index%u/level", cpu, i);
+		current = (uint32_t)read_number(path, 0);
+		if (current <= *level)
+			continue;
+
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/cache/index%u/shared_cpu_list", cpu, i);
+		if (!read_cpu_list(path, &shared))
+			continue;
+
+		*level = current;
+		*first_cpu = get_first_cpu(&shared);
+		*size = 0;
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/cache/index%u/size", cpu, i);
+		if (read_sysfs(path, buf, sizeof(buf))) {
+			*size = strtoull(buf, &end, 10);
+			if (*end == 'K')
+				*size *= 1024;
+			else if (*end == 'M')
+				*size *= 1024 * 1024;
+		}
+	}
+
+	return *level != 0;
+}
+
+// Mark the efficiency cores of a hybrid CPU
+static void find_efficiency_cores(topology_t *topology)
+{
+	topology_cpuset_t atom;
+	uint64_t capacities[TOPOLOGY_MAX_CPUS];
+	uint64_t highest;
+	uint64_t lowest;
+	char path[256];
+	uint32_t i;
+
+	// Intel hybrid CPUs have a separate PMU for the efficiency cores, which lists them
+	if (read_cpu_list("/sys/devices/cpu_atom/cpus", &atom)) {
+		for (i = 0; i < topology->core_count; i++) {
+			if (topology_cpuset_has(&atom, topology->cores[i].cpus[0]))
+				topology->cores[i].type = TOPOLOGY_CORE_EFFICIENCY;
+		}
+	} else {
+		// Otherwise, ARM's big.LITTLE and others give a relative capacity for each processor
+		highest = 0;
+		lowest = UINT64_MAX;
+		for (i = 0; i < topology->core_count; i++) {
+			snprintf(path, sizeof(path), CPU_PATH "/cpu%u/cpu_capacity", topology->cores[i].cpus[0]);
+			capacities[i] = read_number(path, 0);
+			highest = PURPL_MAX(highest, capacities[i]);
+			lowest = PURPL_MIN(lowest, capacities[i]);
+		}
+		for (i = 0; i < topology->core_count && lowest < highest; i++) {
+			if (capacities[i] < highest)
+				topology->cores[i].type = TOPOLOGY_CORE_EFFICIENCY;
+		}
+	}
+
+	topology->efficiency_count = 0;
+	for (i = 0; i < topology->core_count; i++) {
+		if (topology->cores[i].type == TOPOLOGY_CORE_EFFICIENCY)
+			topology->efficiency_count++;
+	}
+
+	// A CPU that's all efficiency cores isn't hybrid
+	if (topology->efficiency_count == topology->core_count) {
+		for (i = 0; i < topology->core_count; i++)
+			topology->cores[i].type = TOPOLOGY_CORE_PERFORMANCE;
+		topology->efficiency_count = 0;
+	}
+}
+
+bool topology_detect_platform(topology_t *topology)
+{
+	topology_cpuset_t online;
+	topology_core_t *core;
+	uint64_t core_ids[TOPOLOGY_MAX_CPUS];
+	uint32_t group_cpus[TOPOLOGY_MAX_CACHE_GROUPS];
+	uint32_t packages[TOPOLOGY_MAX_CPUS];
+	char path[256];
+	uint64_t core_id;
+	uint64_t cache_size;
+	uint32_t cache_level;
+	uint32_t first_cpu;
+	uint32_t package;
+	uint32_t cpu;
+	uint32_t i;
+
+	if (!read_cpu_list(CPU_PATH "/online", &online))
+		return false;
+
+	memset(topology->cores, 0, sizeof(topology->cores));
+	memset(topology->cache_groups, 0, sizeof(topology->cache_groups));
+	topology->core_count = 0;
+	topology->cpu_count = 0;
+	topology->cache_group_count = 0;
+	topology->package_count = 0;
+	for (cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+		if (!topology_cpuset_has(&online, cpu))
+			continue;
+		topology->cpu_count++;
+
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/topology/physical_package_id", cpu);
+		package = (uint32_t)read_number(path, 0);
+		snprintf(path, sizeof(path), CPU_PATH "/cpu%u/topology/core_id", cpu);
+		core_id = read_number(path, cpu);
+
+		// Core IDs are only unique within a package
+		for (i = 0; i < topology->core_count; i++) {
+			if (topology->cores[i].package == package && core_ids[i] == core_id)
+				break;
+		}
+		core = &topology->cores[i];
+		if (i < topology->core_count) {
+			if (core->cpu_count < TOPOLOGY_MAX_SMT)
+				core->cpus[core->cpu_count++] = cpu;
+			continue;
+		}
+
+		core_ids[i] = core_id;
+		core->package = package;
+		core->cpus[0] = cpu;
+		core->cpu_count = 1;
+		topology->core_count++;
+
+		for (i = 0; i < topology->package_count; i++) {
+			if (packages[i] == package)
+				break;
+		}
+		if (i == topology->package_count)
+			packages[topology->package_count++] = package;
+
+		// Every processor sharing the cache lists the same processors, so the first one identifies the group
+		if (!find_last_cache(cpu, &cache_level, &cache_size, &first_cpu)) {
+			cache_level = 0;
+			cache_size = 0;
+			first_cpu = UINT32_MAX - package;
+		}
+		for (i = 0; i < topology->cache_group_count; i++) {
+			if (group_cpus[i] == first_cpu)
+				break;
+		}
+		if (i == topology->cache_group_count) {
+			if (topology->cache_group_count >= TOPOLOGY_MAX_CACHE_GROUPS) {
+				i = topology->cache_group_count - 1;
+			} else {
+				group_cpus[i] = first_cpu;
+				topology->cache_groups[i].level = cache_level;
+				topology->cache_groups[i].size = cache_size;
+				topology->cache_group_count++;
+			}
+		}
+		core->cache_group = i;
+		topology->cache_groups[i].core_count++;
+	}
+
+	find_efficiency_cores(topology);
+
+	return topology->core_count > 0;
+}
+
+bool topology_set_affinity(const topology_cpuset_t *cpus)
+{
+	cpu_set_t set;
+	uint32_t i;
+	int32_t error;
+
+	CPU_ZERO(&set);
+	for (i = 0; i < TOPOLOGY_MAX_CPUS && i < CPU_SETSIZE; i++) {
+		if (topology_cpuset_has(cpus, i))
+			CPU_SET(i, &set);
+	}
+
+	error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	if (error != 0) {
+		PURPL_LOG(TOPOLOGY_LOG_PREFIX "Failed to set thread affinity: %s\n", strerror(error));
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,540 @@
+// Asset streaming
+
+#include "loader.h"
+#include "topology.h"
+
+ARRAY_DECLARE(loader_heap, loader_request_t *)
+
+// The loader
+struct loader {
+	mutex_t lock; // Protects everything below that isn't a thread
+	cond_t io_cond; // Signalled when there's something to read or space in the read list
+	cond_t decompress_cond; // Signalled when something has been read
+
+	loader_heap_t pending[LOADER_PRIORITY_COUNT]; // Binary heaps of requests waiting for I/O
+
+	loader_request_t *read_head; // Requests waiting to be decompressed
+	loader_request_t *read_tail;
+	size_t read_count;
+
+	loader_request_t *done_head; // Requests waiting for loader_update
+	loader_request_t *done_tail;
+
+	gameinfo_t *sources[LOADER_MAX_SOURCES]; // Places to look for files
+	uint32_t source_count;
+
+	thread_t *io_threads[LOADER_MAX_WORKERS]; // I/O threads
+	uint32_t io_count;
+	thread_t *decompress_threads[LOADER_MAX_WORKERS]; // Decompression threads
+	uint32_t decompress_count;
+
+	pool_t *request_pool; // Requests
+	uint64_t sequence; // Sequence number for the next request
+	bool stopping; // Set by loader_destroy
+	loader_stats_t stats; // Statistics
+};
+
+// Whether a should be serviced before b
+static bool heap_before(loader_request_t *a, loader_request_t *b)
+{
+	return a->deadline < b->deadline || (a->deadline == b->deadline && a->sequence < b->sequence);
+}
+
+// Swap two heap entries
+static void heap_swap(loader_request_t **heap, size_t a, size_t b)
+{
+	loader_request_t *tmp;
+
+	tmp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = tmp;
+	heap[a]->heap_index = a;
+	heap[b]->heap_index = b;
+}
+
+// Move an entry towards the top of a heap
+static void heap_sift_up(loader_request_t **heap, size_t i)
+{
+	while (i > 0 && heap_before(heap[i], heap[(i - 1) / 2])) {
+		heap_swap(heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+// Move an entry towards the bottom of a heap
+static void heap_sift_down(loader_request_t **heap, size_t count, size_t i)
+{
+	size_t smallest;
+
+	while (true) {
+		smallest = i;
+		if (i * 2 + 1 < count && heap_before(heap[i * 2 + 1], heap[smallest]))
+			smallest = i * 2 + 1;
+		if (i * 2 + 2 < count && heap_before(heap[i * 2 + 2], heap[smallest]))
+			smallest = i * 2 + 2;
+		if (smallest == i)
+			break;
+
+		heap_swap(heap, i, smallest);
+		i = smallest;
+	}
+}
+
+// Add a request to the pending queue of its priority class
+static void push_pending(loader_t *loader, loader_request_t *request)
+{
+	loader_heap_t *heap = &loader->pending[request->priority];
+
+	request->heap_index = heap->count;
+	loader_heap_push(heap, request);
+	heap_sift_up(heap->data, request->heap_index);
+}
+
+// Remove a request from its pending queue
+static void remove_pending(loader_t *loader, loader_request_t *request)
+{
+	loader_heap_t *heap = &loader->pending[request->priority];
+	size_t i = request->heap_index;
+
+	heap->count--;
+	if (i != heap->count) {
+		heap_swap(heap->data, i, heap->count);
+		heap_sift_down(heap->data, heap->count, i);
+		heap_sift_up(heap->data, i);
+	}
+}
+
+// Get the most urgent pending request
+static loader_request_t *pick_pending(loader_t *loader)
+{
+	loader_request_t *request;
+	uint64_t now;
+	int32_t i;
+
+	request = NULL;
+	if (loader->pending[LOADER_PRIORITY_CRITICAL].count) {
+		request = loader->pending[LOADER_PRIORITY_CRITICAL].data[0];
+	} else {
+		// Anything that's overdue goes first, then the highest priority class with something in it
+		now = util_get_time();
+		for (i = LOADER_PRIORITY_CRITICAL + 1; i < LOADER_PRIORITY_COUNT && !request; i++) {
+			if (loader->pending[i].count && loader->pending[i].data[0]->deadline <= now)
+				request = loader->pending[i].data[0];
+		}
+		for (i = LOADER_PRIORITY_CRITICAL + 1; i < LOADER_PRIORITY_COUNT && !request; i++) {
+			if (loader->pending[i].count)
+				request = loader->pending[i].data[0];
+		}
+	}
+
+	if (request)
+		remove_pending(loader, request);
+
+	return request;
+}
+
+// Check if there's anything pending
+static bool have_pending(loader_t *loader)
+{
+	int32_t i;
+
+	for (i = 0; i < LOADER_PRIORITY_COUNT; i++) {
+		if (loader->pending[i].count)
+			return true;
+	}
+
+	return false;
+}
+
+// Put a request in the completed list, the loader must be locked
+static void complete(loader_t *loader, loader_request_t *request, loader_status_t status)
+{
+	request->status = status;
+	switch (status) {
+	case LOADER_STATUS_DONE:
+		loader->stats.completed++;
+		if (util_get_time() > request->deadline)
+			loader->stats.late++;
+		break;
+	case LOADER_STATUS_FAILED:
+		loader->stats.failed++;
+		break;
+	case LOADER_STATUS_CANCELLED:
+		loader->stats.cancelled++;
+		break;
+	default:
+		break;
+	}
+
+	if (status != LOADER_STATUS_DONE && request->data) {
+		util_free(request->data);
+		request->data = NULL;
+		request->size = 0;
+	}
+
+	request->next = NULL;
+	if (loader->done_tail)
+		loader->done_tail->next = request;
+	else
+		loader->done_head = request;
+	loader->done_tail = request;
+}
+
+// Read a loose file
+static bool read_file(loader_request_t *request, const char *path)
+{
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	request->size = util_fsize(file);
+	ALLOC_TAG_SCOPE(ALLOC_TAG_PACK)
+		request->data = util_alloc(request->size, 1, NULL);
+	request->size = fread(request->data, 1, request->size, file);
+	fclose(file);
+
+	return true;
+}
+
+// Find a request's file and read it, without the loader locked. Returns the next status of the request.
+static loader_status_t read_request(loader_t *loader, loader_request_t *request)
+{
+	gameinfo_t *info;
+	char *path;
+	uint32_t i;
+	size_t j;
+
+	for (i = 0; i < loader->source_count; i++) {
+		request->entry = gameinfo_find(loader->sources[i], request->path, &request->pack);
+		if (request->entry) {
+			request->data = pack_read_compressed(request->pack, request->entry);
+			request->size = request->entry->size;
+			return request->data ? LOADER_STATUS_READ : LOADER_STATUS_FAILED;
+		}
+	}
+
+	for (i = 0; i < loader->source_count; i++) {
+		info = loader->sources[i];
+		for (j = 0; j < info->dirs.count; j++) {
+			path = util_strfmt("%s%s%s", info->dirs.data[j],
+					   info->dirs.data[j][strlen(info->dirs.data[j]) - 1] == '/' ? "" : "/",
+					   atom_str(request->path));
+			if (util_fexist(path) && read_file(request, path)) {
+				util_free(path);
+				// Loose files aren't compressed
+				return LOADER_STATUS_DONE;
+			}
+			util_free(path);
+		}
+	}
+
+	LOG_WARNING(LOG_SUBSYSTEM_LOADER,
+		    LOADER_LOG_PREFIX "Failed to find %s in any search path\n", atom_str(request->path));
+	return LOADER_STATUS_FAILED;
+}
+
+// I/O thread
+static int32_t io_worker(void *data)
+{
+	loader_t *loader = data;
+	loader_request_t *request;
+	loader_status_t status;
+
+	topology_pin_thread(TOPOLOGY_ROLE_IO, 0);
+
+	mutex_lock(&loader->lock);
+	while (true) {
+		while (!loader->stopping && (!have_pending(loader) || loader->read_count >= LOADER_MAX_READ))
+			cond_wait(&loader->io_cond, &loader->lock);
+		if (loader->stopping)
+			break;
+
+		request = pick_pending(loader);
+		request->status = LOADER_STATUS_READING;
+		loader->stats.in_flight++;
+		mutex_unlock(&loader->lock);
+
+		status = read_request(loader, request);
+
+		mutex_lock(&loader->lock);
+		loader->stats.bytes_read += request->size;
+		if (atomic_load(&request->cancelled))
+			status = LOADER_STATUS_CANCELLED;
+
+		if (status == LOADER_STATUS_READ) {
+			request->status = status;
+			request->next = NULL;
+			if (loader->read_tail)
+				loader->read_tail->next = request;
+			else
+				loader->read_head = request;
+			loader->read_tail = request;
+			loader->read_count++;
+			cond_signal(&loader->decompress_cond);
+		} else {
+			loader->stats.in_flight--;
+			complete(loader, request, status);
+		}
+	}
+	mutex_unlock(&loader->lock);
+
+	return 0;
+}
+
+// Decompression thread
+static int32_t decompress_worker(void *data)
+{
+	loader_t *loader = data;
+	loader_request_t *request;
+	loader_status_t status;
+	uint8_t *buf;
+
+	topology_pin_thread(TOPOLOGY_ROLE_IO, 0);
+
+	mutex_lock(&loader->lock);
+	while (true) {
+		while (!loader->stopping && !loader->read_head)
+			cond_wait(&loader->decompress_cond, &loader->lock);
+		if (loader->stopping)
+			break;
+
+		request = loader->read_head;
+		loader->read_head = request->next;
+		if (!loader->read_head)
+			loader->read_tail = NULL;
+		loader->read_count--;
+		request->status = LOADER_STATUS_DECOMPRESSING;
+		cond_signal(&loader->io_cond);
+		mutex_unlock(&loader->lock);
+
+		status = LOADER_STATUS_CANCELLED;
+		if (!atomic_load(&request->cancelled)) {
+			buf = pack_decompress(request->pack, request->entry, request->data);
+			util_free(request->data);
+			request->data = buf;
+			request->size = buf ? request->entry->real_size : 0;
+			status = buf ? LOADER_STATUS_DONE : LOADER_STATUS_FAILED;
+		}
+
+		mutex_lock(&loader->lock);
+		loader->stats.in_flight--;
+		complete(loader, request, status);
+	}
+	mutex_unlock(&loader->lock);
+
+	return 0;
+}
+
+loader_t *loader_create(uint32_t io_workers, uint32_t decompress_workers)
+{
+	loader_t *loader;
+	char name[THREAD_NAME_LENGTH];
+	uint32_t i;
+
+	loader = util_alloc(1, sizeof(loader_t), NULL);
+	mutex_init(&loader->lock);
+	cond_init(&loader->io_cond);
+	cond_init(&loader->decompress_cond);
+	loader->request_pool = pool_create("loader_request", sizeof(loader_request_t), LOADER_REQUEST_POOL_SIZE);
+
+	io_workers = PURPL_MAX(PURPL_MIN(io_workers, LOADER_MAX_WORKERS), 1);
+	decompress_workers = PURPL_MAX(PURPL_MIN(decompress_workers, LOADER_MAX_WORKERS), 1);
+	LOG_INFO(LOG_SUBSYSTEM_LOADER, LOADER_LOG_PREFIX "Starting %u I/O %s and %u decompression %s\n", io_workers,
+		 PURPL_PLURALIZE(io_workers, "threads", "thread"), decompress_workers,
+		 PURPL_PLURALIZE(decompress_workers, "threads", "thread"));
+
+	for (i = 0; i < io_workers; i++) {
+		snprintf(name, sizeof(name), "loader_io%u", i);
+		loader->io_threads[i] = thread_create(io_worker, name, loader);
+		PURPL_ASSERT(loader->io_threads[i]);
+	}
+	loader->io_count = io_workers;
+
+	for (i = 0; i < decompress_workers; i++) {
+		snprintf(name, sizeof(name), "loader_zstd%u", i);
+		loader->decompress_threads[i] = thread_create(decompress_worker, name, loader);
+		PURPL_ASSERT(loader->decompress_threads[i]);
+	}
+	loader->decompress_count = decompress_workers;
+
+	return loader;
+}
+
+void loader_add_source(loader_t *loader, gameinfo_t *info)
+{
+	if (!loader || !info)
+		return;
+
+	mutex_lock(&loader->lock);
+	PURPL_ASSERT(loader->source_count < LOADER_MAX_SOURCES);
+	loader->sources[loader->source_count++] = info;
+	mutex_unlock(&loader->lock);
+
+	LOG_INFO(LOG_SUBSYSTEM_LOADER, LOADER_LOG_PREFIX "Added search paths of game %s\n", info->game);
+}
+
+loader_request_t *loader_request(loader_t *loader, const char *path, loader_priority_t priority,
+				 uint64_t deadline, loader_callback_t callback, void *user)
+{
+	if (!loader || !path || !strlen(path))
+		return NULL;
+
+	return loader_request_atom(loader, atom_intern_path(path[0] == '/' ? path + 1 : path), priority, deadline,
+				   callback, user);
+}
+
+loader_request_t *loader_request_atom(loader_t *loader, atom_t path, loader_priority_t priority, uint64_t deadline,
+				      loader_callback_t callback, void *user)
+{
+	loader_request_t *request;
+
+	if (!loader || path == ATOM_NONE || !callback || priority >= LOADER_PRIORITY_COUNT)
+		return NULL;
+
+	request = pool_calloc(loader->request_pool);
+	PURPL_ASSERT(request);
+	request->path = path;
+	request->priority = priority;
+	request->callback = callback;
+	request->user = user;
+	request->status = LOADER_STATUS_PENDING;
+	atomic_init(&request->cancelled, false);
+
+	mutex_lock(&loader->lock);
+	request->deadline = deadline ? util_get_time() + deadline : UINT64_MAX;
+	request->sequence = loader->sequence++;
+	push_pending(loader, request);
+	cond_signal(&loader->io_cond);
+	mutex_unlock(&loader->lock);
+
+	return request;
+}
+
+void loader_cancel(loader_t *loader, loader_request_t *request)
+{
+	if (!loader || !request)
+		return;
+
+	mutex_lock(&loader->lock);
+	switch (request->status) {
+	case LOADER_STATUS_PENDING:
+		remove_pending(loader, request);
+		complete(loader, request, LOADER_STATUS_CANCELLED);
+		break;
+	case LOADER_STATUS_READING:
+	case LOADER_STATUS_READ:
+	case LOADER_STATUS_DECOMPRESSING:
+		// The thread working on it will notice
+		atomic_store(&request->cancelled, true);
+		break;
+	default:
+		break;
+	}
+	mutex_unlock(&loader->lock);
+}
+
+void loader_update(loader_t *loader, uint32_t max_callbacks)
+{
+	loader_request_t *done;
+	loader_request_t *last;
+	loader_request_t *next;
+	uint32_t count;
+
+	if (!loader)
+		return;
+
+	mutex_lock(&loader->lock);
+
+	// Take up to max_callbacks requests off the front of the list
+	done = loader->done_head;
+	last = done;
+	for (count = 1; last && last->next && (!max_callbacks || count < max_callbacks); count++)
+		last = last->next;
+	if (last) {
+		loader->done_head = last->next;
+		if (!loader->done_head)
+			loader->done_tail = NULL;
+		last->next = NULL;
+	}
+
+	// Overdue requests may have become more important than what the I/O threads are waiting on
+	if (have_pending(loader))
+		cond_broadcast(&loader->io_cond);
+	mutex_unlock(&loader->lock);
+
+	while (done) {
+		next = done->next;
+		done->callback(done, done->status, done->data, done->size, done->user);
+		pool_free(loader->request_pool, done);
+		done = next;
+	}
+}
+
+void loader_get_stats(loader_t *loader, loader_stats_t *stats)
+{
+	int32_t i;
+
+	if (!loader || !stats)
+		return;
+
+	mutex_lock(&loader->lock);
+	*stats = loader->stats;
+	for (i = 0; i < LOADER_PRIORITY_COUNT; i++)
+		stats->pending[i] = loader->pending[i].count;
+	mutex_unlock(&loader->lock);
+}
+
+void loader_destroy(loader_t *loader)
+{
+	loader_request_t *request;
+	int32_t i;
+
+	if (!loader)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_LOADER, LOADER_LOG_PREFIX "Stopping loader threads\n");
+
+	mutex_lock(&loader->lock);
+	loader->stopping = true;
+	for (i = 0; i < LOADER_PRIORITY_COUNT; i++) {
+		while (loader->pending[i].count) {
+			request = loader->pending[i].data[loader->pending[i].count - 1];
+			remove_pending(loader, request);
+			complete(loader, request, LOADER_STATUS_CANCELLED);
+		}
+	}
+	cond_broadcast(&loader->io_cond);
+	cond_broadcast(&loader->decompress_cond);
+	mutex_unlock(&loader->lock);
+
+	for (i = 0; i < (int32_t)loader->io_count; i++)
+		thread_join(loader->io_threads[i]);
+	for (i = 0; i < (int32_t)loader->decompress_count; i++)
+		thread_join(loader->decompress_threads[i]);
+
+	// Anything that was read but never decompressed gets cancelled
+	mutex_lock(&loader->lock);
+	while (loader->read_head) {
+		request = loader->read_head;
+		loader->read_head = request->next;
+		loader->stats.in_flight--;
+		complete(loader, request, LOADER_STATUS_CANCELLED);
+	}
+	loader->read_tail = NULL;
+	mutex_unlock(&loader->lock);
+
+	// Every request's callback gets called
+	loader_update(loader, 0);
+
+	for (i = 0; i < LOADER_PRIORITY_COUNT; i++)
+		loader_heap_free(&loader->pending[i]);
+	pool_flush_cache(loader->request_pool);
+	pool_log_stats(loader->request_pool);
+	pool_destroy(loader->request_pool);
+	cond_destroy(&loader->decompress_cond);
+	cond_destroy(&loader->io_cond);
+	mutex_destroy(&loader->lock);
+	util_free(loader);
+}
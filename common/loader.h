@@ -0,0 +1,118 @@
+// Asset streaming. Requests are queued by priority and deadline, read from the search paths of some gameinfos by a
+// few I/O threads, and decompressed by a few more threads, so the frame loop never waits on the disk. Completed
+// requests are handed back to the thread calling loader_update.
+
+#pragma once
+
+#include "common.h"
+#include "gameinfo.h"
+#include "pack.h"
+#include "pool.h"
+#include "thread.h"
+#include "util.h"
+
+#define LOADER_LOG_PREFIX COMMON_LOG_PREFIX "LOADER: "
+
+// Maximum number of threads of each kind
+#define LOADER_MAX_WORKERS 8
+
+// Maximum number of gameinfos to search
+#define LOADER_MAX_SOURCES 8
+
+// Maximum number of requests that have been read but not decompressed yet, bounds the memory used by compressed data
+#define LOADER_MAX_READ 32
+
+// Number of requests the request pool starts out with room for
+#define LOADER_REQUEST_POOL_SIZE 256
+
+// Request priority classes, most urgent first
+typedef enum loader_priority {
+	LOADER_PRIORITY_CRITICAL, // Needed right now, the game can't continue without it
+	LOADER_PRIORITY_VISIBLE, // Visible to the player, shows up as pop-in if it's late
+	LOADER_PRIORITY_PREFETCH, // Might be needed soon, speculatively loaded around the player
+	LOADER_PRIORITY_COUNT
+} loader_priority_t;
+
+// Request state
+typedef enum loader_status {
+	LOADER_STATUS_PENDING, // Waiting for an I/O thread
+	LOADER_STATUS_READING, // Being read by an I/O thread
+	LOADER_STATUS_READ, // Waiting for a decompression thread
+	LOADER_STATUS_DECOMPRESSING, // Being decompressed
+	LOADER_STATUS_DONE, // Finished successfully
+	LOADER_STATUS_FAILED, // Doesn't exist or couldn't be read
+	LOADER_STATUS_CANCELLED, // Cancelled by loader_cancel
+} loader_status_t;
+
+typedef struct loader_request loader_request_t;
+
+// Called from loader_update when a request finishes, fails, or is cancelled. data is NULL unless status is
+// LOADER_STATUS_DONE, in which case it's size bytes long and the callback has to free it. The request is invalid once
+// this returns.
+typedef void (*loader_callback_t)(loader_request_t *request, loader_status_t status, uint8_t *data, size_t size,
+				  void *user);
+
+// A request
+struct loader_request {
+	atom_t path; // Path of the file, relative to the search paths
+	loader_priority_t priority; // Priority class
+	uint64_t deadline; // util_get_time the request should be done by, UINT64_MAX if it has none
+	uint64_t sequence; // Keeps requests with the same deadline in order
+
+	loader_callback_t callback; // Called when the request is done
+	void *user; // Passed to the callback
+
+	loader_status_t status; // Current state, only changed with the loader locked
+	atomic_bool cancelled; // Set by loader_cancel while the request is being worked on
+	size_t heap_index; // Position in the pending queue
+
+	pack_file_t *pack; // Pack the file is in, if any
+	pack_entry_t *entry; // Entry of the file in the pack
+	uint8_t *data; // Compressed or uncompressed data
+	size_t size; // Size of data
+
+	loader_request_t *next; // Next request in the read or completed list
+};
+
+// Loader statistics
+typedef struct loader_stats {
+	size_t pending[LOADER_PRIORITY_COUNT]; // Requests waiting for I/O in each priority class
+	size_t in_flight; // Requests being read or decompressed
+	uint64_t completed; // Requests that have finished
+	uint64_t failed; // Requests that have failed
+	uint64_t cancelled; // Requests that have been cancelled
+	uint64_t late; // Requests that finished after their deadline
+	uint64_t bytes_read; // Bytes read from storage
+} loader_stats_t;
+
+typedef struct loader loader_t;
+
+// Create a loader with the given number of I/O and decompression threads
+extern loader_t *loader_create(uint32_t io_workers, uint32_t decompress_workers);
+
+// Add a gameinfo to search for files in. Searched in the order they're added, packs before directories.
+extern void loader_add_source(loader_t *loader, gameinfo_t *info);
+
+// Request a file. deadline is the number of nanoseconds from now the file should be loaded within, or 0 for no
+// deadline. Requests past their deadline are serviced before anything else that isn't critical. The returned handle is
+// valid until the callback has been called.
+extern loader_request_t *loader_request(loader_t *loader, const char *path, loader_priority_t priority,
+					uint64_t deadline, loader_callback_t callback, void *user);
+
+// Request a file by its interned path, which has to be normalized and relative like the ones loader_request makes
+extern loader_request_t *loader_request_atom(loader_t *loader, atom_t path, loader_priority_t priority,
+					     uint64_t deadline, loader_callback_t callback, void *user);
+
+// Cancel a request. The callback is still called with LOADER_STATUS_CANCELLED, unless the request had already
+// finished, in which case it gets the data anyway.
+extern void loader_cancel(loader_t *loader, loader_request_t *request);
+
+// Call the callbacks of up to max_callbacks finished requests (0 for no limit). Call this once per frame from the
+// thread that should own the loaded data.
+extern void loader_update(loader_t *loader, uint32_t max_callbacks);
+
+// Get statistics about the loader
+extern void loader_get_stats(loader_t *loader, loader_stats_t *stats);
+
+// Cancel everything, stop the threads, and free the loader
+extern void loader_destroy(loader_t *loader);
@@ -0,0 +1,1056 @@
+// Logging
+
+#include <ctype.h>
+
+#include "log.h"
+#include "alloc.h"
+#include "atom.h"
+#include "thread.h"
+#include "util.h"
+
+// Set in the size of records that only fill the space at the end of a ring
+#define LOG_PADDING_FLAG 0x80000000
+
+// Number of source file names that are kept normalized
+#define LOG_FILE_CACHE_SIZE 64
+
+// Most binary logs with the same prefix
+#define LOG_MAX_BINARY_LOGS 1000
+
+// A message in a ring
+typedef struct log_record {
+	uint32_t size; // Size of the record including the message, rounded up to 8 bytes
+	uint32_t line; // Line it was logged from
+	uint64_t sequence; // Order across all threads
+	const log_site_t *site; // Site it was logged from if the message is packed arguments, NULL if it's text
+	const char *func; // Function it was logged from
+	const char *file; // File it was logged from
+	log_level_t level; // Level
+	uint8_t subsystem; // Subsystem
+	uint16_t length; // Length of the message or the arguments
+	char message[]; // The message or the arguments, terminated
+} log_record_t;
+
+// Length modifier of a conversion
+typedef enum log_length {
+	LOG_LENGTH_NONE, // int or double
+	LOG_LENGTH_HH, // char
+	LOG_LENGTH_H, // short
+	LOG_LENGTH_L, // long
+	LOG_LENGTH_LL, // long long
+	LOG_LENGTH_J, // intmax_t
+	LOG_LENGTH_Z, // size_t
+	LOG_LENGTH_T, // ptrdiff_t
+	LOG_LENGTH_COUNT
+} log_length_t;
+
+// A parsed conversion
+typedef struct log_spec {
+	const char *flags; // Flags
+	size_t flags_length; // Length of the flags
+	const char *width; // Width, if it's not *
+	size_t width_length; // Length of the width
+	const char *precision; // Precision, if it's not *
+	size_t precision_length; // Length of the precision
+	bool width_star; // Whether the width is an argument
+	bool has_precision; // Whether there's a precision
+	bool precision_star; // Whether the precision is an argument
+	char conversion; // Conversion character
+	log_arg_type_t type; // Type of the argument
+} log_spec_t;
+
+// A thread's ring buffer. Only that thread writes to it, and only whoever holds s_flush_lock reads from it.
+typedef struct log_ring {
+	atomic_uint_fast64_t head; // Total bytes written
+	uint8_t head_padding[PURPL_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+	atomic_uint_fast64_t tail; // Total bytes read
+	uint8_t tail_padding[PURPL_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+	uint64_t thread_id; // Thread that owns the ring
+	struct log_ring *next; // Next ring in the list of every thread's ring
+	uint8_t data[LOG_RING_SIZE]; // Records
+} log_ring_t;
+
+// A normalized source file name, looked up by the address of the __FILE__ it came from
+typedef struct log_file {
+	const char *file; // __FILE__
+	const char *name; // Name to print
+} log_file_t;
+
+// State of the flush thread
+typedef enum log_state {
+	LOG_STATE_STOPPED, // Not started yet
+	LOG_STATE_STARTING, // Being started
+	LOG_STATE_RUNNING, // Running
+	LOG_STATE_SHUT_DOWN // Stopped by log_shutdown, messages are written immediately
+} log_state_t;
+
+log_level_t g_log_levels[LOG_SUBSYSTEM_COUNT] = { LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+						  LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL };
+
+static const char *s_level_names[LOG_LEVEL_COUNT] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR" };
+static const char *s_subsystem_names[LOG_SUBSYSTEM_COUNT] = { "GENERAL", "PACK", "LOADER", "ENGINE", "RENDER" };
+
+static _Atomic(log_ring_t *) s_rings;
+static PURPL_THREAD_LOCAL log_ring_t *t_ring;
+static atomic_uint_fast64_t s_sequence;
+
+static atomic_int s_state;
+static thread_t *s_flush_thread;
+static atomic_bool s_stopping;
+static mutex_t s_wake_lock = MUTEX_INITIALIZER;
+static cond_t s_wake_cond = COND_INITIALIZER;
+
+static atomic_uint_fast32_t s_site_count;
+
+static mutex_t s_flush_lock = MUTEX_INITIALIZER; // Held while reading the rings, protects the things below
+static log_file_t s_files[LOG_FILE_CACHE_SIZE];
+static char s_message[LOG_MAX_MESSAGE];
+static char s_output[LOG_MAX_MESSAGE + 512];
+static FILE *s_binary;
+static uint32_t s_binary_generation;
+
+static const log_arg_type_t s_signed_types[LOG_LENGTH_COUNT] = { LOG_ARG_INT, LOG_ARG_CHAR, LOG_ARG_SHORT,
+								 LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_INTMAX,
+								 LOG_ARG_SIZE, LOG_ARG_PTRDIFF };
+static const log_arg_type_t s_unsigned_types[LOG_LENGTH_COUNT] = { LOG_ARG_UINT, LOG_ARG_UCHAR, LOG_ARG_USHORT,
+								   LOG_ARG_ULONG, LOG_ARG_LLONG, LOG_ARG_INTMAX,
+								   LOG_ARG_SIZE, LOG_ARG_PTRDIFF };
+
+// Get the calling thread's ring
+static log_ring_t *get_ring(void)
+{
+	log_ring_t *ring;
+
+	if (t_ring)
+		return t_ring;
+
+	// Rings are kept until the process exits
+	ALLOC_TAG_SCOPE(ALLOC_TAG_LOG | ALLOC_PERMANENT)
+		ring = util_alloc_aligned(sizeof(log_ring_t), PURPL_CACHE_LINE);
+	PURPL_ASSERT(ring);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->thread_id = thread_get_id();
+
+	ring->next = atomic_load(&s_rings);
+	while (!atomic_compare_exchange_weak(&s_rings, &ring->next, ring))
+		;
+	t_ring = ring;
+
+	return ring;
+}
+
+// Wake up the flush thread
+static void wake_flush_thread(void)
+{
+	mutex_lock(&s_wake_lock);
+	cond_signal(&s_wake_cond);
+	mutex_unlock(&s_wake_lock);
+}
+
+// Flush thread
+static int32_t flush_thread(void *data)
+{
+	(void)data;
+
+	mutex_lock(&s_wake_lock);
+	while (!atomic_load(&s_stopping)) {
+		cond_wait_timeout(&s_wake_cond, &s_wake_lock, LOG_FLUSH_INTERVAL);
+		mutex_unlock(&s_wake_lock);
+		log_flush();
+		mutex_lock(&s_wake_lock);
+	}
+	mutex_unlock(&s_wake_lock);
+
+	return 0;
+}
+
+// Start the flush thread the first time something is logged
+static void start(void)
+{
+	const char *binary_prefix;
+	const char *levels;
+	int state;
+
+	state = LOG_STATE_STOPPED;
+	if (!atomic_compare_exchange_strong(&s_state, &state, LOG_STATE_STARTING))
+		return;
+
+	atexit(log_shutdown);
+	// The flush thread is joined after everything else has shut down
+	ALLOC_TAG_SCOPE(ALLOC_TAG_LOG | ALLOC_PERMANENT)
+		s_flush_thread = thread_create(flush_thread, "log_flush", NULL);
+	atomic_store(&s_state, s_flush_thread ? LOG_STATE_RUNNING : LOG_STATE_SHUT_DOWN);
+
+	// The launcher sets this for -binarylog, each module writes its own file
+	binary_prefix = getenv(LOG_BINARY_ENV);
+	if (binary_prefix && *binary_prefix)
+		log_open_binary(binary_prefix);
+
+	// Same for -loglevel, the message that started logging has already been let through
+	levels = getenv(LOG_LEVELS_ENV);
+	if (levels && *levels)
+		log_apply_levels(levels);
+}
+
+// Copy a record into a ring, waiting for space if it's full
+static void push(log_ring_t *ring, const log_record_t *record, const void *message)
+{
+	uint64_t head;
+	uint64_t offset;
+	uint64_t needed;
+	uint64_t used;
+	uint32_t padding;
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	offset = head % LOG_RING_SIZE;
+
+	// Records don't wrap around, the space at the end is skipped if it's too small
+	padding = offset + record->size > LOG_RING_SIZE ? (uint32_t)(LOG_RING_SIZE - offset) : 0;
+	needed = padding + record->size;
+
+	while (head + needed - atomic_load_explicit(&ring->tail, memory_order_acquire) > LOG_RING_SIZE) {
+		if (atomic_load(&s_state) == LOG_STATE_RUNNING) {
+			wake_flush_thread();
+			thread_yield();
+		} else {
+			log_flush();
+		}
+	}
+
+	if (padding) {
+		*(uint32_t *)(ring->data + offset) = padding | LOG_PADDING_FLAG;
+		offset = 0;
+	}
+	memcpy(ring->data + offset, record, offsetof(log_record_t, message));
+	memcpy(ring->data + offset + offsetof(log_record_t, message), message, record->length);
+	ring->data[offset + offsetof(log_record_t, message) + record->length] = 0;
+
+	atomic_store_explicit(&ring->head, head + needed, memory_order_release);
+
+	// Don't let it get close to full before the flush thread's next pass, but only wake it once
+	used = head + needed - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	if (used > LOG_RING_SIZE / 2 && used - needed <= LOG_RING_SIZE / 2 &&
+	    atomic_load_explicit(&s_state, memory_order_relaxed) == LOG_STATE_RUNNING)
+		wake_flush_thread();
+}
+
+// Add a message to the calling thread's ring
+static void submit(const log_site_t *site, log_level_t level, log_subsystem_t subsystem, const char *func, int line,
+		   const char *file, const void *message, size_t length)
+{
+	log_record_t record;
+
+	if (atomic_load_explicit(&s_state, memory_order_relaxed) == LOG_STATE_STOPPED)
+		start();
+
+	record.length = (uint16_t)length;
+	record.size = (uint32_t)((offsetof(log_record_t, message) + length + 1 + 7) & ~(size_t)7);
+	record.line = (uint32_t)line;
+	record.site = site;
+	record.func = func;
+	record.file = file;
+	record.level = level;
+	record.subsystem = (uint8_t)subsystem;
+	record.sequence = atomic_fetch_add_explicit(&s_sequence, 1, memory_order_relaxed);
+
+	push(get_ring(), &record, message);
+
+	// Errors are often followed by a crash, so they can't wait
+	if (level >= LOG_LEVEL_ERROR || atomic_load(&s_state) == LOG_STATE_SHUT_DOWN)
+		log_flush();
+}
+
+// Parse a conversion, starting after the %. Returns the character after it, or NULL if it can't be deferred.
+static const char *parse_spec(const char *fmt, log_spec_t *spec)
+{
+	log_length_t length;
+
+	memset(spec, 0, sizeof(log_spec_t));
+
+	spec->flags = fmt;
+	while (*fmt && strchr("-+ #0'_$", *fmt))
+		fmt++;
+	spec->flags_length = fmt - spec->flags;
+
+	if (*fmt == '*') {
+		spec->width_star = true;
+		fmt++;
+	} else {
+		spec->width = fmt;
+		while (isdigit((unsigned char)*fmt))
+			fmt++;
+		spec->width_length = fmt - spec->width;
+	}
+
+	if (*fmt == '.') {
+		spec->has_precision = true;
+		fmt++;
+		if (*fmt == '*') {
+			spec->precision_star = true;
+			fmt++;
+		} else {
+			spec->precision = fmt;
+			while (isdigit((unsigned char)*fmt))
+				fmt++;
+			spec->precision_length = fmt - spec->precision;
+		}
+	}
+
+	length = LOG_LENGTH_NONE;
+	if (fmt[0] == 'h' && fmt[1] == 'h') {
+		length = LOG_LENGTH_HH;
+		fmt += 2;
+	} else if (fmt[0] == 'l' && fmt[1] == 'l') {
+		length = LOG_LENGTH_LL;
+		fmt += 2;
+	} else if (fmt[0] == 'I' && fmt[1] == '6' && fmt[2] == '4') {
+		length = LOG_LENGTH_LL;
+		fmt += 3;
+	} else if (fmt[0] == 'I' && fmt[1] == '3' && fmt[2] == '2') {
+		fmt += 3;
+	} else if (*fmt == 'h') {
+		length = LOG_LENGTH_H;
+		fmt++;
+	} else if (*fmt == 'l') {
+		length = LOG_LENGTH_L;
+		fmt++;
+	} else if (*fmt == 'j') {
+		length = LOG_LENGTH_J;
+		fmt++;
+	} else if (*fmt == 'z') {
+		length = LOG_LENGTH_Z;
+		fmt++;
+	} else if (*fmt == 't') {
+		length = LOG_LENGTH_T;
+		fmt++;
+	}
+
+	spec->conversion = *fmt;
+	switch (spec->conversion) {
+	case 'd':
+	case 'i':
+		spec->type = s_signed_types[length];
+		break;
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'o':
+	case 'b':
+	case 'B':
+		spec->type = s_unsigned_types[length];
+		break;
+	case 'c':
+		spec->type = LOG_ARG_INT;
+		if (length != LOG_LENGTH_NONE)
+			return NULL;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->type = LOG_ARG_DOUBLE;
+		if (length != LOG_LENGTH_NONE && length != LOG_LENGTH_L)
+			return NULL;
+		break;
+	case 's':
+		spec->type = LOG_ARG_STRING;
+		if (length != LOG_LENGTH_NONE)
+			return NULL;
+		break;
+	case 'p':
+		spec->type = LOG_ARG_POINTER;
+		break;
+	default:
+		// %n, wide strings and anything else
+		return NULL;
+	}
+
+	return fmt + 1;
+}
+
+// Parse a site's format string to find the types of its arguments
+static log_site_state_t parse_site(log_site_t *site)
+{
+	log_spec_t spec;
+	const char *fmt;
+	int32_t precision;
+	size_t i;
+
+	site->arg_count = 0;
+	fmt = site->fmt;
+	while (*fmt) {
+		if (*fmt++ != '%')
+			continue;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+
+		fmt = parse_spec(fmt, &spec);
+		if (!fmt || site->arg_count + spec.width_star + spec.precision_star + 1 > LOG_MAX_ARGS)
+			return LOG_SITE_IMMEDIATE;
+
+		if (spec.width_star)
+			site->arg_types[site->arg_count++] = LOG_ARG_INT;
+		if (spec.precision_star)
+			site->arg_types[site->arg_count++] = LOG_ARG_INT;
+
+		// Strings with a precision don't have to be terminated, so only that much of them can be copied
+		precision = LOG_PRECISION_NONE;
+		if (spec.precision_star) {
+			precision = LOG_PRECISION_STAR;
+		} else if (spec.has_precision) {
+			precision = 0;
+			for (i = 0; i < spec.precision_length; i++)
+				precision = PURPL_MIN(precision * 10 + (spec.precision[i] - '0'), LOG_MAX_MESSAGE);
+		}
+		site->precisions[site->arg_count] = precision;
+		site->arg_types[site->arg_count++] = (uint8_t)spec.type;
+	}
+
+	return LOG_SITE_DEFERRED;
+}
+
+// Set up a site the first time it's used
+static log_site_state_t setup_site(log_site_t *site, const char *func, int line, const char *file, const char *fmt)
+{
+	int state;
+
+	state = LOG_SITE_NEW;
+	if (atomic_compare_exchange_strong(&site->state, &state, LOG_SITE_PARSING)) {
+		site->id = (uint32_t)atomic_fetch_add(&s_site_count, 1) + 1;
+		site->fmt = fmt;
+		site->func = func;
+		site->file = file;
+		site->line = (uint32_t)line;
+		state = parse_site(site);
+		atomic_store_explicit(&site->state, state, memory_order_release);
+		return state;
+	}
+
+	// Another thread is setting it up
+	while ((state = atomic_load_explicit(&site->state, memory_order_acquire)) == LOG_SITE_PARSING)
+		thread_yield();
+
+	return state;
+}
+
+// Copy the arguments of a message, returns their size
+static size_t pack_args(const log_site_t *site, uint8_t *buf, size_t size, va_list args)
+{
+	const char *str;
+	uint64_t value;
+	double real;
+	int64_t precision;
+	size_t offset;
+	size_t length;
+	uint32_t i;
+
+	offset = 0;
+	value = 0;
+	for (i = 0; i < site->arg_count; i++) {
+		switch (site->arg_types[i]) {
+		case LOG_ARG_INT:
+			value = (uint64_t)(int64_t)va_arg(args, int);
+			break;
+		case LOG_ARG_UINT:
+			value = va_arg(args, unsigned int);
+			break;
+		case LOG_ARG_CHAR:
+			value = (uint64_t)(int64_t)(signed char)va_arg(args, int);
+			break;
+		case LOG_ARG_UCHAR:
+			value = (unsigned char)va_arg(args, int);
+			break;
+		case LOG_ARG_SHORT:
+			value = (uint64_t)(int64_t)(short)va_arg(args, int);
+			break;
+		case LOG_ARG_USHORT:
+			value = (unsigned short)va_arg(args, int);
+			break;
+		case LOG_ARG_LONG:
+			value = (uint64_t)(int64_t)va_arg(args, long);
+			break;
+		case LOG_ARG_ULONG:
+			value = va_arg(args, unsigned long);
+			break;
+		case LOG_ARG_LLONG:
+			value = (uint64_t)va_arg(args, long long);
+			break;
+		case LOG_ARG_INTMAX:
+			value = (uint64_t)va_arg(args, intmax_t);
+			break;
+		case LOG_ARG_SIZE:
+			value = va_arg(args, size_t);
+			break;
+		case LOG_ARG_PTRDIFF:
+			value = (uint64_t)(int64_t)va_arg(args, ptrdiff_t);
+			break;
+		case LOG_ARG_DOUBLE:
+			real = va_arg(args, double);
+			memcpy(&value, &real, sizeof(double));
+			break;
+		case LOG_ARG_POINTER:
+			value = (uintptr_t)va_arg(args, void *);
+			break;
+		case LOG_ARG_STRING:
+		default:
+			// Strings are copied, leaving room for the other arguments
+			str = va_arg(args, const char *);
+			if (!str)
+				str = "(null)";
+
+			// A * precision is the int before the string, and a negative one is the same as none
+			precision = site->precisions[i];
+			if (precision == LOG_PRECISION_STAR)
+				precision = (int64_t)value;
+			length = precision >= 0 ? strnlen(str, (size_t)precision) : strlen(str);
+			if (offset + length + 1 + (site->arg_count - i - 1) * sizeof(uint64_t) > size)
+				length = size - offset - 1 - (site->arg_count - i - 1) * sizeof(uint64_t);
+			memcpy(buf + offset, str, length);
+			buf[offset + length] = 0;
+			offset += length + 1;
+			continue;
+		}
+
+		memcpy(buf + offset, &value, sizeof(uint64_t));
+		offset += sizeof(uint64_t);
+	}
+
+	return offset;
+}
+
+void log_write_site(log_site_t *site, log_level_t level, log_subsystem_t subsystem, const char *func, int line,
+		    const char *file, const char *fmt, ...)
+{
+	uint8_t buf[LOG_MAX_MESSAGE];
+	va_list args;
+	size_t size;
+	int state;
+
+	if (!site || !func || !file || !fmt || level >= LOG_LEVEL_COUNT || subsystem >= LOG_SUBSYSTEM_COUNT)
+		return;
+
+	state = atomic_load_explicit(&site->state, memory_order_acquire);
+	if (state != LOG_SITE_DEFERRED && state != LOG_SITE_IMMEDIATE)
+		state = setup_site(site, func, line, file, fmt);
+
+	va_start(args, fmt);
+	// A format string that isn't a literal could be different every time
+	if (state == LOG_SITE_IMMEDIATE || fmt != site->fmt) {
+		log_vwrite(level, subsystem, func, line, file, fmt, args);
+		va_end(args);
+		return;
+	}
+	size = pack_args(site, buf, sizeof(buf), args);
+	va_end(args);
+
+	submit(site, level, subsystem, func, line, file, buf, size);
+}
+
+void log_write(log_level_t level, log_subsystem_t subsystem, const char *func, int line, const char *file,
+	       const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	log_vwrite(level, subsystem, func, line, file, fmt, args);
+	va_end(args);
+}
+
+void log_vwrite(log_level_t level, log_subsystem_t subsystem, const char *func, int line, const char *file,
+		const char *fmt, va_list args)
+{
+	char message[LOG_MAX_MESSAGE];
+	int length;
+
+	if (!func || !file || !fmt || level >= LOG_LEVEL_COUNT || subsystem >= LOG_SUBSYSTEM_COUNT)
+		return;
+
+	length = stbsp_vsnprintf(message, sizeof(message), fmt, args);
+	length = PURPL_MIN(PURPL_MAX(length, 0), (int)sizeof(message) - 1);
+
+	submit(NULL, level, subsystem, func, line, file, message, (size_t)length);
+}
+
+void log_set_level(log_subsystem_t subsystem, log_level_t level)
+{
+	if (subsystem < LOG_SUBSYSTEM_COUNT)
+		g_log_levels[subsystem] = level;
+}
+
+void log_set_all_levels(log_level_t level)
+{
+	uint32_t i;
+
+	for (i = 0; i < LOG_SUBSYSTEM_COUNT; i++)
+		g_log_levels[i] = level;
+}
+
+const char *log_level_name(log_level_t level)
+{
+	return level < LOG_LEVEL_COUNT ? s_level_names[level] : "UNKNOWN";
+}
+
+// Find a name in a table of upper case names, returns count if it isn't there
+static uint32_t find_name(const char *const *names, uint32_t count, const char *name)
+{
+	uint32_t i;
+	size_t j;
+
+	if (!name)
+		return count;
+
+	// Case doesn't matter
+	for (i = 0; i < count; i++) {
+		for (j = 0; name[j] && toupper((unsigned char)name[j]) == names[i][j]; j++)
+			;
+		if (!name[j] && !names[i][j])
+			return i;
+	}
+
+	return count;
+}
+
+log_level_t log_parse_level(const char *name)
+{
+	return (log_level_t)find_name(s_level_names, LOG_LEVEL_COUNT, name);
+}
+
+log_subsystem_t log_parse_subsystem(const char *name)
+{
+	return (log_subsystem_t)find_name(s_subsystem_names, LOG_SUBSYSTEM_COUNT, name);
+}
+
+bool log_apply_levels(const char *spec)
+{
+	char setting[64];
+	const char *end;
+	char *level_name;
+	log_subsystem_t subsystem;
+	log_level_t level;
+	size_t length;
+	bool valid;
+
+	if (!spec)
+		return false;
+
+	valid = true;
+	while (*spec) {
+		end = strchr(spec, ',');
+		if (!end)
+			end = spec + strlen(spec);
+		length = PURPL_MIN((size_t)(end - spec), sizeof(setting) - 1);
+		memcpy(setting, spec, length);
+		setting[length] = 0;
+		spec = *end ? end + 1 : end;
+
+		// No subsystem means all of them
+		level_name = strchr(setting, '=');
+		subsystem = LOG_SUBSYSTEM_COUNT;
+		if (level_name) {
+			*level_name++ = 0;
+			subsystem = log_parse_subsystem(setting);
+			if (subsystem == LOG_SUBSYSTEM_COUNT) {
+				valid = false;
+				continue;
+			}
+		} else {
+			level_name = setting;
+		}
+
+		level = log_parse_level(level_name);
+		if (level == LOG_LEVEL_COUNT) {
+			valid = false;
+			continue;
+		}
+
+		if (subsystem == LOG_SUBSYSTEM_COUNT)
+			log_set_all_levels(level);
+		else
+			log_set_level(subsystem, level);
+	}
+
+	return valid;
+}
+
+// Get the name to print for a source file
+static const char *get_filename(const char *file)
+{
+	log_file_t *cached;
+	const char *name;
+
+	cached = &s_files[((uintptr_t)file >> 3) % LOG_FILE_CACHE_SIZE];
+	if (cached->file != file) {
+		name = atom_str(atom_intern_path(file));
+#ifndef PURPL_DEBUG
+		if (strstr(name, "purpl-engine/"))
+			name = strstr(name, "purpl-engine/") + 13;
+#endif
+		cached->file = file;
+		cached->name = name;
+	}
+
+	return cached->name;
+}
+
+// Get the next record in a ring, skipping padding, or NULL if it's empty
+static log_record_t *peek(log_ring_t *ring)
+{
+	uint64_t tail;
+	uint32_t size;
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	while (tail < atomic_load_explicit(&ring->head, memory_order_acquire)) {
+		size = *(uint32_t *)(ring->data + tail % LOG_RING_SIZE);
+		if (!(size & LOG_PADDING_FLAG))
+			return (log_record_t *)(ring->data + tail % LOG_RING_SIZE);
+
+		tail += size & ~LOG_PADDING_FLAG;
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+
+	return NULL;
+}
+
+// Get the next argument packed by log_write_site, 0 if there aren't any left
+static uint64_t unpack_value(const uint8_t *args, size_t args_size, size_t *offset)
+{
+	uint64_t value;
+
+	if (*offset + sizeof(uint64_t) > args_size)
+		return 0;
+
+	memcpy(&value, args + *offset, sizeof(uint64_t));
+	*offset += sizeof(uint64_t);
+	return value;
+}
+
+// Get the next string packed by log_write_site, an empty string if there aren't any left
+static const char *unpack_string(const uint8_t *args, size_t args_size, size_t *offset)
+{
+	const char *str;
+	const uint8_t *end;
+
+	if (*offset >= args_size)
+		return "";
+
+	str = (const char *)args + *offset;
+	end = memchr(str, 0, args_size - *offset);
+	if (!end)
+		return "";
+	*offset = end + 1 - args;
+
+	return str;
+}
+
+size_t log_format_args(char *buf, size_t size, const char *fmt, const uint8_t *args, size_t args_size)
+{
+	char spec_buf[64];
+	log_spec_t spec;
+	const char *next;
+	size_t length;
+	size_t offset;
+	uint64_t value;
+	double real;
+	int width;
+	int precision;
+	int written;
+	bool integer;
+
+	if (!buf || !size || !fmt || (!args && args_size))
+		return 0;
+
+	length = 0;
+	offset = 0;
+	while (*fmt && length < size - 1) {
+		if (*fmt != '%') {
+			buf[length++] = *fmt++;
+			continue;
+		}
+		if (fmt[1] == '%') {
+			buf[length++] = '%';
+			fmt += 2;
+			continue;
+		}
+
+		next = parse_spec(fmt + 1, &spec);
+		if (!next) {
+			buf[length++] = *fmt++;
+			continue;
+		}
+		fmt = next;
+
+		// Rebuild the conversion with the * arguments filled in and integers widened to long long
+		width = spec.width_star ? (int)unpack_value(args, args_size, &offset) : 0;
+		precision = spec.precision_star ? (int)unpack_value(args, args_size, &offset) : 0;
+		written = stbsp_snprintf(spec_buf, sizeof(spec_buf), "%%%.*s", (int)PURPL_MIN(spec.flags_length, 8),
+					 spec.flags);
+		if (spec.width_star)
+			written += stbsp_snprintf(spec_buf + written, sizeof(spec_buf) - written, "%d", width);
+		else
+			written += stbsp_snprintf(spec_buf + written, sizeof(spec_buf) - written, "%.*s",
+						  (int)PURPL_MIN(spec.width_length, 10), spec.width);
+		if (spec.precision_star && precision >= 0)
+			written += stbsp_snprintf(spec_buf + written, sizeof(spec_buf) - written, ".%d", precision);
+		else if (spec.has_precision && !spec.precision_star)
+			written += stbsp_snprintf(spec_buf + written, sizeof(spec_buf) - written, ".%.*s",
+						  (int)PURPL_MIN(spec.precision_length, 10), spec.precision);
+		integer = spec.type != LOG_ARG_DOUBLE && spec.type != LOG_ARG_STRING && spec.type != LOG_ARG_POINTER &&
+			  spec.conversion != 'c';
+		stbsp_snprintf(spec_buf + written, sizeof(spec_buf) - written, "%s%c", integer ? "ll" : "",
+			       spec.conversion);
+
+		switch (spec.type) {
+		case LOG_ARG_DOUBLE:
+			value = unpack_value(args, args_size, &offset);
+			memcpy(&real, &value, sizeof(double));
+			written = stbsp_snprintf(buf + length, size - length, spec_buf, real);
+			break;
+		case LOG_ARG_STRING:
+			written = stbsp_snprintf(buf + length, size - length, spec_buf,
+						 unpack_string(args, args_size, &offset));
+			break;
+		case LOG_ARG_POINTER:
+			written = stbsp_snprintf(buf + length, size - length, spec_buf,
+						 (void *)(uintptr_t)unpack_value(args, args_size, &offset));
+			break;
+		default:
+			value = unpack_value(args, args_size, &offset);
+			if (integer)
+				written = stbsp_snprintf(buf + length, size - length, spec_buf, (long long)value);
+			else
+				written = stbsp_snprintf(buf + length, size - length, spec_buf, (int)value);
+			break;
+		}
+		length += PURPL_MIN((size_t)PURPL_MAX(written, 0), size - length - 1);
+	}
+	buf[length] = 0;
+
+	return length;
+}
+
+size_t log_format_line(char *buf, size_t size, log_level_t level, const char *func, uint32_t line,
+		       const char *file, const char *message)
+{
+	int length;
+
+	if (!buf || !size)
+		return 0;
+
+	length = stbsp_snprintf(buf, size, "[%s:%u:%s]\n%s%s%s", func, line, file,
+				level == LOG_LEVEL_INFO ? "" : log_level_name(level),
+				level == LOG_LEVEL_INFO ? "" : ": ", message);
+	return (size_t)PURPL_MIN(PURPL_MAX(length, 0), (int)size - 1);
+}
+
+// Write the start of a binary log chunk, returns the padding to write after it so the next one is aligned
+static size_t write_chunk(log_chunk_type_t type, size_t size)
+{
+	log_binary_chunk_t chunk;
+
+	chunk.type = type;
+	chunk.size = (uint32_t)((size + 7) & ~(size_t)7);
+	fwrite(&chunk, sizeof(log_binary_chunk_t), 1, s_binary);
+
+	return chunk.size - size;
+}
+
+// Write a record to the binary log, along with its site if this log doesn't have it yet
+static void write_binary(const log_record_t *record)
+{
+	static const uint8_t padding[8] = { 0 };
+	log_binary_site_t site;
+	log_binary_message_t message;
+	const char *file;
+	size_t func_length;
+	size_t file_length;
+	size_t fmt_length;
+	size_t padding_size;
+
+	file = get_filename(record->file);
+	func_length = strlen(record->func) + 1;
+	file_length = strlen(file) + 1;
+
+	if (record->site && record->site->written != s_binary_generation) {
+		fmt_length = strlen(record->site->fmt) + 1;
+		padding_size = write_chunk(LOG_CHUNK_SITE,
+					   sizeof(log_binary_site_t) + func_length + file_length + fmt_length);
+		site.id = record->site->id;
+		site.line = record->site->line;
+		fwrite(&site, sizeof(log_binary_site_t), 1, s_binary);
+		fwrite(record->func, 1, func_length, s_binary);
+		fwrite(file, 1, file_length, s_binary);
+		fwrite(record->site->fmt, 1, fmt_length, s_binary);
+		fwrite(padding, 1, padding_size, s_binary);
+		((log_site_t *)record->site)->written = s_binary_generation;
+	}
+
+	memset(&message, 0, sizeof(log_binary_message_t));
+	message.sequence = record->sequence;
+	message.site = record->site ? record->site->id : 0;
+	message.line = record->line;
+	message.level = record->level;
+	message.subsystem = record->subsystem;
+
+	if (record->site) {
+		padding_size = write_chunk(LOG_CHUNK_MESSAGE, sizeof(log_binary_message_t) + record->length);
+		fwrite(&message, sizeof(log_binary_message_t), 1, s_binary);
+		fwrite(record->message, 1, record->length, s_binary);
+	} else {
+		padding_size = write_chunk(LOG_CHUNK_TEXT, sizeof(log_binary_message_t) + func_length + file_length +
+								   record->length + 1);
+		fwrite(&message, sizeof(log_binary_message_t), 1, s_binary);
+		fwrite(record->func, 1, func_length, s_binary);
+		fwrite(file, 1, file_length, s_binary);
+		fwrite(record->message, 1, record->length + 1, s_binary);
+	}
+	fwrite(padding, 1, padding_size, s_binary);
+}
+
+// Write out a record
+static void write_record(const log_record_t *record)
+{
+	const char *message;
+	size_t length;
+
+	if (s_binary) {
+		write_binary(record);
+		// Errors still go to the console, in case nobody looks at the log
+		if (record->level < LOG_LEVEL_ERROR)
+			return;
+	}
+
+	message = record->message;
+	if (record->site) {
+		log_format_args(s_message, sizeof(s_message), record->site->fmt, (const uint8_t *)record->message,
+				record->length);
+		message = s_message;
+	}
+
+	length = log_format_line(s_output, sizeof(s_output), record->level, record->func, record->line,
+				 get_filename(record->file), message);
+
+	fwrite(s_output, 1, length, stdout);
+#ifdef _WIN32
+	OutputDebugStringA(s_output);
+#endif
+}
+
+void log_flush(void)
+{
+	log_ring_t *ring;
+	log_ring_t *oldest_ring;
+	log_record_t *record;
+	log_record_t *oldest;
+	bool wrote;
+
+	mutex_lock(&s_flush_lock);
+
+	// Merge the rings by sequence number, so messages come out in the order they were logged
+	wrote = false;
+	while (true) {
+		oldest = NULL;
+		oldest_ring = NULL;
+		for (ring = atomic_load(&s_rings); ring; ring = ring->next) {
+			record = peek(ring);
+			if (record && (!oldest || record->sequence < oldest->sequence)) {
+				oldest = record;
+				oldest_ring = ring;
+			}
+		}
+		if (!oldest)
+			break;
+
+		write_record(oldest);
+		atomic_store_explicit(&oldest_ring->tail, atomic_load(&oldest_ring->tail) + oldest->size,
+				      memory_order_release);
+		wrote = true;
+	}
+
+	if (wrote) {
+		fflush(stdout);
+		if (s_binary)
+			fflush(s_binary);
+	}
+
+	mutex_unlock(&s_flush_lock);
+}
+
+bool log_open_binary(const char *prefix)
+{
+	log_binary_header_t header;
+	char *path;
+	FILE *file;
+	uint32_t i;
+
+	if (!prefix)
+		return false;
+
+	// Find a name that isn't taken, so several modules and runs can log with the same prefix
+	file = NULL;
+	path = NULL;
+	for (i = 0; i < LOG_MAX_BINARY_LOGS && !file; i++) {
+		util_free(path);
+		path = util_strfmt("%s_%u.plog", prefix, i);
+		file = fopen(path, "wbx");
+		if (!file && errno != EEXIST)
+			break;
+	}
+	if (!file) {
+		LOG_ERROR(LOG_SUBSYSTEM_GENERAL, LOG_LOG_PREFIX "Failed to create binary log %s: %s\n", path,
+			  strerror(errno));
+		util_free(path);
+		return false;
+	}
+
+	header.magic = LOG_BINARY_MAGIC;
+	header.version = LOG_BINARY_VERSION;
+	fwrite(&header, sizeof(log_binary_header_t), 1, file);
+
+	// Anything logged before this goes to the old destination
+	log_flush();
+	mutex_lock(&s_flush_lock);
+	if (s_binary)
+		fclose(s_binary);
+	s_binary = file;
+	s_binary_generation++;
+	mutex_unlock(&s_flush_lock);
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL, LOG_LOG_PREFIX "Writing binary log %s\n", path);
+	util_free(path);
+
+	return true;
+}
+
+void log_close_binary(void)
+{
+	log_flush();
+
+	mutex_lock(&s_flush_lock);
+	if (s_binary) {
+		fclose(s_binary);
+		s_binary = NULL;
+	}
+	mutex_unlock(&s_flush_lock);
+}
+
+void log_shutdown(void)
+{
+	int state;
+
+	state = LOG_STATE_RUNNING;
+	if (atomic_compare_exchange_strong(&s_state, &state, LOG_STATE_SHUT_DOWN)) {
+		atomic_store(&s_stopping, true);
+		wake_flush_thread();
+		thread_join(s_flush_thread);
+		s_flush_thread = NULL;
+	}
+
+	log_close_binary();
+}
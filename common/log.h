@@ -0,0 +1,235 @@
+// Logging. Each call site parses its format string once, and after that a message is just its raw arguments copied
+// into a ring buffer that belongs to the calling thread. A background thread formats them and writes them out in
+// order, or writes them to a binary log without formatting them at all, which logdecode turns back into text later.
+// Levels below LOG_MIN_LEVEL are compiled out, and each subsystem can be filtered at runtime.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+#define LOG_LOG_PREFIX COMMON_LOG_PREFIX "LOG: "
+
+// Levels, as macros so they can be compared by the preprocessor
+#define LOG_LEVEL_TRACE 0 // Extremely verbose, things done for every file or every frame
+#define LOG_LEVEL_DEBUG 1 // Useful when working on something
+#define LOG_LEVEL_INFO 2 // Normal messages
+#define LOG_LEVEL_WARNING 3 // Something's wrong, but it can keep going
+#define LOG_LEVEL_ERROR 4 // Something failed, these are written out before log_write returns
+#define LOG_LEVEL_COUNT 5
+
+// A log level
+typedef uint8_t log_level_t;
+
+// Lowest level that's compiled in
+#ifndef LOG_MIN_LEVEL
+#ifdef PURPL_DEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// Lowest level that's written out by default
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_DEBUG
+
+// Size of each thread's ring buffer
+#define LOG_RING_SIZE (64 * 1024)
+
+// Longest message, longer ones are cut off
+#define LOG_MAX_MESSAGE 4096
+
+// Longest the flush thread waits before writing out messages
+#define LOG_FLUSH_INTERVAL 10
+
+// Most arguments a message can have and still have its formatting deferred
+#define LOG_MAX_ARGS 16
+
+// Precision of a string argument that doesn't have one
+#define LOG_PRECISION_NONE -1
+
+// Precision of a string argument that comes from the argument before it
+#define LOG_PRECISION_STAR -2
+
+// Environment variable with the prefix of binary log files, which is how the engine finds out the launcher wants them
+#define LOG_BINARY_ENV "PURPL_BINARY_LOG"
+
+// Environment variable with comma separated [subsystem=]level settings, applied by every module when it starts logging
+#define LOG_LEVELS_ENV "PURPL_LOG_LEVELS"
+
+// Start of a binary log file
+#define LOG_BINARY_MAGIC 0x474F4C50 // PLOG
+#define LOG_BINARY_VERSION 1
+
+// Parts of the engine that can be filtered separately
+typedef enum log_subsystem {
+	LOG_SUBSYSTEM_GENERAL, // Everything that doesn't have its own
+	LOG_SUBSYSTEM_PACK, // Pack files
+	LOG_SUBSYSTEM_LOADER, // Asset streaming
+	LOG_SUBSYSTEM_ENGINE, // The engine
+	LOG_SUBSYSTEM_RENDER, // Rendering
+	LOG_SUBSYSTEM_COUNT
+} log_subsystem_t;
+
+// Lowest level written out for each subsystem
+extern log_level_t g_log_levels[LOG_SUBSYSTEM_COUNT];
+
+// How to get an argument out of a va_list
+typedef enum log_arg_type {
+	LOG_ARG_INT, // int
+	LOG_ARG_UINT, // unsigned int
+	LOG_ARG_CHAR, // signed char, promoted to int
+	LOG_ARG_UCHAR, // unsigned char, promoted to int
+	LOG_ARG_SHORT, // short, promoted to int
+	LOG_ARG_USHORT, // unsigned short, promoted to int
+	LOG_ARG_LONG, // long
+	LOG_ARG_ULONG, // unsigned long
+	LOG_ARG_LLONG, // long long
+	LOG_ARG_INTMAX, // intmax_t
+	LOG_ARG_SIZE, // size_t
+	LOG_ARG_PTRDIFF, // ptrdiff_t
+	LOG_ARG_DOUBLE, // double
+	LOG_ARG_STRING, // String, which is copied
+	LOG_ARG_POINTER, // void *
+} log_arg_type_t;
+
+// State of a call site
+typedef enum log_site_state {
+	LOG_SITE_NEW, // Not used yet
+	LOG_SITE_PARSING, // Its format string is being parsed
+	LOG_SITE_DEFERRED, // Its messages are formatted by the flush thread
+	LOG_SITE_IMMEDIATE, // Its format string can't be deferred, so messages are formatted when they're logged
+} log_site_state_t;
+
+// A place that logs, set up the first time it's used
+typedef struct log_site {
+	atomic_int state; // log_site_state_t
+	uint32_t id; // Identifies it in binary logs
+	const char *fmt; // Format string
+	const char *func; // Function
+	const char *file; // File
+	uint32_t line; // Line
+	uint32_t written; // Last binary log its description was written to, only touched by log_flush
+	uint8_t arg_count; // Number of arguments
+	uint8_t arg_types[LOG_MAX_ARGS]; // log_arg_type_t of each argument
+	int32_t precisions[LOG_MAX_ARGS]; // Most characters of each string argument that are used, or LOG_PRECISION_*
+} log_site_t;
+
+// Types of chunks in a binary log
+typedef enum log_chunk_type {
+	LOG_CHUNK_SITE, // A log_binary_site_t, followed by the function, file and format string, each terminated
+	LOG_CHUNK_MESSAGE, // A log_binary_message_t, followed by the arguments packed by log_write_site
+	LOG_CHUNK_TEXT, // A log_binary_message_t with no site, followed by the function, file and message
+} log_chunk_type_t;
+
+// Start of a binary log
+typedef struct log_binary_header {
+	uint32_t magic; // LOG_BINARY_MAGIC
+	uint32_t version; // LOG_BINARY_VERSION
+} log_binary_header_t;
+
+// Start of a chunk in a binary log
+typedef struct log_binary_chunk {
+	uint32_t type; // log_chunk_type_t
+	uint32_t size; // Size of the rest of the chunk, padded to 8 bytes so the next chunk is aligned
+} log_binary_chunk_t;
+
+// Description of a call site in a binary log
+typedef struct log_binary_site {
+	uint32_t id; // ID of the site
+	uint32_t line; // Line
+} log_binary_site_t;
+
+// A message in a binary log
+typedef struct log_binary_message {
+	uint64_t sequence; // Order the message was logged in
+	uint32_t site; // ID of the site, 0 for text
+	uint32_t line; // Line, for text
+	log_level_t level; // Level
+	uint8_t subsystem; // Subsystem
+	uint8_t padding[6];
+} log_binary_message_t;
+
+// Log a message if its subsystem lets it through
+#define LOG_WRITE(level, subsystem, ...)                                                                       \
+	do {                                                                                                   \
+		static log_site_t log_site_;                                                                   \
+		if ((level) >= g_log_levels[(subsystem)])                                                      \
+			log_write_site(&log_site_, (level), (subsystem), PURPL_FUNCNAME, __LINE__, __FILE__, \
+				       __VA_ARGS__);                                                           \
+	} while (0)
+
+// Logging macros for each level, which do nothing for levels below LOG_MIN_LEVEL
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(subsystem, ...) LOG_WRITE(LOG_LEVEL_TRACE, subsystem, __VA_ARGS__)
+#else
+#define LOG_TRACE(subsystem, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(subsystem, ...) LOG_WRITE(LOG_LEVEL_DEBUG, subsystem, __VA_ARGS__)
+#else
+#define LOG_DEBUG(subsystem, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(subsystem, ...) LOG_WRITE(LOG_LEVEL_INFO, subsystem, __VA_ARGS__)
+#else
+#define LOG_INFO(subsystem, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(subsystem, ...) LOG_WRITE(LOG_LEVEL_WARNING, subsystem, __VA_ARGS__)
+#else
+#define LOG_WARNING(subsystem, ...) ((void)0)
+#endif
+#define LOG_ERROR(subsystem, ...) LOG_WRITE(LOG_LEVEL_ERROR, subsystem, __VA_ARGS__)
+
+// Log a message from a call site, use the macros instead
+extern void log_write_site(log_site_t *site, log_level_t level, log_subsystem_t subsystem, const char *func, int line,
+			   const char *file, const char *fmt, ...);
+
+// Log a message, formatting it immediately. The macros are faster, this is for format strings that aren't literals.
+extern void log_write(log_level_t level, log_subsystem_t subsystem, const char *func, int line, const char *file,
+		      const char *fmt, ...);
+
+// Log a message, formatting it immediately
+extern void log_vwrite(log_level_t level, log_subsystem_t subsystem, const char *func, int line, const char *file,
+		       const char *fmt, va_list args);
+
+// Set the lowest level written out for a subsystem
+extern void log_set_level(log_subsystem_t subsystem, log_level_t level);
+
+// Set the lowest level written out for every subsystem
+extern void log_set_all_levels(log_level_t level);
+
+// Get the name of a level
+extern const char *log_level_name(log_level_t level);
+
+// Parse a level name, returns LOG_LEVEL_COUNT if it isn't one
+extern log_level_t log_parse_level(const char *name);
+
+// Parse a subsystem name, returns LOG_SUBSYSTEM_COUNT if it isn't one
+extern log_subsystem_t log_parse_subsystem(const char *name);
+
+// Apply comma separated [subsystem=]level settings, returns false if any of them are invalid
+extern bool log_apply_levels(const char *spec);
+
+// Format a message from a format string and arguments packed by log_write_site, returns the length
+extern size_t log_format_args(char *buf, size_t size, const char *fmt, const uint8_t *args, size_t args_size);
+
+// Format a message the way it's written to the console, returns the length
+extern size_t log_format_line(char *buf, size_t size, log_level_t level, const char *func, uint32_t line,
+			      const char *file, const char *message);
+
+// Write messages to a new binary log named <prefix>_<n>.plog instead of the console, returns false if it can't be
+// created
+extern bool log_open_binary(const char *prefix);
+
+// Go back to writing messages to the console
+extern void log_close_binary(void);
+
+// Write out every message logged so far
+extern void log_flush(void);
+
+// Stop the flush thread and write out everything. Called at exit, anything logged after this is written out
+// immediately.
+extern void log_shutdown(void);
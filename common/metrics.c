@@ -0,0 +1,372 @@
+// Runtime metrics
+
+#include "metrics.h"
+#include "topology.h"
+
+static metrics_registry_t s_local_registry = { .lock = MUTEX_INITIALIZER };
+static metrics_registry_t *s_registry = &s_local_registry;
+
+static PURPL_THREAD_LOCAL uint32_t t_metrics_shard; // Shard index + 1, 0 until the thread has one
+static atomic_uint_fast32_t s_next_shard;
+
+static mutex_t s_thread_lock = MUTEX_INITIALIZER; // Protects everything below
+static cond_t s_thread_cond = COND_INITIALIZER;
+static thread_t *s_thread;
+static bool s_stop;
+static char *s_path;
+static uint32_t s_interval;
+static bool s_listening;
+
+// Get the index of the highest set bit
+static uint32_t highest_bit(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+
+	_BitScanReverse64(&index, value);
+	return (uint32_t)index;
+#else
+	return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+}
+
+// Get the bucket a value goes in. Values below METRICS_SUB_BUCKETS get their own bucket, after that each power of 2
+// is split into METRICS_SUB_BUCKETS buckets.
+static uint32_t get_bucket(uint64_t value)
+{
+	uint32_t exponent;
+
+	if (value < METRICS_SUB_BUCKETS)
+		return (uint32_t)value;
+
+	exponent = highest_bit(value) - 4; // log2(METRICS_SUB_BUCKETS)
+	return METRICS_SUB_BUCKETS * (exponent + 1) + (uint32_t)(value >> exponent) - METRICS_SUB_BUCKETS;
+}
+
+// Get the value in the middle of a bucket
+static uint64_t get_bucket_value(uint32_t bucket)
+{
+	uint32_t exponent;
+
+	if (bucket < METRICS_SUB_BUCKETS)
+		return bucket;
+
+	exponent = bucket / METRICS_SUB_BUCKETS - 1;
+	return ((uint64_t)(METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS) << exponent) + ((1ull << exponent) >> 1);
+}
+
+metric_t *metrics_get(_Atomic(metric_t *) *cache, const char *name, metric_type_t type)
+{
+	metrics_registry_t *registry;
+	metric_t *metric;
+	uint32_t count;
+	uint32_t i;
+
+	if (!cache || !name)
+		return NULL;
+
+	metric = atomic_load_explicit(cache, memory_order_acquire);
+	if (metric)
+		return metric;
+
+	registry = s_registry;
+	mutex_lock(&registry->lock);
+
+	count = (uint32_t)atomic_load_explicit(&registry->count, memory_order_relaxed);
+	for (i = 0; i < count; i++) {
+		if (strcmp(registry->metrics[i].name, name) == 0)
+			break;
+	}
+
+	if (i < count) {
+		metric = &registry->metrics[i];
+		if (metric->type != type) {
+			PURPL_LOG(METRICS_LOG_PREFIX "Metric %s is already registered with a different type\n", name);
+			metric = NULL;
+		}
+	} else if (count >= METRICS_MAX_METRICS ||
+		   (type == METRIC_TYPE_HISTOGRAM && registry->histogram_count >= METRICS_MAX_HISTOGRAMS)) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Can't register metric %s, the registry is full\n", name);
+		metric = NULL;
+	} else {
+		metric = &registry->metrics[count];
+		strncpy(metric->name, name, METRICS_NAME_LENGTH - 1);
+		metric->type = type;
+		if (type == METRIC_TYPE_HISTOGRAM)
+			metric->histogram = &registry->histograms[registry->histogram_count++];
+		atomic_store_explicit(&registry->count, count + 1, memory_order_release);
+	}
+
+	mutex_unlock(&registry->lock);
+
+	// If it failed, this looks it up again next time and logs it again, which makes the problem hard to miss
+	if (metric)
+		atomic_store_explicit(cache, metric, memory_order_release);
+
+	return metric;
+}
+
+void metrics_add(metric_t *metric, uint64_t value)
+{
+	if (!metric)
+		return;
+
+	if (!t_metrics_shard)
+		t_metrics_shard = (uint32_t)(atomic_fetch_add(&s_next_shard, 1) % METRICS_SHARDS) + 1;
+	atomic_fetch_add_explicit(&metric->shards[t_metrics_shard - 1].value, value, memory_order_relaxed);
+}
+
+void metrics_set(metric_t *metric, int64_t value)
+{
+	if (metric)
+		atomic_store_explicit(&metric->gauge, value, memory_order_relaxed);
+}
+
+void metrics_add_gauge(metric_t *metric, int64_t value)
+{
+	if (metric)
+		atomic_fetch_add_explicit(&metric->gauge, value, memory_order_relaxed);
+}
+
+void metrics_record(metric_t *metric, uint64_t value)
+{
+	metrics_histogram_t *histogram;
+	uint64_t max;
+
+	if (!metric || !metric->histogram)
+		return;
+
+	histogram = metric->histogram;
+	atomic_fetch_add_explicit(&histogram->buckets[get_bucket(value)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+	max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+	while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed,
+								     memory_order_relaxed))
+		;
+}
+
+int64_t metrics_get_value(metric_t *metric)
+{
+	uint64_t value;
+	uint32_t i;
+
+	if (!metric)
+		return 0;
+
+	switch (metric->type) {
+	case METRIC_TYPE_COUNTER:
+		value = 0;
+		for (i = 0; i < METRICS_SHARDS; i++)
+			value += atomic_load_explicit(&metric->shards[i].value, memory_order_relaxed);
+		return (int64_t)value;
+	case METRIC_TYPE_GAUGE:
+		return atomic_load_explicit(&metric->gauge, memory_order_relaxed);
+	case METRIC_TYPE_HISTOGRAM:
+		return (int64_t)atomic_load_explicit(&metric->histogram->count, memory_order_relaxed);
+	}
+
+	return 0;
+}
+
+uint64_t metrics_get_percentile(metric_t *metric, double percentile)
+{
+	metrics_histogram_t *histogram;
+	uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t rank;
+	uint64_t seen;
+	uint64_t max;
+	uint32_t i;
+
+	if (!metric || !metric->histogram)
+		return 0;
+
+	// Values are still being recorded, so this works from one copy of the buckets
+	histogram = metric->histogram;
+	count = 0;
+	for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+		buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+		count += buckets[i];
+	}
+	max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+	if (!count)
+		return 0;
+
+	rank = PURPL_MAX((uint64_t)ceil(count * percentile / 100.0), 1);
+	seen = 0;
+	for (i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= rank)
+			return PURPL_MIN(get_bucket_value(i), max);
+	}
+
+	return max;
+}
+
+metrics_registry_t *metrics_get_registry(void)
+{
+	return s_registry;
+}
+
+void metrics_use_registry(metrics_registry_t *registry)
+{
+	s_registry = registry ? registry : &s_local_registry;
+}
+
+// Write the metrics of one type as a JSON object
+static void write_type(FILE *file, metric_type_t type, uint32_t count)
+{
+	metric_t *metric;
+	uint64_t sum;
+	uint64_t total;
+	bool first;
+	uint32_t i;
+
+	first = true;
+	for (i = 0; i < count; i++) {
+		metric = &s_registry->metrics[i];
+		if (metric->type != type)
+			continue;
+
+		fprintf(file, "%s\n\t\t\"%s\": ", first ? "" : ",", metric->name);
+		first = false;
+		if (type == METRIC_TYPE_HISTOGRAM) {
+			total = atomic_load_explicit(&metric->histogram->count, memory_order_relaxed);
+			sum = atomic_load_explicit(&metric->histogram->sum, memory_order_relaxed);
+			fprintf(file,
+				"{ \"count\": %" PRIu64 ", \"sum\": %" PRIu64 ", \"mean\": %.2lf, \"p50\": %" PRIu64
+				", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 " }",
+				total, sum, total ? (double)sum / total : 0.0, metrics_get_percentile(metric, 50.0),
+				metrics_get_percentile(metric, 90.0), metrics_get_percentile(metric, 99.0),
+				(uint64_t)atomic_load_explicit(&metric->histogram->max, memory_order_relaxed));
+		} else {
+			fprintf(file, "%" PRId64, metrics_get_value(metric));
+		}
+	}
+	fprintf(file, "%s", first ? "" : "\n\t");
+}
+
+void metrics_write(FILE *file)
+{
+	uint32_t count;
+
+	if (!file)
+		return;
+
+	count = (uint32_t)atomic_load_explicit(&s_registry->count, memory_order_acquire);
+	fprintf(file, "{\n\t\"time_ns\": %" PRIu64 ",\n\t\"counters\": {", util_get_time());
+	write_type(file, METRIC_TYPE_COUNTER, count);
+	fprintf(file, "},\n\t\"gauges\": {");
+	write_type(file, METRIC_TYPE_GAUGE, count);
+	fprintf(file, "},\n\t\"histograms\": {");
+	write_type(file, METRIC_TYPE_HISTOGRAM, count);
+	fprintf(file, "}\n}\n");
+}
+
+bool metrics_write_file(const char *path)
+{
+	char *tmp_path;
+	FILE *file;
+
+	if (!path)
+		return false;
+
+	tmp_path = util_append(path, ".tmp");
+	file = fopen(tmp_path, "wb");
+	if (!file) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to open %s: %s\n", tmp_path, strerror(errno));
+		util_free(tmp_path);
+		return false;
+	}
+
+	metrics_write(file);
+	fclose(file);
+
+#ifdef _WIN32
+	// rename doesn't replace files on Windows
+	remove(path);
+#endif
+	if (rename(tmp_path, path) != 0) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to move %s to %s: %s\n", tmp_path, path, strerror(errno));
+		util_free(tmp_path);
+		return false;
+	}
+
+	util_free(tmp_path);
+	return true;
+}
+
+// Writes snapshots until it's told to stop
+static int32_t snapshot_thread(void *data)
+{
+	uint64_t next;
+
+	topology_pin_thread(TOPOLOGY_ROLE_IO, 0);
+
+	next = util_get_time() + s_interval * UTIL_NS_PER_MS;
+
+	mutex_lock(&s_thread_lock);
+	while (!s_stop) {
+		cond_wait_timeout(&s_thread_cond, &s_thread_lock, s_listening ? METRICS_POLL_INTERVAL : s_interval);
+		if (s_stop)
+			break;
+		mutex_unlock(&s_thread_lock);
+
+		if (s_listening)
+			metrics_serve();
+		if (s_path && util_get_time() >= next) {
+			metrics_write_file(s_path);
+			next = util_get_time() + s_interval * UTIL_NS_PER_MS;
+		}
+
+		mutex_lock(&s_thread_lock);
+	}
+	mutex_unlock(&s_thread_lock);
+
+	return 0;
+}
+
+bool metrics_start(const char *path, uint32_t interval, const char *socket_path)
+{
+	if (s_thread || (!path && !socket_path))
+		return false;
+
+	s_path = path ? util_strdup(path) : NULL;
+	s_interval = PURPL_MAX(interval, 1);
+	s_listening = socket_path && metrics_listen(socket_path);
+	s_stop = false;
+
+	if (s_path)
+		PURPL_LOG(METRICS_LOG_PREFIX "Writing metrics to %s every %u ms\n", s_path, s_interval);
+	if (s_listening)
+		PURPL_LOG(METRICS_LOG_PREFIX "Serving metrics on %s\n", socket_path);
+
+	s_thread = thread_create(snapshot_thread, "metrics", NULL);
+	PURPL_ASSERT(s_thread);
+
+	return true;
+}
+
+void metrics_stop(void)
+{
+	if (!s_thread)
+		return;
+
+	mutex_lock(&s_thread_lock);
+	s_stop = true;
+	cond_signal(&s_thread_cond);
+	mutex_unlock(&s_thread_lock);
+	thread_join(s_thread);
+	s_thread = NULL;
+
+	if (s_path) {
+		metrics_write_file(s_path);
+		util_free(s_path);
+		s_path = NULL;
+	}
+	if (s_listening) {
+		metrics_close_socket();
+		s_listening = false;
+	}
+}
@@ -0,0 +1,155 @@
+// Runtime metrics. Counters, gauges and histograms are registered by name the first time they're used, after which
+// updating one is a relaxed atomic operation, and counters are split across cache lines so threads don't fight over
+// them. A background thread writes snapshots of every metric as JSON to a file on an interval, and to anything that
+// connects to a local socket, reading the values without locking anything, so it never holds up the frame loop.
+// Since common is a static library, the launcher gives the engine its registry so they show up in the same snapshots.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "thread.h"
+#include "util.h"
+
+#define METRICS_LOG_PREFIX COMMON_LOG_PREFIX "METRICS: "
+
+// Most metrics a registry can have
+#define METRICS_MAX_METRICS 256
+
+// Most histograms a registry can have
+#define METRICS_MAX_HISTOGRAMS 32
+
+// Longest name of a metric
+#define METRICS_NAME_LENGTH 64
+
+// Number of copies of each counter, threads add to different ones
+#define METRICS_SHARDS 8
+
+// Histogram buckets for each power of 2, which sets the precision to about 6%
+#define METRICS_SUB_BUCKETS 16
+
+// Number of buckets in a histogram, which covers every uint64_t
+#define METRICS_HISTOGRAM_BUCKETS (METRICS_SUB_BUCKETS * 61)
+
+// Default milliseconds between snapshots
+#define METRICS_DEFAULT_INTERVAL 5000
+
+// Milliseconds between checks for socket connections
+#define METRICS_POLL_INTERVAL 100
+
+// Types of metrics
+typedef enum metric_type {
+	METRIC_TYPE_COUNTER, // Only goes up
+	METRIC_TYPE_GAUGE, // Set to whatever the value currently is
+	METRIC_TYPE_HISTOGRAM, // Distribution of values
+} metric_type_t;
+
+// A copy of a counter on its own cache line
+typedef struct metrics_shard {
+	atomic_uint_fast64_t value; // Value
+	uint8_t padding[PURPL_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+} metrics_shard_t;
+
+// Distribution of values, in buckets like framestats
+typedef struct metrics_histogram {
+	atomic_uint_fast64_t buckets[METRICS_HISTOGRAM_BUCKETS]; // Number of values in each bucket
+	atomic_uint_fast64_t count; // Number of values
+	atomic_uint_fast64_t sum; // Sum of the values
+	atomic_uint_fast64_t max; // Largest value
+} metrics_histogram_t;
+
+// A metric
+typedef struct metric {
+	metrics_shard_t shards[METRICS_SHARDS]; // Copies of a counter, which are added up when it's read
+	atomic_int_fast64_t gauge; // Value of a gauge
+	metrics_histogram_t *histogram; // Histogram
+	metric_type_t type; // Type
+	char name[METRICS_NAME_LENGTH]; // Name, dotted like pack.bytes_read
+} metric_t;
+
+// Every metric in a module, or shared between them
+typedef struct metrics_registry {
+	metric_t metrics[METRICS_MAX_METRICS]; // Metrics
+	metrics_histogram_t histograms[METRICS_MAX_HISTOGRAMS]; // Histograms the metrics use
+	atomic_uint_fast32_t count; // Number of metrics, stored after each one is set up
+	uint32_t histogram_count; // Number of histograms used
+	mutex_t lock; // Held while registering
+} metrics_registry_t;
+
+// Add to a counter
+#define METRICS_COUNTER_ADD(name, value)                                                                       \
+	do {                                                                                                   \
+		static _Atomic(metric_t *) metric_;                                                            \
+		metrics_add(metrics_get(&metric_, (name), METRIC_TYPE_COUNTER), (value));                      \
+	} while (0)
+
+// Set a gauge
+#define METRICS_GAUGE_SET(name, value)                                                                         \
+	do {                                                                                                   \
+		static _Atomic(metric_t *) metric_;                                                            \
+		metrics_set(metrics_get(&metric_, (name), METRIC_TYPE_GAUGE), (value));                        \
+	} while (0)
+
+// Add to a gauge, which can be negative
+#define METRICS_GAUGE_ADD(name, value)                                                                         \
+	do {                                                                                                   \
+		static _Atomic(metric_t *) metric_;                                                            \
+		metrics_add_gauge(metrics_get(&metric_, (name), METRIC_TYPE_GAUGE), (value));                  \
+	} while (0)
+
+// Add a value to a histogram
+#define METRICS_HISTOGRAM_RECORD(name, value)                                                                  \
+	do {                                                                                                   \
+		static _Atomic(metric_t *) metric_;                                                            \
+		metrics_record(metrics_get(&metric_, (name), METRIC_TYPE_HISTOGRAM), (value));                 \
+	} while (0)
+
+// Get a metric, registering it if it doesn't exist. cache remembers it, so this only looks it up once. Returns NULL
+// if the registry is full or it exists with a different type.
+extern metric_t *metrics_get(_Atomic(metric_t *) *cache, const char *name, metric_type_t type);
+
+// Add to a counter
+extern void metrics_add(metric_t *metric, uint64_t value);
+
+// Set a gauge
+extern void metrics_set(metric_t *metric, int64_t value);
+
+// Add to a gauge
+extern void metrics_add_gauge(metric_t *metric, int64_t value);
+
+// Add a value to a histogram
+extern void metrics_record(metric_t *metric, uint64_t value);
+
+// Get the value of a counter or gauge
+extern int64_t metrics_get_value(metric_t *metric);
+
+// Get the value below which percentile percent of a histogram's values are
+extern uint64_t metrics_get_percentile(metric_t *metric, double percentile);
+
+// Get the registry this module uses
+extern metrics_registry_t *metrics_get_registry(void);
+
+// Use another module's registry. Metrics used before this stay in the old one, so call it before anything's recorded.
+extern void metrics_use_registry(metrics_registry_t *registry);
+
+// Write a snapshot of every metric as JSON
+extern void metrics_write(FILE *file);
+
+// Write a snapshot to a file, replacing it all at once so readers never see half of one
+extern bool metrics_write_file(const char *path);
+
+// Start writing snapshots to path every interval milliseconds and to connections to socket_path, either can be NULL
+extern bool metrics_start(const char *path, uint32_t interval, const char *socket_path);
+
+// Stop the snapshot thread, writing one last snapshot
+extern void metrics_stop(void);
+
+// Listen for connections on a local socket, platform specific
+extern bool metrics_listen(const char *path);
+
+// Write a snapshot to every waiting connection without blocking, platform specific
+extern void metrics_serve(void);
+
+// Stop listening, platform specific
+extern void metrics_close_socket(void);
@@ -0,0 +1,130 @@
+// Frame pacing
+
+#include "pacer.h"
+#include "metrics.h"
+
+// Get the nanoseconds between frames at a rate, 0 for no limit
+static uint64_t get_interval(uint32_t rate)
+{
+	return rate ? UTIL_NS_PER_SEC / rate : 0;
+}
+
+pacer_t *pacer_create(uint32_t rate, uint32_t background_rate)
+{
+	pacer_t *pacer;
+
+	pacer = util_alloc(1, sizeof(pacer_t), NULL);
+	pacer->margin = PACER_INITIAL_MARGIN;
+	pacer_set_rate(pacer, rate, background_rate);
+
+	return pacer;
+}
+
+void pacer_set_rate(pacer_t *pacer, uint32_t rate, uint32_t background_rate)
+{
+	if (!pacer)
+		return;
+
+	pacer->interval = get_interval(rate);
+	pacer->background_interval = get_interval(background_rate);
+	pacer->deadline = 0;
+
+	if (rate)
+		PURPL_LOG(PACER_LOG_PREFIX "Limiting to %u frames per second, %u in the background\n", rate,
+			  background_rate ? background_rate : rate);
+	else if (background_rate)
+		PURPL_LOG(PACER_LOG_PREFIX "Limiting to %u frames per second in the background\n", background_rate);
+}
+
+// Let the margin come back down a step towards late, without going under the minimum
+static void decay_margin(pacer_t *pacer, uint64_t late)
+{
+	if (pacer->margin > late)
+		pacer->margin -= (pacer->margin - late) / PACER_MARGIN_DECAY;
+	pacer->margin = PURPL_MAX(pacer->margin, PACER_MIN_MARGIN);
+}
+
+// Sleep for a whole number of milliseconds that ends before the margin, and learn from how late it wakes up
+static uint64_t sleep_until_margin(pacer_t *pacer, uint64_t interval, uint64_t now)
+{
+	uint64_t requested;
+	uint64_t late;
+	uint64_t start;
+
+	requested = (pacer->deadline - now - pacer->margin) / UTIL_NS_PER_MS * UTIL_NS_PER_MS;
+	if (!requested)
+		return now;
+
+	start = now;
+	thread_sleep((uint32_t)(requested / UTIL_NS_PER_MS));
+	now = util_get_time();
+
+	// Jump up to a late wake right away, since that's what overshoots the deadline, and come down slowly. A margin
+	// past half the interval would stop it from ever sleeping again, and then it could never come back down.
+	late = now - start > requested ? now - start - requested : 0;
+	if (late > pacer->margin)
+		pacer->margin = PURPL_MAX(PURPL_MIN(late, interval / 2), PACER_MIN_MARGIN);
+	else
+		decay_margin(pacer, late);
+
+	return now;
+}
+
+uint64_t pacer_wait(pacer_t *pacer, bool visible)
+{
+	uint64_t interval;
+	uint64_t start;
+	uint64_t now;
+	uint64_t behind;
+	bool slept;
+
+	if (!pacer)
+		return 0;
+
+	interval = !visible && pacer->background_interval ? pacer->background_interval : pacer->interval;
+	if (!interval) {
+		pacer->deadline = 0;
+		pacer->waited = 0;
+		pacer->error = 0;
+		return 0;
+	}
+
+	start = util_get_time();
+	now = start;
+	if (!pacer->deadline || pacer->current != interval) {
+		pacer->current = interval;
+		pacer->deadline = now;
+	}
+
+	slept = false;
+	while (pacer->deadline > now + pacer->margin + UTIL_NS_PER_MS) {
+		now = sleep_until_margin(pacer, interval, now);
+		slept = true;
+	}
+	// Frames that only spin can't measure a sleep, so the margin still has to come down on them
+	if (!slept)
+		decay_margin(pacer, 0);
+	while (now < pacer->deadline) {
+		thread_yield();
+		now = util_get_time();
+	}
+
+	pacer->waited = now - start;
+	pacer->error = now - pacer->deadline;
+
+	// A frame that ran long leaves the next one less time, unless it's so far behind that it has to be dropped
+	pacer->deadline += interval;
+	if (now > pacer->deadline) {
+		behind = (now - pacer->deadline) / interval + 1;
+		pacer->skipped += behind;
+		pacer->deadline += behind * interval;
+		METRICS_COUNTER_ADD("frame.skipped", behind);
+	}
+
+	return pacer->waited;
+}
+
+void pacer_destroy(pacer_t *pacer)
+{
+	util_free(pacer);
+}
@@ -0,0 +1,53 @@
+// Frame pacing. pacer_wait is called once a frame and waits until the next frame is due, so frames come out at a
+// steady rate instead of as fast as possible. Sleeps can wake up late by anything from tens of microseconds to a whole
+// scheduler tick, so it sleeps until a margin before the deadline and spins for the rest. The margin follows how late
+// recent sleeps have woken up, up to half an interval, and comes down on frames that don't sleep too. Deadlines are on
+// a fixed timeline rather than counted from when the last frame ended, so errors don't add up, and when frames run
+// more than one interval behind the timeline skips ahead instead of rushing to catch up. How late each frame ends
+// compared to its deadline is the pacing error.
+
+#pragma once
+
+#include "common.h"
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+
+#define PACER_LOG_PREFIX COMMON_LOG_PREFIX "PACER: "
+
+// Default frames per second while the window isn't visible
+#define PACER_DEFAULT_BACKGROUND_RATE 15
+
+// Nanoseconds of spinning before the first sleep has been measured
+#define PACER_INITIAL_MARGIN (2 * UTIL_NS_PER_MS)
+
+// Least nanoseconds of spinning, for sleeps that wake up later than usual
+#define PACER_MIN_MARGIN (100 * UTIL_NS_PER_US)
+
+// How many sleeps it takes the margin to mostly come back down after a late one
+#define PACER_MARGIN_DECAY 16
+
+// Frame pacer
+typedef struct pacer {
+	uint64_t interval; // Nanoseconds between frames, 0 for no limit
+	uint64_t background_interval; // Nanoseconds between frames while the window isn't visible, 0 for no limit
+	uint64_t current; // Interval the deadline is on, to start a new timeline when it changes
+	uint64_t deadline; // util_get_time the current frame is due to end, 0 before the first wait
+	uint64_t margin; // Nanoseconds before the deadline to stop sleeping and start spinning
+	uint64_t waited; // Nanoseconds the last wait took
+	uint64_t error; // Nanoseconds the last frame ended after its deadline
+	uint64_t skipped; // Frames the timeline skipped because frames ran long
+} pacer_t;
+
+// Create a pacer for rate frames per second, and background_rate while the window isn't visible. 0 is no limit.
+extern pacer_t *pacer_create(uint32_t rate, uint32_t background_rate);
+
+// Change the rates, which starts a new timeline on the next wait
+extern void pacer_set_rate(pacer_t *pacer, uint32_t rate, uint32_t background_rate);
+
+// Wait until the current frame is due to end, using the background rate if visible is false. Returns how many
+// nanoseconds it waited.
+extern uint64_t pacer_wait(pacer_t *pacer, bool visible);
+
+// Destroy a pacer
+extern void pacer_destroy(pacer_t *pacer);
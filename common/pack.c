@@ -2,6 +2,82 @@
 
 #include "pack.h"
 
+// A file being added to a pack
+typedef struct pack_pending {
+	char *path; // Path of the file
+	char *internal_path; // Path in the pack
+	uint64_t path_hash; // Hash of internal_path
+	pack_entry_t entry; // Sizes and hash, the rest is filled in when it's written
+	uint8_t *compressed; // Compressed contents
+} pack_pending_t;
+
+ARRAY_DECLARE(pack_pending_list, pack_pending_t)
+
+static _Atomic(pool_t *) s_pack_pool;
+
+static mutex_t s_dctx_lock = MUTEX_INITIALIZER; // Protects the idle decompression contexts
+static ZSTD_DCtx *s_dctxs[PACK_MAX_DCTXS];
+static uint32_t s_dctx_count;
+
+// Allocate memory for zstd
+static void *zstd_alloc(void *opaque, size_t size)
+{
+	return alloc_malloc(ALLOC_TAG_ZSTD, size);
+}
+
+// Free memory for zstd
+static void zstd_free(void *opaque, void *address)
+{
+	alloc_free(address);
+}
+
+const ZSTD_customMem g_pack_zstd_mem = { zstd_alloc, zstd_free, NULL };
+
+// Take an idle decompression context, or make one. ZSTD_decompress makes and frees one every time it's called.
+static ZSTD_DCtx *take_dctx(void)
+{
+	ZSTD_DCtx *dctx;
+
+	dctx = NULL;
+	mutex_lock(&s_dctx_lock);
+	if (s_dctx_count)
+		dctx = s_dctxs[--s_dctx_count];
+	mutex_unlock(&s_dctx_lock);
+
+	if (!dctx) {
+		// Idle ones are kept until the process exits
+		ALLOC_TAG_SCOPE(ALLOC_TAG_ZSTD | ALLOC_PERMANENT)
+			dctx = ZSTD_createDCtx_advanced(g_pack_zstd_mem);
+		PURPL_ASSERT(dctx);
+	}
+
+	return dctx;
+}
+
+// Give back a decompression context, freeing it if there are enough idle ones
+static void give_dctx(ZSTD_DCtx *dctx)
+{
+	mutex_lock(&s_dctx_lock);
+	if (s_dctx_count < PACK_MAX_DCTXS) {
+		s_dctxs[s_dctx_count++] = dctx;
+		dctx = NULL;
+	}
+	mutex_unlock(&s_dctx_lock);
+
+	ZSTD_freeDCtx(dctx);
+}
+
+// Allocate a zeroed pack
+static pack_file_t *alloc_pack(void)
+{
+	pack_file_t *pack;
+
+	pack = pool_calloc(pool_get(&s_pack_pool, "pack", sizeof(pack_file_t), PACK_POOL_SIZE));
+	PURPL_ASSERT(pack);
+
+	return pack;
+}
+
 pack_file_t *pack_create(const char *name, const char *src)
 {
 	pack_file_t *pack;
@@ -11,24 +87,27 @@ pack_file_t *pack_create(const char *name, const char *src)
 	if (!name || !src || !strlen(src))
 		return NULL;
 
-	pack = util_alloc(1, sizeof(pack_file_t), NULL);
+	ALLOC_PUSH_TAG(ALLOC_TAG_PACK);
+	pack = alloc_pack();
 
 	pack->name = util_normalize_path(name);
 	src2 = util_normalize_path(src);
-	PURPL_LOG(COMMON_LOG_PREFIX "Creating pack file %s_*.pak from directory %s\n", pack->name, src2);
+	LOG_INFO(LOG_SUBSYSTEM_PACK,
+		 COMMON_LOG_PREFIX "Creating pack file %s_*.pak from directory %s\n", pack->name, src2);
 
 	path = util_strfmt("%s_dir.pak", pack->name);
 	pack->dir = fopen(path, "wb+");
 	PURPL_ASSERT(pack->dir);
-	free(path);
+	util_free(path);
 
 	memcpy(pack->header.signature, PACK_SIGNATURE, PACK_SIGNATURE_LENGTH);
 	pack->header.version = PACK_VERSION;
 	pack_add_dir(pack, src2);
-	free(src2);
+	util_free(src2);
 
 	// Write the header, it's been filled in by pack_add_dir
 	pack_write(pack);
+	ALLOC_POP_TAG();
 
 	return pack;
 }
@@ -42,33 +121,39 @@ pack_file_t *pack_load(const char *name)
 	if (!name || !strlen(name))
 		return NULL;
 
-	pack = calloc(1, sizeof(pack_file_t));
-	PURPL_ASSERT(pack);
+	ALLOC_PUSH_TAG(ALLOC_TAG_PACK);
+	pack = alloc_pack();
 
 	pack->name = util_normalize_path(name);
-	PURPL_LOG(COMMON_LOG_PREFIX "Reading pack file %s_*.pak\n", pack->name);
+	LOG_INFO(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Reading pack file %s_*.pak\n", pack->name);
 
 	path = util_strfmt("%s_dir.pak", pack->name);
 	pack->dir = fopen(path, "rb");
-	free(path);
-	if (!pack->dir)
+	util_free(path);
+	if (!pack->dir) {
+		util_free(pack->name);
+		pool_free(atomic_load(&s_pack_pool), pack);
+		ALLOC_POP_TAG();
 		return NULL;
+	}
 
 	fread(&pack->header, sizeof(pack_header_t), 1, pack->dir);
 	PURPL_ASSERT(memcmp(pack->header.signature, PACK_SIGNATURE, PACK_SIGNATURE_LENGTH) == 0);
 	PURPL_ASSERT(pack->header.version == PACK_VERSION);
 
-	pack->pathbuf = calloc(pack->header.pathbuf_size, sizeof(char));
-	PURPL_ASSERT(pack->pathbuf);
-	fread(pack->pathbuf, 1, pack->header.pathbuf_size, pack->dir);
-	PURPL_LOG(COMMON_LOG_PREFIX "Read %" PRIu64 " byte path buffer\n", pack->header.pathbuf_size);
+	pack_pathbuf_push_n(&pack->pathbuf, NULL, pack->header.pathbuf_size);
+	fread(pack->pathbuf.data, 1, pack->header.pathbuf_size, pack->dir);
+	LOG_INFO(LOG_SUBSYSTEM_PACK,
+		 COMMON_LOG_PREFIX "Read %" PRIu64 " byte path buffer\n", pack->header.pathbuf_size);
 
-	pack->entries = calloc(pack->header.entry_count, sizeof(pack_entry_t));
-	PURPL_ASSERT(pack->entries);
+	pack_entries_push_n(&pack->entries, NULL, pack->header.entry_count);
+	fread(pack->entries.data, sizeof(pack_entry_t), pack->header.entry_count, pack->dir);
+	LOG_INFO(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Read %u entries\n", pack->header.entry_count);
 
+	pack_index_reserve(&pack->index, pack->header.entry_count);
 	for (i = 0; i < pack->header.entry_count; i++)
-		fread(pack->entries + i, sizeof(pack_entry_t), 1, pack->dir);
-	PURPL_LOG(COMMON_LOG_PREFIX "Read %u entries\n", pack->header.entry_count);
+		pack_index_put(&pack->index, pack->entries.data[i].path_hash, i);
+	ALLOC_POP_TAG();
 
 	return pack;
 }
@@ -80,23 +165,27 @@ void pack_write(pack_file_t *pack)
 	if (!pack)
 		return;
 
-	PURPL_LOG(COMMON_LOG_PREFIX "Writing pack %s_*.pak with %u %s and %zu %s in the path buffer\n", pack->name,
-		  pack->header.entry_count, PURPL_PLURALIZE(pack->header.entry_count, "entries", "entry"),
-		  pack->header.pathbuf_size, PURPL_PLURALIZE(pack->header.pathbuf_size, "bytes", "byte"));
+	pack->header.entry_count = (uint32_t)pack->entries.count;
+	pack->header.pathbuf_size = pack->pathbuf.count;
+
+	LOG_INFO(LOG_SUBSYSTEM_PACK,
+		 COMMON_LOG_PREFIX "Writing pack %s_*.pak with %u %s and %zu %s in the path buffer\n",
+		 pack->name, pack->header.entry_count, PURPL_PLURALIZE(pack->header.entry_count, "entries", "entry"),
+		 pack->header.pathbuf_size, PURPL_PLURALIZE(pack->header.pathbuf_size, "bytes", "byte"));
 
 	// Clear out the directory
 	path = util_strfmt("%s_dir.pak", pack->name);
 	fclose(pack->dir);
 	pack->dir = fopen(path, "wb");
-	free(path);
+	util_free(path);
 	PURPL_ASSERT(pack->dir);
 
 	fseek(pack->dir, 0, SEEK_SET);
 	fwrite(&pack->header, sizeof(pack_header_t), 1, pack->dir);
-	fwrite(pack->pathbuf, 1, pack->header.pathbuf_size, pack->dir);
-	fwrite(pack->entries, sizeof(pack_entry_t), pack->header.entry_count, pack->dir);
+	fwrite(pack->pathbuf.data, 1, pack->header.pathbuf_size, pack->dir);
+	fwrite(pack->entries.data, sizeof(pack_entry_t), pack->header.entry_count, pack->dir);
 
-	PURPL_LOG(COMMON_LOG_PREFIX "Flushing file stream\n");
+	LOG_DEBUG(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Flushing file stream\n");
 	fflush(pack->dir);
 }
 
@@ -105,43 +194,65 @@ void pack_close(pack_file_t *pack)
 	if (!pack)
 		return;
 
-	PURPL_LOG(COMMON_LOG_PREFIX "Closing pack %s_*.pak\n", pack->name);
+	LOG_INFO(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Closing pack %s_*.pak\n", pack->name);
 
-	free(pack->name);
-	free(pack->pathbuf);
-	free(pack->entries);
+	util_free(pack->name);
+	pack_pathbuf_free(&pack->pathbuf);
+	pack_entries_free(&pack->entries);
+	pack_index_free(&pack->index);
 	fclose(pack->dir);
-	free(pack);
+	pool_free(atomic_load(&s_pack_pool), pack);
 }
 
 pack_entry_t *pack_get(pack_file_t *pack, const char *path)
 {
-	uint64_t hash;
-	uint32_t i;
-	pack_entry_t *entry = NULL;
-
 	if (!pack || !path || !strlen(path))
 		return NULL;
 
-	hash = XXH3_64bits(path, strlen(path) + 1);
-	for (i = 0; i < pack->header.entry_count; i++) {
-		if (hash == pack->entries[i].path_hash) {
-			entry = pack->entries + i;
-			break;
-		}
-	}
+	return pack_get_hash(pack, ATOM_HASH(path, strlen(path)));
+}
 
-	return entry;
+pack_entry_t *pack_get_hash(pack_file_t *pack, uint64_t path_hash)
+{
+	uint32_t *idx;
+
+	if (!pack)
+		return NULL;
+
+	idx = pack_index_get(&pack->index, path_hash);
+	return idx ? pack->entries.data + *idx : NULL;
+}
+
+pack_entry_t *pack_get_atom(pack_file_t *pack, atom_t path)
+{
+	if (!pack || path == ATOM_NONE)
+		return NULL;
+
+	return pack_get_hash(pack, atom_hash(path));
 }
 
 uint8_t *pack_read(pack_file_t *pack, pack_entry_t *entry)
 {
 	uint8_t *compressed;
 	uint8_t *buf;
+
+	PURPL_PROFILE_BEGIN("pack_read");
+
+	compressed = pack_read_compressed(pack, entry);
+	buf = compressed ? pack_decompress(pack, entry, compressed) : NULL;
+	util_free(compressed);
+
+	PURPL_PROFILE_END();
+
+	return buf;
+}
+
+uint8_t *pack_read_compressed(pack_file_t *pack, pack_entry_t *entry)
+{
+	uint8_t *compressed;
 	uint16_t split_idx = 0;
 	char *split_name;
 	FILE *split;
-	uint64_t hash;
 	size_t offset;
 	size_t remaining;
 	size_t len;
@@ -149,8 +260,10 @@ uint8_t *pack_read(pack_file_t *pack, pack_entry_t *entry)
 	if (!pack || !entry)
 		return NULL;
 
-	compressed = util_alloc(entry->size, 1, NULL);
-	buf = util_alloc(entry->real_size, 1, NULL);
+	PURPL_PROFILE_BEGIN("pack_read_compressed");
+
+	ALLOC_TAG_SCOPE(ALLOC_TAG_PACK)
+		compressed = util_alloc(entry->size, 1, NULL);
 
 	offset = entry->offset;
 	remaining = entry->size;
@@ -159,17 +272,16 @@ uint8_t *pack_read(pack_file_t *pack, pack_entry_t *entry)
 		split_name = util_strfmt("%s_%0.5u.pak", pack->name, split_idx);
 		len = PURPL_MIN(PACK_SPLIT_SIZE - PACK_SPLIT_OFFSET(offset), remaining);
 
-#ifdef PACK_DEBUG
-		PURPL_LOG(COMMON_LOG_PREFIX "Reading %zu %s of file %s (%zu %s remaining, stored hash 0x%" PRIX64 ", offset 0x%" PRIu64
-			  ") from pack split %s\n",
+		LOG_TRACE(LOG_SUBSYSTEM_PACK,
+			  COMMON_LOG_PREFIX "Reading %zu %s of file %s (%zu %s remaining, stored hash 0x%" PRIX64
+					    ", offset 0x%" PRIu64 ") from pack split %s\n",
 			  len, PURPL_PLURALIZE(len, "bytes", "byte"),
 			  PACK_GET_NAME(pack, entry), remaining, PURPL_PLURALIZE(remaining, "bytes", "byte"),
 			  entry->hash, offset, split_name);
-#endif
 
 		split = fopen(split_name, "rb");
 		PURPL_ASSERT(split);
-		free(split_name);
+		util_free(split_name);
 
 		fseek(split, (long)PACK_SPLIT_OFFSET(offset), SEEK_SET);
 		fread(compressed + (offset - entry->offset), 1, len, split);
@@ -179,132 +291,208 @@ uint8_t *pack_read(pack_file_t *pack, pack_entry_t *entry)
 		offset += len;
 	}
 
-	ZSTD_decompress(buf, entry->real_size, compressed, entry->size);
-	free(compressed);
-
-	hash = XXH3_64bits(buf, entry->real_size);
-	if (hash != entry->hash) {
-		PURPL_LOG(COMMON_LOG_PREFIX "Hash 0x%" PRIX64 " does not match expected hash 0x%" PRIX64 "\n", hash, entry->hash);
-		free(buf);
-		return NULL;
-	}
-
-#ifdef PACK_DEBUG
 	if (PACK_SPLIT(offset) != split_idx) {
-		PURPL_LOG(COMMON_LOG_PREFIX "Read %u %s from pack splits %s_%0.5u-%0.5u.pak\n", entry->size,
+		LOG_TRACE(LOG_SUBSYSTEM_PACK,
+			  COMMON_LOG_PREFIX "Read %u %s from pack splits %s_%0.5u-%0.5u.pak\n", entry->size,
 			  PURPL_PLURALIZE(entry->size, "bytes", "byte"), pack->name, PACK_SPLIT(offset), split_idx);
 	} else {
-		PURPL_LOG(COMMON_LOG_PREFIX "Read %u %s from pack split %s_%0.5u.pak\n", entry->size,
+		LOG_TRACE(LOG_SUBSYSTEM_PACK,
+			  COMMON_LOG_PREFIX "Read %u %s from pack split %s_%0.5u.pak\n", entry->size,
 			  PURPL_PLURALIZE(entry->size, "bytes", "byte"), pack->name, split_idx);
 	}
-#endif
 
-	return buf;
+	METRICS_COUNTER_ADD("pack.reads", 1);
+	METRICS_COUNTER_ADD("pack.bytes_read", entry->size);
+
+	PURPL_PROFILE_END();
+
+	return compressed;
 }
 
-pack_entry_t *pack_add(pack_file_t *pack, const char *path, const char *internal_path)
+uint8_t *pack_decompress(pack_file_t *pack, pack_entry_t *entry, const uint8_t *compressed)
 {
-	char *path2;
-	char *internal_path2;
-	void *tmp;
-	size_t len;
-	size_t entry_idx;
-	pack_entry_t entry;
-	FILE *src;
-	FILE *dst;
-	uint8_t *compressed;
-	uint16_t split_idx = 0;
-	size_t offset;
-	size_t remaining;
+	ZSTD_DCtx *dctx;
+	uint8_t *buf;
+	uint64_t hash;
+	uint64_t start;
 
-	if (!pack || !path || !strlen(path) || !internal_path || !strlen(internal_path))
+	if (!pack || !entry || !compressed)
 		return NULL;
 
-	path2 = util_normalize_path(path);
-	internal_path2 = util_normalize_path(internal_path[0] == '/' ? internal_path + 1 : internal_path);
-	if (pack_get(pack, internal_path2)) {
-#ifdef PACK_DEBUG
-		PURPL_LOG(COMMON_LOG_PREFIX "Skipping file %s because it's already present\n", internal_path2);
-#endif
-		return pack_get(pack, internal_path2);
+	ALLOC_TAG_SCOPE(ALLOC_TAG_PACK)
+		buf = util_alloc(entry->real_size, 1, NULL);
+	start = util_get_time();
+	PURPL_PROFILE_SCOPE("pack_decompress") {
+		dctx = take_dctx();
+		ZSTD_decompressDCtx(dctx, buf, entry->real_size, compressed, entry->size);
+		give_dctx(dctx);
+		hash = XXH3_64bits(buf, entry->real_size);
+	}
+	METRICS_HISTOGRAM_RECORD("pack.decompress_ns", util_get_time() - start);
+	METRICS_COUNTER_ADD("pack.bytes_decompressed", entry->real_size);
+	if (hash != entry->hash) {
+		LOG_ERROR(LOG_SUBSYSTEM_PACK,
+			  COMMON_LOG_PREFIX "Hash 0x%" PRIX64 " does not match expected hash 0x%" PRIX64 "\n",
+			  hash, entry->hash);
+		util_free(buf);
+		return NULL;
 	}
-#ifdef PACK_DEBUG
-	PURPL_LOG(COMMON_LOG_PREFIX "Adding file %s to pack %s_*.pak as %s\n", path2, pack->name, internal_path2);
-#endif
 
-	memset(&entry, 0, sizeof(pack_entry_t));
-	entry.offset = PACK_OFFSET(pack);
+	return buf;
+}
 
-	pack->entries = util_alloc(++pack->header.entry_count, sizeof(pack_entry_t), pack->entries);
-	entry_idx = pack->header.entry_count - 1;
+// Read a file and compress it. This can run on any thread, so it sets its own tag.
+static void compress_file(pack_pending_t *file)
+{
+	ZSTD_CCtx *cctx;
+	FILE *src;
+	void *tmp;
 
-	len = strlen(internal_path) + 1;
-	pack->pathbuf = util_alloc(pack->header.pathbuf_size + len, sizeof(char), pack->pathbuf);
-	strncpy(pack->pathbuf + pack->header.pathbuf_size, internal_path2, len);
-	entry.path_offset = pack->header.pathbuf_size;
-	pack->header.pathbuf_size += len;
+	ALLOC_PUSH_TAG(ALLOC_TAG_PACK);
 
-	src = fopen(path2, "rb");
+	src = fopen(file->path, "rb");
 	PURPL_ASSERT(src);
-	free(path2);
-	free(internal_path2);
-	entry.real_size = util_fsize(src);
-	tmp = util_alloc(entry.real_size, 1, NULL);
+	file->entry.real_size = util_fsize(src);
+	tmp = util_alloc(file->entry.real_size, 1, NULL);
 
-	fread(tmp, 1, entry.real_size, src);
+	fread(tmp, 1, file->entry.real_size, src);
 	fclose(src);
 
-	entry.path_hash = XXH3_64bits(PACK_GET_NAME(pack, &entry), strlen(PACK_GET_NAME(pack, &entry)) + 1);
-	entry.hash = XXH3_64bits(tmp, entry.real_size);
-	entry.size = (uint32_t)ZSTD_compressBound(entry.real_size);
+	file->entry.hash = XXH3_64bits(tmp, file->entry.real_size);
+	file->entry.size = (uint32_t)ZSTD_compressBound(file->entry.real_size);
 
-	compressed = util_alloc(entry.size, 1, NULL);
+	file->compressed = util_alloc(file->entry.size, 1, NULL);
 
-	entry.size = (uint32_t)ZSTD_compress(compressed, entry.size, tmp, entry.real_size, ZSTD_btultra2);
-#ifdef PACK_DEBUG
-	PURPL_LOG(COMMON_LOG_PREFIX "Read %" PRIu64 " %s, hash 0x%" PRIX64 "X, compressed size is %u %s\n", entry.real_size,
-		  PURPL_PLURALIZE(entry.real_size, "bytes", "byte"), entry.hash, entry.size,
-		  PURPL_PLURALIZE(entry.size, "bytes", "byte"));
-#endif
-	free(tmp);
+	cctx = ZSTD_createCCtx_advanced(g_pack_zstd_mem);
+	PURPL_ASSERT(cctx);
+	file->entry.size = (uint32_t)ZSTD_compressCCtx(cctx, file->compressed, file->entry.size, tmp,
+						       file->entry.real_size, ZSTD_btultra2);
+	ZSTD_freeCCtx(cctx);
+	LOG_TRACE(LOG_SUBSYSTEM_PACK,
+		  COMMON_LOG_PREFIX "Read %" PRIu64 " %s, hash 0x%" PRIX64 "X, compressed size is %u %s\n",
+		  file->entry.real_size, PURPL_PLURALIZE(file->entry.real_size, "bytes", "byte"), file->entry.hash,
+		  file->entry.size, PURPL_PLURALIZE(file->entry.size, "bytes", "byte"));
+	util_free(tmp);
+
+	ALLOC_POP_TAG();
+}
+
+// Compress a batch of files for job_parallel_for
+static void compress_files(pack_pending_t *files, size_t start, size_t end)
+{
+	size_t i;
+
+	for (i = start; i < end; i++)
+		compress_file(&files[i]);
+}
+
+// Write a compressed file to the end of a pack and add its entry
+static pack_entry_t *append_file(pack_file_t *pack, pack_pending_t *file)
+{
+	pack_entry_t entry;
+	size_t entry_idx;
+	size_t len;
+	FILE *dst;
+	char *path;
+	uint16_t split_idx = 0;
+	size_t offset;
+	size_t remaining;
+
+	LOG_TRACE(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Adding file %s to pack %s_*.pak as %s\n", file->path,
+		  pack->name, file->internal_path);
+
+	// The padding ends up in the directory file, so it has to be zeroed rather than copied from file->entry
+	memset(&entry, 0, sizeof(pack_entry_t));
+	entry.hash = file->entry.hash;
+	entry.size = file->entry.size;
+	entry.real_size = file->entry.real_size;
+	entry.offset = PACK_OFFSET(pack);
+
+	entry_idx = pack->entries.count;
+	pack_entries_push(&pack->entries, entry);
+	pack->header.entry_count = (uint32_t)pack->entries.count;
+
+	len = strlen(file->internal_path);
+	entry.path_offset = pack->pathbuf.count;
+	entry.path_hash = file->path_hash;
+	pack_pathbuf_push_n(&pack->pathbuf, file->internal_path, len + 1);
+	pack->header.pathbuf_size = pack->pathbuf.count;
 
 	// Write the compressed data, but not the header
 	offset = entry.offset;
 	remaining = entry.size;
 	while (remaining > 0) {
 		split_idx = (uint16_t)PACK_SPLIT(offset);
-		path2 = util_strfmt("%s_%0.5u.pak", pack->name, split_idx);
+		path = util_strfmt("%s_%0.5u.pak", pack->name, split_idx);
 
 		len = PURPL_MIN(PACK_SPLIT_SIZE - PACK_SPLIT_OFFSET(offset), remaining);
-		dst = fopen(path2, "ab+");
+		dst = fopen(path, "ab+");
 		PURPL_ASSERT(dst);
-		free(path2);
+		util_free(path);
 
-		fwrite(compressed + (offset - entry.offset), 1, len, dst);
+		fwrite(file->compressed + (offset - entry.offset), 1, len, dst);
 		fclose(dst);
 
 		remaining = len >= remaining ? 0 : remaining - len;
 		offset += len;
 	}
-	free(compressed);
+	util_free(file->compressed);
+	file->compressed = NULL;
 
-#ifdef PACK_DEBUG
 	if (PACK_SPLIT(offset) != split_idx) {
-		PURPL_LOG(COMMON_LOG_PREFIX "Wrote %u %s in pack splits %u-%u\n", entry.size,
+		LOG_TRACE(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Wrote %u %s in pack splits %u-%u\n", entry.size,
 			  PURPL_PLURALIZE(entry.size, "bytes", "byte"), PACK_SPLIT(offset), split_idx);
 	} else {
-		PURPL_LOG(COMMON_LOG_PREFIX "\rWrote %u %s in pack split %u\n", entry.size, PURPL_PLURALIZE(entry.size, "bytes", "byte"),
-			  split_idx);
+		LOG_TRACE(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "\rWrote %u %s in pack split %u\n", entry.size,
+			  PURPL_PLURALIZE(entry.size, "bytes", "byte"), split_idx);
 	}
-#endif
 
-	pack->entries[entry_idx] = entry;
+	memcpy(&pack->entries.data[entry_idx], &entry, sizeof(pack_entry_t));
+	pack_index_put(&pack->index, entry.path_hash, (uint32_t)entry_idx);
 	pack->header.total_size += entry.size;
-	return pack->entries + entry_idx;
+	return pack->entries.data + entry_idx;
 }
 
-void pack_add_dir(pack_file_t *pack, const char *path)
+// Normalize the paths of a file to add, returns false if it's already in the pack
+static bool init_pending(pack_file_t *pack, pack_pending_t *file, const char *path, const char *internal_path)
+{
+	memset(file, 0, sizeof(pack_pending_t));
+	file->internal_path = util_normalize_path(internal_path[0] == '/' ? internal_path + 1 : internal_path);
+	file->path_hash = ATOM_HASH(file->internal_path, strlen(file->internal_path));
+	if (pack_get_hash(pack, file->path_hash)) {
+		LOG_TRACE(LOG_SUBSYSTEM_PACK, COMMON_LOG_PREFIX "Skipping file %s because it's already present\n",
+			  file->internal_path);
+		util_free(file->internal_path);
+		return false;
+	}
+
+	file->path = util_normalize_path(path);
+	return true;
+}
+
+pack_entry_t *pack_add(pack_file_t *pack, const char *path, const char *internal_path)
+{
+	pack_pending_t file;
+	pack_entry_t *entry;
+
+	if (!pack || !path || !strlen(path) || !internal_path || !strlen(internal_path))
+		return NULL;
+
+	if (!init_pending(pack, &file, path, internal_path))
+		return pack_get_hash(pack, file.path_hash);
+
+	compress_file(&file);
+	entry = append_file(pack, &file);
+	util_free(file.path);
+	util_free(file.internal_path);
+
+	return entry;
+}
+
+// Find the files in a directory that aren't in a pack yet
+static void find_files(pack_file_t *pack, const char *path, pack_pending_list_t *files)
 {
+	pack_pending_t file;
 	char *path2;
 	char *path3;
 	DIR *dir;
@@ -313,9 +501,6 @@ void pack_add_dir(pack_file_t *pack, const char *path)
 		struct stat st;
 #endif
 
-	if (!pack || !path || !strlen(path))
-		return;
-
 	path2 = util_normalize_path(path);
 	dir = opendir(path2);
 	PURPL_ASSERT(dir);
@@ -334,13 +519,42 @@ void pack_add_dir(pack_file_t *pack, const char *path)
 		stat(path3, &st);
 		if (S_ISDIR(st.st_mode))
 #endif
-			pack_add_dir(pack, path3);
-		else
-			pack_add(pack, path3, strchr(path3, '/') + 1);
+			find_files(pack, path3, files);
+		else if (init_pending(pack, &file, path3, strchr(path3, '/') + 1))
+			pack_pending_list_push(files, file);
 
-		free(path3);
+		util_free(path3);
 		ent = readdir(dir);
 	}
 
-	free(path2);
+	closedir(dir);
+	util_free(path2);
+}
+
+void pack_add_dir(pack_file_t *pack, const char *path)
+{
+	pack_pending_list_t files;
+	size_t count;
+	size_t i;
+	size_t j;
+
+	if (!pack || !path || !strlen(path))
+		return;
+
+	memset(&files, 0, sizeof(pack_pending_list_t));
+	find_files(pack, path, &files);
+
+	// Compress a batch in parallel, then write it in order, so the pack comes out the same every time and only one
+	// batch of compressed data is in memory
+	for (i = 0; i < files.count; i += count) {
+		count = PURPL_MIN(files.count - i, PACK_COMPRESS_BATCH);
+		job_parallel_for(count, 1, (job_for_func_t)compress_files, files.data + i);
+		for (j = i; j < i + count; j++) {
+			append_file(pack, &files.data[j]);
+			util_free(files.data[j].path);
+			util_free(files.data[j].internal_path);
+		}
+	}
+
+	pack_pending_list_free(&files);
 }
@@ -6,6 +6,13 @@
 #pragma once
 
 #include "common.h"
+#include "alloc.h"
+#include "atom.h"
+#include "container.h"
+#include "job.h"
+#include "metrics.h"
+#include "pool.h"
+#include "profile.h"
 #include "util.h"
 
 // Pack signature
@@ -17,15 +24,21 @@
 // Pack version
 #define PACK_VERSION 1
 
-// Enable logging in pack_add and pack_read
-#define PACK_DEBUG 0
+// Number of packs the pool of pack_file_ts starts with room for
+#define PACK_POOL_SIZE 16
+
+// Files pack_add_dir compresses at once before writing them
+#define PACK_COMPRESS_BATCH 64
+
+// Most idle decompression contexts kept for reuse
+#define PACK_MAX_DCTXS 16
 
 // Split data into 69 MB (nice) files to make it easier to update packs
 #define PACK_SPLIT_SIZE 72351744
 
 // Get the last entry
 #define PACK_LAST_ENTRY(pack) \
-	((pack) && (pack)->header.entry_count ? (pack)->entries + (pack)->header.entry_count - 1 : 0)
+	((pack) && (pack)->entries.count ? (pack)->entries.data + (pack)->entries.count - 1 : 0)
 
 // Get the offset of a new file's data
 #define PACK_OFFSET(pack) (PACK_LAST_ENTRY((pack)) ? PACK_LAST_ENTRY(pack)->offset + PACK_LAST_ENTRY(pack)->size : 0)
@@ -38,7 +51,7 @@
 
 // Get the name of an entry
 #define PACK_GET_NAME(pack, entry) \
-	((pack) && (entry)->path_offset < (pack)->header.pathbuf_size ? (pack)->pathbuf + (entry)->path_offset : "")
+	((pack) && (entry)->path_offset < (pack)->pathbuf.count ? (pack)->pathbuf.data + (entry)->path_offset : "")
 
 // Pack header (combined with entry_count entries and the path buffer, forms the "directory", because I couldn't be
 // bothered to think of a more accurate name)
@@ -60,15 +73,26 @@ typedef struct pack_entry {
 	uint64_t real_size; // The size of the uncompressed data in memory
 } pack_entry_t;
 
+// Path hashes are already xxHashes, so the index doesn't need to hash them again
+#define PACK_INDEX_HASH(path_hash) (path_hash)
+
+ARRAY_DECLARE(pack_pathbuf, char)
+ARRAY_DECLARE(pack_entries, pack_entry_t)
+HASHMAP_DECLARE(pack_index, uint64_t, uint32_t, PACK_INDEX_HASH, HASHMAP_EQUAL)
+
 // Pack file
 typedef struct pack_file {
 	char *name; // Path up until _dir.pak or _#####.pak
 	FILE *dir; // File stream of the directory
-	pack_header_t header; // The header
-	char *pathbuf; // Path buffer
-	pack_entry_t *entries; // The entries
+	pack_header_t header; // The header, the counts in it are updated from pathbuf and entries by pack_write
+	pack_pathbuf_t pathbuf; // Path buffer
+	pack_entries_t entries; // The entries
+	pack_index_t index; // Indices of entries by path hash
 } pack_file_t;
 
+// Allocator for zstd contexts, which charges them to ALLOC_TAG_ZSTD
+extern const ZSTD_customMem g_pack_zstd_mem;
+
 // Create a pack file
 extern pack_file_t *pack_create(const char *name, const char *src);
 
@@ -84,9 +108,22 @@ extern void pack_close(pack_file_t *pack);
 // Get a file entry from a pack. Do not pass a call to this to pack_read, because you'll want the size of the buffer returned.
 extern pack_entry_t *pack_get(pack_file_t *pack, const char *path);
 
+// Get an entry from a path hash (see ATOM_HASH)
+extern pack_entry_t *pack_get_hash(pack_file_t *pack, uint64_t path_hash);
+
+// Get an entry from an interned path, without hashing it again
+extern pack_entry_t *pack_get_atom(pack_file_t *pack, atom_t path);
+
 // Read a file from a pack
 extern uint8_t *pack_read(pack_file_t *pack, pack_entry_t *entry);
 
+// Read the compressed data of a file from a pack, entry->size bytes long. This and pack_decompress are the two halves
+// of pack_read, split up so the I/O and the decompression can be done on different threads.
+extern uint8_t *pack_read_compressed(pack_file_t *pack, pack_entry_t *entry);
+
+// Decompress and verify data read by pack_read_compressed. Doesn't free the compressed data.
+extern uint8_t *pack_decompress(pack_file_t *pack, pack_entry_t *entry, const uint8_t *compressed);
+
 // Add a file to a pack file
 extern pack_entry_t *pack_add(pack_file_t *pack, const char *path, const char *internal_path);
 
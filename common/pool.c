@@ -0,0 +1,388 @@
+// Pool allocators
+
+#include "pool.h"
+
+// Free objects a thread is holding on to for one pool
+typedef struct pool_cache {
+	uint32_t generation; // cache_generation of the pool the objects are from
+	uint32_t count; // Number of objects
+	uint32_t objects[POOL_CACHE_SIZE]; // Indices of the objects
+} pool_cache_t;
+
+static PURPL_THREAD_LOCAL pool_cache_t t_pool_caches[POOL_MAX_CACHED];
+static mutex_t s_cache_lock = MUTEX_INITIALIZER; // Protects the things below
+static bool s_cache_used[POOL_MAX_CACHED]; // Whether each cache slot belongs to a pool
+static uint32_t s_cache_generation; // Last generation handed out
+
+// Get an object from its index
+static void *get_object(pool_t *pool, uint32_t index)
+{
+	return pool->chunks[index / pool->chunk_objects]->objects + (index % pool->chunk_objects) * pool->object_size;
+}
+
+// Get the index of an object
+static uint32_t get_index(pool_t *pool, void *object)
+{
+	pool_chunk_t *chunk;
+
+	chunk = (pool_chunk_t *)((uintptr_t)object & ~(uintptr_t)(pool->chunk_size - 1));
+	PURPL_ASSERT(chunk->pool == pool);
+
+	return chunk->index * pool->chunk_objects + (uint32_t)(((uint8_t *)object - chunk->objects) / pool->object_size);
+}
+
+// Free objects hold the index of the next free object in their first 4 bytes
+static _Atomic(uint32_t) *get_next(pool_t *pool, uint32_t index)
+{
+	return get_object(pool, index);
+}
+
+// Make a new free list head from an index, changing the tag of the old head
+#define MAKE_HEAD(old, index) ((((old) >> 32) + 1) << 32 | (uint32_t)(index))
+
+// Push a chain of linked objects onto the free list
+static void push_chain(pool_t *pool, uint32_t first, uint32_t last)
+{
+	uint64_t head;
+
+	head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+	do {
+		atomic_store_explicit(get_next(pool, last), (uint32_t)head, memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, MAKE_HEAD(head, first),
+							memory_order_release, memory_order_relaxed));
+}
+
+// Pop an object from the free list
+static uint32_t pop(pool_t *pool)
+{
+	uint64_t head;
+	uint32_t index;
+	uint32_t next;
+
+	head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+	do {
+		index = (uint32_t)head;
+		if (index == POOL_INVALID_INDEX)
+			return POOL_INVALID_INDEX;
+
+		// If another thread took this object first, this might be garbage, but then the tag won't match
+		next = atomic_load_explicit(get_next(pool, index), memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, MAKE_HEAD(head, next),
+							memory_order_acquire, memory_order_acquire));
+
+	return index;
+}
+
+// Add a chunk to a pool, returns false if it can't have any more
+static bool grow(pool_t *pool)
+{
+	pool_chunk_t *chunk;
+	uint32_t count;
+	uint32_t first;
+	uint32_t i;
+
+	mutex_lock(&pool->grow_lock);
+
+	// Another thread might have grown it already
+	if ((uint32_t)atomic_load(&pool->free_head) != POOL_INVALID_INDEX) {
+		mutex_unlock(&pool->grow_lock);
+		return true;
+	}
+
+	count = (uint32_t)atomic_load_explicit(&pool->chunk_count, memory_order_relaxed);
+	if (count >= POOL_MAX_CHUNKS) {
+		mutex_unlock(&pool->grow_lock);
+		PURPL_LOG(POOL_LOG_PREFIX "Pool %s is full with %u objects\n", pool->name, count * pool->chunk_objects);
+		return false;
+	}
+
+	ALLOC_TAG_SCOPE(pool->alloc_tag)
+		chunk = util_alloc_aligned(pool->chunk_size, pool->chunk_size);
+	PURPL_ASSERT(chunk);
+	chunk->pool = pool;
+	chunk->index = count;
+	chunk->objects = (uint8_t *)chunk + PURPL_CACHE_LINE;
+	pool->chunks[count] = chunk;
+
+	first = count * pool->chunk_objects;
+	for (i = first; i < first + pool->chunk_objects - 1; i++)
+		atomic_store_explicit(get_next(pool, i), i + 1, memory_order_relaxed);
+
+	atomic_store_explicit(&pool->chunk_count, count + 1, memory_order_release);
+	push_chain(pool, first, first + pool->chunk_objects - 1);
+
+	mutex_unlock(&pool->grow_lock);
+
+	return true;
+}
+
+// Pop an object, growing the pool if there aren't any
+static uint32_t take(pool_t *pool)
+{
+	uint32_t index;
+
+	while ((index = pop(pool)) == POOL_INVALID_INDEX) {
+		if (!grow(pool))
+			return POOL_INVALID_INDEX;
+	}
+
+	return index;
+}
+
+// Count objects taken from the free list
+static void add_used(pool_t *pool, uint32_t count)
+{
+	uint_fast32_t used;
+	uint_fast32_t peak;
+
+	used = atomic_fetch_add_explicit(&pool->used, count, memory_order_relaxed) + count;
+	peak = atomic_load_explicit(&pool->peak, memory_order_relaxed);
+	while (used > peak && !atomic_compare_exchange_weak_explicit(&pool->peak, &peak, used, memory_order_relaxed,
+								      memory_order_relaxed))
+		;
+}
+
+// Get a slot for a pool's per-thread caches, or POOL_MAX_CACHED if they're all taken
+static uint32_t acquire_cache(pool_t *pool)
+{
+	uint32_t i;
+
+	mutex_lock(&s_cache_lock);
+	for (i = 0; i < POOL_MAX_CACHED && s_cache_used[i]; i++)
+		;
+	if (i < POOL_MAX_CACHED) {
+		s_cache_used[i] = true;
+		// 0 is what every thread's caches start out with, so no pool gets it
+		if (!++s_cache_generation)
+			s_cache_generation++;
+		pool->cache_generation = s_cache_generation;
+	}
+	mutex_unlock(&s_cache_lock);
+
+	return i;
+}
+
+// Let another pool use a slot
+static void release_cache(uint32_t id)
+{
+	mutex_lock(&s_cache_lock);
+	s_cache_used[id] = false;
+	mutex_unlock(&s_cache_lock);
+}
+
+// Get the calling thread's cache for a pool, emptying it if it's left over from a destroyed pool with the same slot
+static pool_cache_t *get_cache(pool_t *pool)
+{
+	pool_cache_t *cache;
+
+	cache = &t_pool_caches[pool->cache_id];
+	if (cache->generation != pool->cache_generation) {
+		cache->generation = pool->cache_generation;
+		cache->count = 0;
+	}
+
+	return cache;
+}
+
+// Give the oldest count objects in a thread's cache back to the free list
+static void flush(pool_t *pool, pool_cache_t *cache, uint32_t count)
+{
+	uint32_t i;
+
+	if (!count)
+		return;
+
+	for (i = 0; i < count - 1; i++)
+		atomic_store_explicit(get_next(pool, cache->objects[i]), cache->objects[i + 1], memory_order_relaxed);
+	push_chain(pool, cache->objects[0], cache->objects[count - 1]);
+	atomic_fetch_sub_explicit(&pool->used, count, memory_order_relaxed);
+
+	cache->count -= count;
+	memmove(cache->objects, cache->objects + count, cache->count * sizeof(uint32_t));
+}
+
+pool_t *pool_create(const char *name, size_t object_size, uint32_t initial_count)
+{
+	pool_t *pool;
+
+	if (!name || !object_size)
+		return NULL;
+
+	pool = util_alloc_aligned(sizeof(pool_t), PURPL_CACHE_LINE);
+	PURPL_ASSERT(pool);
+	memset(pool, 0, sizeof(pool_t));
+
+	strncpy(pool->name, name, PURPL_ARRSIZE(pool->name) - 1);
+	pool->alloc_tag = alloc_get_tag();
+
+	// Objects are at least big enough to hold a free list link, and keep 16 byte alignment if they're big enough
+	pool->object_size = PURPL_MAX(object_size, sizeof(uint32_t));
+	pool->object_size = (pool->object_size + 7) & ~(size_t)7;
+	if (pool->object_size >= 16)
+		pool->object_size = (pool->object_size + 15) & ~(size_t)15;
+
+	pool->chunk_size = POOL_CHUNK_SIZE;
+	while (pool->chunk_size - PURPL_CACHE_LINE < pool->object_size * 16)
+		pool->chunk_size *= 2;
+	pool->chunk_objects = (uint32_t)((pool->chunk_size - PURPL_CACHE_LINE) / pool->object_size);
+
+	pool->cache_id = acquire_cache(pool);
+	if (pool->cache_id >= POOL_MAX_CACHED)
+		PURPL_LOG(POOL_LOG_PREFIX "Pool %s won't have per-thread caches, there are already %d pools\n", name,
+			  POOL_MAX_CACHED);
+
+	atomic_init(&pool->free_head, POOL_INVALID_INDEX);
+	mutex_init(&pool->grow_lock);
+
+	while (atomic_load(&pool->chunk_count) * pool->chunk_objects < initial_count) {
+		if (!grow(pool))
+			break;
+	}
+
+	return pool;
+}
+
+pool_t *pool_get(_Atomic(pool_t *) *pool, const char *name, size_t object_size, uint32_t initial_count)
+{
+	pool_t *existing;
+	pool_t *new_pool;
+
+	if (!pool)
+		return NULL;
+
+	existing = atomic_load_explicit(pool, memory_order_acquire);
+	if (existing)
+		return existing;
+
+	// Shared pools are never destroyed
+	ALLOC_TAG_SCOPE(alloc_get_tag() | ALLOC_PERMANENT)
+		new_pool = pool_create(name, object_size, initial_count);
+	if (!atomic_compare_exchange_strong(pool, &existing, new_pool)) {
+		// Another thread made it first
+		pool_destroy(new_pool);
+		return existing;
+	}
+
+	return new_pool;
+}
+
+void *pool_alloc(pool_t *pool)
+{
+	pool_cache_t *cache;
+	uint32_t index;
+
+	if (!pool)
+		return NULL;
+
+	if (pool->cache_id >= POOL_MAX_CACHED) {
+		index = take(pool);
+		if (index == POOL_INVALID_INDEX)
+			return NULL;
+		add_used(pool, 1);
+		METRICS_COUNTER_ADD("pool.allocations", 1);
+		return get_object(pool, index);
+	}
+
+	cache = get_cache(pool);
+	if (!cache->count) {
+		// Take half a cache's worth, so the next few allocations don't touch the shared list
+		index = take(pool);
+		if (index == POOL_INVALID_INDEX)
+			return NULL;
+		cache->objects[cache->count++] = index;
+		while (cache->count < POOL_CACHE_SIZE / 2 && (index = pop(pool)) != POOL_INVALID_INDEX)
+			cache->objects[cache->count++] = index;
+		add_used(pool, cache->count);
+		METRICS_COUNTER_ADD("pool.cache_misses", 1);
+	}
+
+	METRICS_COUNTER_ADD("pool.allocations", 1);
+	return get_object(pool, cache->objects[--cache->count]);
+}
+
+void *pool_calloc(pool_t *pool)
+{
+	void *object;
+
+	object = pool_alloc(pool);
+	if (object)
+		memset(object, 0, pool->object_size);
+
+	return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	pool_cache_t *cache;
+	uint32_t index;
+
+	if (!pool || !object)
+		return;
+
+	index = get_index(pool, object);
+
+	if (pool->cache_id >= POOL_MAX_CACHED) {
+		push_chain(pool, index, index);
+		atomic_fetch_sub_explicit(&pool->used, 1, memory_order_relaxed);
+		return;
+	}
+
+	cache = get_cache(pool);
+	if (cache->count == POOL_CACHE_SIZE)
+		flush(pool, cache, POOL_CACHE_SIZE / 2);
+	cache->objects[cache->count++] = index;
+}
+
+void pool_flush_cache(pool_t *pool)
+{
+	pool_cache_t *cache;
+
+	if (!pool || pool->cache_id >= POOL_MAX_CACHED)
+		return;
+
+	cache = get_cache(pool);
+	flush(pool, cache, cache->count);
+}
+
+void pool_get_stats(pool_t *pool, pool_stats_t *stats)
+{
+	if (!pool || !stats)
+		return;
+
+	stats->object_size = pool->object_size;
+	stats->chunks = (uint32_t)atomic_load(&pool->chunk_count);
+	stats->capacity = stats->chunks * pool->chunk_objects;
+	stats->used = (uint32_t)atomic_load(&pool->used);
+	stats->peak = (uint32_t)atomic_load(&pool->peak);
+	stats->occupancy = stats->capacity ? PURPL_PERCENT(stats->used, stats->capacity) : 0.0;
+}
+
+void pool_log_stats(pool_t *pool)
+{
+	pool_stats_t stats;
+
+	if (!pool)
+		return;
+
+	pool_get_stats(pool, &stats);
+	PURPL_LOG(POOL_LOG_PREFIX "Pool %s: %u/%u %zu byte objects used (%.2lf%%), peak %u, %u %s\n", pool->name,
+		  stats.used, stats.capacity, stats.object_size, stats.occupancy, stats.peak, stats.chunks,
+		  PURPL_PLURALIZE(stats.chunks, "chunks", "chunk"));
+}
+
+void pool_destroy(pool_t *pool)
+{
+	uint32_t i;
+
+	if (!pool)
+		return;
+
+	// Caches that still have objects from this pool are emptied by the next pool to get the slot
+	if (pool->cache_id < POOL_MAX_CACHED)
+		release_cache(pool->cache_id);
+
+	for (i = 0; i < atomic_load(&pool->chunk_count); i++)
+		util_free_aligned(pool->chunks[i]);
+	mutex_destroy(&pool->grow_lock);
+	util_free_aligned(pool);
+}
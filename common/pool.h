@@ -0,0 +1,94 @@
+// Pool allocators for objects of the same size. Objects live in large chunks, the free ones are kept in a lock-free
+// list shared by every thread, and each thread keeps a few free objects of each pool to itself so most allocations
+// don't touch anything shared.
+
+#pragma once
+
+#include "common.h"
+#include "alloc.h"
+#include "metrics.h"
+#include "thread.h"
+#include "util.h"
+
+#define POOL_LOG_PREFIX COMMON_LOG_PREFIX "POOL: "
+
+// Size of a chunk of objects, chunks are aligned to their size so an object's chunk can be found from its address
+#define POOL_CHUNK_SIZE (64 * 1024)
+
+// Most chunks a pool can have
+#define POOL_MAX_CHUNKS 4096
+
+// Most pools that can use per-thread caches at once, pools created while this many exist work without them
+#define POOL_MAX_CACHED 64
+
+// Number of free objects each thread can keep for each pool
+#define POOL_CACHE_SIZE 32
+
+// Marks the end of the free list
+#define POOL_INVALID_INDEX UINT32_MAX
+
+// Header at the start of each chunk
+typedef struct pool_chunk {
+	struct pool *pool; // Pool the chunk belongs to
+	uint32_t index; // Index of the chunk in the pool
+	uint8_t *objects; // First object in the chunk
+} pool_chunk_t;
+
+// A pool
+typedef struct pool {
+	char name[32]; // Name of the pool, for stats and logging
+	size_t object_size; // Size of each object, at least the requested size
+	size_t chunk_size; // Size of each chunk
+	uint32_t chunk_objects; // Number of objects in each chunk
+	uint32_t cache_id; // Slot of the pool in the per-thread caches, POOL_MAX_CACHED if it has none
+	uint32_t cache_generation; // Unique to each pool with a slot, so old pools' leftover caches are dropped
+	uint8_t alloc_tag; // Allocation tag of whatever made the pool, which its chunks are charged to
+
+	// Head of the free list. The low 32 bits are an object index, the high 32 bits are a tag that changes every time
+	// the head does, so a head that was popped and pushed back between a load and a compare exchange doesn't look
+	// unchanged.
+	PURPL_CACHE_ALIGN atomic_uint_fast64_t free_head;
+
+	PURPL_CACHE_ALIGN atomic_uint_fast32_t used; // Objects not in the shared free list (in use or in thread caches)
+	atomic_uint_fast32_t peak; // Most objects that have been out of the shared free list at once
+	atomic_uint_fast32_t chunk_count; // Number of chunks
+	mutex_t grow_lock; // Held while adding a chunk
+	pool_chunk_t *chunks[POOL_MAX_CHUNKS]; // Chunks, only written under grow_lock before chunk_count is increased
+} pool_t;
+
+// Statistics about a pool
+typedef struct pool_stats {
+	size_t object_size; // Size of each object
+	uint32_t capacity; // Objects that fit in the current chunks
+	uint32_t used; // Objects in use or held in thread caches
+	uint32_t peak; // Highest value of used
+	uint32_t chunks; // Number of chunks
+	double occupancy; // used as a percentage of capacity
+} pool_stats_t;
+
+// Create a pool for objects of the given size. initial_count objects are allocated up front.
+extern pool_t *pool_create(const char *name, size_t object_size, uint32_t initial_count);
+
+// Get a pool stored in a static variable, creating it the first time. Safe to call from multiple threads.
+extern pool_t *pool_get(_Atomic(pool_t *) *pool, const char *name, size_t object_size, uint32_t initial_count);
+
+// Allocate an object, its contents are undefined
+extern void *pool_alloc(pool_t *pool);
+
+// Allocate a zeroed object
+extern void *pool_calloc(pool_t *pool);
+
+// Return an object to its pool
+extern void pool_free(pool_t *pool, void *object);
+
+// Put the calling thread's cached objects back in the shared free list, call before a thread that used the pool exits
+extern void pool_flush_cache(pool_t *pool);
+
+// Get statistics about a pool
+extern void pool_get_stats(pool_t *pool, pool_stats_t *stats);
+
+// Log a pool's statistics
+extern void pool_log_stats(pool_t *pool);
+
+// Destroy a pool and every object in it, no other threads can be using it
+extern void pool_destroy(pool_t *pool);
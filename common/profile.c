@@ -0,0 +1,235 @@
+// Instrumented CPU profiler
+
+#include "profile.h"
+
+// Part of a thread's buffer
+typedef struct profile_block {
+	profile_event_t events[PROFILE_BLOCK_EVENTS]; // Events
+	atomic_uint_fast32_t count; // Number of events, stored after each one is written so profile_dump can read them
+	_Atomic(struct profile_block *) next; // Next block
+} profile_block_t;
+
+// Everything a thread has recorded
+typedef struct profile_thread {
+	uint64_t id; // ID of the thread
+	profile_block_t *first; // First block
+	profile_block_t *current; // Block being written to, only touched by the thread
+	uint32_t block_count; // Number of blocks, only touched by the thread
+	struct profile_thread *next; // Next thread in s_threads
+} profile_thread_t;
+
+// A section that hasn't ended yet
+typedef struct profile_open {
+	const char *name; // Name
+	uint64_t start; // When it started, 0 if it isn't being recorded
+} profile_open_t;
+
+static atomic_bool s_enabled;
+static _Atomic(profile_thread_t *) s_threads;
+static atomic_uint_fast64_t s_dropped;
+
+static PURPL_THREAD_LOCAL profile_thread_t *t_profile_thread;
+static PURPL_THREAD_LOCAL profile_open_t t_profile_open[PROFILE_MAX_DEPTH];
+static PURPL_THREAD_LOCAL uint32_t t_profile_depth;
+
+// Allocate a block
+static profile_block_t *new_block(void)
+{
+	profile_block_t *block;
+
+	block = util_alloc(1, sizeof(profile_block_t), NULL);
+	atomic_init(&block->count, 0);
+	atomic_init(&block->next, NULL);
+
+	return block;
+}
+
+// Get the calling thread's buffer, making it the first time
+static profile_thread_t *get_thread(void)
+{
+	profile_thread_t *thread;
+
+	if (t_profile_thread)
+		return t_profile_thread;
+
+	thread = util_alloc(1, sizeof(profile_thread_t), NULL);
+	thread->id = thread_get_id();
+	thread->first = new_block();
+	thread->current = thread->first;
+	thread->block_count = 1;
+
+	thread->next = atomic_load_explicit(&s_threads, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&s_threads, &thread->next, thread, memory_order_release,
+						      memory_order_relaxed))
+		;
+
+	t_profile_thread = thread;
+	return thread;
+}
+
+// Add an event to the calling thread's buffer
+static void record(const char *name, uint64_t start, uint64_t end)
+{
+	profile_thread_t *thread;
+	profile_block_t *block;
+	profile_event_t *event;
+	uint32_t count;
+
+	thread = get_thread();
+	block = thread->current;
+	count = (uint32_t)atomic_load_explicit(&block->count, memory_order_relaxed);
+	if (count >= PROFILE_BLOCK_EVENTS) {
+		if (thread->block_count >= PROFILE_MAX_BLOCKS) {
+			atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+			return;
+		}
+
+		thread->current = new_block();
+		thread->block_count++;
+		atomic_store_explicit(&block->next, thread->current, memory_order_release);
+		block = thread->current;
+		count = 0;
+	}
+
+	event = &block->events[count];
+	event->name = name;
+	event->start = start;
+	event->duration = end - start;
+	atomic_store_explicit(&block->count, count + 1, memory_order_release);
+}
+
+void profile_begin(const char *name)
+{
+	uint32_t depth;
+
+	// Sections are counted even when they aren't recorded, so ends always match the right beginning
+	depth = t_profile_depth++;
+	if (depth >= PROFILE_MAX_DEPTH)
+		return;
+
+	t_profile_open[depth].name = name;
+	t_profile_open[depth].start = atomic_load_explicit(&s_enabled, memory_order_relaxed) ? util_get_time() : 0;
+}
+
+void profile_end(void)
+{
+	profile_open_t *open;
+	uint64_t end;
+	uint32_t depth;
+
+	if (!t_profile_depth)
+		return;
+
+	end = util_get_time();
+	depth = --t_profile_depth;
+	if (depth >= PROFILE_MAX_DEPTH) {
+		if (atomic_load_explicit(&s_enabled, memory_order_relaxed))
+			atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	open = &t_profile_open[depth];
+	if (open->start)
+		record(open->name, open->start, end);
+}
+
+void profile_set_enabled(bool enabled)
+{
+	atomic_store(&s_enabled, enabled);
+}
+
+bool profile_is_enabled(void)
+{
+	return atomic_load(&s_enabled);
+}
+
+// Write a string for JSON
+static void write_string(FILE *file, const char *str)
+{
+	fputc('"', file);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(file, "\\%c", *str);
+		else if ((uint8_t)*str < ' ')
+			fprintf(file, "\\u%04x", (uint8_t)*str);
+		else
+			fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+bool profile_dump(const char *path)
+{
+	profile_thread_t *thread;
+	profile_block_t *block;
+	profile_event_t *event;
+	uint64_t count;
+	uint32_t block_count;
+	uint32_t i;
+	FILE *file;
+
+	if (!path)
+		return false;
+
+	file = fopen(path, "ab");
+	if (!file) {
+		PURPL_LOG(PROFILE_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0)
+		fputs("[\n", file);
+
+	count = 0;
+	for (thread = atomic_load_explicit(&s_threads, memory_order_acquire); thread; thread = thread->next) {
+		block = thread->first;
+		while (block) {
+			// Events past this might still be being written
+			block_count = (uint32_t)atomic_load_explicit(&block->count, memory_order_acquire);
+			for (i = 0; i < block_count; i++) {
+				event = &block->events[i];
+				fputs("{\"name\":", file);
+				write_string(file, event->name);
+				fprintf(file,
+					",\"cat\":\"purpl\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu64
+					",\"ts\":%.3lf,\"dur\":%.3lf},\n",
+					thread->id, (double)event->start / UTIL_NS_PER_US,
+					(double)event->duration / UTIL_NS_PER_US);
+			}
+			count += block_count;
+			block = atomic_load_explicit(&block->next, memory_order_acquire);
+		}
+	}
+
+	fclose(file);
+
+	PURPL_LOG(PROFILE_LOG_PREFIX "Wrote %" PRIu64 " %s to %s, %" PRIu64 " dropped\n", count,
+		  PURPL_PLURALIZE(count, "events", "event"), path, (uint64_t)atomic_load(&s_dropped));
+
+	return true;
+}
+
+void profile_shutdown(void)
+{
+	profile_thread_t *thread;
+	profile_thread_t *next_thread;
+	profile_block_t *block;
+	profile_block_t *next_block;
+
+	thread = atomic_exchange(&s_threads, NULL);
+	while (thread) {
+		next_thread = thread->next;
+		block = thread->first;
+		while (block) {
+			next_block = atomic_load(&block->next);
+			util_free(block);
+			block = next_block;
+		}
+		util_free(thread);
+		thread = next_thread;
+	}
+
+	t_profile_thread = NULL;
+	atomic_store(&s_dropped, 0);
+}
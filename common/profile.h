@@ -0,0 +1,79 @@
+// Instrumented CPU profiler. Code marks sections with PURPL_PROFILE_SCOPE or PURPL_PROFILE_BEGIN and PURPL_PROFILE_END,
+// which record into a buffer that belongs to the calling thread without taking any locks, and profile_dump writes
+// them out in the Chrome trace format, which chrome://tracing and ui.perfetto.dev can open. The markers are compiled
+// out unless PURPL_PROFILE is defined, which it is in debug builds, and record nothing until profile_set_enabled is
+// called, which is done in developer mode. Since common is a static library, the launcher and the engine each have
+// their own profiler, and both append to the same file.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "thread.h"
+#include "util.h"
+
+#define PROFILE_LOG_PREFIX COMMON_LOG_PREFIX "PROFILE: "
+
+// Whether the markers are compiled in
+#ifndef PURPL_PROFILE
+#ifdef PURPL_DEBUG
+#define PURPL_PROFILE 1
+#endif
+#endif
+
+// Name of the trace written in the base directory
+#define PROFILE_FILE_NAME "profile.json"
+
+// Number of events in each block of a thread's buffer
+#define PROFILE_BLOCK_EVENTS 4096
+
+// Most blocks a thread can fill, after that its events are dropped
+#define PROFILE_MAX_BLOCKS 256
+
+// Deepest sections can be nested, deeper ones are dropped
+#define PROFILE_MAX_DEPTH 64
+
+// A finished section
+typedef struct profile_event {
+	const char *name; // Name, which has to last as long as the program
+	uint64_t start; // util_get_time when it started
+	uint64_t duration; // Nanoseconds it took
+} profile_event_t;
+
+#ifdef PURPL_PROFILE
+// Start a section, which has to be ended on the same thread
+#define PURPL_PROFILE_BEGIN(name) profile_begin(name)
+
+// End the innermost section
+#define PURPL_PROFILE_END() profile_end()
+
+// Profile the following statement or block as a section. Leaving the block early with break, return or goto skips
+// ending it, so use PURPL_PROFILE_BEGIN and PURPL_PROFILE_END for those.
+#define PURPL_PROFILE_SCOPE(name)                                                                            \
+	for (int profile_scope_once_ = (profile_begin(name), 1); profile_scope_once_;                       \
+	     profile_scope_once_ = 0, profile_end())
+#else
+#define PURPL_PROFILE_BEGIN(name) ((void)0)
+#define PURPL_PROFILE_END() ((void)0)
+#define PURPL_PROFILE_SCOPE(name)
+#endif
+
+// Start a section, use the macros instead
+extern void profile_begin(const char *name);
+
+// End the innermost section, use the macros instead
+extern void profile_end(void);
+
+// Start or stop recording. Sections that started while it was stopped aren't recorded.
+extern void profile_set_enabled(bool enabled);
+
+// Get whether sections are being recorded
+extern bool profile_is_enabled(void);
+
+// Append every event recorded so far to a Chrome trace. The JSON array is left open so other modules can append to
+// it too, which the trace viewers accept. Returns false if the file can't be opened.
+extern bool profile_dump(const char *path);
+
+// Free every thread's buffer. No other threads can be recording when this is called.
+extern void profile_shutdown(void);
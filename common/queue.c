@@ -0,0 +1,343 @@
+// Bounded lock-free queues
+
+#include "queue.h"
+
+// Round a capacity up to a power of 2
+static size_t round_capacity(size_t capacity)
+{
+	size_t rounded;
+
+	rounded = 1;
+	while (rounded < capacity)
+		rounded <<= 1;
+
+	return rounded;
+}
+
+spsc_queue_t *spsc_queue_create(size_t capacity, size_t size)
+{
+	spsc_queue_t *queue;
+
+	if (!capacity || !size)
+		return NULL;
+
+	queue = util_alloc_aligned(sizeof(spsc_queue_t), PURPL_CACHE_LINE);
+	memset(queue, 0, sizeof(spsc_queue_t));
+	queue->capacity = round_capacity(capacity);
+	queue->size = size;
+	queue->items = util_alloc(queue->capacity, size, NULL);
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+
+	return queue;
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, const void *item)
+{
+	size_t tail;
+
+	if (!queue || !item)
+		return false;
+
+	tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	if (tail - queue->cached_head >= queue->capacity) {
+		// Acquire so the consumer is done copying out of the slot
+		queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+		if (tail - queue->cached_head >= queue->capacity)
+			return false;
+	}
+
+	memcpy(queue->items + (tail & (queue->capacity - 1)) * queue->size, item, queue->size);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, void *item)
+{
+	size_t head;
+
+	if (!queue || !item)
+		return false;
+
+	head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	if (head == queue->cached_tail) {
+		// Acquire so the item is fully copied in
+		queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+		if (head == queue->cached_tail)
+			return false;
+	}
+
+	memcpy(item, queue->items + (head & (queue->capacity - 1)) * queue->size, queue->size);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+size_t spsc_queue_get_count(spsc_queue_t *queue)
+{
+	size_t head;
+	size_t tail;
+
+	if (!queue)
+		return 0;
+
+	// Head first, so this can't catch tail before a pop moves head past it
+	head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	return tail - head;
+}
+
+void spsc_queue_destroy(spsc_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	util_free(queue->items);
+	util_free_aligned(queue);
+}
+
+// Get a cell's sequence number
+static inline atomic_size_t *get_sequence(mpmc_queue_t *queue, size_t index)
+{
+	return (atomic_size_t *)(queue->cells + (index & (queue->capacity - 1)) * queue->stride);
+}
+
+// Set up a queue that's already allocated
+static void init_mpmc(mpmc_queue_t *queue, size_t capacity, size_t size)
+{
+	size_t i;
+
+	queue->capacity = round_capacity(capacity);
+	queue->size = size;
+	queue->stride = (sizeof(atomic_size_t) + size + sizeof(atomic_size_t) - 1) & ~(sizeof(atomic_size_t) - 1);
+	queue->cells = util_alloc(queue->capacity, queue->stride, NULL);
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+
+	// A cell is ready to push to when its sequence number matches tail, so they start at their index
+	for (i = 0; i < queue->capacity; i++)
+		atomic_init(get_sequence(queue, i), i);
+}
+
+mpmc_queue_t *mpmc_queue_create(size_t capacity, size_t size)
+{
+	mpmc_queue_t *queue;
+
+	if (capacity < 2 || !size)
+		return NULL;
+
+	queue = util_alloc_aligned(sizeof(mpmc_queue_t), PURPL_CACHE_LINE);
+	memset(queue, 0, sizeof(mpmc_queue_t));
+	init_mpmc(queue, capacity, size);
+
+	return queue;
+}
+
+bool mpmc_queue_push(mpmc_queue_t *queue, const void *item)
+{
+	atomic_size_t *sequence;
+	intptr_t difference;
+	size_t tail;
+
+	if (!queue || !item)
+		return false;
+
+	tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	while (true) {
+		sequence = get_sequence(queue, tail);
+		difference = (intptr_t)atomic_load_explicit(sequence, memory_order_acquire) - (intptr_t)tail;
+		if (difference == 0) {
+			// The cell's free, try to claim it
+			if (atomic_compare_exchange_weak_explicit(&queue->tail, &tail, tail + 1, memory_order_relaxed,
+								  memory_order_relaxed))
+				break;
+		} else if (difference < 0) {
+			// The cell still has the item from the last lap in it
+			return false;
+		} else {
+			// Another thread pushed here first
+			tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+		}
+	}
+
+	memcpy(sequence + 1, item, queue->size);
+	atomic_store_explicit(sequence, tail + 1, memory_order_release);
+
+	return true;
+}
+
+bool mpmc_queue_pop(mpmc_queue_t *queue, void *item)
+{
+	atomic_size_t *sequence;
+	intptr_t difference;
+	size_t head;
+
+	if (!queue || !item)
+		return false;
+
+	head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	while (true) {
+		sequence = get_sequence(queue, head);
+		difference = (intptr_t)atomic_load_explicit(sequence, memory_order_acquire) - (intptr_t)(head + 1);
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&queue->head, &head, head + 1, memory_order_relaxed,
+								  memory_order_relaxed))
+				break;
+		} else if (difference < 0) {
+			// Nothing's been pushed to the cell yet
+			return false;
+		} else {
+			head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+		}
+	}
+
+	memcpy(item, sequence + 1, queue->size);
+
+	// Ready for the push on the next lap
+	atomic_store_explicit(sequence, head + queue->capacity, memory_order_release);
+
+	return true;
+}
+
+size_t mpmc_queue_get_count(mpmc_queue_t *queue)
+{
+	size_t head;
+	size_t tail;
+
+	if (!queue)
+		return 0;
+
+	// Pops can move head past the tail that was read, so clamp it
+	head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+	return tail > head ? PURPL_MIN(tail - head, queue->capacity) : 0;
+}
+
+void mpmc_queue_destroy(mpmc_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	util_free(queue->cells);
+	util_free_aligned(queue);
+}
+
+blocking_queue_t *blocking_queue_create(size_t capacity, size_t size)
+{
+	blocking_queue_t *queue;
+
+	if (capacity < 2 || !size)
+		return NULL;
+
+	queue = util_alloc_aligned(sizeof(blocking_queue_t), PURPL_CACHE_LINE);
+	memset(queue, 0, sizeof(blocking_queue_t));
+	init_mpmc(&queue->queue, capacity, size);
+	atomic_init(&queue->pushes, 0);
+	atomic_init(&queue->pop_waiters, 0);
+	atomic_init(&queue->pops, 0);
+	atomic_init(&queue->push_waiters, 0);
+
+	return queue;
+}
+
+// Wake a thread waiting on counter if there are any. The fence pairs with the one in run_or_wait: either this sees
+// the waiter, or the waiter's second attempt sees what this thread just did to the queue.
+static void wake_waiter(_Atomic(uint32_t) *counter, atomic_uint_fast32_t *waiters)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(waiters, memory_order_acquire)) {
+		atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+		futex_wake(counter, false);
+	}
+}
+
+// Run an operation, and if it fails, wait on counter for another thread to do something that might let it succeed.
+// Returns false if timeout milliseconds passed before the operation succeeded.
+static bool run_or_wait(blocking_queue_t *queue, bool (*operation)(mpmc_queue_t *queue, void *item), void *item,
+			_Atomic(uint32_t) *counter, atomic_uint_fast32_t *waiters, uint32_t timeout)
+{
+	uint64_t deadline;
+	uint64_t now;
+	uint32_t spins;
+	uint32_t seen;
+	bool succeeded;
+	bool timed_out;
+
+	// The other side is usually quick, so try a few more times before paying for a system call
+	for (spins = 0; spins < QUEUE_SPIN_COUNT; spins++) {
+		if (operation(&queue->queue, item))
+			return true;
+		if (!timeout)
+			return false;
+		thread_yield();
+	}
+
+	deadline = timeout == QUEUE_WAIT_FOREVER ? UINT64_MAX : util_get_time() + timeout * UTIL_NS_PER_MS;
+	timed_out = false;
+	do {
+		if (timed_out)
+			return false;
+
+		// Read counter before becoming a waiter, so increments from threads that see this one aren't missed
+		seen = atomic_load_explicit(counter, memory_order_relaxed);
+		atomic_fetch_add_explicit(waiters, 1, memory_order_release);
+		atomic_thread_fence(memory_order_seq_cst);
+		succeeded = operation(&queue->queue, item);
+		if (!succeeded) {
+			if (deadline == UINT64_MAX) {
+				futex_wait(counter, seen, QUEUE_WAIT_FOREVER);
+			} else {
+				now = util_get_time();
+				timed_out = now >= deadline ||
+					    !futex_wait(counter, seen,
+							(uint32_t)PURPL_MAX((deadline - now) / UTIL_NS_PER_MS, 1));
+			}
+		}
+		atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+	} while (!succeeded && !operation(&queue->queue, item));
+
+	return true;
+}
+
+// Adapts mpmc_queue_push to the operation run_or_wait takes
+static bool push_operation(mpmc_queue_t *queue, void *item)
+{
+	return mpmc_queue_push(queue, item);
+}
+
+bool blocking_queue_push(blocking_queue_t *queue, const void *item, uint32_t timeout)
+{
+	if (!queue || !item)
+		return false;
+
+	// The item isn't written to, the cast is only so pushing and popping can share run_or_wait
+	if (!run_or_wait(queue, push_operation, (void *)item, &queue->pops, &queue->push_waiters, timeout))
+		return false;
+
+	wake_waiter(&queue->pushes, &queue->pop_waiters);
+	return true;
+}
+
+bool blocking_queue_pop(blocking_queue_t *queue, void *item, uint32_t timeout)
+{
+	if (!queue || !item)
+		return false;
+
+	if (!run_or_wait(queue, mpmc_queue_pop, item, &queue->pushes, &queue->pop_waiters, timeout))
+		return false;
+
+	wake_waiter(&queue->pops, &queue->push_waiters);
+	return true;
+}
+
+void blocking_queue_destroy(blocking_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	util_free(queue->queue.cells);
+	util_free_aligned(queue);
+}
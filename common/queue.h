@@ -0,0 +1,97 @@
+// Bounded lock-free queues. spsc_queue_t is a ring for one producer thread and one consumer thread, where each side
+// only writes its own index and keeps a copy of the other one so it only has to read it when the ring looks full or
+// empty. mpmc_queue_t is Dmitry Vyukov's bounded queue, where every cell has a sequence number that says whether it's
+// ready to be pushed to or popped from for the current lap of the ring, so any number of threads can push and pop with
+// one compare and swap each. Items are copied in and out, and the indices written by different threads are on
+// separate cache lines. Pushing to a full queue or popping from an empty one fails instead of waiting. blocking_queue_t
+// wraps an MPMC queue for threads that would rather sleep, and waits on a futex until the other side makes progress
+// after a few tries. Waiters are counted so pushing and popping only make a system call when someone is asleep.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "thread.h"
+#include "util.h"
+
+// Times blocking_queue_push and blocking_queue_pop try again before sleeping
+#define QUEUE_SPIN_COUNT 16
+
+// Wait forever in blocking_queue_push and blocking_queue_pop
+#define QUEUE_WAIT_FOREVER UINT32_MAX
+
+// Single producer, single consumer queue
+typedef struct spsc_queue {
+	PURPL_CACHE_ALIGN atomic_size_t head; // Next item to pop, only written by the consumer
+	size_t cached_tail; // The consumer's copy of tail
+	PURPL_CACHE_ALIGN atomic_size_t tail; // Where the next item is pushed, only written by the producer
+	size_t cached_head; // The producer's copy of head
+	PURPL_CACHE_ALIGN uint8_t *items; // Ring of items
+	size_t capacity; // Number of items the ring holds, a power of 2
+	size_t size; // Size of each item
+} spsc_queue_t;
+
+// Multiple producer, multiple consumer queue
+typedef struct mpmc_queue {
+	PURPL_CACHE_ALIGN atomic_size_t head; // Next cell to pop
+	PURPL_CACHE_ALIGN atomic_size_t tail; // Next cell to push
+	PURPL_CACHE_ALIGN uint8_t *cells; // Ring of cells, each a sequence number followed by an item
+	size_t capacity; // Number of cells, a power of 2
+	size_t size; // Size of each item
+	size_t stride; // Size of each cell
+} mpmc_queue_t;
+
+// MPMC queue that can be waited on
+typedef struct blocking_queue {
+	mpmc_queue_t queue; // Items
+	PURPL_CACHE_ALIGN _Atomic(uint32_t) pushes; // Incremented by pushes while something's waiting to pop
+	atomic_uint_fast32_t pop_waiters; // Threads waiting on pushes
+	PURPL_CACHE_ALIGN _Atomic(uint32_t) pops; // Incremented by pops while something's waiting to push
+	atomic_uint_fast32_t push_waiters; // Threads waiting on pops
+} blocking_queue_t;
+
+// Create a single producer, single consumer queue of capacity items of size bytes. The capacity is rounded up to a
+// power of 2.
+extern spsc_queue_t *spsc_queue_create(size_t capacity, size_t size);
+
+// Copy an item into the queue, returns false if it's full. Only call this from the producer.
+extern bool spsc_queue_push(spsc_queue_t *queue, const void *item);
+
+// Copy the oldest item out of the queue, returns false if it's empty. Only call this from the consumer.
+extern bool spsc_queue_pop(spsc_queue_t *queue, void *item);
+
+// Get roughly how many items are in the queue
+extern size_t spsc_queue_get_count(spsc_queue_t *queue);
+
+// Destroy a single producer, single consumer queue
+extern void spsc_queue_destroy(spsc_queue_t *queue);
+
+// Create a multiple producer, multiple consumer queue of capacity items of size bytes. The capacity is rounded up to a
+// power of 2, and has to be at least 2.
+extern mpmc_queue_t *mpmc_queue_create(size_t capacity, size_t size);
+
+// Copy an item into the queue, returns false if it's full
+extern bool mpmc_queue_push(mpmc_queue_t *queue, const void *item);
+
+// Copy the oldest item out of the queue, returns false if it's empty
+extern bool mpmc_queue_pop(mpmc_queue_t *queue, void *item);
+
+// Get roughly how many items are in the queue
+extern size_t mpmc_queue_get_count(mpmc_queue_t *queue);
+
+// Destroy a multiple producer, multiple consumer queue
+extern void mpmc_queue_destroy(mpmc_queue_t *queue);
+
+// Create a blocking queue of capacity items of size bytes, with the same limits as mpmc_queue_create
+extern blocking_queue_t *blocking_queue_create(size_t capacity, size_t size);
+
+// Push an item, waiting at most timeout milliseconds for room if the queue is full. Returns false if it timed out, so
+// a timeout of 0 doesn't wait.
+extern bool blocking_queue_push(blocking_queue_t *queue, const void *item, uint32_t timeout);
+
+// Pop an item, waiting at most timeout milliseconds for one if the queue is empty. Returns false if it timed out.
+extern bool blocking_queue_pop(blocking_queue_t *queue, void *item, uint32_t timeout);
+
+// Destroy a blocking queue, nothing can be waiting on it
+extern void blocking_queue_destroy(blocking_queue_t *queue);
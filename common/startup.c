@@ -0,0 +1,148 @@
+// Startup timeline
+
+#include "startup.h"
+
+static startup_timeline_t s_local_timeline;
+static startup_timeline_t *s_timeline = &s_local_timeline;
+
+void startup_begin(const char *format, ...)
+{
+	startup_phase_t *phase;
+	va_list args;
+
+	if (!format || s_timeline->finished)
+		return;
+
+	if (s_timeline->count >= STARTUP_MAX_PHASES || s_timeline->depth >= STARTUP_MAX_DEPTH) {
+		// Still push something so the startup_end that goes with this has something to pop
+		if (s_timeline->depth < STARTUP_MAX_DEPTH)
+			s_timeline->open[s_timeline->depth] = UINT32_MAX;
+		s_timeline->depth++;
+		return;
+	}
+
+	phase = &s_timeline->phases[s_timeline->count];
+	va_start(args, format);
+	vsnprintf(phase->name, STARTUP_NAME_LENGTH, format, args);
+	va_end(args);
+	phase->depth = s_timeline->depth;
+	phase->start = util_get_time();
+	phase->end = 0;
+	if (!s_timeline->count)
+		s_timeline->start = phase->start;
+
+	s_timeline->open[s_timeline->depth++] = s_timeline->count++;
+}
+
+void startup_end(void)
+{
+	uint32_t index;
+
+	if (s_timeline->finished || !s_timeline->depth)
+		return;
+
+	s_timeline->depth--;
+	if (s_timeline->depth >= STARTUP_MAX_DEPTH)
+		return;
+
+	index = s_timeline->open[s_timeline->depth];
+	if (index < s_timeline->count)
+		s_timeline->phases[index].end = util_get_time();
+}
+
+void startup_finish(void)
+{
+	if (s_timeline->finished)
+		return;
+
+	while (s_timeline->depth)
+		startup_end();
+	s_timeline->end = util_get_time();
+	s_timeline->finished = true;
+}
+
+bool startup_is_finished(void)
+{
+	return s_timeline->finished;
+}
+
+uint64_t startup_get_time(void)
+{
+	if (!s_timeline->count)
+		return 0;
+
+	return (s_timeline->finished ? s_timeline->end : util_get_time()) - s_timeline->start;
+}
+
+void startup_log(void)
+{
+	startup_phase_t *phase;
+	uint64_t end;
+	uint32_t i;
+
+	if (!s_timeline->count)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+		 STARTUP_LOG_PREFIX "Startup took %.3lf ms, %u %s (start and duration in ms):\n",
+		 (double)startup_get_time() / UTIL_NS_PER_MS, s_timeline->count,
+		 PURPL_PLURALIZE(s_timeline->count, "phases", "phase"));
+	for (i = 0; i < s_timeline->count; i++) {
+		phase = &s_timeline->phases[i];
+		end = phase->end ? phase->end : util_get_time();
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL, STARTUP_LOG_PREFIX "%9.3lf %9.3lf %*s%s\n",
+			 (double)(phase->start - s_timeline->start) / UTIL_NS_PER_MS,
+			 (double)(end - phase->start) / UTIL_NS_PER_MS, phase->depth * 2, "", phase->name);
+	}
+}
+
+bool startup_write(const char *path)
+{
+	startup_phase_t *phase;
+	const char *c;
+	uint64_t end;
+	uint32_t i;
+	FILE *file;
+
+	if (!path)
+		return false;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		PURPL_LOG(STARTUP_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	fputs("[\n", file);
+	for (i = 0; i < s_timeline->count; i++) {
+		phase = &s_timeline->phases[i];
+		end = phase->end ? phase->end : util_get_time();
+
+		fputs("{\"name\":\"", file);
+		for (c = phase->name; *c; c++) {
+			if (*c == '"' || *c == '\\')
+				fputc('\\', file);
+			if ((uint8_t)*c >= ' ')
+				fputc(*c, file);
+		}
+		fprintf(file, "\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3lf,\"dur\":%.3lf}%s\n",
+			(double)(phase->start - s_timeline->start) / UTIL_NS_PER_US,
+			(double)(end - phase->start) / UTIL_NS_PER_US, i < s_timeline->count - 1 ? "," : "");
+	}
+	fputs("]\n", file);
+	fclose(file);
+
+	PURPL_LOG(STARTUP_LOG_PREFIX "Wrote startup timeline to %s\n", path);
+
+	return true;
+}
+
+startup_timeline_t *startup_get_timeline(void)
+{
+	return s_timeline;
+}
+
+void startup_use_timeline(startup_timeline_t *timeline)
+{
+	s_timeline = timeline ? timeline : &s_local_timeline;
+}
@@ -0,0 +1,72 @@
+// Startup timeline. The launcher and the engine mark each phase of startup with startup_begin and startup_end, and
+// once the first frame is done, startup_finish closes the timeline, which can be logged or written in the Chrome
+// trace format like the profiler's output. Unlike the profiler, this is always compiled in, since it only records a
+// handful of phases, and it's only meant to be used on the main thread. Since common is a static library, the
+// launcher gives the engine its timeline so the engine's phases nest inside the launcher's.
+
+#pragma once
+
+#include "common.h"
+#include "util.h"
+
+#define STARTUP_LOG_PREFIX COMMON_LOG_PREFIX "STARTUP: "
+
+// Most phases a timeline can have
+#define STARTUP_MAX_PHASES 128
+
+// Deepest phases can be nested
+#define STARTUP_MAX_DEPTH 16
+
+// Longest name of a phase
+#define STARTUP_NAME_LENGTH 64
+
+// A phase of startup
+typedef struct startup_phase {
+	char name[STARTUP_NAME_LENGTH]; // Name
+	uint64_t start; // util_get_time when it started
+	uint64_t end; // util_get_time when it ended
+	uint32_t depth; // Number of phases it's inside of
+} startup_phase_t;
+
+// Phases of startup, in the order they started
+typedef struct startup_timeline {
+	startup_phase_t phases[STARTUP_MAX_PHASES]; // Phases
+	uint32_t count; // Number of phases
+	uint32_t open[STARTUP_MAX_DEPTH]; // Indices of the phases that haven't ended, innermost last
+	uint32_t depth; // Number of phases that haven't ended
+	uint64_t start; // util_get_time when the first phase started
+	uint64_t end; // util_get_time when startup_finish was called
+	bool finished; // Whether startup_finish has been called, after which nothing else is recorded
+} startup_timeline_t;
+
+// Run the statement or block after this as a phase
+#define STARTUP_SCOPE(...)                                                                                     \
+	for (int startup_scope_once_ = (startup_begin(__VA_ARGS__), 1); startup_scope_once_;                   \
+	     startup_scope_once_ = 0, startup_end())
+
+// Start a phase inside the current one, the name is a format string
+extern void startup_begin(const char *format, ...);
+
+// End the innermost phase
+extern void startup_end(void);
+
+// End any phases that are still going and stop recording
+extern void startup_finish(void);
+
+// Get whether startup_finish has been called
+extern bool startup_is_finished(void);
+
+// Get the nanoseconds between the first phase starting and startup_finish, or until now if it hasn't been called
+extern uint64_t startup_get_time(void);
+
+// Log the timeline
+extern void startup_log(void);
+
+// Write the timeline as a Chrome trace
+extern bool startup_write(const char *path);
+
+// Get the timeline this module uses
+extern startup_timeline_t *startup_get_timeline(void);
+
+// Use another module's timeline
+extern void startup_use_timeline(startup_timeline_t *timeline);
@@ -0,0 +1,341 @@
+// Streaming file reads
+
+#include "stream.h"
+
+stream_t *stream_open(pack_file_t *pack, const char *path)
+{
+	stream_t *stream;
+	pack_entry_t *entry;
+	char *path2;
+
+	if (!path || !strlen(path))
+		return NULL;
+
+	path2 = util_normalize_path(pack && path[0] == '/' ? path + 1 : path);
+
+	if (pack) {
+		entry = pack_get(pack, path2);
+		if (!entry) {
+			PURPL_LOG(STREAM_LOG_PREFIX "File %s is not in pack %s_*.pak\n", path2, pack->name);
+			util_free(path2);
+			return NULL;
+		}
+
+		util_free(path2);
+		return stream_open_entry(pack, entry);
+	}
+
+	stream = util_alloc(1, sizeof(stream_t), NULL);
+	stream->file = fopen(path2, "rb");
+	if (!stream->file) {
+		PURPL_LOG(STREAM_LOG_PREFIX "Failed to open %s: %s\n", path2, strerror(errno));
+		util_free(path2);
+		util_free(stream);
+		return NULL;
+	}
+	util_free(path2);
+
+	stream->size = util_fsize(stream->file);
+
+	return stream;
+}
+
+stream_t *stream_open_entry(pack_file_t *pack, pack_entry_t *entry)
+{
+	stream_t *stream;
+
+	if (!pack || !entry)
+		return NULL;
+
+	stream = util_alloc(1, sizeof(stream_t), NULL);
+	stream->pack = pack;
+	stream->entry = entry;
+	stream->size = entry->real_size;
+
+	stream->dstream = ZSTD_createDStream_advanced(g_pack_zstd_mem);
+	PURPL_ASSERT(stream->dstream);
+	ZSTD_DCtx_setParameter(stream->dstream, ZSTD_d_windowLogMax, STREAM_MAX_WINDOW_LOG);
+
+	stream->hash = XXH3_createState();
+	PURPL_ASSERT(stream->hash);
+	XXH3_64bits_reset(stream->hash);
+
+	return stream;
+}
+
+// Read the next window of compressed data, opening the right split if needed
+static bool fill_input(stream_t *stream)
+{
+	uint64_t offset;
+	uint16_t split_idx;
+	char *split_name;
+	size_t len;
+
+	offset = stream->entry->offset + stream->compressed_pos;
+	len = PURPL_MIN(PURPL_MIN(STREAM_WINDOW_SIZE, stream->entry->size - stream->compressed_pos),
+			PACK_SPLIT_SIZE - PACK_SPLIT_OFFSET(offset));
+	if (!len)
+		return false;
+
+	split_idx = (uint16_t)PACK_SPLIT(offset);
+	if (!stream->file || split_idx != stream->split_idx) {
+		if (stream->file)
+			fclose(stream->file);
+
+		split_name = util_strfmt("%s_%0.5u.pak", stream->pack->name, split_idx);
+		stream->file = fopen(split_name, "rb");
+		if (!stream->file) {
+			PURPL_LOG(STREAM_LOG_PREFIX "Failed to open pack split %s: %s\n", split_name, strerror(errno));
+			util_free(split_name);
+			stream->error = true;
+			return false;
+		}
+		util_free(split_name);
+		stream->split_idx = split_idx;
+	}
+
+	fseek(stream->file, (long)PACK_SPLIT_OFFSET(offset), SEEK_SET);
+	stream->in_size = fread(stream->in, 1, len, stream->file);
+	stream->in_pos = 0;
+	stream->compressed_pos += stream->in_size;
+	if (!stream->in_size) {
+		PURPL_LOG(STREAM_LOG_PREFIX "Unexpected end of pack split %s_%0.5u.pak\n", stream->pack->name,
+			  split_idx);
+		stream->error = true;
+		return false;
+	}
+
+	return true;
+}
+
+// Decompress up to size bytes into dst
+static size_t decompress(stream_t *stream, uint8_t *dst, size_t size)
+{
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t before;
+	size_t ret;
+
+	out.dst = dst;
+	out.size = size;
+	out.pos = 0;
+	while (out.pos < out.size && !stream->error) {
+		if (stream->in_pos >= stream->in_size && stream->compressed_pos < stream->entry->size &&
+		    !fill_input(stream))
+			break;
+
+		in.src = stream->in;
+		in.size = stream->in_size;
+		in.pos = stream->in_pos;
+		before = out.pos;
+		ret = ZSTD_decompressStream(stream->dstream, &out, &in);
+		stream->in_pos = in.pos;
+		if (ZSTD_isError(ret)) {
+			PURPL_LOG(STREAM_LOG_PREFIX "Failed to decompress %s: %s\n",
+				  PACK_GET_NAME(stream->pack, stream->entry), ZSTD_getErrorName(ret));
+			stream->error = true;
+			break;
+		}
+
+		// Nothing left to give it and nothing came out
+		if (out.pos == before && in.pos >= in.size && stream->compressed_pos >= stream->entry->size)
+			break;
+	}
+
+	XXH3_64bits_update(stream->hash, dst, out.pos);
+	return out.pos;
+}
+
+// Check the hash of a pack entry once all of it has been decompressed
+static void verify(stream_t *stream)
+{
+	uint64_t hash;
+
+	if (!stream->pack || stream->pos != stream->size)
+		return;
+
+	hash = XXH3_64bits_digest(stream->hash);
+	if (hash != stream->entry->hash) {
+		PURPL_LOG(STREAM_LOG_PREFIX "Hash 0x%" PRIX64 " of %s does not match expected hash 0x%" PRIX64 "\n",
+			  hash, PACK_GET_NAME(stream->pack, stream->entry), stream->entry->hash);
+		stream->error = true;
+	}
+}
+
+// Read from a pack entry
+static size_t read_pack(stream_t *stream, uint8_t *dst, size_t size)
+{
+	size_t done;
+	size_t len;
+
+	// Use up what's already been decompressed
+	len = PURPL_MIN(size, stream->out_size - stream->out_pos);
+	memcpy(dst, stream->out + stream->out_pos, len);
+	stream->out_pos += len;
+	done = len;
+
+	if (size - done >= STREAM_WINDOW_SIZE) {
+		// Big reads go straight into the caller's buffer
+		done += decompress(stream, dst + done, size - done);
+		stream->out_size = 0;
+		stream->out_pos = 0;
+	} else if (size - done > 0) {
+		stream->out_size = decompress(stream, stream->out, STREAM_WINDOW_SIZE);
+		len = PURPL_MIN(size - done, stream->out_size);
+		memcpy(dst + done, stream->out, len);
+		stream->out_pos = len;
+		done += len;
+	}
+
+	return done;
+}
+
+// Read from a loose file
+static size_t read_file(stream_t *stream, uint8_t *dst, size_t size)
+{
+	size_t done;
+	size_t len;
+
+	len = PURPL_MIN(size, stream->in_size - stream->in_pos);
+	memcpy(dst, stream->in + stream->in_pos, len);
+	stream->in_pos += len;
+	done = len;
+
+	if (size - done >= STREAM_WINDOW_SIZE) {
+		done += fread(dst + done, 1, size - done, stream->file);
+		stream->in_size = 0;
+		stream->in_pos = 0;
+	} else if (size - done > 0) {
+		stream->in_size = fread(stream->in, 1, STREAM_WINDOW_SIZE, stream->file);
+		len = PURPL_MIN(size - done, stream->in_size);
+		memcpy(dst + done, stream->in, len);
+		stream->in_pos = len;
+		done += len;
+	}
+
+	return done;
+}
+
+size_t stream_read(stream_t *stream, void *buf, size_t size)
+{
+	size_t read;
+
+	if (!stream || !buf || stream->error)
+		return 0;
+
+	size = (size_t)PURPL_MIN(size, stream->size - stream->pos);
+	if (!size)
+		return 0;
+
+	if (stream->pack)
+		read = read_pack(stream, buf, size);
+	else
+		read = read_file(stream, buf, size);
+
+	stream->pos += read;
+	if (stream->pos == stream->size)
+		verify(stream);
+
+	return read;
+}
+
+// Start decompressing a pack entry over from the beginning
+static void rewind_pack(stream_t *stream)
+{
+	ZSTD_DCtx_reset(stream->dstream, ZSTD_reset_session_only);
+	XXH3_64bits_reset(stream->hash);
+	stream->compressed_pos = 0;
+	stream->in_size = 0;
+	stream->in_pos = 0;
+	stream->out_size = 0;
+	stream->out_pos = 0;
+	stream->pos = 0;
+	stream->error = false;
+}
+
+bool stream_seek(stream_t *stream, int64_t offset, int32_t origin)
+{
+	int64_t target;
+	uint64_t window_start;
+	size_t len;
+
+	if (!stream)
+		return false;
+
+	switch (origin) {
+	case SEEK_SET:
+		target = offset;
+		break;
+	case SEEK_CUR:
+		target = (int64_t)stream->pos + offset;
+		break;
+	case SEEK_END:
+		target = (int64_t)stream->size + offset;
+		break;
+	default:
+		return false;
+	}
+	if (target < 0 || (uint64_t)target > stream->size)
+		return false;
+
+	if (!stream->pack) {
+		window_start = stream->pos - stream->in_pos;
+		if ((uint64_t)target >= window_start && (uint64_t)target <= window_start + stream->in_size) {
+			stream->in_pos = (size_t)(target - window_start);
+		} else {
+			fseek(stream->file, (long)target, SEEK_SET);
+			stream->in_size = 0;
+			stream->in_pos = 0;
+		}
+		stream->pos = target;
+		return true;
+	}
+
+	window_start = stream->pos - stream->out_pos;
+	if ((uint64_t)target >= window_start && (uint64_t)target <= window_start + stream->out_size) {
+		stream->out_pos = (size_t)(target - window_start);
+		stream->pos = target;
+		return true;
+	}
+
+	if ((uint64_t)target < stream->pos)
+		rewind_pack(stream);
+
+	// Decompress and throw away everything up to the target
+	while (stream->pos < (uint64_t)target) {
+		if (stream->out_pos >= stream->out_size) {
+			stream->out_size = decompress(stream, stream->out, STREAM_WINDOW_SIZE);
+			stream->out_pos = 0;
+			if (!stream->out_size)
+				return false;
+		}
+
+		len = (size_t)PURPL_MIN((uint64_t)target - stream->pos, stream->out_size - stream->out_pos);
+		stream->out_pos += len;
+		stream->pos += len;
+	}
+
+	if (stream->pos == stream->size)
+		verify(stream);
+
+	return !stream->error;
+}
+
+uint64_t stream_tell(stream_t *stream)
+{
+	return stream ? stream->pos : 0;
+}
+
+void stream_close(stream_t *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->file)
+		fclose(stream->file);
+	if (stream->dstream)
+		ZSTD_freeDStream(stream->dstream);
+	if (stream->hash)
+		XXH3_freeState(stream->hash);
+	util_free(stream);
+}
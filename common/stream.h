@@ -0,0 +1,60 @@
+// Streaming reads of files in packs or on disk. Unlike pack_read, the whole file is never in memory at once, each open
+// stream only has a fixed size window of compressed and uncompressed data.
+
+#pragma once
+
+#include "common.h"
+#include "pack.h"
+#include "util.h"
+
+#define STREAM_LOG_PREFIX COMMON_LOG_PREFIX "STREAM: "
+
+// Size of each of the buffers of a stream
+#define STREAM_WINDOW_SIZE (64 * 1024)
+
+// Largest zstd window a stream will decompress with (8 MB), frames that need more than this fail instead of
+// allocating more memory
+#define STREAM_MAX_WINDOW_LOG 23
+
+// An open stream
+typedef struct stream {
+	pack_file_t *pack; // Pack the file is in, NULL for loose files
+	pack_entry_t *entry; // Entry of the file in the pack
+	FILE *file; // The loose file, or the pack split currently open
+	uint16_t split_idx; // Index of the open split
+
+	uint64_t size; // Size of the (uncompressed) file
+	uint64_t pos; // Position in the (uncompressed) file
+	bool error; // Set when the file can't be read or its hash doesn't match
+
+	ZSTD_DStream *dstream; // Decompression context
+	XXH3_state_t *hash; // Hash of everything decompressed so far
+	uint64_t compressed_pos; // Amount of compressed data read from the pack
+
+	uint8_t in[STREAM_WINDOW_SIZE]; // Compressed data, or buffered data from a loose file
+	size_t in_size; // Amount of data in in
+	size_t in_pos; // Position in in
+
+	uint8_t out[STREAM_WINDOW_SIZE]; // Decompressed data
+	size_t out_size; // Amount of data in out
+	size_t out_pos; // Position in out
+} stream_t;
+
+// Open a file in a pack, or a loose file if pack is NULL
+extern stream_t *stream_open(pack_file_t *pack, const char *path);
+
+// Open an entry in a pack
+extern stream_t *stream_open_entry(pack_file_t *pack, pack_entry_t *entry);
+
+// Read up to size bytes, returns the number of bytes read (less than size at the end of the file or on error)
+extern size_t stream_read(stream_t *stream, void *buf, size_t size);
+
+// Seek like fseek. Seeking backwards in a pack entry has to start decompressing from the beginning again, and seeking
+// forwards decompresses everything in between, so it's best to read sequentially.
+extern bool stream_seek(stream_t *stream, int64_t offset, int32_t origin);
+
+// Get the position in a stream
+extern uint64_t stream_tell(stream_t *stream);
+
+// Close a stream
+extern void stream_close(stream_t *stream);
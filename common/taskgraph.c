@@ -0,0 +1,310 @@
+// Task graphs
+
+#include "taskgraph.h"
+
+taskgraph_t *taskgraph_create(const char *name)
+{
+	taskgraph_t *graph;
+
+	if (!name)
+		return NULL;
+
+	graph = util_alloc(1, sizeof(taskgraph_t), NULL);
+	graph->name = util_strdup(name);
+	graph->main_queue = mpmc_queue_create(TASKGRAPH_MAX_TASKS, sizeof(uint32_t));
+	snprintf(graph->time_name, sizeof(graph->time_name), "taskgraph.%s.time_ns", name);
+	snprintf(graph->critical_name, sizeof(graph->critical_name), "taskgraph.%s.critical_ns", name);
+
+	return graph;
+}
+
+// Intern each name in a comma separated list, returns false if there are too many
+static bool parse_resources(const char *list, atom_t *resources, uint32_t *count)
+{
+	const char *start;
+	const char *end;
+
+	*count = 0;
+	if (!list)
+		return true;
+
+	start = list;
+	while (*start) {
+		while (*start == ' ' || *start == ',')
+			start++;
+		if (!*start)
+			break;
+
+		end = start;
+		while (*end && *end != ',')
+			end++;
+		while (end > start && end[-1] == ' ')
+			end--;
+
+		if (*count >= TASKGRAPH_MAX_RESOURCES)
+			return false;
+		resources[(*count)++] = atom_intern_n(start, (size_t)(end - start));
+
+		start = end;
+	}
+
+	return true;
+}
+
+bool taskgraph_add(taskgraph_t *graph, const char *name, taskgraph_func_t func, void *data, uint32_t flags,
+		   const char *reads, const char *writes)
+{
+	taskgraph_task_t *task;
+
+	if (!graph || !name || !func)
+		return false;
+
+	if (graph->built) {
+		PURPL_LOG(TASKGRAPH_LOG_PREFIX "Can't add task %s to graph %s after it's built\n", name, graph->name);
+		return false;
+	}
+	if (graph->task_count >= TASKGRAPH_MAX_TASKS) {
+		PURPL_LOG(TASKGRAPH_LOG_PREFIX "Can't add task %s to graph %s, it's full\n", name, graph->name);
+		return false;
+	}
+
+	task = &graph->tasks[graph->task_count];
+	memset(task, 0, sizeof(taskgraph_task_t));
+	task->graph = graph;
+	task->name = atom_intern(name);
+	task->func = func;
+	task->data = data;
+	task->flags = flags;
+	if (!parse_resources(reads, task->reads, &task->read_count) ||
+	    !parse_resources(writes, task->writes, &task->write_count)) {
+		PURPL_LOG(TASKGRAPH_LOG_PREFIX "Task %s uses more than %u resources\n", name, TASKGRAPH_MAX_RESOURCES);
+		return false;
+	}
+
+	graph->task_count++;
+	return true;
+}
+
+// Check whether two lists of resources have anything in common
+static bool overlaps(const atom_t *a, uint32_t a_count, const atom_t *b, uint32_t b_count)
+{
+	uint32_t i;
+	uint32_t j;
+
+	for (i = 0; i < a_count; i++) {
+		for (j = 0; j < b_count; j++) {
+			if (a[i] == b[j])
+				return true;
+		}
+	}
+
+	return false;
+}
+
+bool taskgraph_build(taskgraph_t *graph)
+{
+	taskgraph_task_t *before;
+	taskgraph_task_t *after;
+	uint32_t edges;
+	uint32_t i;
+	uint32_t j;
+
+	if (!graph)
+		return false;
+	if (graph->built)
+		return true;
+
+	// Only earlier tasks can be depended on, so the order tasks were added in is already a topological order
+	edges = 0;
+	for (j = 0; j < graph->task_count; j++) {
+		after = &graph->tasks[j];
+		for (i = 0; i < j; i++) {
+			before = &graph->tasks[i];
+			if (overlaps(before->writes, before->write_count, after->reads, after->read_count) ||
+			    overlaps(before->writes, before->write_count, after->writes, after->write_count) ||
+			    overlaps(before->reads, before->read_count, after->writes, after->write_count)) {
+				before->dependents[before->dependent_count++] = j;
+				after->dependency_count++;
+				edges++;
+			}
+		}
+	}
+
+	PURPL_LOG(TASKGRAPH_LOG_PREFIX "Built graph %s with %u %s and %u %s\n", graph->name, graph->task_count,
+		  PURPL_PLURALIZE(graph->task_count, "tasks", "task"), edges,
+		  PURPL_PLURALIZE(edges, "dependencies", "dependency"));
+
+	graph->built = true;
+	return true;
+}
+
+static void dispatch(taskgraph_t *graph, uint32_t index);
+
+// Run a task, then start any dependents it was the last thing waiting on
+static void run_task(taskgraph_task_t *task)
+{
+	taskgraph_t *graph;
+	uint32_t i;
+
+	graph = task->graph;
+
+	task->start = util_get_time();
+	PURPL_PROFILE_BEGIN(atom_str(task->name));
+	if (!task->func(task->data, graph->param))
+		atomic_store_explicit(&graph->failed, true, memory_order_relaxed);
+	PURPL_PROFILE_END();
+	task->end = util_get_time();
+
+	// Acquire and release so each dependent sees what all of its dependencies did
+	for (i = 0; i < task->dependent_count; i++) {
+		if (atomic_fetch_sub_explicit(&graph->tasks[task->dependents[i]].pending, 1, memory_order_acq_rel) == 1)
+			dispatch(graph, task->dependents[i]);
+	}
+
+	// Release so the thread waiting for the run sees the times
+	atomic_fetch_sub_explicit(&graph->remaining, 1, memory_order_release);
+}
+
+// Job that runs a task
+static void task_job(void *data)
+{
+	run_task(data);
+}
+
+// Start a task that's ready
+static void dispatch(taskgraph_t *graph, uint32_t index)
+{
+	if (graph->tasks[index].flags & TASKGRAPH_MAIN_THREAD) {
+		// The queue holds every task, so this can't fail
+		mpmc_queue_push(graph->main_queue, &index);
+	} else {
+		job_run(task_job, &graph->tasks[index], graph->counter);
+	}
+}
+
+// Find the chain of dependent tasks that took longest in the last run
+static void find_critical_path(taskgraph_t *graph)
+{
+	uint64_t finish[TASKGRAPH_MAX_TASKS];
+	uint32_t parent[TASKGRAPH_MAX_TASKS];
+	taskgraph_task_t *task;
+	uint32_t dependent;
+	uint32_t last;
+	uint32_t i;
+	uint32_t j;
+
+	memset(finish, 0, sizeof(finish));
+	for (i = 0; i < graph->task_count; i++)
+		parent[i] = UINT32_MAX;
+
+	// finish starts out as the longest chain before each task, and dependents come after their dependencies, so
+	// one pass in order is enough
+	last = 0;
+	for (i = 0; i < graph->task_count; i++) {
+		task = &graph->tasks[i];
+		finish[i] += task->end - task->start;
+		for (j = 0; j < task->dependent_count; j++) {
+			dependent = task->dependents[j];
+			if (finish[i] > finish[dependent]) {
+				finish[dependent] = finish[i];
+				parent[dependent] = i;
+			}
+		}
+		if (finish[i] > finish[last])
+			last = i;
+	}
+
+	graph->critical_time = 0;
+	graph->critical_count = 0;
+	if (!graph->task_count)
+		return;
+
+	// Follow the chain back from the task that finished last, then put it in order
+	graph->critical_time = finish[last];
+	for (i = last; i != UINT32_MAX; i = parent[i])
+		graph->critical_count++;
+	j = graph->critical_count;
+	for (i = last; i != UINT32_MAX; i = parent[i])
+		graph->critical_path[--j] = i;
+}
+
+bool taskgraph_run(taskgraph_t *graph, const void *param)
+{
+	job_counter_t counter = JOB_COUNTER_INITIALIZER;
+	uint32_t index;
+	uint32_t i;
+
+	if (!graph || !taskgraph_build(graph))
+		return false;
+
+	graph->start = util_get_time();
+	graph->param = param;
+	graph->counter = &counter;
+	atomic_store_explicit(&graph->failed, false, memory_order_relaxed);
+	atomic_store_explicit(&graph->remaining, graph->task_count, memory_order_relaxed);
+	for (i = 0; i < graph->task_count; i++)
+		atomic_store_explicit(&graph->tasks[i].pending, graph->tasks[i].dependency_count, memory_order_relaxed);
+
+	for (i = 0; i < graph->task_count; i++) {
+		if (!graph->tasks[i].dependency_count)
+			dispatch(graph, i);
+	}
+
+	// Run main thread tasks as they become ready, and help with the rest in between
+	while (atomic_load_explicit(&graph->remaining, memory_order_acquire) > 0) {
+		if (mpmc_queue_pop(graph->main_queue, &index))
+			run_task(&graph->tasks[index]);
+		else if (!job_help())
+			thread_yield();
+	}
+
+	// The tasks are done, but the jobs that ran them might not have returned yet
+	job_wait(&counter);
+	graph->counter = NULL;
+
+	graph->time = util_get_time() - graph->start;
+	find_critical_path(graph);
+	metrics_record(metrics_get(&graph->time_metric, graph->time_name, METRIC_TYPE_HISTOGRAM), graph->time);
+	metrics_record(metrics_get(&graph->critical_metric, graph->critical_name, METRIC_TYPE_HISTOGRAM),
+		       graph->critical_time);
+
+	return !atomic_load_explicit(&graph->failed, memory_order_relaxed);
+}
+
+void taskgraph_log(taskgraph_t *graph)
+{
+	taskgraph_task_t *task;
+	bool critical;
+	uint32_t i;
+	uint32_t j;
+
+	if (!graph || !graph->built)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+		 TASKGRAPH_LOG_PREFIX "Last run of graph %s took %.3lf ms, %.3lf ms of it on the critical path "
+				      "(start and duration in ms, * is on the critical path):\n",
+		 graph->name, (double)graph->time / UTIL_NS_PER_MS, (double)graph->critical_time / UTIL_NS_PER_MS);
+	for (i = 0; i < graph->task_count; i++) {
+		task = &graph->tasks[i];
+		critical = false;
+		for (j = 0; j < graph->critical_count; j++)
+			critical = critical || graph->critical_path[j] == i;
+
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL, TASKGRAPH_LOG_PREFIX "%c %9.3lf %9.3lf %s%s, after %u %s\n",
+			 critical ? '*' : ' ', (double)(task->start - graph->start) / UTIL_NS_PER_MS,
+			 (double)(task->end - task->start) / UTIL_NS_PER_MS, atom_str(task->name),
+			 task->flags & TASKGRAPH_MAIN_THREAD ? " (main thread)" : "", task->dependency_count,
+			 PURPL_PLURALIZE(task->dependency_count, "tasks", "task"));
+	}
+}
+
+void taskgraph_destroy(taskgraph_t *graph)
+{
+	if (!graph)
+		return;
+
+	mpmc_queue_destroy(graph->main_queue);
+	util_free(graph->name);
+	util_free(graph);
+}
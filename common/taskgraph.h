@@ -0,0 +1,106 @@
+// Task graphs. Subsystems add tasks along with the resources they read and write, which are just names like "world"
+// or "render", and taskgraph_build orders them: a task waits for every task added before it that writes something it
+// reads or writes, or reads something it writes, and anything without a conflict can overlap. A graph is built once
+// and run as often as needed, like once a frame, with tasks going to the job system as soon as everything they depend
+// on is done. Tasks that have to stay on the thread that called taskgraph_run, like ones using the window, are run by
+// that thread while it waits. Every run times each task and finds the critical path, the chain of dependent tasks that
+// took longest, which is as fast as the run could be with unlimited cores. The gap between that and the time the whole
+// run took is time spent waiting for a thread or a main thread task, and shows up in the metrics for the graph.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "atom.h"
+#include "job.h"
+#include "log.h"
+#include "metrics.h"
+#include "profile.h"
+#include "queue.h"
+#include "util.h"
+
+#define TASKGRAPH_LOG_PREFIX COMMON_LOG_PREFIX "TASKGRAPH: "
+
+// Most tasks in a graph
+#define TASKGRAPH_MAX_TASKS 64
+
+// Most resources a task can read, and separately, write
+#define TASKGRAPH_MAX_RESOURCES 8
+
+// Task flags
+typedef enum taskgraph_flags {
+	TASKGRAPH_MAIN_THREAD = 1 << 0, // Run on the thread that called taskgraph_run instead of a worker
+} taskgraph_flags_t;
+
+// A task, which gets the param passed to taskgraph_run and returns false if it failed
+typedef bool (*taskgraph_func_t)(void *data, const void *param);
+
+struct taskgraph;
+
+// A task in a graph
+typedef struct taskgraph_task {
+	struct taskgraph *graph; // Graph the task is in
+	atom_t name; // Name
+	taskgraph_func_t func; // Function
+	void *data; // Passed to the function
+	uint32_t flags; // taskgraph_flags_t
+	atom_t reads[TASKGRAPH_MAX_RESOURCES]; // Resources the task reads
+	uint32_t read_count; // Number of resources read
+	atom_t writes[TASKGRAPH_MAX_RESOURCES]; // Resources the task writes
+	uint32_t write_count; // Number of resources written
+
+	uint32_t dependents[TASKGRAPH_MAX_TASKS]; // Tasks that wait for this one, which all come after it
+	uint32_t dependent_count; // Number of dependents
+	uint32_t dependency_count; // Number of tasks this one waits for
+
+	atomic_uint_fast32_t pending; // Dependencies that haven't finished in this run
+	uint64_t start; // util_get_time when the task started in the last run
+	uint64_t end; // util_get_time when the task finished in the last run
+} taskgraph_task_t;
+
+// A graph of tasks
+typedef struct taskgraph {
+	char *name; // Name, used for its metrics
+	taskgraph_task_t tasks[TASKGRAPH_MAX_TASKS]; // Tasks, in the order they were added
+	uint32_t task_count; // Number of tasks
+	bool built; // Whether taskgraph_build has worked out the dependencies, after which tasks can't be added
+
+	mpmc_queue_t *main_queue; // Indices of main thread tasks that are ready to run
+	const void *param; // Passed to the tasks in the current run
+	job_counter_t *counter; // Jobs started by the current run
+	atomic_uint_fast32_t remaining; // Tasks that haven't finished in the current run
+	atomic_bool failed; // Whether a task failed in the current run
+
+	uint64_t start; // util_get_time when the last run started
+	uint64_t time; // Nanoseconds the last run took
+	uint64_t critical_time; // Nanoseconds of task time along the critical path of the last run
+	uint32_t critical_path[TASKGRAPH_MAX_TASKS]; // Tasks on the critical path of the last run, first to last
+	uint32_t critical_count; // Number of tasks on the critical path
+
+	char time_name[METRICS_NAME_LENGTH]; // Name of the histogram of run times
+	char critical_name[METRICS_NAME_LENGTH]; // Name of the histogram of critical path times
+	_Atomic(metric_t *) time_metric; // Histogram of run times
+	_Atomic(metric_t *) critical_metric; // Histogram of critical path times
+} taskgraph_t;
+
+// Create an empty graph. Its metrics are taskgraph.<name>.time_ns and taskgraph.<name>.critical_ns.
+extern taskgraph_t *taskgraph_create(const char *name);
+
+// Add a task that reads and writes the resources in comma separated lists, which can be NULL. Returns false if the
+// graph is full or already built.
+extern bool taskgraph_add(taskgraph_t *graph, const char *name, taskgraph_func_t func, void *data, uint32_t flags,
+			  const char *reads, const char *writes);
+
+// Work out which tasks depend on which, taskgraph_run does this if it hasn't been done
+extern bool taskgraph_build(taskgraph_t *graph);
+
+// Run every task, passing param to them, and wait for them to finish. Returns false if any of them failed, which
+// doesn't stop the others.
+extern bool taskgraph_run(taskgraph_t *graph, const void *param);
+
+// Log the dependencies of each task and how long it took in the last run, with the critical path marked
+extern void taskgraph_log(taskgraph_t *graph);
+
+// Destroy a graph, which can't be running
+extern void taskgraph_destroy(taskgraph_t *graph);
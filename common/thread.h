@@ -0,0 +1,119 @@
+// Threading primitives. The system-specific parts are in linux_thread.c and win32_thread.c, like dll.h.
+
+#pragma once
+
+#include "common.h"
+#include "util.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include <stdatomic.h>
+
+#define THREAD_LOG_PREFIX COMMON_LOG_PREFIX "THREAD: "
+
+// Thread local storage
+#ifdef _MSC_VER
+#define PURPL_THREAD_LOCAL __declspec(thread)
+#else
+#define PURPL_THREAD_LOCAL _Thread_local
+#endif
+
+// Size of a cache line, used to keep things written by different threads apart
+#define PURPL_CACHE_LINE 64
+
+// Align a type or variable to a cache line
+#ifdef _MSC_VER
+#define PURPL_CACHE_ALIGN __declspec(align(PURPL_CACHE_LINE))
+#else
+#define PURPL_CACHE_ALIGN __attribute__((aligned(PURPL_CACHE_LINE)))
+#endif
+
+// Maximum length of a thread name, including the terminator (Linux limits them to 16 characters)
+#define THREAD_NAME_LENGTH 16
+
+// Thread entry point
+typedef int32_t (*thread_func_t)(void *data);
+
+// A thread
+typedef struct thread {
+	char name[THREAD_NAME_LENGTH]; // Name of the thread
+	thread_func_t func; // Entry point
+	void *data; // Passed to the entry point
+	int32_t result; // Return value of the entry point
+	void *handle; // System handle
+} thread_t;
+
+// Mutex and condition variable
+#ifdef _WIN32
+typedef SRWLOCK mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+// Static initializers for mutexes and condition variables, ones initialized like this don't need mutex_init or
+// cond_init
+#ifdef _WIN32
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define COND_INITIALIZER CONDITION_VARIABLE_INIT
+#else
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#endif
+
+// Create and start a thread
+extern thread_t *thread_create(thread_func_t func, const char *name, void *data);
+
+// Wait for a thread to exit, free it, and get its return value
+extern int32_t thread_join(thread_t *thread);
+
+// Give up the rest of the calling thread's time slice
+extern void thread_yield(void);
+
+// Sleep for at least the given number of milliseconds
+extern void thread_sleep(uint32_t ms);
+
+// Get the number of logical processors
+extern uint32_t thread_get_cpu_count(void);
+
+// Get an identifier for the calling thread
+extern uint64_t thread_get_id(void);
+
+// Initialize a mutex
+extern void mutex_init(mutex_t *mutex);
+
+// Lock a mutex
+extern void mutex_lock(mutex_t *mutex);
+
+// Unlock a mutex
+extern void mutex_unlock(mutex_t *mutex);
+
+// Destroy a mutex
+extern void mutex_destroy(mutex_t *mutex);
+
+// Initialize a condition variable
+extern void cond_init(cond_t *cond);
+
+// Wait on a condition variable, the mutex must be locked
+extern void cond_wait(cond_t *cond, mutex_t *mutex);
+
+// Wait on a condition variable for at most timeout milliseconds, returns false if it timed out
+extern bool cond_wait_timeout(cond_t *cond, mutex_t *mutex, uint32_t timeout);
+
+// Wake up one waiter
+extern void cond_signal(cond_t *cond);
+
+// Wake up all waiters
+extern void cond_broadcast(cond_t *cond);
+
+// Destroy a condition variable
+extern void cond_destroy(cond_t *cond);
+
+// Sleep while the value at address is expected, for at most timeout milliseconds or forever if it's UINT32_MAX. This
+// can return early without the value changing, so callers have to check it again. Returns false if it timed out.
+extern bool futex_wait(_Atomic(uint32_t) *address, uint32_t expected, uint32_t timeout);
+
+// Wake one or every thread in futex_wait on address
+extern void futex_wake(_Atomic(uint32_t) *address, bool all);
@@ -0,0 +1,323 @@
+// CPU topology and thread pinning
+
+#include "topology.h"
+
+static topology_t s_local_topology;
+static topology_t *s_topology = &s_local_topology;
+static mutex_t s_detect_lock = MUTEX_INITIALIZER;
+
+static const char *s_policy_names[TOPOLOGY_POLICY_COUNT] = {
+	"none",
+	"spread",
+	"compact",
+};
+
+void topology_cpuset_add(topology_cpuset_t *cpus, uint32_t cpu)
+{
+	if (cpus && cpu < TOPOLOGY_MAX_CPUS)
+		cpus->bits[cpu / 64] |= 1ull << (cpu % 64);
+}
+
+bool topology_cpuset_has(const topology_cpuset_t *cpus, uint32_t cpu)
+{
+	return cpus && cpu < TOPOLOGY_MAX_CPUS && (cpus->bits[cpu / 64] & (1ull << (cpu % 64)));
+}
+
+// Add a core's processors to a set
+static void add_core(topology_cpuset_t *cpus, const topology_core_t *core)
+{
+	uint32_t i;
+
+	for (i = 0; i < core->cpu_count; i++)
+		topology_cpuset_add(cpus, core->cpus[i]);
+}
+
+// Assume every logical processor is its own core, for when detection fails
+static void assume_flat(topology_t *topology)
+{
+	uint32_t i;
+
+	memset(topology->cores, 0, sizeof(topology->cores));
+	topology->cpu_count = PURPL_MIN(thread_get_cpu_count(), TOPOLOGY_MAX_CPUS);
+	topology->core_count = topology->cpu_count;
+	for (i = 0; i < topology->core_count; i++) {
+		topology->cores[i].cpus[0] = i;
+		topology->cores[i].cpu_count = 1;
+	}
+	memset(topology->cache_groups, 0, sizeof(topology->cache_groups));
+	topology->cache_groups[0].core_count = topology->core_count;
+	topology->cache_group_count = 1;
+	topology->package_count = 1;
+	topology->efficiency_count = 0;
+	topology->detected = false;
+}
+
+// Get how early a core should be handed out, lower is earlier
+static uint64_t get_order_key(const topology_t *topology, uint32_t core, uint32_t main_group)
+{
+	const topology_core_t *info;
+	uint64_t rank;
+	uint32_t i;
+
+	info = &topology->cores[core];
+
+	// Performance cores always come first
+	rank = (uint64_t)info->type << 48;
+	switch (topology->policy) {
+	case TOPOLOGY_POLICY_SPREAD:
+	default:
+		// Take turns between cache groups, by counting earlier cores of the same type in this core's group
+		for (i = 0; i < core; i++) {
+			if (topology->cores[i].cache_group == info->cache_group &&
+			    topology->cores[i].type == info->type)
+				rank += 1ull << 24;
+		}
+		rank += (uint64_t)info->cache_group << 16;
+		break;
+	case TOPOLOGY_POLICY_COMPACT:
+		// The main thread's group, then the others in order
+		rank += (uint64_t)(info->cache_group != main_group) << 40;
+		rank += (uint64_t)info->cache_group << 16;
+		break;
+	}
+
+	return rank + core;
+}
+
+// Work out the order cores are handed out in for the current policy
+static void order_cores(topology_t *topology)
+{
+	uint64_t keys[TOPOLOGY_MAX_CPUS];
+	uint32_t main_group;
+	uint32_t core;
+	uint64_t key;
+	uint32_t i;
+	uint32_t j;
+
+	// The main thread always gets the first performance core, so compact keeps everything in its group
+	main_group = 0;
+	for (i = 0; i < topology->core_count; i++) {
+		if (topology->cores[i].type == TOPOLOGY_CORE_PERFORMANCE) {
+			main_group = topology->cores[i].cache_group;
+			break;
+		}
+	}
+
+	// There aren't enough cores for the sort to matter, so insertion sort is fine
+	for (i = 0; i < topology->core_count; i++) {
+		core = i;
+		key = get_order_key(topology, i, main_group);
+		for (j = i; j > 0 && keys[j - 1] > key; j--) {
+			keys[j] = keys[j - 1];
+			topology->order[j] = topology->order[j - 1];
+		}
+		keys[j] = key;
+		topology->order[j] = core;
+	}
+}
+
+topology_t *topology_detect(void)
+{
+	topology_t *topology;
+
+	topology = s_topology;
+	mutex_lock(&s_detect_lock);
+	if (!topology->core_count) {
+		if (!topology_detect_platform(topology) || !topology->core_count) {
+			PURPL_LOG(TOPOLOGY_LOG_PREFIX
+				  "Failed to detect CPU topology, assuming every processor is a core\n");
+			assume_flat(topology);
+		} else {
+			topology->detected = true;
+		}
+		order_cores(topology);
+	}
+	mutex_unlock(&s_detect_lock);
+
+	return topology;
+}
+
+topology_t *topology_get(void)
+{
+	return s_topology;
+}
+
+void topology_use(topology_t *topology)
+{
+	s_topology = topology ? topology : &s_local_topology;
+}
+
+// Write a set of processors as a list of ranges, like 0-3,8-11
+static void format_cpus(const topology_cpuset_t *cpus, char *buf, size_t size)
+{
+	size_t length;
+	uint32_t start;
+	uint32_t i;
+
+	buf[0] = 0;
+	length = 0;
+	for (i = 0; i < TOPOLOGY_MAX_CPUS && length < size; i++) {
+		if (!topology_cpuset_has(cpus, i))
+			continue;
+
+		start = i;
+		while (i + 1 < TOPOLOGY_MAX_CPUS && topology_cpuset_has(cpus, i + 1))
+			i++;
+		if (start == i)
+			length += snprintf(buf + length, size - length, "%s%u", length ? "," : "", start);
+		else
+			length += snprintf(buf + length, size - length, "%s%u-%u", length ? "," : "", start, i);
+	}
+}
+
+void topology_log(void)
+{
+	topology_t *topology;
+	topology_cpuset_t group;
+	topology_cpuset_t efficiency;
+	topology_core_t *core;
+	char list[256];
+	uint32_t smt;
+	uint32_t i;
+	uint32_t j;
+
+	topology = topology_detect();
+
+	smt = 0;
+	for (i = 0; i < topology->core_count; i++)
+		smt = PURPL_MAX(smt, topology->cores[i].cpu_count);
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+		 TOPOLOGY_LOG_PREFIX "%u logical %s on %u %s (%u-way SMT) in %u %s, %u cache %s%s\n",
+		 topology->cpu_count, PURPL_PLURALIZE(topology->cpu_count, "processors", "processor"),
+		 topology->core_count, PURPL_PLURALIZE(topology->core_count, "cores", "core"), smt,
+		 topology->package_count, PURPL_PLURALIZE(topology->package_count, "packages", "package"),
+		 topology->cache_group_count, PURPL_PLURALIZE(topology->cache_group_count, "groups", "group"),
+		 topology->detected ? "" : " (assumed)");
+
+	for (i = 0; i < topology->cache_group_count; i++) {
+		memset(&group, 0, sizeof(topology_cpuset_t));
+		memset(&efficiency, 0, sizeof(topology_cpuset_t));
+		for (j = 0; j < topology->core_count; j++) {
+			core = &topology->cores[j];
+			if (core->cache_group != i)
+				continue;
+			add_core(&group, core);
+			if (core->type == TOPOLOGY_CORE_EFFICIENCY)
+				add_core(&efficiency, core);
+		}
+
+		format_cpus(&group, list, sizeof(list));
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+			 TOPOLOGY_LOG_PREFIX "Cache group %u: L%u, %" PRIu64 " KiB, %u %s, processors %s\n", i,
+			 topology->cache_groups[i].level, topology->cache_groups[i].size / 1024,
+			 topology->cache_groups[i].core_count,
+			 PURPL_PLURALIZE(topology->cache_groups[i].core_count, "cores", "core"),
+			 list);
+		format_cpus(&efficiency, list, sizeof(list));
+		if (list[0])
+			LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+				 TOPOLOGY_LOG_PREFIX "Cache group %u has efficiency processors %s\n", i, list);
+	}
+
+	if (topology->efficiency_count)
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL,
+			 TOPOLOGY_LOG_PREFIX "Hybrid CPU with %u performance and %u efficiency %s\n",
+			 topology->core_count - topology->efficiency_count, topology->efficiency_count,
+			 PURPL_PLURALIZE(topology->efficiency_count, "cores", "core"));
+}
+
+void topology_set_policy(topology_policy_t policy)
+{
+	topology_t *topology;
+
+	if (policy >= TOPOLOGY_POLICY_COUNT)
+		return;
+
+	topology = topology_detect();
+	mutex_lock(&s_detect_lock);
+	topology->policy = policy;
+	order_cores(topology);
+	mutex_unlock(&s_detect_lock);
+
+	LOG_INFO(LOG_SUBSYSTEM_GENERAL, TOPOLOGY_LOG_PREFIX "Placing threads with the %s policy\n",
+		 topology_policy_name(policy));
+}
+
+const char *topology_policy_name(topology_policy_t policy)
+{
+	return policy < TOPOLOGY_POLICY_COUNT ? s_policy_names[policy] : "unknown";
+}
+
+topology_policy_t topology_find_policy(const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; name && i < TOPOLOGY_POLICY_COUNT; i++) {
+		if (strcmp(name, s_policy_names[i]) == 0)
+			return (topology_policy_t)i;
+	}
+
+	return TOPOLOGY_POLICY_COUNT;
+}
+
+bool topology_get_cpus(topology_role_t role, uint32_t index, topology_cpuset_t *cpus)
+{
+	topology_t *topology;
+	topology_core_t *core;
+	uint32_t main_core;
+	uint32_t i;
+
+	if (!cpus)
+		return false;
+
+	// Setting a policy detects the topology, so there's nothing to do until then
+	topology = s_topology;
+	memset(cpus, 0, sizeof(topology_cpuset_t));
+	if (topology->policy == TOPOLOGY_POLICY_NONE || topology->core_count < 2)
+		return false;
+
+	main_core = topology->order[0];
+	switch (role) {
+	case TOPOLOGY_ROLE_MAIN:
+		add_core(cpus, &topology->cores[main_core]);
+		break;
+	case TOPOLOGY_ROLE_WORKER:
+		// Worker 0 is the main thread, so worker 1 gets the next core, and they double up once there are more
+		// workers than cores
+		add_core(cpus, &topology->cores[topology->order[index % topology->core_count]]);
+		break;
+	case TOPOLOGY_ROLE_SIM:
+		// Any performance core but the main thread's, it's only one thread but it runs every tick
+		for (i = 0; i < topology->core_count; i++) {
+			core = &topology->cores[i];
+			if (i != main_core && core->type == TOPOLOGY_CORE_PERFORMANCE)
+				add_core(cpus, core);
+		}
+		break;
+	case TOPOLOGY_ROLE_IO:
+		// Efficiency cores if there are any, otherwise anywhere but the main thread's core
+		for (i = 0; i < topology->core_count; i++) {
+			core = &topology->cores[i];
+			if (topology->efficiency_count ? core->type == TOPOLOGY_CORE_EFFICIENCY : i != main_core)
+				add_core(cpus, core);
+		}
+		break;
+	}
+
+	for (i = 0; i < PURPL_ARRSIZE(cpus->bits); i++) {
+		if (cpus->bits[i])
+			return true;
+	}
+
+	return false;
+}
+
+bool topology_pin_thread(topology_role_t role, uint32_t index)
+{
+	topology_cpuset_t cpus;
+
+	if (!topology_get_cpus(role, index, &cpus))
+		return false;
+
+	return topology_set_affinity(&cpus);
+}
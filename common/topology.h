@@ -0,0 +1,123 @@
+// CPU topology and thread pinning. topology_detect finds the logical processors, which physical core each one is on
+// (the ones sharing a core are SMT siblings), which cores share a last level cache (an AMD CCX, or a cluster of
+// efficiency cores), and on hybrid CPUs which cores are the performance ones. The system-specific parts are in
+// linux_topology.c and win32_topology.c. Threads then pin themselves based on their role and a policy: the main thread
+// gets the first performance core to itself, workers get one physical core each after that, and I/O threads are kept
+// off the main thread's core, on the efficiency cores if there are any. Since common is a static library, the launcher
+// gives the engine its topology, like the metrics registry, so they use the same policy.
+
+#pragma once
+
+#include "common.h"
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+
+#define TOPOLOGY_LOG_PREFIX COMMON_LOG_PREFIX "TOPOLOGY: "
+
+// Most logical processors that are detected, the rest are ignored
+#define TOPOLOGY_MAX_CPUS 256
+
+// Most SMT siblings on one core
+#define TOPOLOGY_MAX_SMT 8
+
+// Most groups of cores sharing a cache
+#define TOPOLOGY_MAX_CACHE_GROUPS 64
+
+// Set of logical processors, by index in the system's numbering
+typedef struct topology_cpuset {
+	uint64_t bits[TOPOLOGY_MAX_CPUS / 64]; // One bit for each processor
+} topology_cpuset_t;
+
+// Kinds of core on hybrid CPUs
+typedef enum topology_core_type {
+	TOPOLOGY_CORE_PERFORMANCE, // Big core, or any core on CPUs that aren't hybrid
+	TOPOLOGY_CORE_EFFICIENCY, // Little core
+} topology_core_type_t;
+
+// How threads are placed
+typedef enum topology_policy {
+	TOPOLOGY_POLICY_NONE, // Leave it to the system
+	TOPOLOGY_POLICY_SPREAD, // Spread workers across cache groups, for the most cache
+	TOPOLOGY_POLICY_COMPACT, // Fill the main thread's cache group first, so workers share its cache
+	TOPOLOGY_POLICY_COUNT
+} topology_policy_t;
+
+// What a thread is for, which decides where it goes
+typedef enum topology_role {
+	TOPOLOGY_ROLE_MAIN, // The main thread, which renders, and is worker 0 of the job system
+	TOPOLOGY_ROLE_WORKER, // A job system worker
+	TOPOLOGY_ROLE_SIM, // The simulation thread
+	TOPOLOGY_ROLE_IO, // I/O and other background threads
+} topology_role_t;
+
+// A physical core
+typedef struct topology_core {
+	topology_core_type_t type; // Kind of core
+	uint32_t package; // Socket the core is in
+	uint32_t cache_group; // Index of the group of cores sharing a last level cache with this one
+	uint32_t cpus[TOPOLOGY_MAX_SMT]; // Logical processors on this core, which are SMT siblings
+	uint32_t cpu_count; // Number of logical processors
+} topology_core_t;
+
+// Cores sharing a last level cache
+typedef struct topology_cache_group {
+	uint32_t level; // Level of the shared cache, 0 if it's unknown
+	uint64_t size; // Size of the shared cache in bytes, 0 if it's unknown
+	uint32_t core_count; // Number of cores in the group
+} topology_cache_group_t;
+
+// Layout of the CPUs, and how threads are placed on them
+typedef struct topology {
+	topology_core_t cores[TOPOLOGY_MAX_CPUS]; // Physical cores, in the system's order
+	uint32_t core_count; // Number of physical cores
+	uint32_t cpu_count; // Number of logical processors
+	topology_cache_group_t cache_groups[TOPOLOGY_MAX_CACHE_GROUPS]; // Groups of cores sharing a cache
+	uint32_t cache_group_count; // Number of cache groups
+	uint32_t package_count; // Number of sockets
+	uint32_t efficiency_count; // Number of efficiency cores, 0 if the CPU isn't hybrid
+	bool detected; // Whether the topology was detected, instead of assumed to be one core per logical processor
+
+	topology_policy_t policy; // How threads are placed
+	uint32_t order[TOPOLOGY_MAX_CPUS]; // Indices of cores in the order the main thread and workers get them
+} topology_t;
+
+// Detect the topology, which is done once and remembered
+extern topology_t *topology_detect(void);
+
+// Get the topology this module uses, without detecting it
+extern topology_t *topology_get(void);
+
+// Use another module's topology
+extern void topology_use(topology_t *topology);
+
+// Log the topology
+extern void topology_log(void);
+
+// Set how threads are placed, which only affects threads that pin themselves after this
+extern void topology_set_policy(topology_policy_t policy);
+
+// Get the name of a policy
+extern const char *topology_policy_name(topology_policy_t policy);
+
+// Get a policy by name, TOPOLOGY_POLICY_COUNT if there isn't one
+extern topology_policy_t topology_find_policy(const char *name);
+
+// Get the processors a thread should be on, returns false if it can go anywhere. index tells apart threads with the
+// same role, like job workers.
+extern bool topology_get_cpus(topology_role_t role, uint32_t index, topology_cpuset_t *cpus);
+
+// Pin the calling thread to the processors for its role, returns false if it was left alone
+extern bool topology_pin_thread(topology_role_t role, uint32_t index);
+
+// Add a processor to a set
+extern void topology_cpuset_add(topology_cpuset_t *cpus, uint32_t cpu);
+
+// Check whether a processor is in a set
+extern bool topology_cpuset_has(const topology_cpuset_t *cpus, uint32_t cpu);
+
+// Fill in the topology, platform specific. Returns false if it couldn't be detected.
+extern bool topology_detect_platform(topology_t *topology);
+
+// Set the calling thread's affinity, platform specific
+extern bool topology_set_affinity(const topology_cpuset_t *cpus);
@@ -0,0 +1,67 @@
+// Lock-free triple buffer
+
+#include "triplebuf.h"
+
+triplebuf_t *triplebuf_create(size_t size)
+{
+	triplebuf_t *buf;
+
+	if (!size)
+		return NULL;
+
+	buf = util_alloc(1, sizeof(triplebuf_t), NULL);
+	buf->buffers = util_alloc(3, size, NULL);
+	buf->size = size;
+	buf->back = 0;
+	atomic_init(&buf->middle, 1);
+	buf->front = 2;
+
+	return buf;
+}
+
+void *triplebuf_write(triplebuf_t *buf)
+{
+	if (!buf)
+		return NULL;
+
+	return buf->buffers + buf->back * buf->size;
+}
+
+void *triplebuf_publish(triplebuf_t *buf)
+{
+	if (!buf)
+		return NULL;
+
+	// Release so the reader sees what was written, acquire so the buffer the reader gave back is done with
+	buf->back = (uint8_t)(atomic_exchange_explicit(&buf->middle, buf->back | TRIPLEBUF_FRESH,
+							memory_order_acq_rel) &
+			      TRIPLEBUF_INDEX_MASK);
+
+	return buf->buffers + buf->back * buf->size;
+}
+
+const void *triplebuf_read(triplebuf_t *buf, bool *fresh)
+{
+	bool is_fresh;
+
+	if (!buf)
+		return NULL;
+
+	is_fresh = atomic_load_explicit(&buf->middle, memory_order_relaxed) & TRIPLEBUF_FRESH;
+	if (is_fresh)
+		buf->front = (uint8_t)(atomic_exchange_explicit(&buf->middle, buf->front, memory_order_acq_rel) &
+				       TRIPLEBUF_INDEX_MASK);
+	if (fresh)
+		*fresh = is_fresh;
+
+	return buf->buffers + buf->front * buf->size;
+}
+
+void triplebuf_destroy(triplebuf_t *buf)
+{
+	if (!buf)
+		return;
+
+	util_free(buf->buffers);
+	util_free(buf);
+}
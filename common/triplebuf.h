@@ -0,0 +1,42 @@
+// Lock-free triple buffer, for handing the latest version of something from one thread to another. The writer fills
+// in the back buffer and publishes it by swapping it with the middle one, and the reader swaps its front buffer with
+// the middle one when there's something new there. Neither side ever waits, the writer can publish as often as it
+// wants without the reader keeping up, and the reader always gets the newest complete buffer.
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "util.h"
+
+// Set in the middle index when the writer has published something the reader hasn't seen
+#define TRIPLEBUF_FRESH 0x4
+
+// Mask for the buffer index in the middle index
+#define TRIPLEBUF_INDEX_MASK 0x3
+
+// A triple buffer
+typedef struct triplebuf {
+	uint8_t *buffers; // Three buffers of size bytes each
+	size_t size; // Size of each buffer
+	atomic_uint_fast8_t middle; // Index of the buffer between the writer and reader, with TRIPLEBUF_FRESH
+	uint8_t back; // Index of the writer's buffer, only used by the writer
+	uint8_t front; // Index of the reader's buffer, only used by the reader
+} triplebuf_t;
+
+// Create a triple buffer, all three buffers start out zeroed
+extern triplebuf_t *triplebuf_create(size_t size);
+
+// Get the buffer to write the next version in, only call this from the writer
+extern void *triplebuf_write(triplebuf_t *buf);
+
+// Publish what's in the buffer from triplebuf_write and get a new one to write in
+extern void *triplebuf_publish(triplebuf_t *buf);
+
+// Get the newest published buffer, and set fresh to whether it's new since the last call, only call this from the
+// reader. The buffer is the reader's until the next call.
+extern const void *triplebuf_read(triplebuf_t *buf, bool *fresh);
+
+// Destroy a triple buffer
+extern void triplebuf_destroy(triplebuf_t *buf);
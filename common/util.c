@@ -3,57 +3,60 @@
 // All the stb headers (that're used) are included in common.h, which util.h includes
 #define STB_SPRINTF_IMPLEMENTATION
 
+#include "alloc.h"
 #include "util.h"
 
-void util_log(const char *func, int line, const char *file, const char *fmt, ...)
+void *util_alloc(size_t count, size_t size, void *old)
 {
-	va_list args;
-	char *buf;
-	char *buf2;
-	char *file2;
-	char *filename;
-
-	if (!func || !file || !fmt)
-		return;
+	void *buf;
 
-	file2 = util_normalize_path(file);
-#ifdef PURPL_DEBUG
-	filename = file2;
-#else
-	filename = strstr(file2, "purpl-engine/") + 13;
-#endif
+	// The old size isn't known, so copying count * size bytes out of it would read past its end
+	if (old) {
+		buf = ALLOC_REALLOC(old, count * size);
+	} else {
+		buf = calloc(count, size);
+		ALLOC_TRACK(buf, count * size);
+	}
+	PURPL_ASSERT(buf);
 
-	va_start(args, fmt);
-	buf = util_vstrfmt(fmt, args);
-	va_end(args);
+	return buf;
+}
 
-	buf2 = util_strfmt("[%s:%d:%s]\n%s", func, line, filename, buf);
+void util_free(void *buf)
+{
+	if (!buf)
+		return;
 
+	ALLOC_UNTRACK(buf);
 	free(buf);
-	free(file2);
-
-	printf("%s", buf2);
-#ifdef _WIN32
-	OutputDebugStringA(buf2);
-#endif
-
-	free(buf2);
 }
 
-void *util_alloc(size_t count, size_t size, void *old)
+void *util_alloc_aligned(size_t size, size_t alignment)
 {
 	void *buf;
 
-	buf = calloc(count, size);
+#ifdef _WIN32
+	buf = _aligned_malloc(size, alignment);
+#else
+	if (posix_memalign(&buf, alignment, size) != 0)
+		buf = NULL;
+#endif
 	PURPL_ASSERT(buf);
-	if (old) {
-		memcpy(buf, old, count * size);
-		free(old);
-	}
+	ALLOC_TRACK(buf, size);
 
 	return buf;
 }
 
+void util_free_aligned(void *buf)
+{
+	ALLOC_UNTRACK(buf);
+#ifdef _WIN32
+	_aligned_free(buf);
+#else
+	free(buf);
+#endif
+}
+
 void util_free_list(void **list, size_t count)
 {
 	size_t i;
@@ -63,7 +66,7 @@ void util_free_list(void **list, size_t count)
 
 	for (i = 0; i < count; i++) {
 		if (list[i])
-			free(list[i]);
+			util_free(list[i]);
 	}
 }
 
@@ -98,32 +101,34 @@ size_t util_fsize(FILE *stream)
 char *util_normalize_path(const char *path)
 {
 	char *buf;
-	char *buf2;
-	char *p;
-	size_t len;
 
 	if (!path)
 		return NULL;
 
-	buf = util_strdup(path);
-	p = strchr(buf, '\\');
-	while (p) {
-		*p = '/';
-		p = strchr(++p, '\\');
-	}
+	buf = util_alloc(strlen(path) + 1, sizeof(char), NULL);
+	util_normalize_path_to(buf, path);
+
+	return buf;
+}
+
+size_t util_normalize_path_to(char *buf, const char *path)
+{
+	size_t len;
+	char c;
 
-	p = strstr(buf, "//");
-	while (p) {
-		len = strlen(buf) - (p - buf);
-		if (len > strlen(buf))
-			break;
-		memmove(p, p + 1, len);
-		p[len - 1] = 0;
+	if (!buf || !path)
+		return 0;
+
+	len = 0;
+	for (; *path; path++) {
+		c = *path == '\\' ? '/' : *path;
+		if (c == '/' && len && buf[len - 1] == '/')
+			continue;
+		buf[len++] = c;
 	}
+	buf[len] = 0;
 
-	buf2 = util_strdup(buf);
-	free(buf);
-	return buf2;
+	return len;
 }
 
 char *util_absolute_path(const char *path)
@@ -143,7 +148,7 @@ char *util_absolute_path(const char *path)
 #endif
 
 	path2 = util_normalize_path(buf);
-	free(buf);
+	util_free(buf);
 
 	return path2;
 }
@@ -158,8 +163,8 @@ bool util_isabsolute(const char *path)
 	path3 = util_absolute_path(path);
 	ret = strcmp(path2, path3) == 0;
 
-	free(path2);
-	free(path3);
+	util_free(path2);
+	util_free(path3);
 
 	return ret;
 }
@@ -207,7 +212,7 @@ char *util_replace(const char *str, const char *orig, const char *rplc)
 	for (i = 0; i < strlen(str2); i++) {
 		if (strncmp(str2 + i, orig, strlen(orig)) == 0) {
 			str3 = util_strfmt("%.*s%s%s", i, str2, rplc, str2 + strlen(orig));
-			free(str2);
+			util_free(str2);
 			str2 = str3;
 			i += strlen(rplc);
 		}
@@ -294,7 +299,7 @@ void util_mkdir(const char *path)
 #ifdef _WIN32
 			CreateDirectoryA(path2, NULL);
 #else
-			mkdir(path2, 777);
+			mkdir(path2, 0755);
 #endif
 			*p = '/';
 		}
@@ -303,8 +308,10 @@ void util_mkdir(const char *path)
 #ifdef _WIN32
 	CreateDirectoryA(path2, NULL);
 #else
-	mkdir(path2, 0);
+	mkdir(path2, 0755);
 #endif
+
+	util_free(path2);
 }
 
 uint64_t util_getaccuratetime(void)
@@ -315,11 +322,94 @@ uint64_t util_getaccuratetime(void)
 	time /= 10000; // FILETIME is 100 nanosecond intervals, convert to milliseconds
 	time -= 11644473600000; // 1601 -> 1970
 #else
+	struct timespec ts;
 
+	clock_gettime(CLOCK_REALTIME, &ts);
+	time = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / UTIL_NS_PER_MS;
 #endif
 	return time;
 }
 
+uint64_t util_get_time(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	// The frequency is fixed at boot, so it only has to be gotten once
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	// Split it up so the multiplication can't overflow
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * UTIL_NS_PER_SEC +
+	       (uint64_t)(counter.QuadPart % frequency.QuadPart) * UTIL_NS_PER_SEC / frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	// This is a vDSO call that reads the TSC, so it doesn't need its own calibration
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * UTIL_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void util_timer_start(util_timer_t *timer)
+{
+	if (!timer)
+		return;
+
+	timer->elapsed = 0;
+	timer->running = true;
+	timer->start = util_get_time();
+}
+
+void util_timer_resume(util_timer_t *timer)
+{
+	if (!timer || timer->running)
+		return;
+
+	timer->running = true;
+	timer->start = util_get_time();
+}
+
+uint64_t util_timer_stop(util_timer_t *timer)
+{
+	if (!timer)
+		return 0;
+
+	if (timer->running) {
+		timer->elapsed += util_get_time() - timer->start;
+		timer->running = false;
+	}
+
+	return timer->elapsed;
+}
+
+uint64_t util_timer_elapsed(const util_timer_t *timer)
+{
+	if (!timer)
+		return 0;
+
+	return timer->elapsed + (timer->running ? util_get_time() - timer->start : 0);
+}
+
+void util_next_frame(frame_delta_t *delta)
+{
+	uint64_t now;
+
+	if (!delta)
+		return;
+
+	now = util_get_time();
+	if (delta->start) {
+		delta->frame++;
+		delta->delta = now - delta->start;
+		delta->elapsed += delta->delta;
+	}
+	delta->start = now;
+	delta->seconds = UTIL_NS_TO_SEC(delta->delta);
+}
+
 uint32_t util_parse_version(const char *version)
 {
 	uint8_t i;
@@ -336,7 +426,7 @@ uint32_t util_parse_version(const char *version)
 		version2 = util_strdup(version);
 
 	if (!strlen(version2)) {
-		free(version2);
+		util_free(version2);
 		return 0;
 	}
 
@@ -347,7 +437,7 @@ uint32_t util_parse_version(const char *version)
 	while (token && i < 4)
 		parts[i] = strtol(token, NULL, 10) & 0xFF;
 
-	free(version2);
+	util_free(version2);
 	return PURPL_MAKE_VERSION(parts[0], parts[1], parts[2], parts[3]);
 }
 
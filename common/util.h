@@ -3,24 +3,32 @@
 #pragma once
 
 #include "common.h"
+#include "log.h"
 
 // Calls a string function and frees the old string
 #define UTIL_STRFUNC(str, call)     \
 	{                           \
 		char *tmp = (call); \
-		free((str));        \
+		util_free((str));   \
 		(str) = tmp;        \
 	}
 
-// Print a message to places to aid in debugging and troubleshooting and stuff
-extern void util_log(const char *func, int line, const char *file, const char *fmt, ...);
+// Print a message to places to aid in debugging and troubleshooting and stuff, see log.h for levels and subsystems
+#define PURPL_LOG(...) LOG_INFO(LOG_SUBSYSTEM_GENERAL, __VA_ARGS__)
 
-// Wrapper around util_log
-#define PURPL_LOG(...) util_log(PURPL_FUNCNAME, __LINE__, __FILE__, __VA_ARGS__)
-
-// Allocate or grow memory (growing invalidates old pointers)
+// Allocate zeroed memory, or grow memory with realloc (growing invalidates old pointers and doesn't zero the new
+// space). Use the containers in container.h for anything that grows one element at a time.
 extern void *util_alloc(size_t count, size_t size, void *old);
 
+// Free memory from util_alloc or anything else that returns allocated memory, like util_strdup
+extern void util_free(void *buf);
+
+// Allocate memory aligned to a power of two, which has to be freed with util_free_aligned
+extern void *util_alloc_aligned(size_t size, size_t alignment);
+
+// Free memory from util_alloc_aligned
+extern void util_free_aligned(void *buf);
+
 // Free a list
 extern void util_free_list(void **list, size_t count);
 
@@ -30,9 +38,12 @@ extern bool util_fexist(const char *path);
 // Get the length of a file
 extern size_t util_fsize(FILE *stream);
 
-// Normalize a path
+// Normalize a path (backslashes become forward slashes and repeated slashes are collapsed)
 extern char *util_normalize_path(const char *path);
 
+// Normalize a path into a buffer with room for at least strlen(path) + 1 characters, returns the new length
+extern size_t util_normalize_path_to(char *buf, const char *path);
+
 // Get an absolute path
 extern char *util_absolute_path(const char *path);
 
@@ -72,9 +83,61 @@ extern char *util_vstrfmt(const char *fmt, va_list args);
 // Make directories
 extern void util_mkdir(const char *path);
 
-// Get the number of milliseconds since 1970
+// Get the number of milliseconds since 1970. This is wall clock time, which can jump around, so use util_get_time to
+// measure how long things take.
 extern uint64_t util_getaccuratetime(void);
 
+// Nanoseconds in other units
+#define UTIL_NS_PER_US 1000ull
+#define UTIL_NS_PER_MS 1000000ull
+#define UTIL_NS_PER_SEC 1000000000ull
+
+// Convert nanoseconds to other units
+#define UTIL_NS_TO_US(ns) ((double)(ns) / UTIL_NS_PER_US)
+#define UTIL_NS_TO_MS(ns) ((double)(ns) / UTIL_NS_PER_MS)
+#define UTIL_NS_TO_SEC(ns) ((double)(ns) / UTIL_NS_PER_SEC)
+
+// Get the time in nanoseconds from a monotonic clock, which never goes backwards. It only means anything compared to
+// other times from it.
+extern uint64_t util_get_time(void);
+
+// Measures elapsed time, possibly across several start/stop pairs
+typedef struct util_timer {
+	uint64_t start; // When it was last started
+	uint64_t elapsed; // Nanoseconds it ran for before it was last started
+	bool running; // Whether it's running
+} util_timer_t;
+
+// Reset a timer and start it
+extern void util_timer_start(util_timer_t *timer);
+
+// Start a timer again without resetting it
+extern void util_timer_resume(util_timer_t *timer);
+
+// Stop a timer, returns the total time it's run for
+extern uint64_t util_timer_stop(util_timer_t *timer);
+
+// Get the total time a timer has run for, including now if it's running
+extern uint64_t util_timer_elapsed(const util_timer_t *timer);
+
+// Add the nanoseconds the following statement or block takes to total, which is a uint64_t. Leaving the block early
+// with break, return or goto skips adding the time.
+#define UTIL_TIME_SCOPE(total)                                                                             \
+	for (uint64_t util_scope_start_ = util_get_time(), util_scope_once_ = 1; util_scope_once_;         \
+	     util_scope_once_ = 0, (total) += util_get_time() - util_scope_start_)
+
+// Timing of a frame, which every frame callback is given
+typedef struct frame_delta {
+	uint64_t frame; // Number of the frame, starting at 0
+	uint64_t start; // util_get_time when the frame started
+	uint64_t delta; // Nanoseconds since the previous frame started, 0 for the first frame
+	double seconds; // delta in seconds, for scaling things by time
+	uint64_t elapsed; // Nanoseconds since the first frame started
+} frame_delta_t;
+
+// Fill out the timing of the next frame from the previous one, which should be zeroed before the first frame
+extern void util_next_frame(frame_delta_t *delta);
+
 // Parse a version number
 extern uint32_t util_parse_version(const char *version);
 
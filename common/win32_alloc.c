@@ -0,0 +1,64 @@
+// Call stacks for allocation tracking on Windows
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <dbghelp.h>
+
+#include "common/alloc.h"
+#include "common/thread.h"
+
+// Longest symbol name looked up
+#define ALLOC_MAX_SYMBOL_NAME 256
+
+// DbgHelp isn't thread safe
+static mutex_t s_symbol_lock = MUTEX_INITIALIZER;
+static bool s_symbols_loaded;
+
+uint8_t alloc_capture_stack(void **frames, uint8_t max_frames)
+{
+	return (uint8_t)RtlCaptureStackBackTrace(1, max_frames, frames, NULL);
+}
+
+void alloc_log_stack(void *const *frames, uint8_t frame_count)
+{
+	uint8_t buf[sizeof(SYMBOL_INFO) + ALLOC_MAX_SYMBOL_NAME];
+	SYMBOL_INFO *symbol;
+	IMAGEHLP_LINE64 line;
+	DWORD64 displacement;
+	DWORD line_displacement;
+	uintptr_t address;
+	HANDLE process;
+	uint8_t i;
+
+	if (!frames || !frame_count)
+		return;
+
+	process = GetCurrentProcess();
+	mutex_lock(&s_symbol_lock);
+	if (!s_symbols_loaded) {
+		SymSetOptions(SymGetOptions() | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES | SYMOPT_UNDNAME);
+		s_symbols_loaded = SymInitialize(process, NULL, TRUE);
+	}
+
+	symbol = (SYMBOL_INFO *)buf;
+	for (i = 0; i < frame_count; i++) {
+		address = (uintptr_t)frames[i];
+		memset(buf, 0, sizeof(buf));
+		symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		symbol->MaxNameLen = ALLOC_MAX_SYMBOL_NAME;
+		memset(&line, 0, sizeof(IMAGEHLP_LINE64));
+		line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+		// Without symbols, the address is all there is
+		if (!s_symbols_loaded || !SymFromAddr(process, address, &displacement, symbol))
+			LOG_INFO(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "\t0x%" PRIXPTR "\n", address);
+		else if (SymGetLineFromAddr64(process, address, &line_displacement, &line))
+			LOG_INFO(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "\t%s+0x%llx (%s:%lu) [0x%" PRIXPTR "]\n",
+				 symbol->Name, (unsigned long long)displacement, line.FileName, line.LineNumber,
+				 address);
+		else
+			LOG_INFO(LOG_SUBSYSTEM_GENERAL, ALLOC_LOG_PREFIX "\t%s+0x%llx [0x%" PRIXPTR "]\n",
+				 symbol->Name, (unsigned long long)displacement, address);
+	}
+	mutex_unlock(&s_symbol_lock);
+}
@@ -0,0 +1,123 @@
+// Metrics socket for Windows, which has had AF_UNIX since Windows 10 1803
+
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+
+#include "common/metrics.h"
+
+static SOCKET s_socket = INVALID_SOCKET;
+static struct sockaddr_un s_address;
+
+bool metrics_listen(const char *path)
+{
+	WSADATA data;
+	u_long nonblocking;
+
+	if (!path || strlen(path) >= sizeof(s_address.sun_path)) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Socket path %s is too long\n", path ? path : "(null)");
+		return false;
+	}
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to initialize Winsock: error %d\n", WSAGetLastError());
+		return false;
+	}
+
+	memset(&s_address, 0, sizeof(struct sockaddr_un));
+	s_address.sun_family = AF_UNIX;
+	strncpy(s_address.sun_path, path, sizeof(s_address.sun_path) - 1);
+
+	s_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s_socket == INVALID_SOCKET) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to create socket: error %d\n", WSAGetLastError());
+		WSACleanup();
+		return false;
+	}
+
+	// A previous run might have left it behind
+	remove(path);
+	nonblocking = 1;
+	if (ioctlsocket(s_socket, FIONBIO, &nonblocking) != 0 ||
+	    bind(s_socket, (struct sockaddr *)&s_address, sizeof(struct sockaddr_un)) != 0 ||
+	    listen(s_socket, 8) != 0) {
+		PURPL_LOG(METRICS_LOG_PREFIX "Failed to listen on %s: error %d\n", path, WSAGetLastError());
+		closesocket(s_socket);
+		s_socket = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+
+	return true;
+}
+
+// Format the metrics into memory, since there's no open_memstream
+static char *format_metrics(size_t *size)
+{
+	FILE *stream;
+	char *buf;
+	long length;
+
+	stream = tmpfile();
+	if (!stream)
+		return NULL;
+
+	metrics_write(stream);
+	length = ftell(stream);
+	if (length <= 0) {
+		fclose(stream);
+		return NULL;
+	}
+
+	rewind(stream);
+	buf = util_alloc((size_t)length, 1, NULL);
+	*size = fread(buf, 1, (size_t)length, stream);
+	fclose(stream);
+
+	return buf;
+}
+
+void metrics_serve(void)
+{
+	DWORD timeout;
+	SOCKET client;
+	u_long blocking;
+	char *buf;
+	size_t size;
+	size_t sent;
+	int32_t len;
+
+	if (s_socket == INVALID_SOCKET)
+		return;
+
+	while ((client = accept(s_socket, NULL, NULL)) != INVALID_SOCKET) {
+		// Accepted sockets inherit non-blocking mode, and a client that doesn't read shouldn't hold up the next
+		// snapshot for long
+		blocking = 0;
+		ioctlsocket(client, FIONBIO, &blocking);
+		timeout = 1000;
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(DWORD));
+
+		size = 0;
+		buf = format_metrics(&size);
+		for (sent = 0; buf && sent < size; sent += (size_t)len) {
+			len = send(client, buf + sent, (int32_t)PURPL_MIN(size - sent, INT32_MAX), 0);
+			if (len <= 0)
+				break;
+		}
+		util_free(buf);
+
+		closesocket(client);
+	}
+}
+
+void metrics_close_socket(void)
+{
+	if (s_socket == INVALID_SOCKET)
+		return;
+
+	closesocket(s_socket);
+	s_socket = INVALID_SOCKET;
+	WSACleanup();
+	remove(s_address.sun_path);
+}
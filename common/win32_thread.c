@@ -0,0 +1,172 @@
+// thread.h implementation for Windows
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common/thread.h"
+
+// Sleep only wakes up on the scheduler tick, which is 15.6ms unless something raised the timer resolution, so each
+// thread gets a high resolution timer instead. Windows before 10 1803 doesn't have them, and falls back to Sleep.
+static PURPL_THREAD_LOCAL HANDLE s_sleep_timer;
+static PURPL_THREAD_LOCAL bool s_sleep_timer_failed;
+
+// CreateThread wants a DWORD return value and the WINAPI calling convention
+static DWORD WINAPI thread_entry(void *data)
+{
+	thread_t *thread = data;
+	wchar_t name[THREAD_NAME_LENGTH];
+
+	MultiByteToWideChar(CP_UTF8, 0, thread->name, -1, name, THREAD_NAME_LENGTH);
+	SetThreadDescription(GetCurrentThread(), name);
+	thread->result = thread->func(thread->data);
+
+	// Thread locals aren't cleaned up, so the timer from thread_sleep would leak
+	if (s_sleep_timer) {
+		CloseHandle(s_sleep_timer);
+		s_sleep_timer = NULL;
+	}
+
+	return 0;
+}
+
+thread_t *thread_create(thread_func_t func, const char *name, void *data)
+{
+	thread_t *thread;
+
+	if (!func)
+		return NULL;
+
+	thread = util_alloc(1, sizeof(thread_t), NULL);
+	strncpy(thread->name, name ? name : "purpl", THREAD_NAME_LENGTH - 1);
+	thread->func = func;
+	thread->data = data;
+
+	thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+	if (!thread->handle) {
+		PURPL_LOG(THREAD_LOG_PREFIX "CreateThread failed for thread %s: %u\n", thread->name, GetLastError());
+		util_free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+int32_t thread_join(thread_t *thread)
+{
+	int32_t result;
+
+	if (!thread)
+		return -1;
+
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	result = thread->result;
+	util_free(thread);
+
+	return result;
+}
+
+void thread_yield(void)
+{
+	SwitchToThread();
+}
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+void thread_sleep(uint32_t ms)
+{
+	LARGE_INTEGER due;
+
+	if (!s_sleep_timer && !s_sleep_timer_failed) {
+		s_sleep_timer =
+			CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		s_sleep_timer_failed = !s_sleep_timer;
+	}
+
+	// Negative due times are relative, in 100 nanosecond units
+	due.QuadPart = -(LONGLONG)ms * 10000;
+	if (!s_sleep_timer || !SetWaitableTimer(s_sleep_timer, &due, 0, NULL, NULL, FALSE)) {
+		Sleep(ms);
+		return;
+	}
+	WaitForSingleObject(s_sleep_timer, INFINITE);
+}
+
+uint32_t thread_get_cpu_count(void)
+{
+	return GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+uint64_t thread_get_id(void)
+{
+	return GetCurrentThreadId();
+}
+
+void mutex_init(mutex_t *mutex)
+{
+	InitializeSRWLock(mutex);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void mutex_destroy(mutex_t *mutex)
+{
+	// SRW locks don't need to be destroyed
+}
+
+void cond_init(cond_t *cond)
+{
+	InitializeConditionVariable(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+bool cond_wait_timeout(cond_t *cond, mutex_t *mutex, uint32_t timeout)
+{
+	return SleepConditionVariableSRW(cond, mutex, timeout, 0);
+}
+
+void cond_signal(cond_t *cond)
+{
+	WakeConditionVariable(cond);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+void cond_destroy(cond_t *cond)
+{
+	// Condition variables don't need to be destroyed either
+}
+
+bool futex_wait(_Atomic(uint32_t) *address, uint32_t expected, uint32_t timeout)
+{
+	if (!WaitOnAddress((volatile void *)address, &expected, sizeof(uint32_t),
+			   timeout == UINT32_MAX ? INFINITE : timeout))
+		return GetLastError() != ERROR_TIMEOUT;
+
+	return true;
+}
+
+void futex_wake(_Atomic(uint32_t) *address, bool all)
+{
+	if (all)
+		WakeByAddressAll((void *)address);
+	else
+		WakeByAddressSingle((void *)address);
+}
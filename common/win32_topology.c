@@ -0,0 +1,172 @@
+// CPU topology for Windows
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common/topology.h"
+
+// Add the processors in a group affinity to a set
+static void add_mask(topology_cpuset_t *cpus, const GROUP_AFFINITY *affinity)
+{
+	uint32_t i;
+
+	for (i = 0; i < 64; i++) {
+		if (affinity->Mask & ((KAFFINITY)1 << i))
+			topology_cpuset_add(cpus, affinity->Group * 64 + i);
+	}
+}
+
+// Check whether two sets have any processors in common
+static bool cpusets_overlap(const topology_cpuset_t *a, const topology_cpuset_t *b)
+{
+	uint32_t i;
+
+	for (i = 0; i < PURPL_ARRSIZE(a->bits); i++) {
+		if (a->bits[i] & b->bits[i])
+			return true;
+	}
+
+	return false;
+}
+
+bool topology_detect_platform(topology_t *topology)
+{
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *info;
+	topology_cpuset_t core_cpus[TOPOLOGY_MAX_CPUS];
+	topology_cpuset_t cache_cpus;
+	topology_cpuset_t package_cpus;
+	uint8_t classes[TOPOLOGY_MAX_CPUS];
+	topology_cpuset_t *cpus;
+	topology_core_t *core;
+	uint8_t *buffer;
+	DWORD size;
+	DWORD offset;
+	uint32_t highest_level;
+	uint8_t highest_class;
+	uint32_t i;
+	uint32_t j;
+	WORD k;
+
+	size = 0;
+	GetLogicalProcessorInformationEx(RelationAll, NULL, &size);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		return false;
+
+	buffer = util_alloc(1, size, NULL);
+	if (!GetLogicalProcessorInformationEx(RelationAll, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)buffer, &size)) {
+		PURPL_LOG(TOPOLOGY_LOG_PREFIX "Failed to get processor information: error %lu\n", GetLastError());
+		util_free(buffer);
+		return false;
+	}
+
+	memset(topology->cores, 0, sizeof(topology->cores));
+	memset(topology->cache_groups, 0, sizeof(topology->cache_groups));
+	topology->core_count = 0;
+	topology->cpu_count = 0;
+	topology->cache_group_count = 0;
+	topology->package_count = 0;
+
+	// Cores first, so caches and packages can be matched to them
+	highest_class = 0;
+	for (offset = 0; offset < size; offset += info->Size) {
+		info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(buffer + offset);
+		if (info->Relationship != RelationProcessorCore || topology->core_count >= TOPOLOGY_MAX_CPUS)
+			continue;
+
+		core = &topology->cores[topology->core_count];
+		cpus = &core_cpus[topology->core_count];
+		memset(cpus, 0, sizeof(topology_cpuset_t));
+		for (k = 0; k < info->Processor.GroupCount; k++)
+			add_mask(cpus, &info->Processor.GroupMask[k]);
+		for (i = 0; i < TOPOLOGY_MAX_CPUS; i++) {
+			if (core->cpu_count < TOPOLOGY_MAX_SMT && topology_cpuset_has(cpus, i))
+				core->cpus[core->cpu_count++] = i;
+		}
+
+		// Higher efficiency classes are faster, and they're all 0 on CPUs that aren't hybrid
+		classes[topology->core_count] = info->Processor.EfficiencyClass;
+		highest_class = PURPL_MAX(highest_class, info->Processor.EfficiencyClass);
+		topology->cpu_count += core->cpu_count;
+		topology->core_count++;
+	}
+
+	// Only the highest level unified or data cache makes a group
+	highest_level = 0;
+	for (offset = 0; offset < size; offset += info->Size) {
+		info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(buffer + offset);
+		if (info->Relationship == RelationCache && info->Cache.Type != CacheInstruction)
+			highest_level = PURPL_MAX(highest_level, info->Cache.Level);
+	}
+
+	for (offset = 0; offset < size; offset += info->Size) {
+		info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(buffer + offset);
+		if (info->Relationship == RelationCache && info->Cache.Type != CacheInstruction &&
+		    info->Cache.Level == highest_level && topology->cache_group_count < TOPOLOGY_MAX_CACHE_GROUPS) {
+			memset(&cache_cpus, 0, sizeof(topology_cpuset_t));
+			add_mask(&cache_cpus, &info->Cache.GroupMask);
+			for (i = 0; i < topology->core_count; i++) {
+				if (cpusets_overlap(&core_cpus[i], &cache_cpus)) {
+					topology->cores[i].cache_group = topology->cache_group_count;
+					topology->cache_groups[topology->cache_group_count].core_count++;
+				}
+			}
+			topology->cache_groups[topology->cache_group_count].level = info->Cache.Level;
+			topology->cache_groups[topology->cache_group_count].size = info->Cache.CacheSize;
+			topology->cache_group_count++;
+		} else if (info->Relationship == RelationProcessorPackage) {
+			memset(&package_cpus, 0, sizeof(topology_cpuset_t));
+			for (k = 0; k < info->Processor.GroupCount; k++)
+				add_mask(&package_cpus, &info->Processor.GroupMask[k]);
+			for (i = 0; i < topology->core_count; i++) {
+				if (cpusets_overlap(&core_cpus[i], &package_cpus))
+					topology->cores[i].package = topology->package_count;
+			}
+			topology->package_count++;
+		}
+	}
+
+	util_free(buffer);
+
+	// Without cache information, every core is in one group
+	if (!topology->cache_group_count) {
+		topology->cache_groups[0].core_count = topology->core_count;
+		topology->cache_group_count = 1;
+	}
+	topology->package_count = PURPL_MAX(topology->package_count, 1);
+
+	topology->efficiency_count = 0;
+	for (j = 0; j < topology->core_count; j++) {
+		if (classes[j] < highest_class) {
+			topology->cores[j].type = TOPOLOGY_CORE_EFFICIENCY;
+			topology->efficiency_count++;
+		}
+	}
+
+	return topology->core_count > 0;
+}
+
+bool topology_set_affinity(const topology_cpuset_t *cpus)
+{
+	GROUP_AFFINITY affinity;
+	uint32_t i;
+
+	// A thread can only be in one processor group, so use the group of the first processor
+	memset(&affinity, 0, sizeof(GROUP_AFFINITY));
+	for (i = 0; i < TOPOLOGY_MAX_CPUS && !topology_cpuset_has(cpus, i); i++)
+		;
+	if (i == TOPOLOGY_MAX_CPUS)
+		return false;
+
+	affinity.Group = (WORD)(i / 64);
+	for (; i < (affinity.Group + 1u) * 64 && i < TOPOLOGY_MAX_CPUS; i++) {
+		if (topology_cpuset_has(cpus, i))
+			affinity.Mask |= (KAFFINITY)1 << (i % 64);
+	}
+
+	if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL)) {
+		PURPL_LOG(TOPOLOGY_LOG_PREFIX "Failed to set thread affinity: error %lu\n", GetLastError());
+		return false;
+	}
+
+	return true;
+}
@@ -16,10 +16,10 @@ extern bool engine_directx_init(void);
 extern bool engine_directx_create_device(void);
 
 // Prepare to draw a frame
-extern bool engine_directx_begin_frame(uint64_t delta);
+extern bool engine_directx_begin_frame(const frame_delta_t *delta);
 
 // Finish commands
-extern bool engine_directx_end_frame(uint64_t delta);
+extern bool engine_directx_end_frame(const frame_delta_t *delta);
 
 // Shut down Direct3D
 extern void engine_directx_shutdown(void);
@@ -4,85 +4,349 @@
 
 engine_dll_t *g_engine;
 
+static taskgraph_t *s_frame_graph;
+static const frame_delta_t *s_frame_delta; // Delta the graph ran with, which is the recording's while replaying
+
+#ifdef PURPL_PROFILE
+static char *s_profile_path;
+#endif
+
+// The launcher allocates a dll_t and the engine fills in the rest of it
+static_assert(sizeof(engine_dll_t) <= sizeof(dll_t), "engine_dll_t has outgrown the padding in dll_t");
+
+// Allocate memory for SDL
+static void *sdl_malloc(size_t size)
+{
+	return alloc_malloc(ALLOC_TAG_SDL, size);
+}
+
+// Allocate zeroed memory for SDL
+static void *sdl_calloc(size_t count, size_t size)
+{
+	return alloc_calloc(ALLOC_TAG_SDL, count, size);
+}
+
+// Resize memory for SDL
+static void *sdl_realloc(void *ptr, size_t size)
+{
+	return alloc_realloc(ALLOC_TAG_SDL, ptr, size);
+}
+
+// Allocate memory for flecs
+static void *ecs_malloc(int32_t size)
+{
+	return alloc_malloc(ALLOC_TAG_ECS, (size_t)size);
+}
+
+// Allocate zeroed memory for flecs
+static void *ecs_calloc(int32_t size)
+{
+	return alloc_calloc(ALLOC_TAG_ECS, 1, (size_t)size);
+}
+
+// Resize memory for flecs
+static void *ecs_realloc(void *ptr, int32_t size)
+{
+	return alloc_realloc(ALLOC_TAG_ECS, ptr, (size_t)size);
+}
+
+// Make SDL and flecs allocate through the tracker, which has to happen before either of them allocates anything
+static void set_allocators(void)
+{
+	ecs_os_api_t api;
+
+	if (SDL_SetMemoryFunctions(sdl_malloc, sdl_calloc, sdl_realloc, alloc_free) < 0)
+		LOG_WARNING(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Failed to set SDL memory functions: %s\n",
+			    SDL_GetError());
+
+	ecs_os_set_api_defaults();
+	api = ecs_os_api;
+	api.malloc_ = ecs_malloc;
+	api.calloc_ = ecs_calloc;
+	api.realloc_ = ecs_realloc;
+	api.free_ = alloc_free;
+	ecs_os_set_api(&api);
+
+	alloc_set_budget(ALLOC_TAG_SDL, ENGINE_SDL_MEMORY_BUDGET);
+	alloc_set_budget(ALLOC_TAG_ECS, ENGINE_ECS_MEMORY_BUDGET);
+	alloc_set_budget(ALLOC_TAG_ZSTD, ENGINE_ZSTD_MEMORY_BUDGET);
+}
+
+// Hand out finished asset requests, whose callbacks can touch the world
+static bool loader_task(void *data, const void *param)
+{
+	loader_update(g_engine->loader, ENGINE_LOADER_CALLBACKS_PER_FRAME);
+	return true;
+}
+
+// Run the first half of the world's systems
+static bool world_begin_task(void *data, const void *param)
+{
+	engine_world_begin_frame(param);
+	return true;
+}
+
+// Run the second half of the world's systems
+static bool world_end_task(void *data, const void *param)
+{
+	engine_world_end_frame(param);
+	return true;
+}
+
+// Pick up the simulation's latest snapshot
+static bool sim_task(void *data, const void *param)
+{
+	engine_sim_update();
+	return true;
+}
+
+// Start drawing a frame
+static bool render_begin_task(void *data, const void *param)
+{
+	return engine_render_begin_frame(param);
+}
+
+// Build the graph of everything engine_begin_frame does. Starting the frame stays on the main thread, because of the
+// window, and overlaps with the world's systems. engine_end_frame finishes drawing once the graph is done, so the
+// launcher times the two halves separately.
+static bool build_frame_graph(void)
+{
+	bool success;
+
+	s_frame_graph = taskgraph_create("frame");
+	if (!s_frame_graph)
+		return false;
+
+	// When the world ticks on its own thread, all the frame needs from it is the latest snapshot
+	if (engine_sim_is_running()) {
+		success = taskgraph_add(s_frame_graph, "sim update", sim_task, NULL, 0, NULL, "snapshot");
+	} else {
+		success = taskgraph_add(s_frame_graph, "asset callbacks", loader_task, NULL, 0, NULL, "world") &&
+			  taskgraph_add(s_frame_graph, "world begin", world_begin_task, NULL, 0, NULL, "world") &&
+			  taskgraph_add(s_frame_graph, "world end", world_end_task, NULL, 0, NULL, "world");
+	}
+	success = success &&
+		  taskgraph_add(s_frame_graph, "render begin", render_begin_task, NULL, TASKGRAPH_MAIN_THREAD, NULL,
+				"render") &&
+		  taskgraph_build(s_frame_graph);
+
+	return success;
+}
+
 bool engine_init(const char *basedir, const char *coredir, const char *gamedir, gameinfo_t *core, gameinfo_t *game, render_api_t render_api, bool devmode)
 {
 	SDL_WindowFlags wnd_flags;
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Initializing engine for game %s\n", game->title);
+	metrics_use_registry(g_engine->metrics);
+	startup_use_timeline(g_engine->startup);
+	alloc_use_tracker(g_engine->alloc);
+	job_use_system(g_engine->jobs);
+	topology_use(g_engine->topology);
+	set_allocators();
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Initializing engine for game %s\n", game->title);
 
 	g_engine->dev = devmode;
 	g_engine->core = core;
 	g_engine->game = game;
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Initializing SDL\n");
-	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-		PURPL_LOG(ENGINE_LOG_PREFIX "Failed to initialize SDL: %s\n", SDL_GetError());
+#ifdef PURPL_PROFILE
+	// The launcher clears the trace, and both of them add to it when they shut down
+	if (devmode) {
+		s_profile_path = util_append(basedir, PROFILE_FILE_NAME);
+		profile_set_enabled(true);
+	}
+#endif
+
+	// Headless runs still get events, so they can be stopped with SDL_QUIT
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Initializing SDL\n");
+	startup_begin("SDL_Init");
+	if (SDL_Init(render_api == RENDER_API_NONE ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Failed to initialize SDL: %s\n", SDL_GetError());
+		startup_end();
 		return false;
 	}
+	startup_end();
 
 	wnd_flags = SDL_WINDOW_ALLOW_HIGHDPI;
 	if (render_api == RENDER_API_VULKAN)
 		wnd_flags |= SDL_WINDOW_VULKAN;
 
+	// Without a window, the pacer treats it as visible so it runs at the normal rate
 	g_engine->wnd_width = 1024;
 	g_engine->wnd_height = 576;
-	g_engine->wnd = SDL_CreateWindow(game->title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, g_engine->wnd_width, g_engine->wnd_height,
-				 wnd_flags);
-	PURPL_ASSERT(g_engine->wnd);
+	g_engine->wnd_visible = true;
+	if (render_api != RENDER_API_NONE) {
+		STARTUP_SCOPE("create window")
+			g_engine->wnd = SDL_CreateWindow(game->title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+							 g_engine->wnd_width, g_engine->wnd_height, wnd_flags);
+		PURPL_ASSERT(g_engine->wnd);
+	}
 
 	// TODO: make this dependant on settings instead of just being hardcoded to my better GPU
 	g_engine->device_idx = -1;
 
-	PURPL_ASSERT(engine_render_init(render_api));
+	startup_begin("render init");
+	if (!engine_render_init(render_api)) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE,
+			  ENGINE_LOG_PREFIX "Failed to initialize %s, use -headless to run without rendering\n",
+			  engine_render_api_name(render_api));
+		startup_end();
+		return false;
+	}
+	startup_end();
+
+	startup_begin("create world");
+	if (!engine_world_init(game->ecs_threads ? game->ecs_threads : core->ecs_threads)) {
+		startup_end();
+		return false;
+	}
+	startup_end();
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Starting asset loader\n");
+	STARTUP_SCOPE("start asset loader") {
+		g_engine->loader = loader_create(ENGINE_LOADER_IO_THREADS, PURPL_MAX(thread_get_cpu_count() / 4, 1));
+		loader_add_source(g_engine->loader, game);
+		loader_add_source(g_engine->loader, core);
+	}
+
+	if (g_engine->replay_path || g_engine->record_path) {
+		// The simulation thread keeps its own time, so its ticks wouldn't line up with the recorded frames
+		if (g_engine->tick_rate) {
+			LOG_WARNING(LOG_SUBSYSTEM_ENGINE,
+				    ENGINE_LOG_PREFIX "Ticking once per frame instead of %u times a second, since "
+						      "recordings need the same ticks every time\n",
+				    g_engine->tick_rate);
+			g_engine->tick_rate = 0;
+		}
+
+		if (g_engine->replay_path ? !engine_replay_play(g_engine->replay_path)
+					  : !engine_replay_record(g_engine->record_path))
+			return false;
+	}
+
+	// From here on, only the simulation thread touches the world and the loader's callbacks
+	if (g_engine->tick_rate) {
+		STARTUP_SCOPE("start simulation")
+			engine_sim_start(g_engine->tick_rate);
+	}
+
+	if (!build_frame_graph()) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Failed to build frame task graph\n");
+		return false;
+	}
 
 	return true;
 }
 
-bool engine_begin_frame(uint64_t delta)
+bool engine_begin_frame(const frame_delta_t *delta)
 {
 	SDL_Event event;
 
-	while (SDL_PollEvent(&event)) {
-		if (event.type == SDL_WINDOWEVENT && event.window.windowID == SDL_GetWindowID(g_engine->wnd)) {
+	PURPL_PROFILE_BEGIN("engine_begin_frame");
+
+	frame_begin();
+
+	// While playing a recording, its deltas and events replace the real ones
+	delta = engine_replay_begin_frame(delta);
+	if (!delta) {
+		PURPL_PROFILE_END();
+		return false;
+	}
+
+	while (engine_replay_poll_event(&event)) {
+		if (event.type == SDL_QUIT) {
+			LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Quit requested\n");
+			PURPL_PROFILE_END();
+			return false;
+		} else if (event.type == SDL_WINDOWEVENT && g_engine->wnd &&
+			   event.window.windowID == SDL_GetWindowID(g_engine->wnd)) {
 			switch (event.window.event) {
 			case SDL_WINDOWEVENT_FOCUS_LOST:
-				PURPL_LOG(ENGINE_LOG_PREFIX "Window unfocused\n");
+				LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Window unfocused\n");
 				g_engine->wnd_visible = false;
 				break;
 			case SDL_WINDOWEVENT_FOCUS_GAINED:
-				PURPL_LOG(ENGINE_LOG_PREFIX "Window focused\n");
+				LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Window focused\n");
 				g_engine->wnd_visible = true;
 				break;
 			case SDL_WINDOWEVENT_CLOSE:
-				PURPL_LOG(ENGINE_LOG_PREFIX "Window closed\n");
+				LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Window closed\n");
+				PURPL_PROFILE_END();
 				return false;
 			}
 		}
 	}
 
-	engine_render_begin_frame(delta);
+	engine_replay_end_frame();
+
+	s_frame_delta = delta;
+	if (!taskgraph_run(s_frame_graph, delta)) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Frame %" PRIu64 " failed\n", delta->frame);
+		PURPL_PROFILE_END();
+		return false;
+	}
+
+	PURPL_PROFILE_END();
 
 	return true;
 }
 
-bool engine_end_frame(uint64_t delta)
+bool engine_end_frame(const frame_delta_t *delta)
 {
-	engine_render_end_frame(delta);
-	return true;
+	bool success;
+
+	PURPL_PROFILE_BEGIN("engine_end_frame");
+
+	// The world is done by now, since taskgraph_run waits for everything
+	success = engine_render_end_frame(s_frame_delta ? s_frame_delta : delta);
+	if (!success)
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Failed to finish frame %" PRIu64 "\n", delta->frame);
+
+	frame_end();
+	PURPL_PROFILE_END();
+	return success;
 }
 
 void engine_shutdown(void)
 {
-	PURPL_LOG(ENGINE_LOG_PREFIX "Shutting down\n");
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Shutting down\n");
+
+	engine_sim_stop();
+	engine_replay_stop();
+
+	if (g_engine->dev)
+		taskgraph_log(s_frame_graph);
+	taskgraph_destroy(s_frame_graph);
+	s_frame_graph = NULL;
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Stopping asset loader\n");
+	loader_destroy(g_engine->loader);
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Destroying window\n");
-	SDL_DestroyWindow(g_engine->wnd);
+	engine_world_shutdown();
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Shutting down SDL\n");
+	if (g_engine->wnd) {
+		LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Destroying window\n");
+		SDL_DestroyWindow(g_engine->wnd);
+		g_engine->wnd = NULL;
+	}
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Shutting down SDL\n");
 	SDL_Quit();
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Shutting down rendering\n");
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, ENGINE_LOG_PREFIX "Shutting down rendering\n");
 	engine_render_shutdown();
+
+	frame_shutdown();
+
+#ifdef PURPL_PROFILE
+	if (s_profile_path) {
+		profile_dump(s_profile_path);
+		profile_shutdown();
+		util_free(s_profile_path);
+		s_profile_path = NULL;
+	}
+#endif
 }
 
 PURPL_INTERFACE void create_interface(engine_dll_t *dll)
@@ -90,7 +354,8 @@ PURPL_INTERFACE void create_interface(engine_dll_t *dll)
 	if (!dll)
 		return;
 
-	PURPL_LOG(ENGINE_LOG_PREFIX "Creating interface to engine v%u.%u.%u.%u\n", PURPL_VERSION_FORMAT(PURPL_VERSION));
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE,
+		 ENGINE_LOG_PREFIX "Creating interface to engine v%u.%u.%u.%u\n", PURPL_VERSION_FORMAT(PURPL_VERSION));
 
 	g_engine = dll;
 	g_engine->version = PURPL_VERSION;
@@ -3,14 +3,37 @@
 #pragma once
 
 #include "common/common.h"
+#include "common/alloc.h"
+#include "common/arena.h"
 #include "common/dll.h"
 #include "common/gameinfo.h"
+#include "common/job.h"
+#include "common/loader.h"
+#include "common/metrics.h"
 #include "common/pack.h"
+#include "common/profile.h"
+#include "common/startup.h"
+#include "common/taskgraph.h"
+#include "common/topology.h"
 
 #include "render.h"
+#include "replay.h"
+#include "sim.h"
+#include "world.h"
 
 #define ENGINE_LOG_PREFIX "ENGINE: "
 
+// Number of asset streaming I/O threads
+#define ENGINE_LOADER_IO_THREADS 2
+
+// Maximum number of finished asset requests to hand out each frame, so a burst of them can't cause a hitch
+#define ENGINE_LOADER_CALLBACKS_PER_FRAME 16
+
+// Bytes SDL, flecs and zstd are each expected to stay under, going over one logs a warning
+#define ENGINE_SDL_MEMORY_BUDGET (32 * 1024 * 1024)
+#define ENGINE_ECS_MEMORY_BUDGET (64 * 1024 * 1024)
+#define ENGINE_ZSTD_MEMORY_BUDGET (16 * 1024 * 1024)
+
 // Interface to the engine
 typedef struct engine_dll {
 	// Fields shared with dll_t
@@ -37,6 +60,18 @@ typedef struct engine_dll {
 	int32_t device_idx; // Index of the graphics device
 
 	ecs_world_t *world; // ECS world
+
+	loader_t *loader; // Asset streaming
+
+	uint32_t tick_rate; // Ticks per second to simulate on its own thread, 0 to tick once per frame, set before init
+	const char *record_path; // File to record frames to, NULL for none, set before init
+	const char *replay_path; // Recording to play back instead of real input, NULL for none, set before init
+
+	metrics_registry_t *metrics; // The launcher's metrics registry, set before init so the engine records into it
+	startup_timeline_t *startup; // The launcher's startup timeline, set before init like metrics
+	alloc_tracker_t *alloc; // The launcher's allocation tracker, set before init like metrics
+	job_system_t *jobs; // The launcher's job system, set before init like metrics
+	topology_t *topology; // The launcher's CPU topology and affinity policy, set before init like metrics
 } engine_dll_t;
 
 // Global engine interface
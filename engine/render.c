@@ -12,6 +12,8 @@ const char *engine_render_api_name(render_api_t api)
 		return "Direct3D 12";
 	case RENDER_API_METAL:
 		return "Metal";
+	case RENDER_API_NONE:
+		return "None";
 	}
 
 	return "Unknown";
@@ -33,71 +35,124 @@ const char *engine_render_pci_vendor_name(pci_vendor_id_t vendor)
 
 bool engine_render_init(render_api_t api)
 {
+	bool success;
+
 	g_engine->render_api = api;
 
+	PURPL_PROFILE_BEGIN("engine_render_init");
+	ALLOC_PUSH_TAG(ALLOC_TAG_RENDER);
+
 	switch (g_engine->render_api) {
 #ifndef __APPLE__
 	case RENDER_API_VULKAN:
-		return engine_vulkan_init();
+		success = engine_vulkan_init();
+		break;
 #endif
 #ifdef _WIN32
 	case RENDER_API_DIRECTX:
-		return engine_directx_init();
+		success = engine_directx_init();
+		break;
 #endif
 #ifdef __APPLE__
 	case RENDER_API_METAL:
-		return engine_metal_init();
+		success = engine_metal_init();
+		break;
 #endif
+	case RENDER_API_NONE:
+		LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Running headless, nothing will be drawn\n");
+		success = true;
+		break;
 	default:
-		PURPL_LOG(RENDER_LOG_PREFIX "Render initialization attempted with invalid API %d\n", api);
-		return false;
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "Render initialization attempted with invalid API %d\n", api);
+		success = false;
+		break;
 	}
+
+	ALLOC_POP_TAG();
+	PURPL_PROFILE_END();
+
+	return success;
 }
 
-bool engine_render_begin_frame(uint64_t delta)
+bool engine_render_begin_frame(const frame_delta_t *delta)
 {
+	bool success;
+
+	PURPL_PROFILE_BEGIN("engine_render_begin_frame");
+
 	switch (g_engine->render_api) {
 #ifdef VULKAN_ENABLED
 	case RENDER_API_VULKAN:
-		return engine_vulkan_begin_frame(delta);
+		success = engine_vulkan_begin_frame(delta);
+		break;
 #endif
 #ifdef DIRECTX_ENABLED
 	case RENDER_API_DIRECTX:
-		return engine_directx_begin_frame(delta);
+		success = engine_directx_begin_frame(delta);
+		break;
 #endif
 #ifdef METAL_ENABLED
 	case RENDER_API_METAL:
-		return engine_metal_begin_frame(delta);
+		success = engine_metal_begin_frame(delta);
+		break;
 #endif
+	case RENDER_API_NONE:
+		success = true;
+		break;
 	default:
-		PURPL_LOG(RENDER_LOG_PREFIX "Frame setup attempted with invalid API %d\n", g_engine->render_api);
-		return false;
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "Frame setup attempted with invalid API %d\n", g_engine->render_api);
+		success = false;
+		break;
 	}
+
+	PURPL_PROFILE_END();
+
+	return success;
 }
 
-bool engine_render_end_frame(uint64_t delta)
+bool engine_render_end_frame(const frame_delta_t *delta)
 {
+	bool success;
+
+	PURPL_PROFILE_BEGIN("engine_render_end_frame");
+
 	switch (g_engine->render_api) {
 #ifdef VULKAN_ENABLED
 	case RENDER_API_VULKAN:
-		return engine_vulkan_end_frame(delta);
+		success = engine_vulkan_end_frame(delta);
+		break;
 #endif
 #ifdef DIRECTX_ENABLED
 	case RENDER_API_DIRECTX:
-		return engine_directx_end_frame(delta);
+		success = engine_directx_end_frame(delta);
+		break;
 #endif
 #ifdef METAL_ENABLED
 	case RENDER_API_METAL:
-		return engine_metal_end_frame(delta);
+		success = engine_metal_end_frame(delta);
+		break;
 #endif
+	case RENDER_API_NONE:
+		success = true;
+		break;
 	default:
-		PURPL_LOG(RENDER_LOG_PREFIX "Frame draw attempted with invalid API %d\n", g_engine->render_api);
-		return false;
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "Frame draw attempted with invalid API %d\n", g_engine->render_api);
+		success = false;
+		break;
 	}
+
+	PURPL_PROFILE_END();
+
+	return success;
 }
 
 void engine_render_shutdown(void)
 {
+	PURPL_PROFILE_BEGIN("engine_render_shutdown");
+
 	switch (g_engine->render_api) {
 #ifdef VULKAN_ENABLED
 	case RENDER_API_VULKAN:
@@ -114,8 +169,13 @@ void engine_render_shutdown(void)
 		engine_metal_shutdown();
 		break;
 #endif
+	case RENDER_API_NONE:
+		break;
 	default:
-		PURPL_LOG(RENDER_LOG_PREFIX "Render shutdown attempted with invalid API %d\n", g_engine->render_api);
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "Render shutdown attempted with invalid API %d\n", g_engine->render_api);
 		break;
 	}
+
+	PURPL_PROFILE_END();
 }
@@ -22,6 +22,7 @@ typedef enum render_api {
 	RENDER_API_VULKAN = 0, // Vulkan, non-Apple only
 	RENDER_API_DIRECTX = 1, // Direct3D 12, Windows-based only (Windows, ReactOS maybe, Xbox)
 	RENDER_API_METAL = 2, // Metal, Apple systems only
+	RENDER_API_NONE = 3, // No window or graphics device, for servers and automated runs
 } render_api_t;
 
 // Graphics device vendors
@@ -41,10 +42,10 @@ extern const char *engine_render_pci_vendor_name(pci_vendor_id_t vendor);
 extern bool engine_render_init(render_api_t api);
 
 // Set up a frame to be drawn
-extern bool engine_render_begin_frame(uint64_t delta);
+extern bool engine_render_begin_frame(const frame_delta_t *delta);
 
 // Draw a frame
-extern bool engine_render_end_frame(uint64_t delta);
+extern bool engine_render_end_frame(const frame_delta_t *delta);
 
 // Shut down rendering
 extern void engine_render_shutdown(void);
@@ -0,0 +1,231 @@
+// Recording and replaying frames
+
+#include "engine.h"
+#include "replay.h"
+
+#include "common/container.h"
+
+// Most events a frame in a recording can have, so a corrupt one can't ask for a huge allocation
+#define REPLAY_MAX_EVENTS 65536
+
+ARRAY_DECLARE(replay_events, SDL_Event)
+
+static FILE *s_file;
+static char *s_path;
+static bool s_playing;
+static replay_events_t s_events; // Events in the current frame
+static size_t s_next_event; // Index of the next recorded event to hand out
+static uint64_t s_delta; // Delta of the frame being recorded
+static frame_delta_t s_replay_delta; // Delta of the frame being played
+static uint64_t s_frames; // Frames recorded or played so far
+
+// Check whether an event can be recorded, which it can't if it points to memory outside itself
+static bool is_recordable(const SDL_Event *event)
+{
+	switch (event->type) {
+	case SDL_SYSWMEVENT:
+	case SDL_DROPFILE:
+	case SDL_DROPTEXT:
+		return false;
+	default:
+		return event->type < SDL_USEREVENT;
+	}
+}
+
+// Point a recorded event at this run's window
+static void fix_window(SDL_Event *event)
+{
+	switch (event->type) {
+	case SDL_WINDOWEVENT:
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+	case SDL_TEXTEDITING:
+	case SDL_TEXTINPUT:
+	case SDL_MOUSEMOTION:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+	case SDL_MOUSEWHEEL:
+		// These all start with the type, a timestamp, and the window ID
+		event->window.windowID = g_engine->wnd ? SDL_GetWindowID(g_engine->wnd) : 0;
+		break;
+	}
+}
+
+bool engine_replay_record(const char *path)
+{
+	replay_header_t header;
+
+	if (!path || s_file)
+		return false;
+
+	s_file = fopen(path, "wb");
+	if (!s_file) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	memset(&header, 0, sizeof(replay_header_t));
+	header.magic = REPLAY_MAGIC;
+	header.version = REPLAY_VERSION;
+	header.event_size = sizeof(SDL_Event);
+	if (fwrite(&header, sizeof(replay_header_t), 1, s_file) != 1) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Failed to write to %s: %s\n", path, strerror(errno));
+		fclose(s_file);
+		s_file = NULL;
+		return false;
+	}
+
+	s_path = util_strdup(path);
+	s_playing = false;
+	s_frames = 0;
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Recording frames to %s\n", path);
+
+	return true;
+}
+
+bool engine_replay_play(const char *path)
+{
+	replay_header_t header;
+
+	if (!path || s_file)
+		return false;
+
+	s_file = fopen(path, "rb");
+	if (!s_file) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (fread(&header, sizeof(replay_header_t), 1, s_file) != 1 || header.magic != REPLAY_MAGIC ||
+	    header.version != REPLAY_VERSION) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "%s isn't a version %u recording\n", path,
+			  REPLAY_VERSION);
+		fclose(s_file);
+		s_file = NULL;
+		return false;
+	}
+	if (header.event_size != sizeof(SDL_Event)) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE,
+			  REPLAY_LOG_PREFIX "%s has %u byte events, but this build of SDL has %zu byte events\n", path,
+			  header.event_size, sizeof(SDL_Event));
+		fclose(s_file);
+		s_file = NULL;
+		return false;
+	}
+
+	s_path = util_strdup(path);
+	s_playing = true;
+	s_frames = 0;
+	memset(&s_replay_delta, 0, sizeof(frame_delta_t));
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Playing back %s\n", path);
+
+	return true;
+}
+
+bool engine_replay_is_playing(void)
+{
+	return s_file && s_playing;
+}
+
+const frame_delta_t *engine_replay_begin_frame(const frame_delta_t *delta)
+{
+	replay_frame_t frame;
+
+	replay_events_clear(&s_events);
+	s_next_event = 0;
+	if (!s_file)
+		return delta;
+
+	if (!s_playing) {
+		s_delta = delta->delta;
+		return delta;
+	}
+
+	if (fread(&frame, sizeof(replay_frame_t), 1, s_file) != 1) {
+		LOG_INFO(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Finished playing %" PRIu64 " %s from %s\n", s_frames,
+			 PURPL_PLURALIZE(s_frames, "frames", "frame"), s_path);
+		return NULL;
+	}
+	if (frame.event_count > REPLAY_MAX_EVENTS ||
+	    (frame.event_count && fread(replay_events_push_n(&s_events, NULL, frame.event_count), sizeof(SDL_Event),
+					frame.event_count, s_file) != frame.event_count)) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Frame %" PRIu64 " of %s is corrupt\n", s_frames,
+			  s_path);
+		return NULL;
+	}
+
+	// Only the start time is real, so the launcher can still time the frame
+	s_replay_delta.start = delta->start;
+	s_replay_delta.frame = s_frames;
+	s_replay_delta.delta = frame.delta;
+	s_replay_delta.elapsed += frame.delta;
+	s_replay_delta.seconds = UTIL_NS_TO_SEC(frame.delta);
+	s_frames++;
+
+	return &s_replay_delta;
+}
+
+bool engine_replay_poll_event(SDL_Event *event)
+{
+	if (!event)
+		return false;
+
+	if (engine_replay_is_playing()) {
+		// Real input would make the run different, but it should still be possible to stop it
+		while (SDL_PollEvent(event)) {
+			if (event->type == SDL_QUIT)
+				return true;
+		}
+
+		if (s_next_event >= s_events.count)
+			return false;
+		*event = s_events.data[s_next_event++];
+		fix_window(event);
+		return true;
+	}
+
+	if (!SDL_PollEvent(event))
+		return false;
+	if (s_file && is_recordable(event))
+		replay_events_push(&s_events, *event);
+
+	return true;
+}
+
+void engine_replay_end_frame(void)
+{
+	replay_frame_t frame;
+
+	if (!s_file || s_playing)
+		return;
+
+	memset(&frame, 0, sizeof(replay_frame_t));
+	frame.delta = s_delta;
+	frame.event_count = (uint32_t)s_events.count;
+	if (fwrite(&frame, sizeof(replay_frame_t), 1, s_file) != 1 ||
+	    (s_events.count && fwrite(s_events.data, sizeof(SDL_Event), s_events.count, s_file) != s_events.count)) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Failed to write frame %" PRIu64 " to %s: %s\n",
+			  s_frames, s_path, strerror(errno));
+		engine_replay_stop();
+		return;
+	}
+
+	s_frames++;
+}
+
+void engine_replay_stop(void)
+{
+	if (!s_file)
+		return;
+
+	if (!s_playing)
+		LOG_INFO(LOG_SUBSYSTEM_ENGINE, REPLAY_LOG_PREFIX "Recorded %" PRIu64 " %s to %s\n", s_frames,
+			 PURPL_PLURALIZE(s_frames, "frames", "frame"), s_path);
+
+	fclose(s_file);
+	s_file = NULL;
+	s_playing = false;
+	util_free(s_path);
+	s_path = NULL;
+	replay_events_free(&s_events);
+}
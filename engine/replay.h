@@ -0,0 +1,54 @@
+// Recording and replaying frames. While recording, the delta of every frame and the SDL events polled in it are
+// written to a file, and a replay reads them back in place of the clock and the real events, so every run of it does
+// the same work with the same deltas. Frames don't wait for each other in a replay, so with no frame limit it runs as
+// fast as the engine can, which makes it a repeatable workload for comparing builds. Events that point to memory
+// outside themselves, like dropped files, aren't recorded. Recordings are only meant to be played back by the same
+// build of SDL on the same platform, since events are stored as they are in memory.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/util.h"
+
+#define REPLAY_LOG_PREFIX ENGINE_LOG_PREFIX "REPLAY: "
+
+#define REPLAY_MAGIC 0x43455250 // PREC
+#define REPLAY_VERSION 1
+
+// Start of a recording
+typedef struct replay_header {
+	uint32_t magic; // REPLAY_MAGIC
+	uint32_t version; // REPLAY_VERSION
+	uint32_t event_size; // sizeof(SDL_Event) in the build that recorded it
+	uint32_t reserved; // 0
+} replay_header_t;
+
+// Start of each frame in a recording, followed by its events
+typedef struct replay_frame {
+	uint64_t delta; // Nanoseconds since the previous frame
+	uint32_t event_count; // Number of events
+	uint32_t reserved; // 0
+} replay_frame_t;
+
+// Start recording to a file
+extern bool engine_replay_record(const char *path);
+
+// Start playing a recording back
+extern bool engine_replay_play(const char *path);
+
+// Get whether a recording is being played back
+extern bool engine_replay_is_playing(void);
+
+// Start a frame, which returns the delta to use for it: the recorded one when playing, or delta itself. Returns NULL
+// when a playback has run out of frames.
+extern const frame_delta_t *engine_replay_begin_frame(const frame_delta_t *delta);
+
+// Get the next event for this frame, in place of SDL_PollEvent. While playing, this is the recorded events, and real
+// ones are ignored other than SDL_QUIT.
+extern bool engine_replay_poll_event(SDL_Event *event);
+
+// Finish a frame, which writes it out when recording
+extern void engine_replay_end_frame(void);
+
+// Stop recording or playing
+extern void engine_replay_stop(void);
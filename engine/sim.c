@@ -0,0 +1,175 @@
+// Fixed timestep simulation
+
+#include "engine.h"
+#include "sim.h"
+
+static thread_t *s_thread;
+static atomic_bool s_stop;
+static uint64_t s_tick_length; // Nanoseconds per tick
+static triplebuf_t *s_snapshots; // Snapshots from the simulation thread
+static sim_snapshot_t *s_snapshot; // Snapshot being written by the simulation thread
+
+static sim_snapshot_t s_render_snapshots[2]; // Copies of the last two snapshots, since the triple buffer only has one
+static sim_snapshot_t *s_previous; // Snapshot before s_current
+static sim_snapshot_t *s_current; // Newest snapshot the main thread has
+static double s_alpha; // How far between s_previous and s_current the frame being rendered is
+
+// Ticks the world until it's told to stop
+static int32_t sim_thread(void *data)
+{
+	frame_delta_t delta;
+	uint64_t start;
+	uint64_t next;
+	uint64_t now;
+	uint64_t behind;
+	uint32_t ticks;
+	sim_snapshot_t *published;
+
+	topology_pin_thread(TOPOLOGY_ROLE_SIM, 0);
+
+	memset(&delta, 0, sizeof(frame_delta_t));
+	delta.delta = s_tick_length;
+	delta.seconds = (double)s_tick_length / UTIL_NS_PER_SEC;
+
+	start = util_get_time();
+	next = start;
+	while (!atomic_load_explicit(&s_stop, memory_order_relaxed)) {
+		now = util_get_time();
+		if (now < next) {
+			// Sleep for whole milliseconds and yield for the rest, since sleeps can overshoot by a bit
+			if (next - now > UTIL_NS_PER_MS)
+				thread_sleep((uint32_t)((next - now) / UTIL_NS_PER_MS - 1));
+			else
+				thread_yield();
+			continue;
+		}
+
+		// If it's too far behind, it won't catch up, so drop the ticks rather than running flat out forever
+		behind = (now - next) / s_tick_length;
+		if (behind > SIM_MAX_CATCH_UP) {
+			LOG_WARNING(LOG_SUBSYSTEM_ENGINE,
+				    SIM_LOG_PREFIX "Simulation is %" PRIu64 " ticks behind, skipping them\n", behind);
+			METRICS_COUNTER_ADD("sim.dropped_ticks", behind);
+			next += behind * s_tick_length;
+		}
+
+		for (ticks = 0; ticks <= SIM_MAX_CATCH_UP && next <= util_get_time(); ticks++) {
+			PURPL_PROFILE_BEGIN("sim tick");
+			delta.start = util_get_time();
+			delta.elapsed = next - start;
+
+			s_snapshot->tick = delta.frame + 1;
+			s_snapshot->time = next;
+
+			loader_update(g_engine->loader, ENGINE_LOADER_CALLBACKS_PER_FRAME);
+			engine_world_begin_frame(&delta);
+			engine_world_end_frame(&delta);
+
+			// Start the next snapshot from this one, so systems only have to write what changes
+			published = s_snapshot;
+			s_snapshot = triplebuf_publish(s_snapshots);
+			memcpy(s_snapshot, published, sizeof(sim_snapshot_t));
+			METRICS_HISTOGRAM_RECORD("sim.tick_ns", util_get_time() - delta.start);
+			PURPL_PROFILE_END();
+
+			delta.frame++;
+			next += s_tick_length;
+		}
+	}
+
+	return 0;
+}
+
+bool engine_sim_start(uint32_t tick_rate)
+{
+	if (s_thread || !tick_rate)
+		return false;
+	if (tick_rate > SIM_MAX_TICK_RATE) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, SIM_LOG_PREFIX "Tick rate %u is higher than the limit of %u\n",
+			  tick_rate, SIM_MAX_TICK_RATE);
+		return false;
+	}
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, SIM_LOG_PREFIX "Simulating at %u ticks per second on a separate thread\n",
+		 tick_rate);
+
+	s_tick_length = UTIL_NS_PER_SEC / tick_rate;
+	s_snapshots = triplebuf_create(sizeof(sim_snapshot_t));
+	s_snapshot = triplebuf_write(s_snapshots);
+	memset(s_render_snapshots, 0, sizeof(s_render_snapshots));
+	s_previous = &s_render_snapshots[0];
+	s_current = &s_render_snapshots[1];
+	s_alpha = 1.0;
+
+	atomic_store(&s_stop, false);
+	s_thread = thread_create(sim_thread, "sim", NULL);
+	PURPL_ASSERT(s_thread);
+
+	return true;
+}
+
+sim_snapshot_t *engine_sim_get_snapshot(void)
+{
+	return s_snapshot;
+}
+
+void engine_sim_update(void)
+{
+	const sim_snapshot_t *snapshot;
+	sim_snapshot_t *tmp;
+	uint64_t render_time;
+	bool fresh;
+
+	if (!s_thread)
+		return;
+
+	snapshot = triplebuf_read(s_snapshots, &fresh);
+	if (fresh) {
+		tmp = s_previous;
+		s_previous = s_current;
+		s_current = tmp;
+		memcpy(s_current, snapshot, sizeof(sim_snapshot_t));
+	}
+
+	// Rendering is a tick behind, so there's usually a snapshot on either side of it
+	render_time = util_get_time() - s_tick_length;
+	if (!s_previous->tick || s_current->time <= s_previous->time || render_time >= s_current->time)
+		s_alpha = 1.0;
+	else if (render_time <= s_previous->time)
+		s_alpha = 0.0;
+	else
+		s_alpha = (double)(render_time - s_previous->time) / (double)(s_current->time - s_previous->time);
+}
+
+double engine_sim_get_interpolation(const sim_snapshot_t **previous, const sim_snapshot_t **current)
+{
+	if (previous)
+		*previous = s_previous;
+	if (current)
+		*current = s_current;
+
+	return s_alpha;
+}
+
+bool engine_sim_is_running(void)
+{
+	return s_thread != NULL;
+}
+
+void engine_sim_stop(void)
+{
+	if (!s_thread)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, SIM_LOG_PREFIX "Stopping simulation thread\n");
+	atomic_store(&s_stop, true);
+	thread_join(s_thread);
+	s_thread = NULL;
+
+	triplebuf_destroy(s_snapshots);
+	s_snapshots = NULL;
+	s_snapshot = NULL;
+	s_previous = NULL;
+	s_current = NULL;
+	s_alpha = 1.0;
+}
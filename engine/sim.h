@@ -0,0 +1,49 @@
+// Fixed timestep simulation. With a tick rate set, the ECS world is ticked at that rate on its own thread instead of
+// once per frame, so slow rendering can't slow the game down and every tick has the same delta. Each tick fills in a
+// snapshot of what rendering needs, which is handed to the main thread through a triple buffer, and rendering draws
+// one tick in the past, interpolating between the last two snapshots it's seen, so the frame rate doesn't have to
+// match the tick rate.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/thread.h"
+#include "common/triplebuf.h"
+#include "common/util.h"
+
+#define SIM_LOG_PREFIX ENGINE_LOG_PREFIX "SIM: "
+
+// Bytes in each snapshot for game state
+#define SIM_SNAPSHOT_DATA_SIZE 4096
+
+// Highest tick rate, past which ticks are too short to time
+#define SIM_MAX_TICK_RATE 10000
+
+// Most ticks the simulation runs back to back to catch up before it gives up and drops them
+#define SIM_MAX_CATCH_UP 5
+
+// State of the simulation at the end of a tick
+typedef struct sim_snapshot {
+	uint64_t tick; // Number of the tick, starting at 1, 0 if nothing's been simulated yet
+	uint64_t time; // util_get_time the tick was scheduled for
+	uint8_t data[SIM_SNAPSHOT_DATA_SIZE]; // Game state for rendering, written by systems during the tick
+} sim_snapshot_t;
+
+// Start ticking the world at tick_rate ticks per second on another thread
+extern bool engine_sim_start(uint32_t tick_rate);
+
+// Get the snapshot the current tick is filling in, only valid on the simulation thread during a tick
+extern sim_snapshot_t *engine_sim_get_snapshot(void);
+
+// Pick up the newest snapshot and work out how far between the last two rendering is, call this once per frame
+extern void engine_sim_update(void);
+
+// Get the two snapshots to interpolate between, which are NULL if the simulation isn't running, returns how far from
+// previous to current to go, from 0 to 1
+extern double engine_sim_get_interpolation(const sim_snapshot_t **previous, const sim_snapshot_t **current);
+
+// Get whether the simulation thread is running
+extern bool engine_sim_is_running(void);
+
+// Stop the simulation thread
+extern void engine_sim_stop(void);
@@ -50,7 +50,7 @@ static queue_families_t find_queue_families(VkPhysicalDevice device)
 		}
 	}
 
-	free(families);
+	util_free(families);
 
 	return indices;
 }
@@ -84,7 +84,7 @@ static bool check_extensions(VkPhysicalDevice device, const char **extensions, s
 						  sizeof(VkExtensionProperties), extensions, extension_count,
 						  sizeof(const char *), (list_check_func_t)check_extension));
 
-	free(properties);
+	util_free(properties);
 	return supported;
 }
 
@@ -96,20 +96,23 @@ static uint32_t score_device(VkPhysicalDevice device, const char **extensions, s
 	uint32_t score;
 	queue_families_t indices;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Getting properties of device %d\n", i);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Getting properties of device %d\n", i);
 	vkGetPhysicalDeviceProperties(device, properties);
 	vkGetPhysicalDeviceFeatures(device, features);
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Checking if device %d (%s) is usable\n", i, properties->deviceName);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER,
+		 RENDER_LOG_PREFIX "Checking if device %d (%s) is usable\n", i, properties->deviceName);
 
 	indices = find_queue_families(device);
 	if (!CHECK_QUEUE_FAMILIES(indices)) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Not all queue families detected for device %d, ignoring\n", i);
+		LOG_INFO(LOG_SUBSYSTEM_RENDER,
+			 RENDER_LOG_PREFIX "Not all queue families detected for device %d, ignoring\n", i);
 		return 0;
 	}
 
 	if (!check_extensions(device, extensions, extension_count)) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Not all required extensions are supported by device %d, ignoring\n", i);
+		LOG_INFO(LOG_SUBSYSTEM_RENDER,
+			 RENDER_LOG_PREFIX "Not all required extensions are supported by device %d, ignoring\n", i);
 		return 0;
 	}
 
@@ -138,20 +141,20 @@ static uint32_t score_device(VkPhysicalDevice device, const char **extensions, s
 	score *= VK_API_VERSION_MINOR(properties->apiVersion);
 
 	// clang-format off
-	PURPL_LOG(RENDER_LOG_PREFIX "Device %d information:\n"
-		  RENDER_LOG_PREFIX "\tName: %s\n"
-		  RENDER_LOG_PREFIX "\tPCI ID: %x:%x (vendor is %s)\n"
-		  RENDER_LOG_PREFIX "\tVulkan API version: %u.%u.%u\n"
-		  RENDER_LOG_PREFIX "\tScore: %d\n"
-		  RENDER_LOG_PREFIX "\tQueue family indices:\n"
-		  RENDER_LOG_PREFIX "\t\tGraphics: %u\n"
-		  RENDER_LOG_PREFIX "\t\tPresent: %u\n"
-		  RENDER_LOG_PREFIX "\t\tCompute: %u\n",
-		  // clang-format on
-		  i, properties->deviceName, properties->vendorID, properties->deviceID,
-		  engine_render_pci_vendor_name(properties->vendorID), VK_API_VERSION_MAJOR(properties->apiVersion),
-		  VK_API_VERSION_MINOR(properties->apiVersion), VK_API_VERSION_PATCH(properties->apiVersion), score,
-		  indices.graphics, indices.present, indices.compute);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Device %d information:\n"
+		 RENDER_LOG_PREFIX "\tName: %s\n"
+		 RENDER_LOG_PREFIX "\tPCI ID: %x:%x (vendor is %s)\n"
+		 RENDER_LOG_PREFIX "\tVulkan API version: %u.%u.%u\n"
+		 RENDER_LOG_PREFIX "\tScore: %d\n"
+		 RENDER_LOG_PREFIX "\tQueue family indices:\n"
+		 RENDER_LOG_PREFIX "\t\tGraphics: %u\n"
+		 RENDER_LOG_PREFIX "\t\tPresent: %u\n"
+		 RENDER_LOG_PREFIX "\t\tCompute: %u\n",
+		 // clang-format on
+		 i, properties->deviceName, properties->vendorID, properties->deviceID,
+		 engine_render_pci_vendor_name(properties->vendorID), VK_API_VERSION_MAJOR(properties->apiVersion),
+		 VK_API_VERSION_MINOR(properties->apiVersion), VK_API_VERSION_PATCH(properties->apiVersion), score,
+		 indices.graphics, indices.present, indices.compute);
 
 	return score;
 }
@@ -170,27 +173,28 @@ bool engine_vulkan_choose_device(const char **extensions, size_t extension_count
 	VkPhysicalDeviceProperties best_properties;
 	VkPhysicalDeviceFeatures best_features;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Getting devices\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Getting devices\n");
 	vkEnumeratePhysicalDevices(g_vulkan_inst, &device_count, NULL);
 	physical_devices = util_alloc(device_count, sizeof(VkPhysicalDevice), NULL);
 	result = vkEnumeratePhysicalDevices(g_vulkan_inst, &device_count, physical_devices);
 	if (result != VK_SUCCESS) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Failed to enumerate devices: VkResult %d\n", result);
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Failed to enumerate devices: VkResult %d\n", result);
 		return false;
 	}
-	PURPL_LOG(RENDER_LOG_PREFIX "Got %d devices\n", device_count);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Got %d devices\n", device_count);
 
 	if (g_engine->device_idx > 0 && g_engine->device_idx <= device_count) {
 		g_vulkan_phys_device = physical_devices[g_engine->device_idx];
 		vkGetPhysicalDeviceProperties(g_vulkan_phys_device, &properties);
-		PURPL_LOG(RENDER_LOG_PREFIX "Device %d (%s) is within valid range, assuming it works. If not,"
+		LOG_INFO(LOG_SUBSYSTEM_RENDER,
+			 RENDER_LOG_PREFIX "Device %d (%s) is within valid range, assuming it works. If not,"
 					    "change device_index to -1 in the settings\n",
-			  g_engine->device_idx, properties.deviceName);
-		free(physical_devices);
+			 g_engine->device_idx, properties.deviceName);
+		util_free(physical_devices);
 		return true;
 	}
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Choosing graphics device to use\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Choosing graphics device to use\n");
 	g_vulkan_phys_device = NULL;
 	score = 0;
 	best_score = 0;
@@ -208,16 +212,16 @@ bool engine_vulkan_choose_device(const char **extensions, size_t extension_count
 
 	g_engine->device_idx = best_idx;
 	if (g_engine->device_idx < 0) {
-		PURPL_LOG(RENDER_LOG_PREFIX "No suitable device found\n");
-		free(physical_devices);
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "No suitable device found\n");
+		util_free(physical_devices);
 		return false;
 	}
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Using device %d (%s, score %u)\n", g_engine->device_idx,
-		  best_properties.deviceName);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Using device %d (%s, score %u)\n", g_engine->device_idx,
+		 best_properties.deviceName);
 
 	g_vulkan_phys_device = physical_devices[g_engine->device_idx];
-	free(physical_devices);
+	util_free(physical_devices);
 
 	return true;
 }
@@ -239,18 +243,21 @@ bool engine_vulkan_create_device(void)
 	if (!engine_vulkan_choose_device(extensions, PURPL_ARRSIZE(extensions)))
 		return false;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Getting queue family indices for device %d\n", g_engine->device_idx);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER,
+		 RENDER_LOG_PREFIX "Getting queue family indices for device %d\n", g_engine->device_idx);
 	indices = find_queue_families(g_vulkan_phys_device);
 	queue_indices[0] = indices.graphics;
 	queue_indices[1] = indices.present;
 	queue_indices[2] = indices.compute;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Filling VkDeviceQueueCreateInfo structures\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Filling VkDeviceQueueCreateInfo structures\n");
 	queue_priority = 1;
 	memset(queue_infos, 0, sizeof(queue_infos));
 	for (i = 0, j = 0; i < 3; i++) {
 		if (i > 0 && queue_indices[i - 1] == queue_indices[i]) {
-			PURPL_LOG("Queues at %u and %u both have index %u\n", i - 1, i, queue_indices[i]);
+			LOG_DEBUG(LOG_SUBSYSTEM_RENDER,
+				  RENDER_LOG_PREFIX "Queues at %u and %u both have index %u\n", i - 1, i,
+				  queue_indices[i]);
 			j++;
 		}
 		queue_infos[i - j].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -259,7 +266,7 @@ bool engine_vulkan_create_device(void)
 		queue_infos[i - j].pQueuePriorities = &queue_priority;
 	}
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Setting VkDeviceCreateInfo fields\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Setting VkDeviceCreateInfo fields\n");
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	device_info.pEnabledFeatures = &features;
 	device_info.queueCreateInfoCount = i - j;
@@ -267,16 +274,17 @@ bool engine_vulkan_create_device(void)
 	device_info.ppEnabledExtensionNames = extensions;
 	device_info.enabledExtensionCount = PURPL_ARRSIZE(extensions);
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Creating VkDevice\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Creating VkDevice\n");
 	result = vkCreateDevice(g_vulkan_phys_device, &device_info, NULL, &g_vulkan_device);
 	if (result != VK_SUCCESS) {
-		PURPL_LOG(RENDER_LOG_PREFIX "vkCreateDevice(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
-					    ") failed: VkResult %d\n",
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "vkCreateDevice(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
+					     ") failed: VkResult %d\n",
 			  g_vulkan_phys_device, &device_info, NULL, &g_vulkan_device, result);
 		return false;
 	}
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Retrieving presentation queue\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Retrieving presentation queue\n");
 	vkGetDeviceQueue(g_vulkan_device, indices.present, 0, &g_vulkan_present_queue);
 
 	return true;
@@ -27,32 +27,24 @@ static VkBool32 VKAPI_CALL debug_messenger_callback(VkDebugUtilsMessageSeverityF
 						    VkDebugUtilsMessageTypeFlagsEXT types,
 						    const VkDebugUtilsMessengerCallbackDataEXT *data, void *user)
 {
-	char *severity_str;
-	char *type_str;
-	char *tmp;
-
-	type_str = util_alloc(1, sizeof(char), NULL);
-	if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT)
-		UTIL_STRFUNC(type_str, util_append(type_str, "GENERAL "));
-	if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT)
-		UTIL_STRFUNC(type_str, util_append(type_str, "VALIDATION "));
-	if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)
-		UTIL_STRFUNC(type_str, util_append(type_str, "PERFORMANCE "));
-
-	severity_str = util_alloc(1, sizeof(char), NULL);
-	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT)
-		UTIL_STRFUNC(severity_str, util_append(severity_str, "VERBOSE "));
-	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
-		UTIL_STRFUNC(severity_str, util_append(severity_str, "INFO "));
-	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
-		UTIL_STRFUNC(severity_str, util_append(severity_str, "WARNING "));
+	log_level_t level;
+	const char *type_str;
+
 	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
-		UTIL_STRFUNC(severity_str, util_append(severity_str, "ERROR "));
+		level = LOG_LEVEL_ERROR;
+	else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		level = LOG_LEVEL_WARNING;
+	else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+		level = LOG_LEVEL_DEBUG;
+	else
+		level = LOG_LEVEL_TRACE;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "VULKAN %s%sMESSAGE: %s\n", type_str, severity_str, data->pMessage);
+	// This only has to last until the message is logged, so it comes from the frame arena instead of the heap
+	type_str = frame_strfmt("%s%s%s", types & VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT ? "GENERAL " : "",
+				types & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT ? "VALIDATION " : "",
+				types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT ? "PERFORMANCE " : "");
 
-	free(type_str);
-	free(severity_str);
+	LOG_WRITE(level, LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "VULKAN %sMESSAGE: %s\n", type_str, data->pMessage);
 
 	return true;
 }
@@ -69,10 +61,11 @@ bool engine_vulkan_init(void)
 
 	const char *validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Loading Vulkan\n");
-	gladLoaderLoadVulkan(NULL, NULL, NULL);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Loading Vulkan\n");
+	STARTUP_SCOPE("load Vulkan")
+		gladLoaderLoadVulkan(NULL, NULL, NULL);
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Setting VkApplicationInfo fields\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Setting VkApplicationInfo fields\n");
 	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 	app_info.pEngineName = "Purpl Engine";
 	app_info.pApplicationName = g_engine->game->game;
@@ -84,7 +77,7 @@ bool engine_vulkan_init(void)
 						     PURPL_VERSION_MINOR(PURPL_VERSION),
 						     PURPL_VERSION_PATCH(PURPL_VERSION));
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Setting VkDebugUtilsMessengerCreateInfoEXT fields\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Setting VkDebugUtilsMessengerCreateInfoEXT fields\n");
 	debug_messenger_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
 	debug_messenger_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
 					       VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
@@ -98,11 +91,11 @@ bool engine_vulkan_init(void)
 	inst_info.pApplicationInfo = &app_info;
 	inst_info.pNext = &debug_messenger_info;
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Getting list of extensions\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Getting list of extensions\n");
 	extension_count = 0;
 	extensions = get_extensions(&extension_count);
 	for (i = 0; i < extension_count; i++)
-		PURPL_LOG(RENDER_LOG_PREFIX "\t%s\n", extensions[i]);
+		LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "\t%s\n", extensions[i]);
 	inst_info.ppEnabledExtensionNames = extensions;
 	inst_info.enabledExtensionCount = extension_count;
 	inst_info.ppEnabledLayerNames = validation_layers;
@@ -110,43 +103,54 @@ bool engine_vulkan_init(void)
 	if (g_engine->dev)
 		inst_info.enabledLayerCount = PURPL_ARRSIZE(validation_layers);
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Creating VkInstance\n");
-	result = vkCreateInstance(&inst_info, NULL, &g_vulkan_inst);
-	free((void *)extensions);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Creating VkInstance\n");
+	STARTUP_SCOPE("create instance")
+		result = vkCreateInstance(&inst_info, NULL, &g_vulkan_inst);
+	util_free((void *)extensions);
 	if (result != VK_SUCCESS) {
-		PURPL_LOG(RENDER_LOG_PREFIX "vkCreateInstance(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
-					    ") failed: VkResult %d\n ",
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "vkCreateInstance(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
+					     ") failed: VkResult %d\n ",
 			  &inst_info, NULL, &g_vulkan_inst, result);
 		engine_vulkan_shutdown();
 		return false;
 	}
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Creating VkSurfaceKHR\n");
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Creating VkSurfaceKHR\n");
+	startup_begin("create surface");
 	if (!SDL_Vulkan_CreateSurface(g_engine->wnd, g_vulkan_inst, &g_vulkan_surface)) {
-		PURPL_LOG(RENDER_LOG_PREFIX "SDL_Vulkan_CreateSurface(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
-					    ") failed: %s\n",
+		startup_end();
+		LOG_ERROR(LOG_SUBSYSTEM_RENDER,
+			  RENDER_LOG_PREFIX "SDL_Vulkan_CreateSurface(0x%" PRIXPTR ", 0x%" PRIXPTR ", 0x%" PRIXPTR
+					     ") failed: %s\n",
 			  g_engine->wnd, g_vulkan_inst, &g_vulkan_surface, SDL_GetError());
 		engine_vulkan_shutdown();
 		return false;
 	}
 
+	startup_end();
+
+	startup_begin("create device");
 	if (!engine_vulkan_create_device()) {
+		startup_end();
 		engine_vulkan_shutdown();
 		return false;
 	}
+	startup_end();
 
-	PURPL_LOG(RENDER_LOG_PREFIX "Reloading Vulkan\n");
-	gladLoaderLoadVulkan(g_vulkan_inst, g_vulkan_phys_device, g_vulkan_device);
+	LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Reloading Vulkan\n");
+	STARTUP_SCOPE("reload Vulkan")
+		gladLoaderLoadVulkan(g_vulkan_inst, g_vulkan_phys_device, g_vulkan_device);
 
 	return true;
 }
 
-bool engine_vulkan_begin_frame(uint64_t delta)
+bool engine_vulkan_begin_frame(const frame_delta_t *delta)
 {
 	return true;
 }
 
-bool engine_vulkan_end_frame(uint64_t delta)
+bool engine_vulkan_end_frame(const frame_delta_t *delta)
 {
 	return true;
 }
@@ -154,15 +158,15 @@ bool engine_vulkan_end_frame(uint64_t delta)
 void engine_vulkan_shutdown(void)
 {
 	if (g_vulkan_device) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Destroying VkDevice\n");
+		LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Destroying VkDevice\n");
 		vkDestroyDevice(g_vulkan_device, NULL);
 	}
 	if (g_vulkan_surface) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Destroying VkSurfaceKHR\n");
+		LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Destroying VkSurfaceKHR\n");
 		vkDestroySurfaceKHR(g_vulkan_inst, g_vulkan_surface, NULL);
 	}
 	if (g_vulkan_inst) {
-		PURPL_LOG(RENDER_LOG_PREFIX "Destroying VkInstance\n");
+		LOG_INFO(LOG_SUBSYSTEM_RENDER, RENDER_LOG_PREFIX "Destroying VkInstance\n");
 		vkDestroyInstance(g_vulkan_inst, NULL);
 	}
 }
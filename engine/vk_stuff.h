@@ -15,10 +15,10 @@ extern bool engine_vulkan_choose_device(const char **extensions, size_t extensio
 extern bool engine_vulkan_create_device(void);
 
 // Prepare to draw a frame
-extern bool engine_vulkan_begin_frame(uint64_t delta);
+extern bool engine_vulkan_begin_frame(const frame_delta_t *delta);
 
 // Finish commands
-extern bool engine_vulkan_end_frame(uint64_t delta);
+extern bool engine_vulkan_end_frame(const frame_delta_t *delta);
 
 // Shut down Vulkan
 extern void engine_vulkan_shutdown(void);
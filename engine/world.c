@@ -0,0 +1,152 @@
+// ECS world
+
+#include "engine.h"
+#include "world.h"
+
+static ecs_entity_t s_end_frame; // Tag on EcsPostUpdate, which the end of frame pipeline is made of
+static ecs_entity_t s_begin_pipeline; // Phases run by engine_world_begin_frame
+static ecs_entity_t s_end_pipeline; // Phases run by engine_world_end_frame
+static ecs_os_api_thread_new_t s_thread_new; // flecs's own thread_new_, which pin_thread_new wraps
+static atomic_uint s_thread_count; // Worker threads flecs has started
+
+// What a flecs worker thread needs to start after it's been pinned
+typedef struct world_thread {
+	ecs_os_thread_callback_t callback; // flecs's thread function
+	void *param; // Its parameter
+	uint32_t index; // Index to pin it with
+} world_thread_t;
+
+// Keep systems in a phase in the order they were made, like the default pipeline
+static int32_t compare_entities(ecs_entity_t e1, const void *ptr1, ecs_entity_t e2, const void *ptr2)
+{
+	return (e1 > e2) - (e1 < e2);
+}
+
+// Make a pipeline of the systems in phases that do or don't come after EcsPostUpdate
+static ecs_entity_t create_pipeline(ecs_world_t *world, const char *name, bool end_frame)
+{
+	ecs_pipeline_desc_t desc;
+
+	memset(&desc, 0, sizeof(ecs_pipeline_desc_t));
+	desc.entity = ecs_entity(world, { .name = name });
+
+	// Same as the default pipeline, plus whether the system's phase depends on EcsPostUpdate
+	desc.query.filter.terms[0].id = EcsSystem;
+	desc.query.filter.terms[1].id = EcsPhase;
+	desc.query.filter.terms[1].src.flags = EcsCascade;
+	desc.query.filter.terms[1].src.trav = EcsDependsOn;
+	desc.query.filter.terms[2].id = EcsDisabled;
+	desc.query.filter.terms[2].src.flags = EcsUp;
+	desc.query.filter.terms[2].src.trav = EcsDependsOn;
+	desc.query.filter.terms[2].oper = EcsNot;
+	desc.query.filter.terms[3].id = s_end_frame;
+	desc.query.filter.terms[3].src.flags = EcsUp;
+	desc.query.filter.terms[3].src.trav = EcsDependsOn;
+	desc.query.filter.terms[3].oper = end_frame ? EcsAnd : EcsNot;
+	desc.query.order_by = compare_entities;
+
+	return ecs_pipeline_init(world, &desc);
+}
+
+// Pin a flecs worker thread and run it
+static void *world_thread(void *data)
+{
+	world_thread_t thread;
+
+	thread = *(world_thread_t *)data;
+	util_free(data);
+	topology_pin_thread(TOPOLOGY_ROLE_WORKER, thread.index);
+
+	return thread.callback(thread.param);
+}
+
+// Start a flecs worker thread, placed after the job system's workers so they only share cores once there's nowhere
+// else to go
+static ecs_os_thread_t pin_thread_new(ecs_os_thread_callback_t callback, void *param)
+{
+	world_thread_t *thread;
+	ecs_os_thread_t handle;
+
+	thread = util_alloc(1, sizeof(world_thread_t), NULL);
+	thread->callback = callback;
+	thread->param = param;
+	thread->index = job_get_worker_count() + atomic_fetch_add(&s_thread_count, 1);
+
+	handle = s_thread_new(world_thread, thread);
+	if (!handle)
+		util_free(thread);
+
+	return handle;
+}
+
+bool engine_world_init(uint32_t threads)
+{
+	uint32_t cpus;
+	uint32_t workers;
+
+	// The job system already has a worker on every core, so by default flecs only gets what it leaves free
+	if (!threads) {
+		cpus = thread_get_cpu_count();
+		workers = job_get_worker_count();
+		threads = cpus > workers ? cpus - workers : 1;
+	}
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, WORLD_LOG_PREFIX "Creating ECS world with %u %s\n", threads,
+		 PURPL_PLURALIZE(threads, "threads", "thread"));
+
+	g_engine->world = ecs_init();
+	if (!g_engine->world) {
+		LOG_ERROR(LOG_SUBSYSTEM_ENGINE, WORLD_LOG_PREFIX "Failed to create ECS world\n");
+		return false;
+	}
+
+	s_end_frame = ecs_entity(g_engine->world, { .name = "EndFrame" });
+	ecs_add_id(g_engine->world, EcsPostUpdate, s_end_frame);
+	s_begin_pipeline = create_pipeline(g_engine->world, "BeginFramePipeline", false);
+	s_end_pipeline = create_pipeline(g_engine->world, "EndFramePipeline", true);
+	PURPL_ASSERT(s_begin_pipeline && s_end_pipeline);
+
+	if (threads > 1) {
+		if (!s_thread_new) {
+			s_thread_new = ecs_os_api.thread_new_;
+			ecs_os_api.thread_new_ = pin_thread_new;
+		}
+		ecs_set_threads(g_engine->world, (int32_t)threads);
+	}
+
+	return true;
+}
+
+void engine_world_begin_frame(const frame_delta_t *delta)
+{
+	ecs_ftime_t seconds;
+
+	PURPL_PROFILE_BEGIN("engine_world_begin_frame");
+
+	// This is what ecs_progress does, split in two around the rest of the frame. Giving flecs the launcher's delta
+	// keeps its time in step with everything else, except on the first frame, where it's 0 and flecs measures it.
+	seconds = ecs_frame_begin(g_engine->world, (ecs_ftime_t)delta->seconds);
+	ecs_run_pipeline(g_engine->world, s_begin_pipeline, seconds);
+
+	PURPL_PROFILE_END();
+}
+
+void engine_world_end_frame(const frame_delta_t *delta)
+{
+	PURPL_PROFILE_BEGIN("engine_world_end_frame");
+
+	ecs_run_pipeline(g_engine->world, s_end_pipeline, (ecs_ftime_t)delta->seconds);
+	ecs_frame_end(g_engine->world);
+
+	PURPL_PROFILE_END();
+}
+
+void engine_world_shutdown(void)
+{
+	if (!g_engine->world)
+		return;
+
+	LOG_INFO(LOG_SUBSYSTEM_ENGINE, WORLD_LOG_PREFIX "Destroying ECS world\n");
+	ecs_fini(g_engine->world);
+	g_engine->world = NULL;
+}
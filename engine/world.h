@@ -0,0 +1,24 @@
+// ECS world. Systems go in flecs's built in phases, which are split between two pipelines: everything up to
+// EcsOnValidate runs in the frame graph's world begin task, after asset callbacks, and EcsPostUpdate onwards runs in
+// its world end task, before the frame is drawn. Custom phases end up in whichever half the phase they depend on is
+// in. Both pipelines run systems across flecs's worker threads, which are pinned after the job system's workers.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/util.h"
+
+#define WORLD_LOG_PREFIX ENGINE_LOG_PREFIX "WORLD: "
+
+// Create the world, with a worker thread for each core the job system doesn't use if threads is 0, or one if it uses
+// them all
+extern bool engine_world_init(uint32_t threads);
+
+// Start a frame and run the first half of the systems
+extern void engine_world_begin_frame(const frame_delta_t *delta);
+
+// Run the rest of the systems and finish the frame
+extern void engine_world_end_frame(const frame_delta_t *delta);
+
+// Destroy the world
+extern void engine_world_shutdown(void);
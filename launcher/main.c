@@ -1,8 +1,16 @@
 // Main file of the launcher. Loads the shared libraries for the engine.
 
 #include "common/common.h"
+#include "common/alloc.h"
 #include "common/dll.h"
+#include "common/framestats.h"
 #include "common/gameinfo.h"
+#include "common/job.h"
+#include "common/metrics.h"
+#include "common/pacer.h"
+#include "common/profile.h"
+#include "common/startup.h"
+#include "common/topology.h"
 #include "common/util.h"
 
 #include "engine/engine.h"
@@ -22,33 +30,67 @@ __declspec(dllexport) uint32_t NvOptimusEnablement = 1;
 __declspec(dllexport) uint32_t AmdPowerXpressRequestHighPerformance = 1;
 #endif
 
-// Enter the loop that runs the engine
-void run(dll_t **dlls, uint8_t dll_count)
+// Enter the loop that runs the engine, adding the time each frame takes to stats, and waiting for pacer at the end of
+// each one, at its background rate when *visible is false. Finishes the startup timeline after the first frame, and
+// stops there if startup_bench is set.
+void run(dll_t **dlls, uint8_t dll_count, framestats_t *stats, pacer_t *pacer, const bool *visible, bool startup_bench)
 {
+	frame_delta_t delta;
+	uint64_t times[FRAMESTATS_PHASE_COUNT];
 	bool running;
-	uint64_t now;
-	uint64_t last;
-	uint64_t delta;
 	uint64_t i;
 
-	last = util_getaccuratetime();
+	memset(&delta, 0, sizeof(frame_delta_t));
 	running = true;
 	while (running) {
-		now = util_getaccuratetime();
-		delta = now - last;
-		for (i = 0; i < dll_count; i++) {
-			if (dlls[i] && dlls[i]->begin_frame)
-				running = running && dlls[i]->begin_frame(delta);
+		util_next_frame(&delta);
+		PURPL_PROFILE_BEGIN("frame");
+		memset(times, 0, sizeof(times));
+		if (!startup_is_finished())
+			startup_begin("first frame");
+
+		UTIL_TIME_SCOPE(times[FRAMESTATS_PHASE_BEGIN]) {
+			for (i = 0; i < dll_count; i++) {
+				if (dlls[i] && dlls[i]->begin_frame)
+					running = running && dlls[i]->begin_frame(&delta);
+			}
+		}
+
+		UTIL_TIME_SCOPE(times[FRAMESTATS_PHASE_END]) {
+			for (i = 0; i < dll_count; i++) {
+				if (dlls[i] && dlls[i]->end_frame)
+					running = running && dlls[i]->end_frame(&delta);
+			}
 		}
 
-		now = util_getaccuratetime();
-		delta += now - last;
-		for (i = 0; i < dll_count; i++) {
-			if (dlls[i] && dlls[i]->end_frame)
-				running = running && dlls[i]->end_frame(delta);
+		// Not after the first frame, since that's timed for startup
+		if (startup_is_finished()) {
+			PURPL_PROFILE_BEGIN("pace");
+			times[FRAMESTATS_PHASE_WAIT] = pacer_wait(pacer, *visible);
+			times[FRAMESTATS_PHASE_PACING] = pacer->error;
+			PURPL_PROFILE_END();
 		}
 
-		last = now;
+		times[FRAMESTATS_PHASE_FRAME] = util_get_time() - delta.start;
+		PURPL_PROFILE_END();
+
+		METRICS_HISTOGRAM_RECORD("frame.begin_ns", times[FRAMESTATS_PHASE_BEGIN]);
+		METRICS_HISTOGRAM_RECORD("frame.end_ns", times[FRAMESTATS_PHASE_END]);
+		METRICS_HISTOGRAM_RECORD("frame.wait_ns", times[FRAMESTATS_PHASE_WAIT]);
+		METRICS_HISTOGRAM_RECORD("frame.pacing_error_ns", times[FRAMESTATS_PHASE_PACING]);
+		METRICS_HISTOGRAM_RECORD("frame.time_ns", times[FRAMESTATS_PHASE_FRAME]);
+
+		framestats_add_frame(stats, times);
+
+		if (!startup_is_finished()) {
+			startup_finish();
+			startup_log();
+			METRICS_GAUGE_SET("startup.time_ns", (int64_t)startup_get_time());
+			if (startup_bench) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "Exiting after the first frame for -startupbench\n");
+				running = false;
+			}
+		}
 	}
 }
 
@@ -66,6 +108,22 @@ int32_t main(int32_t argc, char *argv[])
 	char *coredir;
 	char *gamedir;
 	char *path;
+	char *stats_path;
+	char *metrics_path;
+	char *metrics_socket;
+	char *startup_path;
+	bool startup_bench;
+	bool alloc_stacks;
+	uint32_t job_workers;
+	uint32_t tick_rate;
+	uint32_t fps;
+	uint32_t background_fps;
+	char *record_path;
+	char *replay_path;
+	char *levels;
+	topology_policy_t affinity;
+	framestats_t *stats;
+	pacer_t *pacer;
 	gameinfo_t *coreinfo;
 	gameinfo_t *gameinfo;
 	render_api_t render_api;
@@ -73,6 +131,8 @@ int32_t main(int32_t argc, char *argv[])
 
 	char *dlls[] = { "flecs", "SDL2", "zstd" };
 
+	startup_begin("setup");
+
 	basedir = util_absolute_path(argv[0]);
 	if (strstr(basedir, "bin")) {
 		*(strstr(basedir, "bin")) = 0;
@@ -81,7 +141,7 @@ int32_t main(int32_t argc, char *argv[])
 		strrchr(basedir, '/')[1] = 0;
 		bindir = util_append(basedir, "bin/");
 		if (!util_fexist(bindir)) {
-			free(bindir);
+			util_free(bindir);
 			bindir = util_strdup(basedir);
 		}
 	}
@@ -89,6 +149,19 @@ int32_t main(int32_t argc, char *argv[])
 
 	error = false;
 	gamedir = NULL;
+	stats_path = NULL;
+	metrics_path = NULL;
+	metrics_socket = NULL;
+	startup_path = NULL;
+	startup_bench = false;
+	alloc_stacks = false;
+	job_workers = 0;
+	tick_rate = 0;
+	fps = 0;
+	background_fps = PACER_DEFAULT_BACKGROUND_RATE;
+	record_path = NULL;
+	replay_path = NULL;
+	affinity = TOPOLOGY_POLICY_SPREAD;
 #ifdef __APPLE__
 	render_api = RENDER_API_METAL;
 	PURPL_LOG(LAUNCHER_LOG_PREFIX "Setting render API to Metal\n");
@@ -129,6 +202,9 @@ int32_t main(int32_t argc, char *argv[])
 #else
 			PURPL_LOG("Ignoring -vulkan on unsupported platform\n");
 #endif
+		} else if (strcmp(arg, "headless") == 0 && render_api != RENDER_API_NONE) {
+			PURPL_LOG(LAUNCHER_LOG_PREFIX "Running headless, without a window or rendering\n");
+			render_api = RENDER_API_NONE;
 		} else if (strcmp(arg, "deviceidx") == 0 || strcmp(arg, "deviceindex") == 0) {
 			if (i >= argc - 1) {
 				PURPL_LOG(LAUNCHER_LOG_PREFIX "-%s requires an argument\n", arg);
@@ -144,14 +220,149 @@ int32_t main(int32_t argc, char *argv[])
 		} else if ((strcmp(arg, "nodev") == 0 || strcmp(arg, "nodebug")) == 0 && devmode) {
 			PURPL_LOG(LAUNCHER_LOG_PREFIX "Disabling developer mode\n");
 			devmode = false;
+		} else if (strcmp(arg, "binarylog") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-binarylog requires an argument\n");
+				error = true;
+				break;
+			}
+			i++;
+			if (!log_open_binary(argv[i])) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "Failed to open binary log %s\n", argv[i]);
+				error = true;
+				break;
+			}
+			// The engine has its own logger, which checks the environment when it starts
+#ifdef _WIN32
+			_putenv_s(LOG_BINARY_ENV, argv[i]);
+#else
+			setenv(LOG_BINARY_ENV, argv[i], true);
+#endif
+		} else if (strcmp(arg, "loglevel") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-loglevel requires an argument\n");
+				error = true;
+				break;
+			}
+			i++;
+			if (!log_apply_levels(argv[i])) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "Invalid log level %s\n", argv[i]);
+				error = true;
+				break;
+			}
+			// Passed on the same way as -binarylog, keeping the ones from earlier -loglevel options
+			levels = getenv(LOG_LEVELS_ENV);
+			levels = levels && *levels ? util_strfmt("%s,%s", levels, argv[i]) : util_strdup(argv[i]);
+#ifdef _WIN32
+			_putenv_s(LOG_LEVELS_ENV, levels);
+#else
+			setenv(LOG_LEVELS_ENV, levels, true);
+#endif
+			util_free(levels);
+		} else if (strcmp(arg, "framestats") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-framestats requires an argument\n");
+				error = true;
+				break;
+			}
+			stats_path = argv[++i];
+		} else if (strcmp(arg, "metrics") == 0 || strcmp(arg, "metricssocket") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-%s requires an argument\n", arg);
+				error = true;
+				break;
+			}
+			if (strcmp(arg, "metrics") == 0)
+				metrics_path = argv[++i];
+			else
+				metrics_socket = argv[++i];
+		} else if (strcmp(arg, "jobworkers") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-jobworkers requires an argument\n");
+				error = true;
+				break;
+			}
+			job_workers = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(arg, "tickrate") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-tickrate requires an argument\n");
+				error = true;
+				break;
+			}
+			// Clamp before narrowing, so a huge rate can't wrap around to a small one
+			tick_rate = (uint32_t)PURPL_MIN(strtoul(argv[++i], NULL, 10), (unsigned long)UINT32_MAX);
+			if (tick_rate > SIM_MAX_TICK_RATE) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-tickrate can't be more than %u\n", SIM_MAX_TICK_RATE);
+				error = true;
+				break;
+			}
+		} else if (strcmp(arg, "fps") == 0 || strcmp(arg, "backgroundfps") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-%s requires an argument\n", arg);
+				error = true;
+				break;
+			}
+			if (strcmp(arg, "fps") == 0)
+				fps = (uint32_t)strtoul(argv[++i], NULL, 10);
+			else
+				background_fps = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(arg, "record") == 0 || strcmp(arg, "replay") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-%s requires an argument\n", arg);
+				error = true;
+				break;
+			}
+			if (strcmp(arg, "record") == 0)
+				record_path = argv[++i];
+			else
+				replay_path = argv[++i];
+		} else if (strcmp(arg, "affinity") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-affinity requires an argument\n");
+				error = true;
+				break;
+			}
+			affinity = topology_find_policy(argv[++i]);
+			if (affinity == TOPOLOGY_POLICY_COUNT) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "Unknown affinity policy %s\n", argv[i]);
+				error = true;
+				break;
+			}
+		} else if (strcmp(arg, "allocstacks") == 0) {
+			alloc_stacks = true;
+		} else if (strcmp(arg, "startupbench") == 0) {
+			startup_bench = true;
+		} else if (strcmp(arg, "startuptrace") == 0) {
+			if (i >= argc - 1) {
+				PURPL_LOG(LAUNCHER_LOG_PREFIX "-startuptrace requires an argument\n");
+				error = true;
+				break;
+			}
+			startup_path = argv[++i];
 		} else if (strcmp(arg, "help") == 0) {
 			printf("\n-- LIST OF AVAILABLE OPTIONS --\n\n"
 			       "-game <gamedir>\t\t\t- Set the game directory\n"
 			       //"-directx/-direct3d\t- Use Direct3D 12 for rendering\n"
 			       "-vulkan\t\t\t\t- Use Vulkan for rendering\n"
+			       "-headless\t\t\t- Run the full frame loop without a window or graphics device\n"
 			       "-deviceidx/-deviceindex <index> - The index (0-based) of the graphics device to render on\n"
 			       "-dev/-debug\t\t\t- Enable developer mode\n"
 			       "-nodev/-nodebug\t\t\t- Disable developer mode\n"
+			       "-binarylog <prefix>\t\t- Write logs to <prefix>_<n>.plog for logdecode instead of the console\n"
+			       "-loglevel [subsystem=]<level>\t- Only log messages at <level> or above, for one subsystem or all of them\n"
+			       "-metrics <file>\t\t\t- Write a snapshot of the engine's metrics to <file> every few seconds\n"
+			       "-metricssocket <path>\t\t- Send a snapshot of the metrics to anything connecting to <path>\n"
+			       "-jobworkers <count>\t\t- Run jobs on <count> threads (default one per core)\n"
+			       "-tickrate <rate>\t\t- Simulate at <rate> ticks per second on its own thread, independent of rendering\n"
+			       "-fps <rate>\t\t\t- Limit the frame rate to <rate> frames per second (default 0, no limit)\n"
+			       "-backgroundfps <rate>\t\t- Limit the frame rate while the window isn't focused (default 15)\n"
+			       "-record <file>\t\t\t- Record each frame's delta and input to <file>\n"
+			       "-replay <file>\t\t\t- Play back a recording as fast as possible, or at -fps if it's given\n"
+			       "-affinity <policy>\t\t- Pin threads to cores: none, spread across caches (default), or compact\n"
+			       "-allocstacks\t\t\t- Log where leaked memory was allocated in developer mode (slow)\n"
+			       "-startupbench\t\t\t- Exit after the first frame, to time startup\n"
+			       "-startuptrace <file>\t\t- Write a trace of each phase of startup to <file>\n"
+			       "-framestats <file>\t\t- Write frame statistics to <file> (JSON if it ends in .json, else CSV)\n"
 			       "\nMost/all options print additional information if used incorrectly\n");
 			error = true;
 			break;
@@ -160,11 +371,20 @@ int32_t main(int32_t argc, char *argv[])
 		}
 	}
 
+	if (record_path && replay_path) {
+		PURPL_LOG(LAUNCHER_LOG_PREFIX "Can't use -record and -replay together\n");
+		error = true;
+	}
+
+	// Losing focus would slow a replay down to the background rate, which makes timings useless
+	if (replay_path)
+		background_fps = fps;
+
 	if (error) {
 		if (gamedir)
-			free(gamedir);
-		free(bindir);
-		free(basedir);
+			util_free(gamedir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 
@@ -173,13 +393,33 @@ int32_t main(int32_t argc, char *argv[])
 		FreeConsole();
 #endif
 
+#ifdef PURPL_TRACK_ALLOCATIONS
+	if (alloc_stacks && devmode)
+		alloc_set_capture_stacks(true);
+	else if (alloc_stacks)
+		PURPL_LOG(LAUNCHER_LOG_PREFIX "Ignoring -allocstacks outside of developer mode\n");
+#else
+	if (alloc_stacks)
+		PURPL_LOG(LAUNCHER_LOG_PREFIX "Ignoring -allocstacks, allocation tracking isn't compiled in\n");
+#endif
+
+#ifdef PURPL_PROFILE
+	// The launcher and the engine both add to the trace when they shut down, so start with an empty one
+	if (devmode) {
+		path = util_append(basedir, PROFILE_FILE_NAME);
+		remove(path);
+		util_free(path);
+		profile_set_enabled(true);
+	}
+#endif
+
 	coredir = util_prepend("core/", basedir);
 	if (!util_fexist(coredir)) {
 		PURPL_LOG(LAUNCHER_LOG_PREFIX "Core data directory \"%s\" does not exist\n", coredir);
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 	PURPL_LOG(LAUNCHER_LOG_PREFIX "Core data directory is %s\n", coredir);
@@ -190,58 +430,90 @@ int32_t main(int32_t argc, char *argv[])
 		gamedir = util_append(gamedir, "/");
 	if (!util_fexist(gamedir)) {
 		PURPL_LOG(LAUNCHER_LOG_PREFIX "Game directory \"%s\" does not exist\n", gamedir);
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 	PURPL_LOG(LAUNCHER_LOG_PREFIX "Game directory is %s\n", gamedir);
 
+	startup_end();
+
 	// Load the other libraries needed
-	for (i = 0; i < PURPL_ARRSIZE(dlls); i++) {
-		path = util_strfmt("%s/%s" DLL_SUFFIX, bindir, dlls[i]);
-		dll_load(path, false);
-		free(path);
+	STARTUP_SCOPE("load libraries") {
+		for (i = 0; i < PURPL_ARRSIZE(dlls); i++) {
+			path = util_strfmt("%s/%s" DLL_SUFFIX, bindir, dlls[i]);
+			STARTUP_SCOPE("load %s", dlls[i])
+				dll_load(path, false);
+			util_free(path);
+		}
 	}
 
 	path = util_append(bindir, "engine");
-	engine = (engine_dll_t *)dll_load(path, true);
-	free(path);
+	STARTUP_SCOPE("load engine")
+		engine = (engine_dll_t *)dll_load(path, true);
+	util_free(path);
 	if (!engine) {
 		PURPL_LOG(LAUNCHER_LOG_PREFIX "Failed to load engine\n");
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 
-	coreinfo = gameinfo_parse("game.ini", coredir);
+	// Before the job system, so its workers are pinned as they start
+	STARTUP_SCOPE("detect CPU topology") {
+		topology_detect();
+		topology_log();
+		topology_set_policy(affinity);
+		topology_pin_thread(TOPOLOGY_ROLE_MAIN, 0);
+	}
+
+	STARTUP_SCOPE("start job system")
+		job_init(job_workers);
+
+	// The engine records its metrics and startup phases here too, and shares the job system
+	engine->metrics = metrics_get_registry();
+	engine->startup = startup_get_timeline();
+	engine->alloc = alloc_get_tracker();
+	engine->jobs = job_get_system();
+	engine->topology = topology_get();
+	engine->tick_rate = tick_rate;
+	engine->record_path = record_path;
+	engine->replay_path = replay_path;
+	if (metrics_path || metrics_socket)
+		metrics_start(metrics_path, METRICS_DEFAULT_INTERVAL, metrics_socket);
+
+	STARTUP_SCOPE("parse core gameinfo")
+		coreinfo = gameinfo_parse("game.ini", coredir);
 	if (!coreinfo) {
 		PURPL_LOG(LAUNCHER_LOG_PREFIX "Failed to parse %s/game.ini\n", coredir);
 		dll_unload((dll_t *)engine);
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 
-	gameinfo = gameinfo_parse("game.ini", gamedir);
+	STARTUP_SCOPE("parse game gameinfo")
+		gameinfo = gameinfo_parse("game.ini", gamedir);
 	if (!gameinfo) {
 		PURPL_LOG(LAUNCHER_LOG_PREFIX "Failed to parse %s/game.ini\n", gamedir);
 		dll_unload((dll_t *)engine);
 		gameinfo_free(coreinfo);
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
 
 	// Cast the engine's initialization function pointer correctly, must be the same as engine_init in
 	// engine/engine.c.
+	startup_begin("engine init");
 	// clang-format off
 	if (!PURPL_RECAST_FUNCPTR(engine->init, bool, const char *basedir, const char *coredir, const char *gamedir, gameinfo_t *core, gameinfo_t *game,
 			     render_api_t render_api, bool devmode)(basedir, coredir, gamedir, coreinfo, gameinfo, render_api, devmode)) {
@@ -249,32 +521,64 @@ int32_t main(int32_t argc, char *argv[])
 		dll_unload((dll_t *)engine);
 		gameinfo_free(coreinfo);
 		gameinfo_free(gameinfo);
-		free(gamedir);
-		free(coredir);
-		free(bindir);
-		free(basedir);
+		util_free(gamedir);
+		util_free(coredir);
+		util_free(bindir);
+		util_free(basedir);
 		exit(1);
 	}
+	startup_end();
 
+	stats = framestats_create(FRAMESTATS_REPORT_INTERVAL);
+	pacer = pacer_create(fps, background_fps);
 	run((dll_t *[]){
 			(dll_t *)engine,
 			// client,
 			// server,
-		}, 1);
+		}, 1, stats, pacer, &engine->wnd_visible, startup_bench);
 	// clang-format on
 
+	if (startup_path)
+		startup_write(startup_path);
+
+	framestats_log(stats, true);
+	if (stats_path)
+		framestats_write(stats, stats_path);
+	framestats_destroy(stats);
+	if (pacer->skipped)
+		PURPL_LOG(LAUNCHER_LOG_PREFIX "Frame pacer skipped %" PRIu64 " %s for running long\n", pacer->skipped,
+			  PURPL_PLURALIZE(pacer->skipped, "frames", "frame"));
+	pacer_destroy(pacer);
+
 	engine->shutdown();
+	job_shutdown();
+	metrics_stop();
+
+#ifdef PURPL_PROFILE
+	if (devmode) {
+		path = util_append(basedir, PROFILE_FILE_NAME);
+		profile_dump(path);
+		util_free(path);
+		profile_shutdown();
+	}
+#endif
 
 	gameinfo_free(coreinfo);
 	gameinfo_free(gameinfo);
 
+	util_free(basedir);
+	util_free(bindir);
+	util_free(coredir);
+	util_free(gamedir);
+
+	// The engine's leaks can only be symbolized while it's still loaded
+#ifdef PURPL_TRACK_ALLOCATIONS
+	alloc_report(true);
+#endif
+
 	// dll_unload(client);
 	// dll_unload(server);
 	dll_unload((dll_t *)engine);
 
-	free(basedir);
-	free(coredir);
-	free(gamedir);
-
 	return 0;
 }
@@ -0,0 +1,238 @@
+// Benchmark harness
+
+#include "bench.h"
+
+// Time one repetition
+static bool run_once(const bench_t *bench, void *data, uint64_t iterations, uint64_t *time, uint64_t *bytes)
+{
+	uint64_t start;
+
+	if (bench->setup && !bench->setup(data))
+		return false;
+
+	start = util_get_time();
+	*bytes = bench->run(data, iterations);
+	*time = util_get_time() - start;
+
+	if (bench->teardown)
+		bench->teardown(data);
+
+	return true;
+}
+
+// Work out how many iterations take the minimum time
+static bool calibrate(const bench_t *bench, void *data, const bench_options_t *options, uint64_t *iterations)
+{
+	uint64_t time;
+	uint64_t bytes;
+
+	*iterations = 1;
+	while (true) {
+		if (!run_once(bench, data, *iterations, &time, &bytes))
+			return false;
+
+		if (time >= options->min_time || *iterations >= BENCH_MAX_ITERATIONS)
+			break;
+
+		// Aim a bit past the minimum, but don't jump too far off a time that's mostly noise
+		if (time < options->min_time / 100)
+			*iterations *= 10;
+		else
+			*iterations = (uint64_t)ceil(*iterations * 1.2 * options->min_time / time);
+		*iterations = PURPL_MIN(*iterations, BENCH_MAX_ITERATIONS);
+	}
+
+	return true;
+}
+
+// Compare doubles for qsort
+static int32_t compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+void bench_default_options(bench_options_t *options)
+{
+	if (!options)
+		return;
+
+	options->warmup = BENCH_DEFAULT_WARMUP;
+	options->repetitions = BENCH_DEFAULT_REPETITIONS;
+	options->min_time = BENCH_DEFAULT_MIN_TIME;
+}
+
+bool bench_run(const bench_t *bench, void *data, const bench_options_t *options, bench_result_t *result)
+{
+	double times[BENCH_MAX_REPETITIONS];
+	uint64_t iterations;
+	uint64_t time;
+	uint64_t bytes;
+	uint64_t average_bytes;
+	uint32_t repetitions;
+	uint32_t i;
+
+	if (!bench || !bench->run || !options || !result)
+		return false;
+
+	memset(result, 0, sizeof(bench_result_t));
+	result->name = bench->name;
+
+	iterations = bench->iterations;
+	if (!iterations && !calibrate(bench, data, options, &iterations))
+		return false;
+
+	for (i = 0; i < options->warmup; i++) {
+		if (!run_once(bench, data, iterations, &time, &bytes))
+			return false;
+	}
+
+	repetitions = PURPL_MAX(PURPL_MIN(options->repetitions, BENCH_MAX_REPETITIONS), 1);
+	average_bytes = 0;
+	for (i = 0; i < repetitions; i++) {
+		if (!run_once(bench, data, iterations, &time, &bytes))
+			return false;
+		times[i] = (double)time / iterations;
+		average_bytes += bytes;
+		result->mean += times[i];
+	}
+	average_bytes /= repetitions;
+
+	qsort(times, repetitions, sizeof(double), compare_doubles);
+	result->iterations = iterations;
+	result->repetitions = repetitions;
+	result->min = times[0];
+	result->max = times[repetitions - 1];
+	result->median = repetitions % 2 ? times[repetitions / 2]
+					: (times[repetitions / 2 - 1] + times[repetitions / 2]) / 2.0;
+	result->mean /= repetitions;
+	for (i = 0; i < repetitions; i++)
+		result->stddev += (times[i] - result->mean) * (times[i] - result->mean);
+	result->stddev = sqrt(result->stddev / repetitions);
+	result->ops_per_sec = result->median ? UTIL_NS_PER_SEC / result->median : 0.0;
+	if (average_bytes)
+		result->bytes_per_sec = average_bytes / (result->median * iterations / UTIL_NS_PER_SEC);
+
+	return true;
+}
+
+void bench_print(const bench_result_t *result)
+{
+	if (!result)
+		return;
+
+	printf("%-24s %10" PRIu64 " x %3u  median %12.1lf ns  min %12.1lf ns  max %12.1lf ns  stddev %5.1lf%%",
+	       result->name, result->iterations, result->repetitions, result->median, result->min, result->max,
+	       result->mean ? result->stddev / result->mean * 100.0 : 0.0);
+	printf("  %9.2lf Mop/s", result->ops_per_sec / 1000000.0);
+	if (result->bytes_per_sec)
+		printf("  %9.1lf MiB/s", result->bytes_per_sec / (1024.0 * 1024.0));
+	printf("\n");
+	fflush(stdout);
+}
+
+bool bench_write_json(const bench_result_t *results, size_t count, const char *path)
+{
+	FILE *file;
+	size_t i;
+
+	if (!results || !path)
+		return false;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		PURPL_LOG(BENCH_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	// One benchmark per line, which is what bench_compare expects
+	fprintf(file, "{\n\t\"version\": \"" PURPL_PRIVER "\",\n\t\"benchmarks\": [\n",
+		PURPL_VERSION_FORMAT(PURPL_VERSION));
+	for (i = 0; i < count; i++) {
+		fprintf(file,
+			"\t\t{ \"name\": \"%s\", \"iterations\": %" PRIu64 ", \"repetitions\": %u, \"min_ns\": %.2lf, "
+			"\"median_ns\": %.2lf, \"mean_ns\": %.2lf, \"stddev_ns\": %.2lf, \"max_ns\": %.2lf, "
+			"\"ops_per_sec\": %.0lf, \"bytes_per_sec\": %.0lf }%s\n",
+			results[i].name, results[i].iterations, results[i].repetitions, results[i].min,
+			results[i].median, results[i].mean, results[i].stddev, results[i].max, results[i].ops_per_sec,
+			results[i].bytes_per_sec, i < count - 1 ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+
+	return true;
+}
+
+// Find a benchmark's median in a line of a file written by bench_write_json
+static bool parse_line(const char *line, char *name, size_t name_size, double *median)
+{
+	const char *start;
+	const char *end;
+
+	start = strstr(line, "\"name\": \"");
+	if (!start)
+		return false;
+	start += strlen("\"name\": \"");
+	end = strchr(start, '"');
+	if (!end || (size_t)(end - start) >= name_size)
+		return false;
+	memcpy(name, start, end - start);
+	name[end - start] = 0;
+
+	start = strstr(end, "\"median_ns\": ");
+	if (!start)
+		return false;
+
+	return sscanf(start + strlen("\"median_ns\": "), "%lf", median) == 1;
+}
+
+bool bench_compare(const bench_result_t *results, size_t count, const char *path, double threshold)
+{
+	char line[1024];
+	char name[256];
+	double baseline;
+	double change;
+	bool found;
+	bool success;
+	FILE *file;
+	size_t i;
+
+	if (!results || !path)
+		return false;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		PURPL_LOG(BENCH_LOG_PREFIX "Failed to open baseline %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	success = true;
+	for (i = 0; i < count; i++) {
+		found = false;
+		rewind(file);
+		while (fgets(line, sizeof(line), file)) {
+			if (parse_line(line, name, sizeof(name), &baseline) && strcmp(name, results[i].name) == 0) {
+				found = true;
+				break;
+			}
+		}
+
+		if (!found || baseline <= 0.0) {
+			printf("%-24s not in baseline\n", results[i].name);
+			continue;
+		}
+
+		change = (results[i].median - baseline) / baseline * 100.0;
+		printf("%-24s %12.1lf ns -> %12.1lf ns  %+6.1lf%%%s\n", results[i].name, baseline, results[i].median,
+		       change, change > threshold ? "  REGRESSION" : "");
+		if (change > threshold)
+			success = false;
+	}
+
+	fclose(file);
+	fflush(stdout);
+
+	return success;
+}
@@ -0,0 +1,73 @@
+// Benchmark harness. Each benchmark is run enough times to take a while, warmed up, and then repeated, and the
+// repetitions are summarized and written out as text or JSON, which can be compared to a baseline.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/util.h"
+
+#define BENCH_LOG_PREFIX "BENCH: "
+
+// Default number of repetitions thrown away before measuring
+#define BENCH_DEFAULT_WARMUP 2
+
+// Default number of repetitions measured
+#define BENCH_DEFAULT_REPETITIONS 10
+
+// Default nanoseconds each repetition should take
+#define BENCH_DEFAULT_MIN_TIME (50 * UTIL_NS_PER_MS)
+
+// Most iterations a repetition can have
+#define BENCH_MAX_ITERATIONS (1ull << 30)
+
+// Most repetitions
+#define BENCH_MAX_REPETITIONS 1000
+
+// Default percentage a benchmark can be slower than its baseline before it fails
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+// A benchmark
+typedef struct bench {
+	const char *name; // Name
+	bool (*setup)(void *data); // Called before each repetition, can be NULL
+	uint64_t (*run)(void *data, uint64_t iterations); // Does the thing iterations times, returns bytes processed
+	void (*teardown)(void *data); // Called after each repetition, can be NULL
+	uint64_t iterations; // Iterations in each repetition, 0 to work it out from the minimum time
+} bench_t;
+
+// Options for running benchmarks
+typedef struct bench_options {
+	uint32_t warmup; // Repetitions thrown away before measuring
+	uint32_t repetitions; // Repetitions measured
+	uint64_t min_time; // Nanoseconds each repetition should take
+} bench_options_t;
+
+// Summary of a benchmark's repetitions, times are nanoseconds per iteration
+typedef struct bench_result {
+	const char *name; // Name of the benchmark
+	uint64_t iterations; // Iterations in each repetition
+	uint32_t repetitions; // Repetitions measured
+	double min; // Fastest repetition
+	double median; // Median repetition
+	double mean; // Average
+	double stddev; // Standard deviation
+	double max; // Slowest repetition
+	double bytes_per_sec; // Throughput of the median repetition, 0 if it doesn't process bytes
+	double ops_per_sec; // Iterations per second in the median repetition
+} bench_result_t;
+
+// Fill in the default options
+extern void bench_default_options(bench_options_t *options);
+
+// Run a benchmark, returns false if its setup failed
+extern bool bench_run(const bench_t *bench, void *data, const bench_options_t *options, bench_result_t *result);
+
+// Print a result
+extern void bench_print(const bench_result_t *result);
+
+// Write results as JSON, returns false if the file can't be written
+extern bool bench_write_json(const bench_result_t *results, size_t count, const char *path);
+
+// Compare results to the medians in a JSON file written by bench_write_json, returns false if any are more than
+// threshold percent slower
+extern bool bench_compare(const bench_result_t *results, size_t count, const char *path, double threshold);
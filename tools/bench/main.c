@@ -0,0 +1,867 @@
+// Benchmarks for the hot paths in common, run on generated data
+
+#include "common/atom.h"
+#include "common/common.h"
+#include "common/framestats.h"
+#include "common/gameinfo.h"
+#include "common/ini.h"
+#include "common/job.h"
+#include "common/loader.h"
+#include "common/log.h"
+#include "common/pack.h"
+#include "common/queue.h"
+#include "common/thread.h"
+#include "common/util.h"
+
+#include "bench.h"
+
+// Number of files in the generated pack
+#define BENCH_FILE_COUNT 256
+
+// Number of directories the generated files are spread across
+#define BENCH_DIR_COUNT 8
+
+// Files added to a pack in each repetition of pack_add, which is slow
+#define BENCH_ADD_ITERATIONS 16
+
+// Jobs the job benchmarks queue before waiting on them, so they don't overflow the deques
+#define BENCH_JOB_BATCH 1024
+
+// Items the queue benchmarks' queues hold
+#define BENCH_QUEUE_SIZE 1024
+
+// Most producers in a queue benchmark, which has as many consumers
+#define BENCH_MAX_QUEUE_PAIRS 8
+
+// Files each frame of the streaming benchmarks asks for
+#define BENCH_STREAM_REQUESTS 4
+
+// How long a streamed file has to arrive within, about 8 frames at 60 FPS
+#define BENCH_STREAM_DEADLINE (133 * UTIL_NS_PER_MS)
+
+// Most callbacks loader_update calls in a frame
+#define BENCH_STREAM_CALLBACKS 8
+
+// Most streamed files that can be waited on before frames stop asking for more, like a game that only streams what it
+// has room for
+#define BENCH_STREAM_MAX_OUTSTANDING 64
+
+// Most benchmarks
+#define BENCH_MAX_BENCHMARKS 32
+
+// Generated data shared by the benchmarks
+typedef struct bench_context {
+	char *dir; // Directory everything is generated in, ends in a slash
+	char *pack_name; // Name of the generated pack
+	char *add_name; // Name of the pack pack_add adds to
+	char *empty_dir; // Empty directory the pack_add pack is created from
+	char *ini_path; // Generated INI file
+	char *log_prefix; // Prefix of the binary log messages go to
+	char *sources[BENCH_FILE_COUNT]; // Paths of the generated files
+	char *names[BENCH_FILE_COUNT]; // Paths of the files in the pack
+	pack_file_t *pack; // Generated pack
+	pack_file_t *add_pack; // Pack being added to
+	uint64_t next; // Keeps benchmarks from starting at the same file every repetition
+
+	atom_t atoms[BENCH_FILE_COUNT]; // Interned paths of the files in the pack
+	gameinfo_t *game; // Game with the generated pack, for streaming
+	loader_t *loader; // Loader the streaming benchmark uses
+	framestats_t *frames; // Frame times of the last repetition of a streaming benchmark
+	uint64_t outstanding; // Streamed files that haven't arrived yet
+	uint64_t streamed; // Bytes of streamed files that have arrived
+} bench_context_t;
+
+// Kinds of queue the queue benchmarks use
+typedef enum bench_queue_type {
+	BENCH_QUEUE_SPSC, // spsc_queue_t
+	BENCH_QUEUE_MPMC, // mpmc_queue_t
+	BENCH_QUEUE_BLOCKING, // blocking_queue_t
+} bench_queue_type_t;
+
+// A producer or consumer thread in a queue benchmark
+typedef struct bench_queue_thread {
+	bench_queue_type_t type; // Kind of queue
+	void *queue; // Queue
+	uint64_t count; // Items to push or pop
+	bool producer; // Whether this pushes or pops
+	uint64_t sum; // Sum of the items, so the copies aren't thrown away
+	thread_t *thread; // Thread
+} bench_queue_thread_t;
+
+// Keeps the compiler from throwing away results
+static volatile uint64_t s_sink;
+
+// Messy paths for util_normalize_path
+static const char *s_messy_paths[] = {
+	"textures/../materials//brick.vmt",
+	"./models\\props\\crate01.mdl",
+	"sound/ambient/./wind//gust_03.wav",
+	"maps/test/../../maps/./test.bsp",
+	"scripts\\\\weapons\\..\\items\\medkit.txt",
+	"shaders/vulkan/./../vulkan/mesh.vert.spv",
+};
+
+// Display the help message
+void usage(bool help);
+
+// Delete the splits of a pack
+static void remove_splits(const char *name)
+{
+	char *path;
+	uint32_t i;
+
+	for (i = 0;; i++) {
+		path = util_strfmt("%s_%0.5u.pak", name, i);
+		if (remove(path) != 0) {
+			util_free(path);
+			break;
+		}
+		util_free(path);
+	}
+}
+
+// Delete binary logs
+static void remove_logs(const char *prefix)
+{
+	char *path;
+	uint32_t i;
+
+	for (i = 0;; i++) {
+		path = util_strfmt("%s_%u.plog", prefix, i);
+		if (remove(path) != 0) {
+			util_free(path);
+			break;
+		}
+		util_free(path);
+	}
+}
+
+// Write a file that compresses about as well as real assets, some text and some noise
+static void generate_file(const char *path, size_t size, uint64_t seed)
+{
+	static const char *words[] = { "vertex", "normal", "texcoord", "material", "diffuse", "specular", "bone" };
+	uint8_t *buf;
+	size_t i;
+	size_t len;
+	FILE *file;
+
+	buf = util_alloc(size, 1, NULL);
+	for (i = 0; i < size;) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		if (seed % 4) {
+			len = PURPL_MIN(strlen(words[seed % PURPL_ARRSIZE(words)]), size - i);
+			memcpy(buf + i, words[seed % PURPL_ARRSIZE(words)], len);
+			i += len;
+		} else {
+			buf[i++] = (uint8_t)(seed >> 32);
+		}
+	}
+
+	file = fopen(path, "wb");
+	PURPL_ASSERT(file);
+	fwrite(buf, 1, size, file);
+	fclose(file);
+	util_free(buf);
+}
+
+// Write an INI file like a game.ini with a lot more in it
+static void generate_ini(const char *path)
+{
+	FILE *file;
+	uint32_t i;
+	uint32_t j;
+
+	file = fopen(path, "wb");
+	PURPL_ASSERT(file);
+
+	fprintf(file, "[game]\ngame = bench\ntitle = Purpl Benchmark\nversion = 1.0.0.0\n\n");
+	for (i = 0; i < 8; i++) {
+		fprintf(file, "[section%u]\n", i);
+		for (j = 0; j < 16; j++)
+			fprintf(file, "key%u = value %u of section %u ; comment\n", j, j, i);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+}
+
+// Generate the data the benchmarks use
+static void generate(bench_context_t *ctx, const char *dir)
+{
+	char *src_dir;
+	char *path;
+	uint32_t i;
+
+	ctx->dir = util_normalize_path(dir);
+	if (ctx->dir[strlen(ctx->dir) - 1] != '/') {
+		path = util_append(ctx->dir, "/");
+		util_free(ctx->dir);
+		ctx->dir = path;
+	}
+
+	printf("Generating benchmark data in %s\n", ctx->dir);
+	util_mkdir(ctx->dir);
+
+	ctx->empty_dir = util_append(ctx->dir, "empty");
+	util_mkdir(ctx->empty_dir);
+
+	src_dir = util_append(ctx->dir, "src");
+	for (i = 0; i < BENCH_DIR_COUNT; i++) {
+		path = util_strfmt("%s/dir%02u", src_dir, i);
+		util_mkdir(path);
+		util_free(path);
+	}
+	for (i = 0; i < BENCH_FILE_COUNT; i++) {
+		ctx->sources[i] = util_strfmt("%s/dir%02u/file%04u.bin", src_dir, i % BENCH_DIR_COUNT, i);
+		generate_file(ctx->sources[i], (size_t)1024 << (i % 7), i + 1);
+	}
+
+	ctx->pack_name = util_append(ctx->dir, "bench");
+	ctx->add_name = util_append(ctx->dir, "bench_add");
+	remove_splits(ctx->pack_name);
+	ctx->pack = pack_create(ctx->pack_name, src_dir);
+	pack_close(ctx->pack);
+	util_free(src_dir);
+
+	// Load it like the engine would
+	ctx->pack = pack_load(ctx->pack_name);
+	PURPL_ASSERT(ctx->pack);
+	PURPL_ASSERT(ctx->pack->entries.count == BENCH_FILE_COUNT);
+	for (i = 0; i < BENCH_FILE_COUNT; i++) {
+		ctx->names[i] = util_strdup(PACK_GET_NAME(ctx->pack, &ctx->pack->entries.data[i]));
+		ctx->atoms[i] = atom_intern_path(ctx->names[i]);
+	}
+
+	// The streaming benchmarks get their own copy of the pack, so they can't get in the way of the others
+	ctx->game = util_alloc(1, sizeof(gameinfo_t), NULL);
+	ctx->game->gamedir = util_strdup(ctx->dir);
+	ctx->game->game = util_strdup("bench");
+	gameinfo_packs_push(&ctx->game->packs, pack_load(ctx->pack_name));
+	PURPL_ASSERT(ctx->game->packs.data[0]);
+
+	ctx->ini_path = util_append(ctx->dir, "bench.ini");
+	generate_ini(ctx->ini_path);
+
+	ctx->log_prefix = util_append(ctx->dir, "log");
+	remove_logs(ctx->log_prefix);
+}
+
+// Clean up the context
+static void cleanup(bench_context_t *ctx)
+{
+	uint32_t i;
+
+	pack_close(ctx->pack);
+	gameinfo_free(ctx->game);
+	for (i = 0; i < BENCH_FILE_COUNT; i++) {
+		util_free(ctx->sources[i]);
+		util_free(ctx->names[i]);
+	}
+	util_free(ctx->dir);
+	util_free(ctx->pack_name);
+	util_free(ctx->add_name);
+	util_free(ctx->empty_dir);
+	util_free(ctx->ini_path);
+	util_free(ctx->log_prefix);
+}
+
+static uint64_t bench_pack_get(bench_context_t *ctx, uint64_t iterations)
+{
+	pack_entry_t *entry;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		entry = pack_get(ctx->pack, ctx->names[ctx->next++ % BENCH_FILE_COUNT]);
+		s_sink += entry->size;
+	}
+
+	return 0;
+}
+
+static uint64_t bench_pack_get_miss(bench_context_t *ctx, uint64_t iterations)
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		s_sink += pack_get(ctx->pack, s_messy_paths[i % PURPL_ARRSIZE(s_messy_paths)]) != NULL;
+
+	return 0;
+}
+
+static uint64_t bench_pack_read(bench_context_t *ctx, uint64_t iterations)
+{
+	pack_entry_t *entry;
+	uint8_t *buf;
+	uint64_t bytes;
+	uint64_t i;
+
+	bytes = 0;
+	for (i = 0; i < iterations; i++) {
+		entry = &ctx->pack->entries.data[ctx->next++ % BENCH_FILE_COUNT];
+		buf = pack_read(ctx->pack, entry);
+		PURPL_ASSERT(buf);
+		s_sink += buf[0];
+		bytes += entry->real_size;
+		util_free(buf);
+	}
+
+	return bytes;
+}
+
+static bool setup_pack_add(bench_context_t *ctx)
+{
+	remove_splits(ctx->add_name);
+	ctx->add_pack = pack_create(ctx->add_name, ctx->empty_dir);
+	return ctx->add_pack != NULL;
+}
+
+static uint64_t bench_pack_add(bench_context_t *ctx, uint64_t iterations)
+{
+	pack_entry_t *entry;
+	char name[64];
+	uint64_t bytes;
+	uint64_t i;
+
+	bytes = 0;
+	for (i = 0; i < iterations; i++) {
+		snprintf(name, sizeof(name), "added/%" PRIu64 ".bin", i);
+		entry = pack_add(ctx->add_pack, ctx->sources[ctx->next++ % BENCH_FILE_COUNT], name);
+		PURPL_ASSERT(entry);
+		bytes += entry->real_size;
+	}
+
+	return bytes;
+}
+
+static void teardown_pack_add(bench_context_t *ctx)
+{
+	pack_close(ctx->add_pack);
+	ctx->add_pack = NULL;
+	remove_splits(ctx->add_name);
+}
+
+static uint64_t bench_normalize_path(bench_context_t *ctx, uint64_t iterations)
+{
+	char *path;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		path = util_normalize_path(s_messy_paths[i % PURPL_ARRSIZE(s_messy_paths)]);
+		s_sink += path[0];
+		util_free(path);
+	}
+
+	return 0;
+}
+
+static uint64_t bench_strfmt(bench_context_t *ctx, uint64_t iterations)
+{
+	char *str;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		str = util_strfmt("%s_%0.5u.pak", ctx->pack_name, (uint32_t)i);
+		s_sink += str[0];
+		util_free(str);
+	}
+
+	return 0;
+}
+
+// Count the keys in an INI file
+static int32_t count_key(const char *section, const char *key, const char *value, uint64_t *count)
+{
+	(*count)++;
+	return true;
+}
+
+static uint64_t bench_ini_browse(bench_context_t *ctx, uint64_t iterations)
+{
+	uint64_t count;
+	uint64_t i;
+	FILE *file;
+	uint64_t size;
+
+	file = fopen(ctx->ini_path, "rb");
+	size = util_fsize(file);
+	fclose(file);
+
+	for (i = 0; i < iterations; i++) {
+		count = 0;
+		ini_browse((INI_CALLBACK)count_key, &count, ctx->ini_path);
+		s_sink += count;
+	}
+
+	return size * iterations;
+}
+
+static uint64_t bench_log_deferred(bench_context_t *ctx, uint64_t iterations)
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		LOG_INFO(LOG_SUBSYSTEM_GENERAL, BENCH_LOG_PREFIX "Message %" PRIu64 " from %s took %.2lf ms\n", i,
+			 "bench_log_deferred", 1.5);
+
+	return 0;
+}
+
+static uint64_t bench_log_immediate(bench_context_t *ctx, uint64_t iterations)
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		log_write(LOG_LEVEL_INFO, LOG_SUBSYSTEM_GENERAL, PURPL_FUNCNAME, __LINE__, __FILE__,
+			  BENCH_LOG_PREFIX "Message %" PRIu64 " from %s took %.2lf ms\n", i, "bench_log_immediate",
+			  1.5);
+
+	return 0;
+}
+
+// Write out what the last repetition logged, so the next one doesn't start with a full buffer
+static void teardown_log(bench_context_t *ctx)
+{
+	log_flush();
+}
+
+// A job that does nothing, so only the scheduling is measured
+static void empty_job(void *data)
+{
+}
+
+// An empty job_parallel_for batch
+static void empty_batch(void *data, size_t start, size_t end)
+{
+}
+
+static uint64_t bench_job_run(bench_context_t *ctx, uint64_t iterations)
+{
+	job_counter_t counter = JOB_COUNTER_INITIALIZER;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		job_run(empty_job, NULL, &counter);
+		if ((i + 1) % BENCH_JOB_BATCH == 0)
+			job_wait(&counter);
+	}
+	job_wait(&counter);
+
+	return 0;
+}
+
+static uint64_t bench_job_parallel_for(bench_context_t *ctx, uint64_t iterations)
+{
+	job_parallel_for(iterations, 1, empty_batch, NULL);
+
+	return 0;
+}
+
+// Split a number of jobs in two and run each half as a job until there's only one left, which measures stealing
+// since each worker's jobs are taken from the others
+static void tree_job(void *data)
+{
+	job_counter_t counter = JOB_COUNTER_INITIALIZER;
+	uintptr_t count;
+
+	count = (uintptr_t)data;
+	if (count <= 1)
+		return;
+
+	job_run(tree_job, (void *)((count - 1) / 2), &counter);
+	job_run(tree_job, (void *)(count - 1 - (count - 1) / 2), &counter);
+	job_wait(&counter);
+}
+
+static uint64_t bench_job_tree(bench_context_t *ctx, uint64_t iterations)
+{
+	tree_job((void *)(uintptr_t)iterations);
+
+	return 0;
+}
+
+// Push or pop items, yielding while the queue is full or empty so this works with fewer cores than threads
+static int32_t queue_thread(void *data)
+{
+	bench_queue_thread_t *thread = data;
+	uint64_t item;
+	uint64_t i;
+
+	for (i = 0; i < thread->count; i++) {
+		item = i;
+		switch (thread->type) {
+		case BENCH_QUEUE_SPSC:
+			while (!(thread->producer ? spsc_queue_push(thread->queue, &item)
+						  : spsc_queue_pop(thread->queue, &item)))
+				thread_yield();
+			break;
+		case BENCH_QUEUE_MPMC:
+			while (!(thread->producer ? mpmc_queue_push(thread->queue, &item)
+						  : mpmc_queue_pop(thread->queue, &item)))
+				thread_yield();
+			break;
+		case BENCH_QUEUE_BLOCKING:
+			if (thread->producer)
+				blocking_queue_push(thread->queue, &item, QUEUE_WAIT_FOREVER);
+			else
+				blocking_queue_pop(thread->queue, &item, QUEUE_WAIT_FOREVER);
+			break;
+		}
+		thread->sum += item;
+	}
+
+	return 0;
+}
+
+// Pass iterations items through a queue from pairs producers to pairs consumers, each on their own thread, so an
+// iteration is one push and one pop under however much contention that many threads cause
+static uint64_t run_queue(bench_queue_type_t type, uint32_t pairs, uint64_t iterations)
+{
+	bench_queue_thread_t threads[BENCH_MAX_QUEUE_PAIRS * 2];
+	void *queue;
+	uint32_t i;
+
+	switch (type) {
+	case BENCH_QUEUE_SPSC:
+		queue = spsc_queue_create(BENCH_QUEUE_SIZE, sizeof(uint64_t));
+		break;
+	case BENCH_QUEUE_MPMC:
+		queue = mpmc_queue_create(BENCH_QUEUE_SIZE, sizeof(uint64_t));
+		break;
+	case BENCH_QUEUE_BLOCKING:
+	default:
+		queue = blocking_queue_create(BENCH_QUEUE_SIZE, sizeof(uint64_t));
+		break;
+	}
+
+	// Producer i and consumer i handle the same number of items
+	for (i = 0; i < pairs * 2; i++) {
+		threads[i].type = type;
+		threads[i].queue = queue;
+		threads[i].count = iterations / pairs + (i % pairs < iterations % pairs);
+		threads[i].producer = i < pairs;
+		threads[i].sum = 0;
+		threads[i].thread = thread_create(queue_thread, threads[i].producer ? "producer" : "consumer",
+						  &threads[i]);
+		PURPL_ASSERT(threads[i].thread);
+	}
+	for (i = 0; i < pairs * 2; i++) {
+		thread_join(threads[i].thread);
+		s_sink += threads[i].sum;
+	}
+
+	switch (type) {
+	case BENCH_QUEUE_SPSC:
+		spsc_queue_destroy(queue);
+		break;
+	case BENCH_QUEUE_MPMC:
+		mpmc_queue_destroy(queue);
+		break;
+	case BENCH_QUEUE_BLOCKING:
+		blocking_queue_destroy(queue);
+		break;
+	}
+
+	return 0;
+}
+
+static uint64_t bench_spsc_queue(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_SPSC, 1, iterations);
+}
+
+static uint64_t bench_mpmc_queue_1(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_MPMC, 1, iterations);
+}
+
+static uint64_t bench_mpmc_queue_2(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_MPMC, 2, iterations);
+}
+
+static uint64_t bench_mpmc_queue_4(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_MPMC, 4, iterations);
+}
+
+static uint64_t bench_mpmc_queue_8(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_MPMC, 8, iterations);
+}
+
+static uint64_t bench_blocking_queue_1(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_BLOCKING, 1, iterations);
+}
+
+static uint64_t bench_blocking_queue_4(bench_context_t *ctx, uint64_t iterations)
+{
+	return run_queue(BENCH_QUEUE_BLOCKING, 4, iterations);
+}
+
+// Start keeping frame times for a streaming benchmark
+static bool setup_frames(bench_context_t *ctx)
+{
+	framestats_destroy(ctx->frames);
+	ctx->frames = framestats_create(0);
+	return true;
+}
+
+// Record how long a frame took
+static void add_frame(bench_context_t *ctx, uint64_t start)
+{
+	uint64_t times[FRAMESTATS_PHASE_COUNT];
+
+	memset(times, 0, sizeof(times));
+	times[FRAMESTATS_PHASE_FRAME] = util_get_time() - start;
+	framestats_add_frame(ctx->frames, times);
+}
+
+// Print the frame times of the last repetition of a streaming benchmark
+static void print_frames(bench_context_t *ctx)
+{
+	framestats_summary_t summary;
+
+	framestats_summarize(&ctx->frames->total[FRAMESTATS_PHASE_FRAME], &summary);
+	printf("%-24s %10" PRIu64 " frames  p50 %10.1lf us  p95 %10.1lf us  p99 %10.1lf us  max %10.1lf us  %" PRIu64
+	       " %s\n",
+	       "", summary.count, (double)summary.p50 / UTIL_NS_PER_US, (double)summary.p95 / UTIL_NS_PER_US,
+	       (double)summary.p99 / UTIL_NS_PER_US, (double)summary.max / UTIL_NS_PER_US, ctx->frames->hitches,
+	       PURPL_PLURALIZE(ctx->frames->hitches, "hitches", "hitch"));
+	fflush(stdout);
+}
+
+// Each iteration is a frame that needs a few files, and reads them itself like the engine did before the loader
+static uint64_t bench_stream_sync(bench_context_t *ctx, uint64_t iterations)
+{
+	pack_file_t *pack;
+	pack_entry_t *entry;
+	uint8_t *buf;
+	uint64_t start;
+	uint64_t bytes;
+	uint64_t i;
+	uint32_t j;
+
+	bytes = 0;
+	for (i = 0; i < iterations; i++) {
+		start = util_get_time();
+		for (j = 0; j < BENCH_STREAM_REQUESTS; j++) {
+			entry = gameinfo_find(ctx->game, ctx->atoms[ctx->next++ % BENCH_FILE_COUNT], &pack);
+			PURPL_ASSERT(entry);
+			buf = pack_read(pack, entry);
+			PURPL_ASSERT(buf);
+			s_sink += buf[0];
+			bytes += entry->real_size;
+			util_free(buf);
+		}
+		add_frame(ctx, start);
+	}
+
+	return bytes;
+}
+
+// Take a streamed file
+static void stream_callback(loader_request_t *request, loader_status_t status, uint8_t *data, size_t size,
+			    bench_context_t *ctx)
+{
+	ctx->outstanding--;
+	if (status == LOADER_STATUS_DONE) {
+		s_sink += data[0];
+		ctx->streamed += size;
+		util_free(data);
+	}
+}
+
+static bool setup_stream_loader(bench_context_t *ctx)
+{
+	uint32_t workers;
+
+	// Like the engine, which keeps a core for the main thread
+	workers = PURPL_MAX(thread_get_cpu_count() / 2, 1);
+	ctx->loader = loader_create(workers, workers);
+	loader_add_source(ctx->loader, ctx->game);
+	ctx->outstanding = 0;
+	ctx->streamed = 0;
+
+	return setup_frames(ctx);
+}
+
+// The same frames, but the files are streamed in with the loader
+static uint64_t bench_stream_loader(bench_context_t *ctx, uint64_t iterations)
+{
+	uint64_t start;
+	uint64_t i;
+	uint32_t j;
+
+	for (i = 0; i < iterations; i++) {
+		start = util_get_time();
+		for (j = 0; j < BENCH_STREAM_REQUESTS && ctx->outstanding < BENCH_STREAM_MAX_OUTSTANDING; j++) {
+			loader_request_atom(ctx->loader, ctx->atoms[ctx->next++ % BENCH_FILE_COUNT],
+					    LOADER_PRIORITY_VISIBLE, BENCH_STREAM_DEADLINE,
+					    (loader_callback_t)stream_callback, ctx);
+			ctx->outstanding++;
+		}
+		loader_update(ctx->loader, BENCH_STREAM_CALLBACKS);
+		add_frame(ctx, start);
+	}
+
+	// Only files that arrived during the repetition count, the rest are cancelled in the teardown
+	return ctx->streamed;
+}
+
+static void teardown_stream_loader(bench_context_t *ctx)
+{
+	loader_destroy(ctx->loader);
+	ctx->loader = NULL;
+}
+
+// Describe a benchmark, casting its functions to take a void pointer
+#define BENCH(name, setup, run, teardown, iterations)                                                           \
+	{                                                                                                       \
+		(name), (bool (*)(void *))(setup), (uint64_t(*)(void *, uint64_t))(run),                        \
+			(void (*)(void *))(teardown), (iterations)                                              \
+	}
+
+static const bench_t s_benchmarks[] = {
+	BENCH("pack_get", NULL, bench_pack_get, NULL, 0),
+	BENCH("pack_get_miss", NULL, bench_pack_get_miss, NULL, 0),
+	BENCH("pack_read", NULL, bench_pack_read, NULL, 0),
+	BENCH("pack_add", setup_pack_add, bench_pack_add, teardown_pack_add, BENCH_ADD_ITERATIONS),
+	BENCH("util_normalize_path", NULL, bench_normalize_path, NULL, 0),
+	BENCH("util_strfmt", NULL, bench_strfmt, NULL, 0),
+	BENCH("ini_browse", NULL, bench_ini_browse, NULL, 0),
+	BENCH("log_deferred", NULL, bench_log_deferred, teardown_log, 0),
+	BENCH("log_immediate", NULL, bench_log_immediate, teardown_log, 0),
+	BENCH("job_run", NULL, bench_job_run, NULL, 0),
+	BENCH("job_parallel_for", NULL, bench_job_parallel_for, NULL, 0),
+	BENCH("job_tree", NULL, bench_job_tree, NULL, 0),
+	BENCH("spsc_queue_1x1", NULL, bench_spsc_queue, NULL, 0),
+	BENCH("mpmc_queue_1x1", NULL, bench_mpmc_queue_1, NULL, 0),
+	BENCH("mpmc_queue_2x2", NULL, bench_mpmc_queue_2, NULL, 0),
+	BENCH("mpmc_queue_4x4", NULL, bench_mpmc_queue_4, NULL, 0),
+	BENCH("mpmc_queue_8x8", NULL, bench_mpmc_queue_8, NULL, 0),
+	BENCH("blocking_queue_1x1", NULL, bench_blocking_queue_1, NULL, 0),
+	BENCH("blocking_queue_4x4", NULL, bench_blocking_queue_4, NULL, 0),
+	BENCH("stream_sync", setup_frames, bench_stream_sync, NULL, 0),
+	BENCH("stream_loader", setup_stream_loader, bench_stream_loader, teardown_stream_loader, 0),
+};
+
+int32_t main(int32_t argc, char *argv[])
+{
+	bench_context_t ctx;
+	bench_options_t options;
+	bench_result_t results[BENCH_MAX_BENCHMARKS];
+	const char *filter;
+	const char *json_path;
+	const char *baseline_path;
+	const char *dir;
+	double threshold;
+	uint32_t job_workers;
+	size_t count;
+	size_t i;
+	bool success;
+
+	bench_default_options(&options);
+	filter = NULL;
+	json_path = NULL;
+	baseline_path = NULL;
+	dir = "purpl_bench_data";
+	threshold = BENCH_DEFAULT_THRESHOLD;
+	job_workers = 0;
+	for (i = 1; i < (size_t)argc; i++) {
+		if (strcmp(argv[i], "help") == 0 || strcmp(argv[i], "-help") == 0) {
+			usage(true);
+		} else if (strcmp(argv[i], "-list") == 0) {
+			for (i = 0; i < PURPL_ARRSIZE(s_benchmarks); i++)
+				printf("%s\n", s_benchmarks[i].name);
+			return 0;
+		} else if (i >= (size_t)argc - 1) {
+			usage(false);
+		} else if (strcmp(argv[i], "-filter") == 0) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "-reps") == 0) {
+			options.repetitions = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-warmup") == 0) {
+			options.warmup = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-time") == 0) {
+			options.min_time = strtoull(argv[++i], NULL, 10) * UTIL_NS_PER_MS;
+		} else if (strcmp(argv[i], "-json") == 0) {
+			json_path = argv[++i];
+		} else if (strcmp(argv[i], "-compare") == 0) {
+			baseline_path = argv[++i];
+		} else if (strcmp(argv[i], "-threshold") == 0) {
+			threshold = strtod(argv[++i], NULL);
+		} else if (strcmp(argv[i], "-dir") == 0) {
+			dir = argv[++i];
+		} else if (strcmp(argv[i], "-jobworkers") == 0) {
+			job_workers = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else {
+			usage(false);
+		}
+	}
+
+	memset(&ctx, 0, sizeof(bench_context_t));
+	generate(&ctx, dir);
+
+	// Messages go to a binary log, so the log benchmarks measure the logger and not the terminal
+	if (!log_open_binary(ctx.log_prefix)) {
+		PURPL_LOG(BENCH_LOG_PREFIX "Failed to open binary log %s\n", ctx.log_prefix);
+		cleanup(&ctx);
+		return 1;
+	}
+
+	job_init(job_workers);
+
+	count = 0;
+	success = true;
+	for (i = 0; i < PURPL_ARRSIZE(s_benchmarks); i++) {
+		if (filter && !strstr(s_benchmarks[i].name, filter))
+			continue;
+
+		if (!bench_run(&s_benchmarks[i], &ctx, &options, &results[count])) {
+			PURPL_LOG(BENCH_LOG_PREFIX "Benchmark %s failed to set up\n", s_benchmarks[i].name);
+			success = false;
+			continue;
+		}
+		bench_print(&results[count]);
+		if (ctx.frames) {
+			print_frames(&ctx);
+			framestats_destroy(ctx.frames);
+			ctx.frames = NULL;
+		}
+		count++;
+	}
+
+	job_shutdown();
+	log_close_binary();
+	remove_logs(ctx.log_prefix);
+	cleanup(&ctx);
+
+	if (json_path)
+		success = bench_write_json(results, count, json_path) && success;
+	if (baseline_path)
+		success = bench_compare(results, count, baseline_path, threshold) && success;
+
+	return !success;
+}
+
+void usage(bool help)
+{
+	printf("purpl_bench usage:\n"
+	       "\thelp\t\t\t- Print this message\n"
+	       "\t-list\t\t\t- List the benchmarks\n"
+	       "\t-filter <text>\t\t- Only run benchmarks with <text> in their name\n"
+	       "\t-reps <count>\t\t- Measure <count> repetitions of each benchmark (default %u)\n"
+	       "\t-warmup <count>\t\t- Throw away <count> repetitions first (default %u)\n"
+	       "\t-time <ms>\t\t- Make each repetition take at least <ms> milliseconds (default %" PRIu64 ")\n"
+	       "\t-json <file>\t\t- Write the results to <file> as JSON\n"
+	       "\t-compare <file>\t\t- Compare the results to JSON written by -json, failing if any are slower\n"
+	       "\t-threshold <percent>\t- How much slower than the baseline is too slow (default %.0lf%%)\n"
+	       "\t-dir <directory>\t- Generate data in <directory> (default purpl_bench_data)\n"
+	       "\t-jobworkers <count>\t- Run jobs on <count> threads (default one per core)\n",
+	       BENCH_DEFAULT_REPETITIONS, BENCH_DEFAULT_WARMUP, (uint64_t)(BENCH_DEFAULT_MIN_TIME / UTIL_NS_PER_MS),
+	       BENCH_DEFAULT_THRESHOLD);
+	exit(!help); // Error if help was not requested
+}
@@ -0,0 +1,217 @@
+// Turns binary logs back into text
+
+#include "common/common.h"
+#include "common/container.h"
+#include "common/log.h"
+#include "common/util.h"
+
+#define LOGDECODE_LOG_PREFIX "LOGDECODE: "
+
+// A call site described in a log
+typedef struct logdecode_site {
+	uint32_t line; // Line
+	const char *func; // Function
+	const char *file; // File
+	const char *fmt; // Format string
+} logdecode_site_t;
+
+ARRAY_DECLARE(logdecode_sites, logdecode_site_t)
+
+static char s_message[LOG_MAX_MESSAGE];
+static char s_output[LOG_MAX_MESSAGE + 512];
+
+// Display the help message
+void usage(bool help);
+
+// Get the next terminated string in a chunk, NULL if it runs off the end
+static const char *next_string(const uint8_t **data, const uint8_t *end)
+{
+	const char *str;
+	const uint8_t *terminator;
+
+	terminator = memchr(*data, 0, end - *data);
+	if (!terminator)
+		return NULL;
+
+	str = (const char *)*data;
+	*data = terminator + 1;
+	return str;
+}
+
+// Write out a message
+static void write_message(log_level_t level, const char *func, uint32_t line, const char *file, const char *message)
+{
+	size_t length;
+
+	length = log_format_line(s_output, sizeof(s_output), level, func, line, file, message);
+	fwrite(s_output, 1, length, stdout);
+}
+
+// Decode a log, writing out messages at or above min_level
+static bool decode(const char *path, log_level_t min_level)
+{
+	logdecode_sites_t sites;
+	logdecode_site_t *site;
+	log_binary_header_t *header;
+	log_binary_chunk_t *chunk;
+	log_binary_site_t *site_info;
+	log_binary_message_t *message;
+	const char *func;
+	const char *file;
+	const char *text;
+	uint8_t *buf;
+	const uint8_t *data;
+	const uint8_t *end;
+	size_t size;
+	size_t offset;
+	FILE *stream;
+	bool success;
+
+	stream = fopen(path, "rb");
+	if (!stream) {
+		PURPL_LOG(LOGDECODE_LOG_PREFIX "Failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	size = util_fsize(stream);
+	buf = util_alloc(size + 1, sizeof(uint8_t), NULL);
+	size = fread(buf, 1, size, stream);
+	fclose(stream);
+
+	header = (log_binary_header_t *)buf;
+	if (size < sizeof(log_binary_header_t) || header->magic != LOG_BINARY_MAGIC) {
+		PURPL_LOG(LOGDECODE_LOG_PREFIX "%s is not a binary log\n", path);
+		util_free(buf);
+		return false;
+	}
+	if (header->version != LOG_BINARY_VERSION) {
+		PURPL_LOG(LOGDECODE_LOG_PREFIX "%s is version %u, not version %u\n", path, header->version,
+			  LOG_BINARY_VERSION);
+		util_free(buf);
+		return false;
+	}
+
+	memset(&sites, 0, sizeof(logdecode_sites_t));
+	success = true;
+	offset = sizeof(log_binary_header_t);
+	while (offset + sizeof(log_binary_chunk_t) <= size) {
+		chunk = (log_binary_chunk_t *)(buf + offset);
+		data = buf + offset + sizeof(log_binary_chunk_t);
+		end = data + chunk->size;
+		if (chunk->size > size - offset - sizeof(log_binary_chunk_t)) {
+			// The program probably crashed while writing it
+			PURPL_LOG(LOGDECODE_LOG_PREFIX "%s is cut off at offset 0x%zX\n", path, offset);
+			break;
+		}
+		offset += sizeof(log_binary_chunk_t) + chunk->size;
+
+		switch (chunk->type) {
+		case LOG_CHUNK_SITE: {
+			logdecode_site_t new_site;
+
+			if (chunk->size < sizeof(log_binary_site_t))
+				goto bad_chunk;
+			site_info = (log_binary_site_t *)data;
+			data += sizeof(log_binary_site_t);
+
+			new_site.line = site_info->line;
+			new_site.func = next_string(&data, end);
+			new_site.file = new_site.func ? next_string(&data, end) : NULL;
+			new_site.fmt = new_site.file ? next_string(&data, end) : NULL;
+			if (!new_site.fmt)
+				goto bad_chunk;
+
+			if (site_info->id >= sites.count)
+				logdecode_sites_push_n(&sites, NULL, site_info->id + 1 - sites.count);
+			sites.data[site_info->id] = new_site;
+			break;
+		}
+		case LOG_CHUNK_MESSAGE:
+			if (chunk->size < sizeof(log_binary_message_t))
+				goto bad_chunk;
+			message = (log_binary_message_t *)data;
+			data += sizeof(log_binary_message_t);
+
+			site = message->site < sites.count ? &sites.data[message->site] : NULL;
+			if (!site || !site->fmt) {
+				PURPL_LOG(LOGDECODE_LOG_PREFIX "Message %" PRIu64 " in %s has unknown site %u\n",
+					  message->sequence, path, message->site);
+				success = false;
+				break;
+			}
+
+			if (message->level >= min_level) {
+				log_format_args(s_message, sizeof(s_message), site->fmt, data, end - data);
+				write_message(message->level, site->func, site->line, site->file, s_message);
+			}
+			break;
+		case LOG_CHUNK_TEXT:
+			if (chunk->size < sizeof(log_binary_message_t))
+				goto bad_chunk;
+			message = (log_binary_message_t *)data;
+			data += sizeof(log_binary_message_t);
+
+			func = next_string(&data, end);
+			file = func ? next_string(&data, end) : NULL;
+			text = file ? next_string(&data, end) : NULL;
+			if (!text)
+				goto bad_chunk;
+
+			if (message->level >= min_level)
+				write_message(message->level, func, message->line, file, text);
+			break;
+		default:
+		bad_chunk:
+			PURPL_LOG(LOGDECODE_LOG_PREFIX "Invalid chunk of type %u at offset 0x%zX in %s\n", chunk->type,
+				  offset - chunk->size - sizeof(log_binary_chunk_t), path);
+			success = false;
+			break;
+		}
+	}
+
+	fflush(stdout);
+	logdecode_sites_free(&sites);
+	util_free(buf);
+
+	return success;
+}
+
+int32_t main(int32_t argc, char *argv[])
+{
+	log_level_t min_level;
+	bool success;
+	int32_t i;
+
+	if (argc < 2)
+		usage(false);
+	if (strcmp(argv[1], "help") == 0)
+		usage(true);
+
+	min_level = LOG_LEVEL_TRACE;
+	success = true;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-level") == 0) {
+			if (i >= argc - 1)
+				usage(false);
+			min_level = log_parse_level(argv[++i]);
+			if (min_level >= LOG_LEVEL_COUNT) {
+				PURPL_LOG(LOGDECODE_LOG_PREFIX "Unknown level %s\n", argv[i]);
+				usage(false);
+			}
+			continue;
+		}
+
+		success = decode(argv[i], min_level) && success;
+	}
+
+	return !success;
+}
+
+void usage(bool help)
+{
+	printf("logdecode usage:\n"
+	       "\thelp\t\t\t\t- Print this message\n"
+	       "\t[-level <level>] <log files>\t- Write out the messages in <log files> at or above <level>\n"
+	       "\nLevels are trace, debug, info, warning and error. Binary logs are written by the launcher with\n"
+	       "-binarylog <prefix>, and are named <prefix>_<n>.plog\n");
+	exit(!help); // Error if help was not requested
+}
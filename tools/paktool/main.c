@@ -1,7 +1,9 @@
 // Pack file manipulation tool
 
 #include "common/common.h"
+#include "common/job.h"
 #include "common/pack.h"
+#include "common/stream.h"
 
 #define PAKTOOL_LOG_PREFIX "PAKTOOL: "
 
@@ -17,6 +19,35 @@ typedef enum paktool_mode {
 // Display the help message
 void usage(bool help);
 
+// Copy a file from a pack to dst_path a window at a time, so big files don't have to fit in memory
+static bool extract_file(pack_file_t *pack, pack_entry_t *entry, const char *dst_path)
+{
+	stream_t *stream;
+	uint8_t buf[STREAM_WINDOW_SIZE];
+	size_t len;
+	FILE *dst;
+	bool success;
+
+	stream = stream_open_entry(pack, entry);
+	if (!stream)
+		return false;
+
+	dst = fopen(dst_path, "wb+");
+	PURPL_ASSERT(dst);
+
+	len = stream_read(stream, buf, sizeof(buf));
+	while (len > 0) {
+		fwrite(buf, 1, len, dst);
+		len = stream_read(stream, buf, sizeof(buf));
+	}
+
+	fclose(dst);
+	success = !stream->error && stream_tell(stream) == entry->real_size;
+	stream_close(stream);
+
+	return success;
+}
+
 int32_t main(int32_t argc, char *argv[])
 {
 	paktool_mode_t mode;
@@ -59,6 +90,9 @@ int32_t main(int32_t argc, char *argv[])
 		usage(false);
 	}
 
+	// Files are compressed on every core
+	job_init(0);
+
 	pack_name = util_normalize_path(argv[2]);
 	pack = NULL;
 	other = NULL;
@@ -67,16 +101,16 @@ int32_t main(int32_t argc, char *argv[])
 		pack = pack_load(pack_name);
 		if (!pack) {
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read pack file %s\n", pack_name);
-			free(pack_name);
+			util_free(pack_name);
 			exit(1);
 		}
 
 		for (i = 0; i < pack->header.entry_count; i++) {
 			printf("Path: %s (hash 0x%" PRIX64 ", offset 0x%" PRIX64 ")\nHash: 0x%" PRIX64
 			       "\nCompressed size: %u\nSize: %zu\nOffset: 0x%" PRIX64 "\n\n",
-			       pack->pathbuf + pack->entries[i].path_offset, pack->entries[i].path_hash,
-			       pack->entries[i].path_offset, pack->entries[i].hash, pack->entries[i].size,
-			       pack->entries[i].real_size, pack->entries[i].offset);
+			       PACK_GET_NAME(pack, &pack->entries.data[i]), pack->entries.data[i].path_hash,
+			       pack->entries.data[i].path_offset, pack->entries.data[i].hash, pack->entries.data[i].size,
+			       pack->entries.data[i].real_size, pack->entries.data[i].offset);
 		}
 		printf("Total of %zu bytes compressed across %lf split files\n", pack->header.total_size,
 		       pack->header.total_size / (double)PACK_SPLIT_SIZE);
@@ -84,46 +118,34 @@ int32_t main(int32_t argc, char *argv[])
 	}
 	case READ: {
 		pack_entry_t *entry;
-		uint8_t *buf;
 		char *dst_path;
-		FILE *dst;
 
 		other = util_normalize_path(argv[3]);
 
 		pack = pack_load(pack_name);
 		if (!pack) {
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read pack file %s\n", pack_name);
-			free(pack_name);
-			free(other);
+			util_free(pack_name);
+			util_free(other);
 			exit(1);
 		}
 
 		entry = pack_get(pack, other);
-		buf = pack_read(pack, entry);
-		if (!buf) {
+		dst_path = strrchr(other, '/') ? strrchr(other, '/') + 1 : other;
+		PURPL_LOG(PAKTOOL_LOG_PREFIX "Writing contents of %s to %s\n", other, dst_path);
+		if (!entry || !extract_file(pack, entry, dst_path)) {
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read file %s from pack file %s\n", other, pack_name);
-			free(pack_name);
-			free(other);
+			util_free(pack_name);
+			util_free(other);
 			pack_close(pack);
 			exit(1);
 		}
 
-		dst_path = strrchr(other, '/') ? strrchr(other, '/') + 1 : other;
-		PURPL_LOG(PAKTOOL_LOG_PREFIX "Writing contents of %s to %s\n", other, dst_path);
-		dst = fopen(dst_path, "wb+");
-		PURPL_ASSERT(dst);
-
-		fwrite(buf, 1, entry->real_size, dst);
-
-		free(buf);
-		fclose(dst);
 		break;
 	}
 	case EXTRACT: {
 		pack_entry_t *entry;
-		uint8_t *buf;
 		char *dst_path;
-		FILE *dst;
 		size_t j;
 
 		if (util_fexist(pack_name)) {
@@ -134,8 +156,8 @@ int32_t main(int32_t argc, char *argv[])
 		pack = pack_load(pack_name);
 		if (!pack) {
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read pack file %s\n", pack_name);
-			free(pack_name);
-			free(other);
+			util_free(pack_name);
+			util_free(other);
 			exit(1);
 		}
 
@@ -143,33 +165,24 @@ int32_t main(int32_t argc, char *argv[])
 		util_mkdir(pack_name);
 
 		for (j = 0; j < pack->header.entry_count; j++) {
-			entry = pack->entries + j;
+			entry = pack->entries.data + j;
 
 			dst_path = util_strfmt("%s/%s", pack_name, PACK_GET_NAME(pack, entry));
 			*strrchr(dst_path, '/') = 0;
 			util_mkdir(dst_path);
 			dst_path[strlen(dst_path)] = '/';
 
-			buf = pack_read(pack, entry);
-			if (!buf) {
-				PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read file %s from pack file %s\n", other,
-					  pack_name);
-				free(dst_path);
-				free(pack_name);
-				free(other);
+			PURPL_LOG(PAKTOOL_LOG_PREFIX "Extracting %s from %s\n", dst_path, pack_name);
+			if (!extract_file(pack, entry, dst_path)) {
+				PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to read file %s from pack file %s\n",
+					  PACK_GET_NAME(pack, entry), pack_name);
+				util_free(dst_path);
+				util_free(pack_name);
 				pack_close(pack);
 				exit(1);
 			}
 
-			PURPL_LOG(PAKTOOL_LOG_PREFIX "Extracting %s from %s\n", dst_path, pack_name);
-			dst = fopen(dst_path, "wb+");
-			PURPL_ASSERT(dst);
-
-			fwrite(buf, 1, entry->real_size, dst);
-
-			free(dst_path);
-			free(buf);
-			fclose(dst);
+			util_free(dst_path);
 		}
 
 		break;
@@ -182,24 +195,24 @@ int32_t main(int32_t argc, char *argv[])
 			pack = pack_load(pack_name);
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Removing old files\n");
 			remove(tmp);
-			free(tmp);
+			util_free(tmp);
 			for (i = 0; i < pack->header.total_size / PACK_SPLIT_SIZE + 1; i++) {
 				tmp = util_strfmt("%s_%0.5u.pak", pack_name, i);
 				if (util_fexist(tmp))
 					remove(tmp);
-				free(tmp);
+				util_free(tmp);
 			}
 			pack_close(pack);
 		} else {
-			free(tmp);
+			util_free(tmp);
 		}
 
 		pack = pack_create(pack_name, other);
 		if (!pack) {
 			PURPL_LOG(PAKTOOL_LOG_PREFIX "Failed to create pack file %s from directory %s\n", pack_name,
 				  other);
-			free(pack_name);
-			free(other);
+			util_free(pack_name);
+			util_free(other);
 			exit(1);
 		}
 
@@ -224,9 +237,10 @@ int32_t main(int32_t argc, char *argv[])
 	}
 
 	pack_close(pack);
-	free(pack_name);
+	util_free(pack_name);
 	if (other)
-		free(other);
+		util_free(other);
+	job_shutdown();
 
 	return 0;
 }